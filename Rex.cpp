@@ -24,6 +24,7 @@
 #include "src/suite/Suite.h"
 #include "src/plan/Plan.h"
 #include "src/misc/helpers.h"
+#include "src/logs/LogCommand.h"
 
 void version_info()
 {
@@ -43,17 +44,25 @@ void print_section_header(const std::string &header_title)
 
 void print_usage()
 {
-    fprintf(stderr, "\nUsage:\n\trex [ -h | --help ] [ -v | --verbose ] ( ( ( -c | --config ) CONFIG_PATH ) ( -p | plan ) PLAN_PATH ) )\n");
+    fprintf(stderr, "\nUsage:\n\trex [ -h | --help ] [ -v | --verbose ] [ -j | --jobs JOBS ] [ -r | --resume ] [ -k | --check ] ( ( ( -c | --config ) CONFIG_PATH ) ( -p | plan ) PLAN_PATH ) )\n");
+    fprintf(stderr, "\trex logs ( cat FILE... | runs LOGS_PATH | show LOGS_PATH TASK [ OPTIONS ] | grep LOGS_PATH PATTERN [ OPTIONS ] )\n");
 
     print_section_header("Optional Arguments");
     print_arg(  "-h", "--help",         "This usage screen. Mutually exclusive to all other options.");
     print_arg(  "-v", "--verbose",      "Sets verbose output. Generally more than you want to see.");
     print_arg(  "-i", "--version_info", "Prints version information and exits. Mutually exclusive to all other options.");
+    print_arg(  "-j", "--jobs",         "Number of Tasks to execute concurrently. 0 uses every processor. Overrides 'jobs' in the config.");
+    print_arg(  "-r", "--resume",       "Skip the Tasks completed by the previous run of this plan, as recorded in its journal.");
+    print_arg(  "-k", "--check",        "Check that every Task in the plan could execute, report all problems found, and exit.");
 
     print_section_header("Required Arguments");
     print_arg(  "-c", "--config",       "Supply the path for the configuration file.");
     print_arg(  "-p", "--plan",         "Supply the path for the plan file to execute.");
 
+    print_section_header("Commands");
+    print_arg(  "",   "logs cat FILE...",   "Write Task logs to stdout, decompressing those written with 'log_compression'.");
+    print_arg(  "",   "logs runs|show|grep", "List, show or search the runs kept with 'log_store' set to 'segments'. 'rex logs -h' has more.");
+
     fprintf(stderr, "\n");
 }
 
@@ -76,6 +85,18 @@ int main( int argc, char * argv[] )
     // did the user ask for the version info
     int version_flag = false;
 
+    // did the user supply an argument to jobs
+    int jobs_flag = false;
+
+    // skip the tasks completed by the previous run of this plan
+    int resume_flag = false;
+
+    // only check the plan, without executing it
+    int check_flag = false;
+
+    // number of tasks to execute concurrently, if supplied
+    int jobs = 1;
+
     // default config path
     std::string config_path;
 
@@ -91,6 +112,12 @@ int main( int argc, char * argv[] )
         help_flag = true;
     }
 
+    // reading back logs is a command of its own, with its own arguments
+    if ( argc > 1 && strcmp( argv[1], "logs" ) == 0 )
+    {
+        return logs_command( argc - 1, argv + 1 );
+    }
+
     // process commandline arguments
     while ( 1 )
     {
@@ -104,10 +131,13 @@ int main( int argc, char * argv[] )
                 {"help",         no_argument,        0,      'h' },
                 {"config",       required_argument,  0,    'c' },
                 {"plan",         required_argument,  0,      'p' },
+                {"jobs",         required_argument,  0,      'j' },
+                {"resume",       no_argument,        0,      'r' },
+                {"check",        no_argument,        0,      'k' },
                 {0,0,0,0}
         };
 
-        c = getopt_long(argc, argv, "vihc:p:", long_options, &option_index );
+        c = getopt_long(argc, argv, "vihrkc:p:j:", long_options, &option_index );
         if ( c == -1 )
         {
             break;
@@ -123,6 +153,12 @@ int main( int argc, char * argv[] )
             case 'v':
                 verbose_flag = true;
                 break;
+            case 'r':
+                resume_flag = true;
+                break;
+            case 'k':
+                check_flag = true;
+                break;
             case 'c':
                 config_flag = true;
                 config_path = std::string( optarg );
@@ -131,6 +167,20 @@ int main( int argc, char * argv[] )
                 plan_flag = true;
                 plan_path = std::string( optarg );
                 break;
+            case 'j':
+            {
+                char * end;
+                long parsed = strtol( optarg, &end, 10 );
+                if ( *optarg == '\0' || *end != '\0' || parsed < 0 || parsed > 4096 )
+                {
+                    std::cerr << "INVALID: JOBS must be an integer between 0 and 4096." << std::endl;
+                    help_flag = true;
+                    break;
+                }
+                jobs_flag = true;
+                jobs = (int) parsed;
+                break;
+            }
             case '?':
                 help_flag = true;
                 break;
@@ -185,6 +235,12 @@ int main( int argc, char * argv[] )
     Conf configuration = Conf( config_path, L_LEVEL );
     slog.log_task(E_DEBUG, "INIT", "Configuration initialised.");
 
+    // the commandline takes precedence over the config file
+    if ( jobs_flag )
+    {
+        configuration.set_jobs( jobs );
+    }
+
     // load the paths to definitions of units.
     std::string unit_definitions_path = configuration.get_units_path();
 
@@ -203,18 +259,35 @@ int main( int argc, char * argv[] )
     slog.log_task( E_DEBUG, "PLAN_INIT", "Initialising Plan..." );
     Plan plan = Plan( &configuration, L_LEVEL );
 
-    plan.load_plan_file( plan_file );
+    try
+    {
+        // dependencies are resolved and checked for cycles as the plan loads
+        plan.load_plan_file( plan_file );
+
+        // ingest the suitable Tasks from the Suite into the Plan, and make sure all of them could execute before
+        // any of them do
+        slog.log_task( E_INFO, "LOAD", "Loading planned Tasks from Suite to Plan." );
+        plan.preflight( available_definitions );
+    }
 
+    catch ( std::exception& e )
+    {
+        slog.log( E_FATAL, "Could not load plan.");
+        slog.log( E_FATAL, e.what() );
+        return 1;
+    }
 
-    // ingest the suitable Tasks from the Suite into the Plan
-    slog.log_task( E_INFO, "LOAD", "Loading planned Tasks from Suite to Plan." );
-    plan.load_definitions( available_definitions );
+    if ( check_flag )
+    {
+        slog.log_task( E_INFO, "main", "Plan passed its checks.  Nothing was executed." );
+        return 0;
+    }
 
     slog.log_task( E_INFO, "main", "Ready to execute all actionable Tasks in Plan." );
 
     try
     {
-        plan.execute();
+        plan.execute( resume_flag );
     }
 
     catch ( std::exception& e)
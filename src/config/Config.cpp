@@ -134,6 +134,34 @@ void Conf::set_object_b(std::string keyname, bool & object_member, std::string f
     this->slog.log_task( E_DEBUG, "SET_PROPERTY", "'" + keyname + "' " + std::to_string(object_member));
 }
 
+
+/**
+ * @brief Set the integer value of an optional key
+ *
+ * This method sets the value of a key as an integer in a member variable.
+ * If the key is not present in the configuration file the supplied default is used instead, so that newer tunables
+ * do not break existing configuration files.
+ * If the key is present but is not an integer, a `ConfigLoadException` is thrown.
+ *
+ * @param keyname The name of the key to retrieve
+ * @param object_member The reference to the member variable to store the value
+ * @param default_value The value to use when the key is absent
+ *
+ * @throws ConfigLoadException If the key is present but is not an integer
+ */
+void Conf::set_object_i_optional(std::string keyname, int & object_member, int default_value )
+{
+    if (! this->json_root.isMember( keyname ) )
+    {
+        object_member = default_value;
+    } else if (! this->json_root[keyname].isInt() ) {
+        throw ConfigLoadException( "'" + keyname + "' must be an integer." );
+    } else {
+        object_member = this->json_root[keyname].asInt();
+    }
+    this->slog.log_task( E_DEBUG, "SET_PROPERTY", "'" + keyname + "' " + std::to_string(object_member));
+}
+
 void removeTrailingSlash(std::string &str) {
     if (!str.empty() && str.back() == '/') {
         str.pop_back();
@@ -238,6 +266,40 @@ void Conf::load_shells() {
     }
 }
 
+/**
+ * @brief Load the resource capacities
+ *
+ * This method loads the optional `resources` object, which maps resource names to the number of tokens that Tasks
+ * executing at the same time may hold between them.  Units claim tokens of these resources, and the Plan will not
+ * start a Task until its claims fit in what remains.
+ *
+ * @throws ConfigLoadException If `resources` is not an object of non-negative integers
+ */
+void Conf::load_resources()
+{
+    this->resources.clear();
+    if (! this->json_root.isMember( "resources" ) )
+    {
+        return;
+    }
+
+    Json::Value capacities = this->json_root["resources"];
+    if (! capacities.isObject() )
+    {
+        throw ConfigLoadException( "'resources' must be an object of resource names to token counts." );
+    }
+
+    for ( Json::Value::const_iterator it = capacities.begin(); it != capacities.end(); it++ )
+    {
+        if (! it->isInt() || it->asInt() < 0 )
+        {
+            throw ConfigLoadException( "Resource '" + it.name() + "' must have a non-negative integer capacity." );
+        }
+        this->resources[ it.name() ] = it->asInt();
+        this->slog.log_task( E_DEBUG, "RESOURCES", "'" + it.name() + "' " + std::to_string( it->asInt() ) );
+    }
+}
+
 /**
  * @brief Get a shell by name
  *
@@ -316,6 +378,86 @@ Conf::Conf(std::string filename, int LOG_LEVEL ): JSON_Loader(LOG_LEVEL ), slog(
     set_object_s_derivedpath( "shells_path",      this->shell_definitions_path, filename );
     interpolate( this->shell_definitions_path );
 
+    // tunables, all optional
+    set_object_i_optional( "jobs",                this->jobs,                   1 );
+    this->set_jobs( this->jobs );
+    set_object_i_optional( "default_task_estimate", this->default_task_estimate, 60 );
+    if ( this->default_task_estimate < 0 )
+    {
+        throw ConfigLoadException( "'default_task_estimate' must not be negative." );
+    }
+    load_resources();
+    if ( this->json_root.isMember( "cache_path" ) )
+    {
+        set_object_s_derivedpath( "cache_path", this->cache_path, filename );
+        interpolate( this->cache_path );
+    }
+    this->log_fsync = "none";
+    if ( this->json_root.isMember( "log_fsync" ) )
+    {
+        if (! this->json_root["log_fsync"].isString() )
+        {
+            throw ConfigLoadException( "'log_fsync' must be a string." );
+        }
+        this->log_fsync = this->json_root["log_fsync"].asString();
+        if ( this->log_fsync != "none" && this->log_fsync != "task" && this->log_fsync != "interval" )
+        {
+            throw ConfigLoadException( "'log_fsync' must be one of 'none', 'task' or 'interval', not '" + this->log_fsync + "'." );
+        }
+    }
+    set_object_i_optional( "log_fsync_interval_seconds", this->log_fsync_interval, 5 );
+    if ( this->log_fsync_interval < 1 )
+    {
+        throw ConfigLoadException( "'log_fsync_interval_seconds' must be at least 1." );
+    }
+    this->log_compression = "none";
+    if ( this->json_root.isMember( "log_compression" ) )
+    {
+        if (! this->json_root["log_compression"].isString() )
+        {
+            throw ConfigLoadException( "'log_compression' must be a string." );
+        }
+        this->log_compression = this->json_root["log_compression"].asString();
+        if ( this->log_compression != "none" && this->log_compression != "lz4" )
+        {
+            throw ConfigLoadException( "'log_compression' must be one of 'none' or 'lz4', not '" + this->log_compression + "'." );
+        }
+    }
+    this->log_store = "files";
+    if ( this->json_root.isMember( "log_store" ) )
+    {
+        if (! this->json_root["log_store"].isString() )
+        {
+            throw ConfigLoadException( "'log_store' must be a string." );
+        }
+        this->log_store = this->json_root["log_store"].asString();
+        if ( this->log_store != "files" && this->log_store != "segments" )
+        {
+            throw ConfigLoadException( "'log_store' must be one of 'files' or 'segments', not '" + this->log_store + "'." );
+        }
+    }
+    set_object_i_optional( "pty_pool_size", this->pty_pool_size, 4 );
+    if ( this->pty_pool_size < 0 )
+    {
+        throw ConfigLoadException( "'pty_pool_size' must not be negative." );
+    }
+    this->shell_sessions = false;
+    if ( this->json_root.isMember( "shell_sessions" ) )
+    {
+        set_object_b( "shell_sessions", this->shell_sessions, filename );
+    }
+    set_object_i_optional( "output_excerpt_kib", this->output_excerpt_kib, 4 );
+    if ( this->output_excerpt_kib < 0 )
+    {
+        throw ConfigLoadException( "'output_excerpt_kib' must not be negative." );
+    }
+    // an absolute path, as it names a place in the cgroup hierarchy rather than anything of the project's
+    if ( this->json_root.isMember( "cgroup_root" ) )
+    {
+        set_object_s( "cgroup_root", this->cgroup_root, filename );
+        interpolate( this->cgroup_root );
+    }
+
     // ensure these paths exists, with exception to the logs_path, which will be created at runtime
     this->slog.log_task( E_DEBUG, "SANITY_CHECKS", "Checking for sanity..." );
     checkPathExists( "project_root",     this->project_root );
@@ -346,6 +488,26 @@ std::string Conf::get_units_path() { return this->units_path; }
  */
 std::string Conf::get_logs_path() { return this->logs_path; }
 
+/**
+ * @brief Gets the absolute path to the logs directory
+ *
+ * The `logs_path` key is interpolated and, if relative, taken to be relative to the project root, in the same way as
+ * Tasks resolve it when they create their logs.
+ *
+ * @return The absolute path to the logs directory.
+ */
+std::string Conf::get_logs_root()
+{
+    std::string logs_root = this->logs_path;
+    interpolate( logs_root );
+    if ( logs_root.empty() || logs_root[0] != '/' )
+    {
+        logs_root = this->project_root + "/" + logs_root;
+    }
+    removeTrailingSlash( logs_root );
+    return logs_root;
+}
+
 /**
  * @brief Gets the project root directory
  *
@@ -353,4 +515,129 @@ std::string Conf::get_logs_path() { return this->logs_path; }
  *
  * @return The path to the project root directory.
  */
-std::string Conf::get_project_root() { return this->project_root; }
\ No newline at end of file
+std::string Conf::get_project_root() { return this->project_root; }
+
+/**
+ * @brief Gets the number of Tasks that may execute concurrently
+ *
+ * This function returns the size of the worker pool the Plan uses, as set by the `jobs` key in the configuration
+ * file or overridden from the commandline.
+ *
+ * @return The number of Tasks that may execute concurrently.
+ */
+int Conf::get_jobs() { return this->jobs; }
+
+/**
+ * @brief Overrides the number of Tasks that may execute concurrently
+ *
+ * A value of 0 selects the number of online processors.
+ *
+ * @param jobs The number of Tasks that may execute concurrently.
+ *
+ * @throws ConfigLoadException If jobs is negative
+ */
+void Conf::set_jobs( int jobs )
+{
+    if ( jobs < 0 )
+    {
+        throw ConfigLoadException( "'jobs' must not be negative." );
+    }
+
+    if ( jobs == 0 )
+    {
+        long online = sysconf( _SC_NPROCESSORS_ONLN );
+        jobs = ( online > 0 ) ? (int) online : 1;
+    }
+
+    this->jobs = jobs;
+    this->slog.log_task( E_DEBUG, "SET_PROPERTY", "'jobs' " + std::to_string( this->jobs ) );
+}
+
+/**
+ * @brief Gets the duration assumed for a Task with no recorded history
+ *
+ * Used by the Plan when estimating the critical path through its dependency graph.
+ *
+ * @return The estimate in seconds.
+ */
+int Conf::get_default_task_estimate() { return this->default_task_estimate; }
+
+/**
+ * @brief Gets the declared capacity of each named resource
+ *
+ * @return A map of resource names to the number of tokens Tasks may hold at once.
+ */
+std::map<std::string, int> Conf::get_resources() { return this->resources; }
+
+/**
+ * @brief Gets the absolute path of the directory holding stored Task results
+ *
+ * Like the other paths in the configuration, `cache_path` is relative to the project root.  When it is not set,
+ * results are kept in `.cache` in the logs directory.
+ *
+ * @return The absolute path of the cache directory.
+ */
+std::string Conf::get_cache_root()
+{
+    if ( this->cache_path.empty() )
+    {
+        return this->get_logs_root() + "/.cache";
+    }
+    return this->cache_path;
+}
+
+/**
+ * @brief Gets when Task logs are forced out to disk
+ *
+ * @return `none` unless `log_fsync` is set in the configuration file.
+ */
+std::string Conf::get_log_fsync() { return this->log_fsync; }
+
+/**
+ * @brief Gets the time between flushes of Task logs when `log_fsync` is `interval`
+ *
+ * @return The interval in seconds.
+ */
+int Conf::get_log_fsync_interval() { return this->log_fsync_interval; }
+
+/**
+ * @brief Gets whether shell commands may run in long-lived shell sessions
+ *
+ * @return false unless `shell_sessions` is set in the configuration file.
+ */
+bool Conf::get_shell_sessions() { return this->shell_sessions; }
+
+/**
+ * @brief Gets the delegated cgroup v2 directory Tasks' cgroups are created in
+ *
+ * @return The `cgroup_root` from the configuration file, or an empty string if it is not set.
+ */
+std::string Conf::get_cgroup_root() { return this->cgroup_root; }
+
+/**
+ * @brief Gets how much of the beginning and of the end of a command's output is kept for the report of a failed Task
+ *
+ * @return The KiB kept from each end of stdout and of stderr, or 0 to keep none.  4 unless `output_excerpt_kib` is set.
+ */
+int Conf::get_output_excerpt_kib() { return this->output_excerpt_kib; }
+
+/**
+ * @brief Gets how Task logs are compressed as they are written
+ *
+ * @return `none` unless `log_compression` is set in the configuration file.
+ */
+std::string Conf::get_log_compression() { return this->log_compression; }
+
+/**
+ * @brief Gets how Task logs are kept: a pair of files per execution, or a segment per run
+ *
+ * @return `files` unless `log_store` is set in the configuration file.
+ */
+std::string Conf::get_log_store() { return this->log_store; }
+
+/**
+ * @brief Gets how many pseudo-terminals are opened ahead of the Tasks forcing a PTY
+ *
+ * @return 4 unless `pty_pool_size` is set in the configuration file.
+ */
+int Conf::get_pty_pool_size() { return this->pty_pool_size; }
@@ -24,6 +24,7 @@
 
 #include <exception>
 #include <string>
+#include <map>
 #include "../json_support/JSON.h"
 #include "../logger/Logger.h"
 #include "../misc/helpers.h"
@@ -65,6 +66,13 @@ public:
      */
     std::string get_logs_path();
 
+    /**
+     * @brief Returns the absolute path to the logs directory
+     *
+     * @return The logs path, interpolated and made relative to the project root if it is not already absolute
+     */
+    std::string get_logs_root();
+
     /**
      * @brief Returns the root directory of the project
      *
@@ -81,6 +89,100 @@ public:
      */
     Shell get_shell_by_name(std::string name);
 
+    /**
+     * @brief Returns the number of Tasks that may execute concurrently
+     *
+     * @return The size of the worker pool used to execute the Plan
+     */
+    int get_jobs();
+
+    /**
+     * @brief Overrides the number of Tasks that may execute concurrently
+     *
+     * Used to let the commandline take precedence over the configuration file.  A value of 0 selects the number of
+     * online processors.
+     *
+     * @param jobs The size of the worker pool used to execute the Plan
+     */
+    void set_jobs(int jobs);
+
+    /**
+     * @brief Returns the duration assumed for a Task that has no recorded history
+     *
+     * @return The estimate in seconds
+     */
+    int get_default_task_estimate();
+
+    /**
+     * @brief Returns the declared capacity of each named resource
+     *
+     * @return A map of resource names to the number of tokens available
+     */
+    std::map<std::string, int> get_resources();
+
+    /**
+     * @brief Returns the absolute path of the directory holding stored Task results
+     *
+     * @return The `cache_path` from the configuration file, or `.cache` in the logs directory if it is not set
+     */
+    std::string get_cache_root();
+
+    /**
+     * @brief Returns when Task logs are forced out to disk
+     *
+     * @return One of `none`, `task` or `interval`
+     */
+    std::string get_log_fsync();
+
+    /**
+     * @brief Returns the time between flushes when `log_fsync` is `interval`
+     *
+     * @return The interval in seconds
+     */
+    int get_log_fsync_interval();
+
+    /**
+     * @brief Returns whether shell commands may run in long-lived shell sessions
+     *
+     * @return The `shell_sessions` from the configuration file, or false if it is not set
+     */
+    bool get_shell_sessions();
+
+    /**
+     * @brief Returns the delegated cgroup v2 directory Tasks' cgroups are created in
+     *
+     * @return The `cgroup_root` from the configuration file, or an empty string if it is not set
+     */
+    std::string get_cgroup_root();
+
+    /**
+     * @brief Returns how much of each end of a command's output is kept for the report of a failed Task
+     *
+     * @return The `output_excerpt_kib` from the configuration file, or 4 if it is not set
+     */
+    int get_output_excerpt_kib();
+
+    /**
+     * @brief Returns how Task logs are compressed as they are written
+     *
+     * @return The `log_compression` from the configuration file, or `none` if it is not set
+     */
+    std::string get_log_compression();
+
+    /**
+     * @brief Returns how Task logs are kept: a pair of files per execution, or a segment per run
+     *
+     * @return The `log_store` from the configuration file, or `files` if it is not set
+     */
+    std::string get_log_store();
+
+    /**
+     * @brief Returns how many pseudo-terminals are opened ahead of the Tasks forcing a PTY
+     *
+     * @return The `pty_pool_size` from the configuration file, or 4 if it is not set
+     */
+    int get_pty_pool_size();
+
 private:
     /**
      * @brief The path to the units directory
@@ -107,6 +209,71 @@ private:
      */
     std::vector<Shell> shells;
 
+    /**
+     * @brief The number of Tasks that may execute concurrently
+     */
+    int jobs;
+
+    /**
+     * @brief The duration, in seconds, assumed for a Task with no recorded history
+     */
+    int default_task_estimate;
+
+    /**
+     * @brief The number of tokens of each named resource that executing Tasks may hold at once
+     */
+    std::map<std::string, int> resources;
+
+    /**
+     * @brief The directory holding stored Task results, or empty to keep them in the logs directory
+     */
+    std::string cache_path;
+
+    /**
+     * @brief When Task logs are forced out to disk: `none`, `task` or `interval`
+     */
+    std::string log_fsync;
+
+    /**
+     * @brief The seconds between flushes when `log_fsync` is `interval`
+     */
+    int log_fsync_interval;
+
+    /**
+     * @brief Whether shell commands may run in long-lived shell sessions
+     */
+    bool shell_sessions;
+
+    /**
+     * @brief The delegated cgroup v2 directory Tasks' cgroups are created in, or empty for none
+     */
+    std::string cgroup_root;
+
+    /**
+     * @brief The KiB kept from the beginning and from the end of each stream of a command's output, or 0 for none
+     */
+    int output_excerpt_kib;
+
+    /**
+     * @brief How Task logs are compressed as they are written: `none` or `lz4`
+     */
+    std::string log_compression;
+
+    /**
+     * @brief How Task logs are kept: `files` or `segments`
+     */
+    std::string log_store;
+
+    /**
+     * @brief The most pseudo-terminals kept open for Tasks forcing a PTY, or 0 to open one for each execution
+     */
+    int pty_pool_size;
+
+    /**
+     * @brief Loads the optional resource capacities from the configuration file
+     */
+    void load_resources();
+
     /**
      * @brief Checks if the specified path exists
      *
@@ -161,6 +328,15 @@ private:
      */
     void set_object_b(std::string keyname, bool &object_member, std::string filename);
 
+    /**
+     * @brief Sets an integer object member from a JSON file, falling back to a default when the key is absent
+     *
+     * @param keyname The name of the key in the JSON file
+     * @param object_member The integer object member to be set
+     * @param default_value The value to use when the key is not present
+     */
+    void set_object_i_optional(std::string keyname, int &object_member, int default_value);
+
     /**
      * @brief Loads the shell definitions from the specified file
      */
@@ -0,0 +1,278 @@
+#include "Cgroup.h"
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+
+// how long finish() waits for a killed cgroup to empty, in turns of CGROUP_EMPTY_POLL_MS
+static const int CGROUP_EMPTY_TURNS = 100;
+static const int CGROUP_EMPTY_POLL_MS = 50;
+
+// the longest part of a cgroup's name taken from its label
+static const size_t CGROUP_LABEL_LENGTH = 64;
+
+
+std::string cgroup_limit_controller( const std::string & interface_file )
+{
+    static const std::map<std::string, std::string> controllers = {
+        { "cpu.max", "cpu" },
+        { "memory.max", "memory" },
+        { "io.weight", "io" },
+        { "pids.max", "pids" }
+    };
+    std::map<std::string, std::string>::const_iterator found = controllers.find( interface_file );
+    return found == controllers.end() ? "" : found->second;
+}
+
+
+std::string check_cgroup_root( const std::string & root )
+{
+    struct statfs filesystem;
+    if ( statfs( root.c_str(), &filesystem ) == -1 ) {
+        return "The cgroup root '" + root + "' is not accessible: " + strerror( errno ) + ".";
+    }
+    if ( filesystem.f_type != CGROUP2_SUPER_MAGIC ) {
+        return "The cgroup root '" + root + "' is not in a cgroup v2 hierarchy.";
+    }
+    if ( access( root.c_str(), W_OK ) == -1 ) {
+        return "The cgroup root '" + root + "' is not writable: " + strerror( errno ) + ".";
+    }
+    return "";
+}
+
+
+// write a value to an interface file in one write(), as the kernel takes it.  returns 0, or the error.
+static int write_interface( const std::string & path, const std::string & value )
+{
+    int fd = open( path.c_str(), O_WRONLY | O_CLOEXEC );
+    if ( fd == -1 ) {
+        return errno;
+    }
+    int result = write( fd, value.c_str(), value.size() ) == (ssize_t) value.size() ? 0 : errno;
+    close( fd );
+    return result;
+}
+
+
+// read an interface file, which is always small.  returns whether it could be.
+static bool read_interface( int fd, std::string & contents )
+{
+    char buffer[4096];
+    ssize_t count = pread( fd, buffer, sizeof( buffer ) - 1, 0 );
+    if ( count < 0 ) {
+        return false;
+    }
+    contents.assign( buffer, count );
+    return true;
+}
+
+
+// the value of a "key value" line of a flat-keyed interface file such as cpu.stat, or 0
+static unsigned long long interface_value( const std::string & contents, const std::string & key )
+{
+    size_t at = 0;
+    while ( at < contents.size() ) {
+        size_t end = contents.find( '\n', at );
+        if ( end == std::string::npos ) {
+            end = contents.size();
+        }
+        if ( contents.compare( at, key.size() + 1, key + " " ) == 0 ) {
+            return strtoull( contents.c_str() + at + key.size() + 1, nullptr, 10 );
+        }
+        at = end + 1;
+    }
+    return 0;
+}
+
+
+// a label, cut short, with anything that isn't safe in a path component replaced
+static std::string cgroup_name_part( const std::string & label )
+{
+    std::string part = label.substr( 0, CGROUP_LABEL_LENGTH );
+    for ( size_t i = 0; i < part.size(); i++ ) {
+        char c = part[i];
+        if (! ( ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || ( c >= '0' && c <= '9' ) || c == '-' || c == '_' ) ) {
+            part[i] = '_';
+        }
+    }
+    return part.empty() ? "command" : part;
+}
+
+
+CommandCgroup::CommandCgroup(): procs( -1 ), kill( -1 ), events( -1 ) {}
+
+
+CommandCgroup::~CommandCgroup()
+{
+    if (! this->path.empty() ) {
+        this->empty_out();
+        this->remove();
+    }
+}
+
+
+bool CommandCgroup::create( const CgroupSettings & settings, std::string & error )
+{
+    // unique among every command of every Rex running under the same root
+    static std::atomic<unsigned long> created( 0 );
+
+    // a controller is only offered to a child cgroup once its parent enables it for its children
+    std::set<std::string> controllers;
+    for ( std::map<std::string, std::string>::const_iterator it = settings.limits.begin(); it != settings.limits.end(); it++ ) {
+        controllers.insert( cgroup_limit_controller( it->first ) );
+    }
+    // peak memory is accounted for in every cgroup, limited or not, wherever the memory controller can be had
+    if ( controllers.count( "memory" ) == 0 ) {
+        write_interface( settings.root + "/cgroup.subtree_control", "+memory" );
+    }
+    for ( std::set<std::string>::const_iterator it = controllers.begin(); it != controllers.end(); it++ ) {
+        int result = write_interface( settings.root + "/cgroup.subtree_control", "+" + *it );
+        if ( result != 0 ) {
+            error = "REX: Aborting: could not enable the " + *it + " cgroup controller in " + settings.root + ": " + strerror( result ) + "\n";
+            return false;
+        }
+    }
+
+    std::string path = settings.root + "/" + cgroup_name_part( settings.label ) + "." + std::to_string( getpid() ) + "." + std::to_string( ++created );
+    if ( mkdir( path.c_str(), 0755 ) == -1 ) {
+        error = "REX: Aborting: could not create cgroup " + path + ": " + strerror( errno ) + "\n";
+        return false;
+    }
+    this->path = path;
+
+    for ( std::map<std::string, std::string>::const_iterator it = settings.limits.begin(); it != settings.limits.end(); it++ ) {
+        int result = write_interface( path + "/" + it->first, it->second );
+        if ( result != 0 ) {
+            error = "REX: Aborting: could not set cgroup limit " + it->first + " to '" + it->second + "': " + strerror( result ) + "\n";
+            this->remove();
+            return false;
+        }
+    }
+
+    // cgroup.kill is missing before Linux 5.14, in which case what is left is killed one process at a time
+    this->procs = open( ( path + "/cgroup.procs" ).c_str(), O_RDWR | O_CLOEXEC );
+    this->kill = open( ( path + "/cgroup.kill" ).c_str(), O_WRONLY | O_CLOEXEC );
+    this->events = open( ( path + "/cgroup.events" ).c_str(), O_RDONLY | O_CLOEXEC );
+    if ( this->procs == -1 || this->events == -1 ) {
+        error = "REX: Aborting: could not open cgroup " + path + ": " + strerror( errno ) + "\n";
+        this->remove();
+        return false;
+    }
+    return true;
+}
+
+
+int CommandCgroup::procs_fd() const
+{
+    return this->procs;
+}
+
+
+int CommandCgroup::kill_fd() const
+{
+    return this->kill;
+}
+
+
+bool CommandCgroup::empty_out()
+{
+    for ( int turn = 0; turn < CGROUP_EMPTY_TURNS; turn++ ) {
+        std::string state;
+        if (! read_interface( this->events, state ) ) {
+            return false;
+        }
+        if ( interface_value( state, "populated" ) == 0 ) {
+            return true;
+        }
+
+        // again on every turn, for whatever was forking while the last went out
+        if ( this->kill != -1 ) {
+            ssize_t ignored = write( this->kill, "1", 1 );
+            (void) ignored;
+        } else {
+            std::string members;
+            if ( read_interface( this->procs, members ) ) {
+                const char * cursor = members.c_str();
+                char * next;
+                for ( long pid = strtol( cursor, &next, 10 ); next != cursor; pid = strtol( cursor, &next, 10 ) ) {
+                    ::kill( pid, SIGKILL );
+                    cursor = next;
+                }
+            }
+        }
+
+        // cgroup.events raises POLLPRI when populated changes
+        struct pollfd watched = { this->events, POLLPRI, 0 };
+        poll( &watched, 1, CGROUP_EMPTY_POLL_MS );
+    }
+    return false;
+}
+
+
+bool CommandCgroup::remove()
+{
+    int fds[3] = { this->procs, this->kill, this->events };
+    for ( int i = 0; i < 3; i++ ) {
+        if ( fds[i] != -1 ) {
+            close( fds[i] );
+        }
+    }
+    this->procs = this->kill = this->events = -1;
+
+    // the last process can be gone from populated a moment before the kernel lets go of the cgroup
+    bool removed = false;
+    for ( int turn = 0; turn < CGROUP_EMPTY_TURNS && ! removed; turn++ ) {
+        removed = rmdir( this->path.c_str() ) == 0 || errno == ENOENT;
+        if (! removed && errno != EBUSY ) {
+            break;
+        }
+        if (! removed ) {
+            usleep( CGROUP_EMPTY_POLL_MS * 1000 / 10 );
+        }
+    }
+    this->path.clear();
+    return removed;
+}
+
+
+std::string CommandCgroup::finish( CommandOutcome & outcome )
+{
+    if ( this->path.empty() ) {
+        return "";
+    }
+    std::string path = this->path;
+    bool emptied = this->empty_out();
+
+    // a cgroup's statistics outlive its processes until it is removed.  cpu.stat's times are always there, but memory.peak
+    // needs the memory controller, which create() enabled if it could.
+    int fd = open( ( path + "/cpu.stat" ).c_str(), O_RDONLY | O_CLOEXEC );
+    std::string contents;
+    if ( fd != -1 && read_interface( fd, contents ) ) {
+        outcome.cgroup_measured = true;
+        outcome.cgroup_user_usec = interface_value( contents, "user_usec" );
+        outcome.cgroup_system_usec = interface_value( contents, "system_usec" );
+    }
+    if ( fd != -1 ) {
+        close( fd );
+    }
+    fd = open( ( path + "/memory.peak" ).c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd != -1 && read_interface( fd, contents ) ) {
+        outcome.cgroup_memory_peak = strtoull( contents.c_str(), nullptr, 10 );
+    }
+    if ( fd != -1 ) {
+        close( fd );
+    }
+
+    if (! this->remove() ) {
+        return std::string( "REX: could not remove cgroup " ) + path + ( emptied ? "" : ", which still holds processes" ) + "\n";
+    }
+    return "";
+}
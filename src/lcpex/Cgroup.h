@@ -0,0 +1,108 @@
+#ifndef LCPEX_CGROUP_H
+#define LCPEX_CGROUP_H
+
+#include "helpers.h"
+#include <map>
+#include <string>
+
+// the cgroup a command runs in, if any
+struct CgroupSettings {
+    // whether the command runs in a transient cgroup of its own
+    bool enabled;
+
+    // the delegated cgroup v2 directory the command's cgroup is created in
+    std::string root;
+
+    // what the command's cgroup is named after, such as its Task's name.  made unique, and safe as a path component.
+    std::string label;
+
+    // values to write to the cgroup's interface files before the command starts, keyed by file, such as "cpu.max"
+    std::map<std::string, std::string> limits;
+};
+
+/**
+ * @brief The controller an interface file a command's cgroup may be limited with belongs to.
+ *
+ * @param interface_file The file, such as "memory.max".
+ *
+ * @return The controller, such as "memory", or an empty string if the file is not one commands may set.
+ */
+std::string cgroup_limit_controller( const std::string & interface_file );
+
+/**
+ * @brief Check that a directory can hold commands' cgroups.
+ *
+ * @param root The directory.
+ *
+ * @return An empty string if it is a writable directory of a cgroup v2 hierarchy, or why not.
+ */
+std::string check_cgroup_root( const std::string & root );
+
+/**
+ * @brief A transient cgroup v2 that one command, and everything it starts, runs in.
+ *
+ * The cgroup is created under a delegated root with the command's limits applied, the child moves itself in through
+ * procs_fd() before it executes, and nothing it starts can leave.  So killing the cgroup kills the whole tree, however
+ * it has daemonized or regrouped, and what the cgroup measures covers every descendant, waited for or not.
+ *
+ * Controllers the limits need are enabled in the root's cgroup.subtree_control as they are first needed.  Under cgroup
+ * v2's rule that only leaf cgroups hold processes, the root must not hold any itself, so it should not be the cgroup
+ * Rex runs in.
+ */
+class CommandCgroup
+{
+    public:
+        CommandCgroup();
+
+        // anything left is removed, as finish() would, without recording it
+        ~CommandCgroup();
+
+        /**
+         * @brief Create the cgroup and apply its limits.
+         *
+         * @param settings The root, label and limits.
+         * @param error Receives a line of text for the command's stderr, ending in a newline, if it could not be.
+         *
+         * @return True if the cgroup is ready for the child to join.
+         */
+        bool create( const CgroupSettings & settings, std::string & error );
+
+        /**
+         * @brief The cgroup's cgroup.procs, for the child to write "0" to, or -1 if there is no cgroup.
+         */
+        int procs_fd() const;
+
+        /**
+         * @brief The cgroup's cgroup.kill, which kills everything in it once "1" is written, or -1 if there is no
+         * cgroup.
+         */
+        int kill_fd() const;
+
+        /**
+         * @brief Kill anything still in the cgroup, record what it used, and remove it.
+         *
+         * @param outcome Receives the cgroup's measurements.
+         *
+         * @return An empty string, or a line of text for the command's stderr, ending in a newline, if the cgroup
+         *         could not be removed.
+         */
+        std::string finish( CommandOutcome & outcome );
+
+    private:
+        CommandCgroup( const CommandCgroup & ) = delete;
+        CommandCgroup & operator=( const CommandCgroup & ) = delete;
+
+        // kill everything in the cgroup, and wait a bounded time for it to be empty.  returns whether it is.
+        bool empty_out();
+
+        // close every descriptor and remove the directory.  returns whether it is gone.
+        bool remove();
+
+        // the cgroup's directory, or empty if there is none
+        std::string path;
+        int procs;
+        int kill;
+        int events;
+};
+
+#endif //LCPEX_CGROUP_H
@@ -1,70 +1,225 @@
 #include "Contexts.h"
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
 
 
+// the answer to one lookup, as every caller that asks the same question is given it
+struct IdentityLookup {
+    // being looked up by some caller, which the others wait for
+    bool loading;
+    bool found;
+    unsigned int id;
+    std::string name;
+    std::vector<gid_t> groups;
+};
+
+// every answer so far, keyed by the kind of question and what was asked
+struct IdentityCache {
+    std::mutex lock;
+    std::condition_variable loaded;
+    std::unordered_map<std::string, IdentityLookup> lookups;
+};
+
+static IdentityCache & identity_cache()
+{
+    static IdentityCache * cache = new IdentityCache();
+    return *cache;
+}
+
+// answer a question from the cache, asking resolve() only if nobody has asked it yet.  callers asking while the
+// first one waits on the databases wait for its answer too.
+template <typename Resolve>
+static IdentityLookup cached_lookup( const std::string & key, Resolve resolve )
+{
+    IdentityCache & cache = identity_cache();
+    std::unique_lock<std::mutex> guard( cache.lock );
+    while ( true )
+    {
+        std::unordered_map<std::string, IdentityLookup>::iterator found = cache.lookups.find( key );
+        if ( found == cache.lookups.end() )
+        {
+            IdentityLookup pending = IdentityLookup();
+            pending.loading = true;
+            cache.lookups.emplace( key, pending );
+            break;
+        }
+        if (! found->second.loading )
+        {
+            return found->second;
+        }
+        cache.loaded.wait( guard );
+    }
+    guard.unlock();
+
+    IdentityLookup answer = resolve();
+    answer.loading = false;
+
+    guard.lock();
+    cache.lookups[key] = answer;
+    cache.loaded.notify_all();
+    return answer;
+}
+
+// the buffer size sysconf() suggests for a reentrant user or group lookup, or a generous default if it has none
+static size_t lookup_buffer_size( int name )
+{
+    long suggested = sysconf( name );
+    return suggested > 0 ? suggested : 16384;
+}
+
+// look a user up by name, or by UID if the name is null
+static IdentityLookup lookup_user( const char * username, uid_t uid )
+{
+    IdentityLookup answer = IdentityLookup();
+
+    // reentrant, as Tasks resolve their identities concurrently
+    std::vector<char> buffer( lookup_buffer_size( _SC_GETPW_R_SIZE_MAX ) );
+    struct passwd entry;
+    struct passwd * pw = NULL;
+    while ( ( username != NULL
+              ? getpwnam_r( username, &entry, buffer.data(), buffer.size(), &pw )
+              : getpwuid_r( uid, &entry, buffer.data(), buffer.size(), &pw ) ) == ERANGE )
+    {
+        buffer.resize( buffer.size() * 2 );
+    }
+    if ( pw != NULL )
+    {
+        answer.found = true;
+        answer.id = pw->pw_uid;
+        answer.name = pw->pw_name;
+    }
+    return answer;
+}
+
+// look a group up by name, or by GID if the name is null
+static IdentityLookup lookup_group( const char * groupname, gid_t gid )
+{
+    IdentityLookup answer = IdentityLookup();
+
+    std::vector<char> buffer( lookup_buffer_size( _SC_GETGR_R_SIZE_MAX ) );
+    struct group entry;
+    struct group * gp = NULL;
+    while ( ( groupname != NULL
+              ? getgrnam_r( groupname, &entry, buffer.data(), buffer.size(), &gp )
+              : getgrgid_r( gid, &entry, buffer.data(), buffer.size(), &gp ) ) == ERANGE )
+    {
+        buffer.resize( buffer.size() * 2 );
+    }
+    if ( gp != NULL )
+    {
+        answer.found = true;
+        answer.id = gp->gr_gid;
+        answer.name = gp->gr_name;
+    }
+    return answer;
+}
+
 // converts username to UID
 int username_to_uid( std::string username, int & uid )
 {
-    // assume failure unless proven otherwise
-    int r_code = false;
-
-    struct passwd * pw;
-    if ( ( pw = getpwnam( username.c_str() ) ) != NULL )
+    IdentityLookup answer = cached_lookup( "user-name:" + username, [&]() { return lookup_user( username.c_str(), 0 ); } );
+    if ( answer.found )
     {
-        // successful user lookup
-        r_code = true;
-        uid = pw->pw_uid;
-    } else {
-        // failed lookup, do nothing, assumed failure
+        uid = answer.id;
     }
-    return r_code;
+    return answer.found;
 };
 
 // converts group name to GID
 int groupname_to_gid( std::string groupname, int & gid )
 {
-    int r_code = false;
+    IdentityLookup answer = cached_lookup( "group-name:" + groupname, [&]() { return lookup_group( groupname.c_str(), 0 ); } );
+    if ( answer.found )
+    {
+        gid = answer.id;
+    }
+    return answer.found;
+}
 
-    struct group * gp;
-    if ( ( gp = getgrnam( groupname.c_str() ) ) != NULL )
+// converts UID to username
+int uid_to_username( uid_t uid, std::string & username )
+{
+    IdentityLookup answer = cached_lookup( "user-id:" + std::to_string( uid ), [&]() { return lookup_user( NULL, uid ); } );
+    if ( answer.found )
     {
-        r_code = true;
-        gid = gp->gr_gid;
-    } else {
-        // failed lookup, do nothing, assumed failure
+        username = answer.name;
+    }
+    return answer.found;
+}
+
+// converts GID to group name
+int gid_to_groupname( gid_t gid, std::string & groupname )
+{
+    IdentityLookup answer = cached_lookup( "group-id:" + std::to_string( gid ), [&]() { return lookup_group( NULL, gid ); } );
+    if ( answer.found )
+    {
+        groupname = answer.name;
+    }
+    return answer.found;
+}
+
+// the groups initgroups( user_name, gid ) would give, as getgrouplist() lists them
+static std::vector<gid_t> supplementary_groups( const std::string & user_name, gid_t gid )
+{
+    std::vector<gid_t> groups( 32 );
+    int group_count = groups.size();
+    while ( getgrouplist( user_name.c_str(), gid, groups.data(), &group_count ) == -1 )
+    {
+        // group_count now holds the number needed
+        groups.resize( (size_t) group_count > groups.size() ? group_count : groups.size() * 2 );
+        group_count = groups.size();
     }
-    return r_code;
+    groups.resize( group_count );
+    return groups;
 }
 
-// SET PROCESS TO A CERTAIN IDENTITY CONTEXT
-int set_identity_context( std::string user_name, std::string group_name ) {
+// RESOLVE AN IDENTITY CONTEXT FOR A CHILD TO SWITCH TO
+int resolve_identity_context( std::string user_name, std::string group_name, uid_t & uid, gid_t & gid, std::vector<gid_t> & groups ) {
     // the UID and GID for the username and groupname provided for context setting
     int context_user_id;
     int context_group_id;
 
-    int res = 0;
-
     // convert username to UID
-    if (! ( res = username_to_uid(user_name, context_user_id ) ) )
+    if (! username_to_uid(user_name, context_user_id ) )
     {
         return ERROR_NO_SUCH_USER;
     }
 
     // convert group name to GID
-    if (! ( res = groupname_to_gid(group_name, context_group_id ) ) )
+    if (! groupname_to_gid(group_name, context_group_id ) )
     {
         return ERROR_NO_SUCH_GROUP;
     }
 
-    if ( ( res = setgid(context_group_id) ) ) {
-        perror("lcpex: setgid failed");
-        return ERROR_SETGID_FAILED;
-    }
-
-    if ( ( res = setuid(context_user_id) ) ) {
-        perror("lcpex: setuid failed");
-        return ERROR_SETUID_FAILED;
+    // only root may set its supplementary groups, and for anyone else they stay as they are
+    if ( geteuid() == 0 )
+    {
+        groups = cached_lookup( "user-groups:" + user_name + ":" + std::to_string( context_group_id ), [&]() {
+            IdentityLookup answer = IdentityLookup();
+            answer.found = true;
+            answer.groups = supplementary_groups( user_name, context_group_id );
+            return answer;
+        } ).groups;
+    } else {
+        groups.clear();
     }
 
+    uid = context_user_id;
+    gid = context_group_id;
     return ERROR_NONE;
 }
 
+// DESCRIBE WHY AN IDENTITY CONTEXT COULD NOT BE RESOLVED
+std::string describe_identity_error( int error, std::string user_name, std::string group_name ) {
+    switch ( error ) {
+        case ERROR_NONE:
+            return "";
+        case ERROR_NO_SUCH_USER:
+            return "REX: Aborting: context user not found: " + user_name + "\n";
+        case ERROR_NO_SUCH_GROUP:
+            return "REX: Aborting: context group not found: " + group_name + "\n";
+        default:
+            return "REX: Aborting: Unknown error while setting identity context.\n";
+    }
+}
@@ -6,6 +6,8 @@
 #include <pwd.h>
 #include <grp.h>
 #include <iostream>
+#include <vector>
+#include <unistd.h>
 
 enum IDENTITY_CONTEXT_ERRORS {
     ERROR_NONE = 0,
@@ -16,6 +18,9 @@ enum IDENTITY_CONTEXT_ERRORS {
     ERROR_SETUID_FAILED,
 };
 
+// every lookup below consults the user and group databases once per run, however many units and tasks ask the same
+// question, and is safe to make from several threads at once.  a user or group changed while Rex runs is not noticed.
+
 /**
  * @brief Converts a username to a user ID (UID)
  *
@@ -47,23 +52,63 @@ int groupname_to_gid( std::string groupname, int & gid );
 
 
 /**
- * @brief Sets the execution context for a process
+ * @brief Converts a user ID (UID) to a username
+ *
+ * @param uid The UID to convert
+ * @param username A reference to the resulting username
+ *
+ * @return A boolean indicating whether the conversion was successful
+ *
+ * If the UID has no user, the function returns false and the value of `username` is unchanged.
+ */
+int uid_to_username( uid_t uid, std::string & username );
+
+
+/**
+ * @brief Converts a group ID (GID) to a group name
+ *
+ * @param gid The GID to convert
+ * @param groupname A reference to the resulting group name
+ *
+ * @return A boolean indicating whether the conversion was successful
+ *
+ * If the GID has no group, the function returns false and the value of `groupname` is unchanged.
+ */
+int gid_to_groupname( gid_t gid, std::string & groupname );
+
+
+/**
+ * @brief Resolves the identity a child process is to execute as
  *
  * @param user_name The username to use for the execution context
  * @param group_name The group name to use for the execution context
+ * @param uid A reference to the resulting UID
+ * @param gid A reference to the resulting GID
+ * @param groups A reference to the resulting supplementary groups
  *
- * @return An error code indicating the result of the context setting
+ * @return An error code indicating the result of the resolution
+ *
+ * The names are resolved in the parent, as the child shares the parent's memory until it executes and so can not
+ * consult the user and group databases itself.  The child only applies the numeric IDs, with setgroups(), setgid() and
+ * setuid().  `groups` holds the user's groups as initgroups() would set them, with `gid` among them, when Rex is root;
+ * otherwise Rex can't change its supplementary groups, and `groups` is empty so that the child keeps them.
+ *
+ * If either the username or group name is not found, the function returns `ERROR_NO_SUCH_USER` or `ERROR_NO_SUCH_GROUP`
+ * respectively, and `uid`, `gid` and `groups` are unchanged.  Otherwise, the function returns `ERROR_NONE`.
+ */
+int resolve_identity_context( std::string user_name, std::string group_name, uid_t & uid, gid_t & gid, std::vector<gid_t> & groups );
+
+
+/**
+ * @brief Describes why an identity context could not be resolved
  *
- * This function takes a username and group name as input and sets the execution context for the process.
- * The function converts the username and group name to UID and GID respectively, and sets the process's
- * user and group identity using the setuid() and setgid() functions.
+ * @param error The error code returned by resolve_identity_context()
+ * @param user_name The username that was resolved
+ * @param group_name The group name that was resolved
  *
- * If either the username or group name is not found, the function returns `ERROR_NO_SUCH_USER` or `ERROR_NO_SUCH_GROUP` respectively.
- * If the call to setgid() fails, the function returns `ERROR_SETGID_FAILED`.
- * If the call to setuid() fails, the function returns `ERROR_SETUID_FAILED`.
- * If the context setting is successful, the function returns `ERROR_NONE`.
+ * @return A line of text for the command's stderr, ending in a newline, or an empty string for `ERROR_NONE`
  */
- int set_identity_context( std::string user_name, std::string group_name );
+std::string describe_identity_error( int error, std::string user_name, std::string group_name );
 
 
 #endif //LCPEX_CONTEXTS_H
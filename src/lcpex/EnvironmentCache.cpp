@@ -0,0 +1,369 @@
+#include "EnvironmentCache.h"
+#include "Contexts.h"
+#include "Spawn.h"
+#include "LogWriter.h"
+#include "helpers.h"
+#include "../misc/sha256.h"
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// printed between whatever the environment file prints and the environment itself
+static const char ENVIRONMENT_MARKER[] = "\0rex-environment\0";
+
+// variables the capturing shell sets for itself, which the command's shell sets again
+static const char * const SHELL_OWNED[] = { "_", "SHLVL", "PWD", "OLDPWD" };
+
+
+EnvironmentCache & EnvironmentCache::shared()
+{
+    static EnvironmentCache * cache = new EnvironmentCache();
+    return *cache;
+}
+
+
+EnvironmentCache::EnvironmentCache()
+{
+    this->counters = EnvironmentCacheStats();
+}
+
+
+EnvironmentCacheStats EnvironmentCache::stats()
+{
+    std::lock_guard<std::mutex> guard( this->lock );
+    return this->counters;
+}
+
+
+// the value of a variable in a null-terminated environment, or nullptr if it isn't set
+static const char * find_variable( char * const * environment, const std::string & name )
+{
+    for ( char * const * variable = environment; *variable != nullptr; variable++ )
+    {
+        if ( strncmp( *variable, name.c_str(), name.size() ) == 0 && (*variable)[name.size()] == '=' )
+        {
+            return *variable;
+        }
+    }
+    return nullptr;
+}
+
+
+// run the shell, sourcing the file and printing the environment, and collect everything it writes.  returns whether
+// the file was sourced.
+static bool source_environment(
+        const std::vector<std::string> & arguments,
+        const SpawnRequest & settings,
+        int timeout_seconds,
+        std::string & printed,
+        std::string & errors,
+        std::vector<std::string> & environment
+)
+{
+    int fd_stdout_pipe[2];
+    int fd_stderr_pipe[2];
+    if ( pipe2( fd_stdout_pipe, O_CLOEXEC ) == -1 )
+    {
+        return false;
+    }
+    if ( pipe2( fd_stderr_pipe, O_CLOEXEC ) == -1 )
+    {
+        close( fd_stdout_pipe[READ_END] );
+        close( fd_stdout_pipe[WRITE_END] );
+        return false;
+    }
+
+    std::vector<char *> argv;
+    for ( size_t i = 0; i < arguments.size(); i++ )
+    {
+        argv.push_back( const_cast<char *>( arguments[i].c_str() ) );
+    }
+    argv.push_back( nullptr );
+
+    SpawnRequest request = settings;
+    request.argv = argv.data();
+    request.stdout_fd = fd_stdout_pipe[WRITE_END];
+    request.stderr_fd = fd_stderr_pipe[WRITE_END];
+
+    SPAWN_STAGE failed_stage;
+    int failed_errno;
+    pid_t pid = spawn_process( request, failed_stage, failed_errno );
+    close( fd_stdout_pipe[WRITE_END] );
+    close( fd_stderr_pipe[WRITE_END] );
+
+    // both pipes are drained together, so neither can fill up while the other is waited on
+    std::string output[2];
+    struct pollfd streams[2];
+    streams[0].fd = fd_stdout_pipe[READ_END];
+    streams[1].fd = fd_stderr_pipe[READ_END];
+    streams[0].events = streams[1].events = POLLIN;
+    int open_count = pid == -1 ? 0 : 2;
+    bool timed_out = false;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds( timeout_seconds );
+    char buffer[4096];
+    while ( open_count > 0 )
+    {
+        int wait_milliseconds = -1;
+        if ( timeout_seconds > 0 )
+        {
+            wait_milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>( deadline - std::chrono::steady_clock::now() ).count();
+            if ( wait_milliseconds <= 0 )
+            {
+                // the command will source the file itself, under its timeout, and report that properly.  the shell
+                // leads a group of its own, so whatever the file started goes with it rather than holding the pipes.
+                kill( -pid, SIGKILL );
+                timed_out = true;
+                break;
+            }
+        }
+        int ready_count = poll( streams, 2, wait_milliseconds );
+        if ( ready_count == -1 )
+        {
+            if ( errno == EINTR ) { continue; }
+            break;
+        }
+        for ( int i = 0; i < 2; i++ )
+        {
+            if ( streams[i].fd < 0 || streams[i].revents == 0 )
+            {
+                continue;
+            }
+            ssize_t byte_count = read( streams[i].fd, buffer, sizeof( buffer ) );
+            if ( byte_count > 0 )
+            {
+                output[i].append( buffer, byte_count );
+            } else if ( byte_count == 0 || errno != EINTR ) {
+                // a negative descriptor is skipped by poll()
+                streams[i].fd = -1;
+                open_count--;
+            }
+        }
+    }
+    close( fd_stdout_pipe[READ_END] );
+    close( fd_stderr_pipe[READ_END] );
+
+    int status = 0;
+    if ( pid != -1 )
+    {
+        while ( waitpid( pid, &status, 0 ) == -1 && errno == EINTR ) {}
+    }
+    if ( pid == -1 || timed_out || ! WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+    {
+        return false;
+    }
+
+    std::string marker( ENVIRONMENT_MARKER, sizeof( ENVIRONMENT_MARKER ) - 1 );
+    size_t marker_at = output[0].find( marker );
+    if ( marker_at == std::string::npos )
+    {
+        return false;
+    }
+    printed = output[0].substr( 0, marker_at );
+    errors = output[1];
+
+    environment.clear();
+    size_t start = marker_at + marker.size();
+    while ( start < output[0].size() )
+    {
+        size_t end = output[0].find( '\0', start );
+        if ( end == std::string::npos )
+        {
+            end = output[0].size();
+        }
+        std::string variable = output[0].substr( start, end - start );
+        start = end + 1;
+
+        size_t name_length = variable.find( '=' );
+        if ( name_length == std::string::npos )
+        {
+            continue;
+        }
+        bool owned = false;
+        for ( size_t i = 0; i < sizeof( SHELL_OWNED ) / sizeof( SHELL_OWNED[0] ) && ! owned; i++ )
+        {
+            owned = variable.compare( 0, name_length, SHELL_OWNED[i] ) == 0 && strlen( SHELL_OWNED[i] ) == name_length;
+        }
+        if (! owned )
+        {
+            environment.push_back( variable );
+        }
+    }
+
+    // as the command's shell would have received them, had it sourced the file itself
+    for ( size_t i = 0; i < sizeof( SHELL_OWNED ) / sizeof( SHELL_OWNED[0] ); i++ )
+    {
+        const char * inherited = find_variable( settings.envp, SHELL_OWNED[i] );
+        if ( inherited != nullptr )
+        {
+            environment.push_back( inherited );
+        }
+    }
+    return true;
+}
+
+
+bool EnvironmentCache::capture(
+        const std::string & shell_path,
+        const std::string & shell_execution_arg,
+        const std::string & shell_source_subcommand,
+        const std::string & environment_file_path,
+        bool set_working_directory,
+        const std::string & working_directory,
+        bool context_override,
+        const std::string & context_user,
+        const std::string & context_group,
+        const std::vector<std::string> & environment_variables,
+        int timeout_seconds,
+        int stdout_log_fd,
+        int stderr_log_fd,
+        std::vector<std::string> & environment
+)
+{
+    struct stat file_stat;
+    if ( stat( environment_file_path.c_str(), &file_stat ) == -1 )
+    {
+        return false;
+    }
+
+    std::string key;
+    key.append( shell_path ).push_back( '\0' );
+    key.append( shell_execution_arg ).push_back( '\0' );
+    key.append( shell_source_subcommand ).push_back( '\0' );
+    key.append( environment_file_path ).push_back( '\0' );
+    key.append( set_working_directory ? working_directory : "" ).push_back( '\0' );
+    key.append( context_override ? context_user + ":" + context_group : "" ).push_back( '\0' );
+    for ( size_t i = 0; i < environment_variables.size(); i++ )
+    {
+        key.append( environment_variables[i] ).push_back( '\0' );
+    }
+
+    std::unique_lock<std::mutex> guard( this->lock );
+    Entry * entry;
+    while ( true )
+    {
+        std::unordered_map<std::string, Entry>::iterator found = this->entries.find( key );
+        if ( found == this->entries.end() )
+        {
+            Entry fresh;
+            fresh.loading = false;
+            fresh.valid = false;
+            found = this->entries.emplace( key, fresh ).first;
+        }
+        entry = &found->second;
+        if (! entry->loading )
+        {
+            break;
+        }
+        this->loaded.wait( guard );
+    }
+
+    bool unchanged = entry->valid
+            && entry->device == file_stat.st_dev
+            && entry->inode == file_stat.st_ino
+            && entry->size == file_stat.st_size
+            && entry->modified.tv_sec == file_stat.st_mtim.tv_sec
+            && entry->modified.tv_nsec == file_stat.st_mtim.tv_nsec;
+    if ( unchanged )
+    {
+        this->counters.reused++;
+        environment = entry->environment;
+        return true;
+    }
+
+    // entries are never removed, so this one stays put while the lock is released
+    entry->loading = true;
+    std::string previous_digest = entry->valid ? entry->digest : "";
+    guard.unlock();
+
+    Sha256 hash;
+    bool readable = hash.update_file( environment_file_path );
+    std::string digest = readable ? hash.hex_digest() : "";
+
+    bool sourced = false;
+    std::vector<std::string> captured;
+    std::string printed;
+    std::string errors;
+    bool revalidated = readable && digest == previous_digest;
+    if ( readable && ! revalidated )
+    {
+        uid_t context_uid = 0;
+        gid_t context_gid = 0;
+        std::vector<gid_t> context_groups;
+        bool identity_known = ! context_override
+                || resolve_identity_context( context_user, context_group, context_uid, context_gid, context_groups ) == IDENTITY_CONTEXT_ERRORS::ERROR_NONE;
+
+        if ( identity_known )
+        {
+            // the file runs exactly as it would ahead of the command, with its plain assignments exported
+            std::vector<std::string> arguments;
+            arguments.push_back( shell_path );
+            if ( shell_execution_arg != "" )
+            {
+                arguments.push_back( shell_execution_arg );
+            }
+            arguments.push_back( "set -a && " + shell_source_subcommand + " " + environment_file_path + " && printf '\\000rex-environment\\000' && env -0" );
+
+            std::vector<char *> inherited = child_environment( environment_variables );
+
+            SpawnRequest settings;
+            settings.envp = inherited.data();
+            settings.stdin_fd = -1;
+            settings.new_session = false;
+            settings.controlling_tty_fd = -1;
+            settings.own_process_group = true;
+            settings.cgroup_procs_fd = -1;
+            settings.working_directory = set_working_directory ? working_directory.c_str() : nullptr;
+            settings.set_identity = context_override;
+            settings.uid = context_uid;
+            settings.gid = context_gid;
+            settings.groups = context_groups.data();
+            settings.group_count = context_groups.size();
+
+            sourced = source_environment( arguments, settings, timeout_seconds, printed, errors, captured );
+        }
+    }
+
+    guard.lock();
+    entry->loading = false;
+    if ( revalidated )
+    {
+        // touched, but not changed
+        entry->modified = file_stat.st_mtim;
+        entry->device = file_stat.st_dev;
+        entry->inode = file_stat.st_ino;
+        entry->size = file_stat.st_size;
+        this->counters.reused++;
+        this->counters.revalidated++;
+        environment = entry->environment;
+    } else if ( sourced ) {
+        entry->valid = true;
+        entry->modified = file_stat.st_mtim;
+        entry->device = file_stat.st_dev;
+        entry->inode = file_stat.st_ino;
+        entry->size = file_stat.st_size;
+        entry->digest = digest;
+        entry->environment = captured;
+        this->counters.sourced++;
+        environment = captured;
+    } else {
+        entry->valid = false;
+        this->counters.failed++;
+    }
+    this->loaded.notify_all();
+    guard.unlock();
+
+    // what the file says when sourced is said once, by the command that sourced it
+    if ( sourced )
+    {
+        LogWriter::shared().append( stdout_log_fd, printed.data(), printed.size() );
+        write_all( STDOUT_FILENO, printed.data(), printed.size() );
+        LogWriter::shared().append( stderr_log_fd, errors.data(), errors.size() );
+        write_all( STDERR_FILENO, errors.data(), errors.size() );
+    }
+    return sourced || revalidated;
+}
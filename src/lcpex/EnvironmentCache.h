@@ -0,0 +1,117 @@
+#ifndef LCPEX_ENVIRONMENTCACHE_H
+#define LCPEX_ENVIRONMENTCACHE_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// how the environment cache has been used so far
+struct EnvironmentCacheStats {
+    // environment files sourced, and environments handed out without sourcing
+    unsigned long long sourced;
+    unsigned long long reused;
+    // of those reused, the ones whose file had been touched but not changed
+    unsigned long long revalidated;
+    // captures that failed, so the command sourced the file itself
+    unsigned long long failed;
+};
+
+/**
+ * @brief Sources each environment file once, and hands the environment it produces to every command that asks for it.
+ *
+ * The file is sourced in the command's shell with `set -a`, so that its plain assignments are exported too, and the
+ * result is read back with `env -0`.  Commands are then given that environment directly, instead of every one of them
+ * sourcing the file again.  Only variables carry over: functions, aliases and shell options set by the file do not.
+ *
+ * A captured environment is reused for as long as the file is unchanged: while its size and modification time are the
+ * same, or, when they aren't, while its contents hash the same.  Files the environment file itself sources are not
+ * watched.  The file is sourced with the command's shell, user, group, working directory and added variables, and an
+ * environment is only reused for a command that has the same ones.
+ */
+class EnvironmentCache
+{
+    public:
+        /**
+         * @brief The cache shared by every command.
+         */
+        static EnvironmentCache & shared();
+
+        /**
+         * @brief Get the complete environment a command sees once its shell has sourced an environment file.
+         *
+         * Whatever sourcing the file prints is written to the logs and the console the first time only.  If the file
+         * can't be sourced, nothing is written, so the command can source it itself and report what went wrong.
+         *
+         * @param shell_path The path to the shell executable.
+         * @param shell_execution_arg The argument used to execute a command in the shell.
+         * @param shell_source_subcommand The shell subcommand used to source the environment file.
+         * @param environment_file_path The path to the environment file.
+         * @param set_working_directory Whether the command changes its working directory.
+         * @param working_directory The command's working directory.
+         * @param context_override Whether the command runs as another user and group.
+         * @param context_user The user the command runs as.
+         * @param context_group The group the command runs as.
+         * @param environment_variables NAME=value assignments added to the environment the command inherits.
+         * @param timeout_seconds The time sourcing has to finish, or 0 to wait indefinitely.
+         * @param stdout_log_fd The command's stdout log.
+         * @param stderr_log_fd The command's stderr log.
+         * @param environment Receives the environment, as NAME=value strings.
+         *
+         * @return Whether the environment was captured.
+         */
+        bool capture(
+                const std::string & shell_path,
+                const std::string & shell_execution_arg,
+                const std::string & shell_source_subcommand,
+                const std::string & environment_file_path,
+                bool set_working_directory,
+                const std::string & working_directory,
+                bool context_override,
+                const std::string & context_user,
+                const std::string & context_group,
+                const std::vector<std::string> & environment_variables,
+                int timeout_seconds,
+                int stdout_log_fd,
+                int stderr_log_fd,
+                std::vector<std::string> & environment
+        );
+
+        /**
+         * @brief How the cache has been used so far.
+         */
+        EnvironmentCacheStats stats();
+
+    private:
+        EnvironmentCache();
+
+        // the environment one environment file produced
+        struct Entry {
+            // being sourced by some command, which the others wait for
+            bool loading;
+            // holds an environment
+            bool valid;
+            // the file as it was when sourced
+            dev_t device;
+            ino_t inode;
+            off_t size;
+            struct timespec modified;
+            std::string digest;
+            std::vector<std::string> environment;
+        };
+
+        std::mutex lock;
+
+        // signalled when an entry has finished loading
+        std::condition_variable loaded;
+
+        // keyed by everything that can change what sourcing produces, other than the file's contents
+        std::unordered_map<std::string, Entry> entries;
+
+        EnvironmentCacheStats counters;
+};
+
+#endif //LCPEX_ENVIRONMENTCACHE_H
@@ -0,0 +1,623 @@
+#include "LogCompression.h"
+#include <algorithm>
+#include <cstring>
+
+// the frame's magic number, and the range of magic numbers of skippable frames
+static const uint32_t LZ4_FRAME_MAGIC = 0x184D2204;
+static const uint32_t LZ4_SKIPPABLE_MAGIC = 0x184D2A50;
+static const uint32_t LZ4_SKIPPABLE_MASK = 0xFFFFFFF0;
+
+// the frame descriptor Rex writes: version 1 with independent blocks, and a 64 KiB block maximum
+static const uint8_t LZ4_FLAGS = 0x60;
+static const uint8_t LZ4_BLOCK_DESCRIPTOR = 0x40;
+
+// a block's size field with this bit set holds a block that is stored as it is
+static const uint32_t LZ4_STORED_BLOCK = 0x80000000U;
+
+// the format's rules on matches: at least MINMATCH long, the last one starting at least MFLIMIT from the end of the
+// block, and the last LASTLITERALS bytes always literals
+static const size_t MINMATCH = 4;
+static const size_t MFLIMIT = 12;
+static const size_t LASTLITERALS = 5;
+
+// the size of the history linked blocks may refer to
+static const size_t LZ4_WINDOW = 64 * 1024;
+
+static const uint32_t XXH_PRIME1 = 2654435761U;
+static const uint32_t XXH_PRIME2 = 2246822519U;
+static const uint32_t XXH_PRIME3 = 3266489917U;
+static const uint32_t XXH_PRIME4 = 668265263U;
+static const uint32_t XXH_PRIME5 = 374761393U;
+
+
+static inline uint32_t read32( const uint8_t * p )
+{
+    uint32_t value;
+    memcpy( &value, p, sizeof( value ) );
+    return value;
+}
+
+
+static inline uint32_t read_le32( const uint8_t * p )
+{
+    return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( (uint32_t) p[3] << 24 );
+}
+
+
+static inline void write_le32( uint8_t * p, uint32_t value )
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+
+static inline uint32_t rotate_left( uint32_t value, int bits )
+{
+    return ( value << bits ) | ( value >> ( 32 - bits ) );
+}
+
+
+// xxHash32 with seed 0 of fewer than 16 bytes, which is all a frame descriptor ever is
+static uint32_t short_xxh32( const uint8_t * p, size_t length )
+{
+    uint32_t hash = XXH_PRIME5 + (uint32_t) length;
+    const uint8_t * end = p + length;
+    for ( ; p + 4 <= end; p += 4 )
+    {
+        hash = rotate_left( hash + read_le32( p ) * XXH_PRIME3, 17 ) * XXH_PRIME4;
+    }
+    for ( ; p < end; p++ )
+    {
+        hash = rotate_left( hash + *p * XXH_PRIME5, 11 ) * XXH_PRIME1;
+    }
+    hash ^= hash >> 15;
+    hash *= XXH_PRIME2;
+    hash ^= hash >> 13;
+    hash *= XXH_PRIME3;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+
+// the descriptor's checksum byte, as the format defines it
+static uint8_t descriptor_checksum( const uint8_t * descriptor, size_t length )
+{
+    return ( short_xxh32( descriptor, length ) >> 8 ) & 0xFF;
+}
+
+
+static inline uint32_t hash_position( uint32_t sequence )
+{
+    return ( sequence * XXH_PRIME1 ) >> ( 32 - 13 );
+}
+
+
+// how far two positions agree, up to limit, a word at a time
+static inline size_t common_length( const uint8_t * p, const uint8_t * match, const uint8_t * limit )
+{
+    const uint8_t * start = p;
+    while ( p + 8 <= limit )
+    {
+        uint64_t a, b;
+        memcpy( &a, p, 8 );
+        memcpy( &b, match, 8 );
+        uint64_t difference = a ^ b;
+        if ( difference != 0 )
+        {
+            return p - start + ( __builtin_ctzll( difference ) >> 3 );
+        }
+        p += 8;
+        match += 8;
+    }
+    while ( p < limit && *p == *match )
+    {
+        p++;
+        match++;
+    }
+    return p - start;
+}
+
+
+// a length field's continuation bytes, after the 15 its token holds
+static inline uint8_t * write_length( uint8_t * op, size_t length )
+{
+    for ( ; length >= 255; length -= 255 )
+    {
+        *op++ = 255;
+    }
+    *op++ = (uint8_t) length;
+    return op;
+}
+
+
+// compress a chunk into an LZ4 block.  returns its size, or 0 if it would not fit in capacity.
+static size_t lz4_compress( const uint8_t * source, size_t length, uint8_t * destination, size_t capacity, uint16_t * table )
+{
+    const uint8_t * ip = source;
+    const uint8_t * anchor = source;
+    const uint8_t * end = source + length;
+    uint8_t * op = destination;
+    uint8_t * op_end = destination + capacity;
+
+    if ( length > MFLIMIT )
+    {
+        const uint8_t * match_start_limit = end - MFLIMIT;
+        const uint8_t * match_end_limit = end - LASTLITERALS;
+        memset( table, 0, LZ4_HASH_ENTRIES * sizeof( uint16_t ) );
+        ip++;
+
+        while ( ip <= match_start_limit )
+        {
+            // look for a match, striding further the longer none turns up, so incompressible output goes by quickly
+            const uint8_t * match = nullptr;
+            unsigned misses = 1 << 6;
+            while ( ip <= match_start_limit )
+            {
+                uint32_t sequence = read32( ip );
+                uint32_t slot = hash_position( sequence );
+                const uint8_t * candidate = source + table[slot];
+                table[slot] = (uint16_t) ( ip - source );
+                if ( candidate < ip && read32( candidate ) == sequence )
+                {
+                    match = candidate;
+                    break;
+                }
+                ip += misses++ >> 6;
+            }
+            if ( match == nullptr )
+            {
+                break;
+            }
+
+            while ( ip > anchor && match > source && ip[-1] == match[-1] )
+            {
+                ip--;
+                match--;
+            }
+
+            size_t literals = ip - anchor;
+            size_t match_length = common_length( ip + MINMATCH, match + MINMATCH, match_end_limit );
+            // token, literal length, literals, offset and match length, with room for the last literals' token
+            if ( op + 1 + literals / 255 + 1 + literals + 2 + match_length / 255 + 1 + 1 > op_end )
+            {
+                return 0;
+            }
+
+            uint8_t * token = op++;
+            if ( literals >= 15 )
+            {
+                *token = 15 << 4;
+                op = write_length( op, literals - 15 );
+            } else {
+                *token = (uint8_t) ( literals << 4 );
+            }
+            memcpy( op, anchor, literals );
+            op += literals;
+
+            uint16_t offset = (uint16_t) ( ip - match );
+            *op++ = (uint8_t) offset;
+            *op++ = (uint8_t) ( offset >> 8 );
+
+            if ( match_length >= 15 )
+            {
+                *token |= 15;
+                op = write_length( op, match_length - 15 );
+            } else {
+                *token |= (uint8_t) match_length;
+            }
+
+            ip += MINMATCH + match_length;
+            anchor = ip;
+            if ( ip <= match_start_limit )
+            {
+                table[ hash_position( read32( ip - 2 ) ) ] = (uint16_t) ( ip - 2 - source );
+            }
+        }
+    }
+
+    size_t literals = end - anchor;
+    if ( op + 1 + literals / 255 + 1 + literals > op_end )
+    {
+        return 0;
+    }
+    uint8_t * token = op++;
+    if ( literals >= 15 )
+    {
+        *token = 15 << 4;
+        op = write_length( op, literals - 15 );
+    } else {
+        *token = (uint8_t) ( literals << 4 );
+    }
+    memcpy( op, anchor, literals );
+    op += literals;
+    return op - destination;
+}
+
+
+size_t lz4_frame_block_bound( size_t length )
+{
+    // a block that wouldn't shrink is stored as it is
+    return 4 + length;
+}
+
+
+size_t lz4_frame_header( char * destination )
+{
+    uint8_t * out = (uint8_t *) destination;
+    write_le32( out, LZ4_FRAME_MAGIC );
+    out[4] = LZ4_FLAGS;
+    out[5] = LZ4_BLOCK_DESCRIPTOR;
+    out[6] = descriptor_checksum( out + 4, 2 );
+    return LZ4_FRAME_HEADER_SIZE;
+}
+
+
+size_t lz4_frame_block( const char * source, size_t length, char * destination, uint16_t * table )
+{
+    uint8_t * out = (uint8_t *) destination;
+    // only worth keeping if it is smaller than the chunk
+    size_t compressed = length > 0 ? lz4_compress( (const uint8_t *) source, length, out + 4, length - 1, table ) : 0;
+    if ( compressed == 0 )
+    {
+        write_le32( out, (uint32_t) length | LZ4_STORED_BLOCK );
+        memcpy( out + 4, source, length );
+        return 4 + length;
+    }
+    write_le32( out, (uint32_t) compressed );
+    return 4 + compressed;
+}
+
+
+size_t lz4_frame_end( char * destination )
+{
+    write_le32( (uint8_t *) destination, 0 );
+    return LZ4_FRAME_END_SIZE;
+}
+
+
+std::string lz4_frame( const char * source, size_t length )
+{
+    std::vector<uint16_t> table( LZ4_HASH_ENTRIES );
+    std::string frame( LZ4_FRAME_HEADER_SIZE + ( length / LZ4_BLOCK_SIZE + 1 ) * lz4_frame_block_bound( LZ4_BLOCK_SIZE ) + LZ4_FRAME_END_SIZE, '\0' );
+    size_t at = lz4_frame_header( &frame[0] );
+    for ( size_t offset = 0; offset < length; offset += LZ4_BLOCK_SIZE )
+    {
+        size_t piece = length - offset < LZ4_BLOCK_SIZE ? length - offset : LZ4_BLOCK_SIZE;
+        at += lz4_frame_block( source + offset, piece, &frame[at], table.data() );
+    }
+    at += lz4_frame_end( &frame[at] );
+    frame.resize( at );
+    return frame;
+}
+
+
+// decode an LZ4 block to out, which may refer back as far as history.  returns the bytes produced, or -1 if corrupt.
+static long lz4_decompress( const uint8_t * ip, size_t length, const uint8_t * history, uint8_t * out, size_t capacity )
+{
+    const uint8_t * end = ip + length;
+    uint8_t * op = out;
+    uint8_t * op_end = out + capacity;
+
+    while ( ip < end )
+    {
+        uint8_t token = *ip++;
+
+        size_t literals = token >> 4;
+        if ( literals == 15 )
+        {
+            uint8_t more;
+            do {
+                if ( ip >= end ) { return -1; }
+                more = *ip++;
+                literals += more;
+            } while ( more == 255 );
+        }
+        if ( literals > (size_t) ( end - ip ) || literals > (size_t) ( op_end - op ) )
+        {
+            return -1;
+        }
+        memcpy( op, ip, literals );
+        ip += literals;
+        op += literals;
+
+        // the last sequence is literals only
+        if ( ip == end )
+        {
+            break;
+        }
+
+        if ( end - ip < 2 ) { return -1; }
+        size_t offset = ip[0] | ( ip[1] << 8 );
+        ip += 2;
+        if ( offset == 0 || offset > (size_t) ( op - history ) )
+        {
+            return -1;
+        }
+
+        size_t match_length = token & 15;
+        if ( match_length == 15 )
+        {
+            uint8_t more;
+            do {
+                if ( ip >= end ) { return -1; }
+                more = *ip++;
+                match_length += more;
+            } while ( more == 255 );
+        }
+        match_length += MINMATCH;
+        if ( match_length > (size_t) ( op_end - op ) )
+        {
+            return -1;
+        }
+
+        const uint8_t * match = op - offset;
+        if ( offset >= match_length )
+        {
+            memcpy( op, match, match_length );
+            op += match_length;
+        } else {
+            // the match overlaps what it produces, repeating it
+            for ( size_t i = 0; i < match_length; i++ )
+            {
+                *op++ = *match++;
+            }
+        }
+    }
+    return op - out;
+}
+
+
+Lz4FrameDecoder::Lz4FrameDecoder():
+    state( MAGIC ),
+    needed( 4 ),
+    linked_blocks( false ),
+    block_checksums( false ),
+    content_checksum( false ),
+    block_maximum( 0 ),
+    block_stored( false ),
+    any_frame( false ),
+    window_length( 0 )
+{}
+
+
+bool Lz4FrameDecoder::fail( const std::string & reason )
+{
+    this->state = FAILED;
+    this->failure = reason;
+    return false;
+}
+
+
+bool Lz4FrameDecoder::finish( std::string & output )
+{
+    if ( this->state == MAGIC && !this->any_frame )
+    {
+        output.append( this->pending );
+        this->pending.clear();
+        this->state = PLAIN;
+    }
+    return ( this->state == MAGIC && this->pending.empty() ) || this->state == PLAIN;
+}
+
+
+const std::string & Lz4FrameDecoder::error() const
+{
+    return this->failure;
+}
+
+
+bool Lz4FrameDecoder::decode_block( std::string & output )
+{
+    size_t length = this->pending.size();
+    if (! this->linked_blocks )
+    {
+        this->window_length = 0;
+    }
+    if ( this->window.size() < LZ4_WINDOW + this->block_maximum )
+    {
+        this->window.resize( LZ4_WINDOW + this->block_maximum );
+    }
+
+    uint8_t * history = (uint8_t *) this->window.data();
+    uint8_t * out = history + this->window_length;
+    long produced;
+    if ( this->block_stored )
+    {
+        memcpy( out, this->pending.data(), length );
+        produced = length;
+    } else {
+        produced = lz4_decompress( (const uint8_t *) this->pending.data(), length, history, out, this->block_maximum );
+        if ( produced < 0 )
+        {
+            return this->fail( "corrupt LZ4 block" );
+        }
+    }
+    output.append( (const char *) out, produced );
+
+    // keep the last 64 KiB at the front for the next block to refer to
+    this->window_length += produced;
+    if ( this->linked_blocks && this->window_length > LZ4_WINDOW )
+    {
+        memmove( history, history + this->window_length - LZ4_WINDOW, LZ4_WINDOW );
+        this->window_length = LZ4_WINDOW;
+    }
+    return true;
+}
+
+
+bool Lz4FrameDecoder::feed( const char * data, size_t length, std::string & output )
+{
+    while ( length > 0 )
+    {
+        if ( this->state == FAILED )
+        {
+            return false;
+        }
+        if ( this->state == PLAIN )
+        {
+            output.append( data, length );
+            return true;
+        }
+        if ( this->state == SKIPPING )
+        {
+            // a skippable frame's contents are passed over, not gathered
+            size_t skipped = std::min( this->needed, length );
+            data += skipped;
+            length -= skipped;
+            this->needed -= skipped;
+            if ( this->needed == 0 )
+            {
+                this->state = MAGIC;
+                this->needed = 4;
+            }
+            continue;
+        }
+
+        // gather what the current step needs
+        size_t wanted = this->needed - std::min( this->needed, this->pending.size() );
+        size_t taken = std::min( wanted, length );
+        this->pending.append( data, taken );
+        data += taken;
+        length -= taken;
+        if ( this->pending.size() < this->needed )
+        {
+            return true;
+        }
+
+        const uint8_t * step = (const uint8_t *) this->pending.data();
+        switch ( this->state )
+        {
+            case MAGIC:
+            {
+                uint32_t magic = read_le32( step );
+                if ( magic == LZ4_FRAME_MAGIC )
+                {
+                    // the flags and block descriptor come first, and say how long the rest of the descriptor is
+                    this->state = DESCRIPTOR;
+                    this->needed = 2;
+                } else if ( ( magic & LZ4_SKIPPABLE_MASK ) == LZ4_SKIPPABLE_MAGIC ) {
+                    this->state = SKIPPED;
+                    this->needed = 4;
+                } else if (! this->any_frame ) {
+                    // not compressed at all
+                    this->state = PLAIN;
+                    output.append( this->pending );
+                    this->pending.clear();
+                    continue;
+                } else {
+                    return this->fail( "not an LZ4 frame" );
+                }
+                this->any_frame = true;
+                this->pending.clear();
+                break;
+            }
+
+            case DESCRIPTOR:
+            {
+                uint8_t flags = step[0];
+                uint8_t block_descriptor = step[1];
+                if ( ( flags >> 6 ) != 1 || ( flags & 0x02 ) != 0 || ( block_descriptor & 0x8F ) != 0 )
+                {
+                    return this->fail( "unsupported LZ4 frame version or flags" );
+                }
+                if ( flags & 0x01 )
+                {
+                    return this->fail( "LZ4 frames with a dictionary are not supported" );
+                }
+                int block_size_id = ( block_descriptor >> 4 ) & 0x07;
+                if ( block_size_id < 4 )
+                {
+                    return this->fail( "invalid LZ4 block maximum size" );
+                }
+                this->linked_blocks = ( flags & 0x20 ) == 0;
+                this->block_checksums = ( flags & 0x10 ) != 0;
+                this->content_checksum = ( flags & 0x04 ) != 0;
+                this->block_maximum = (size_t) 1 << ( 8 + 2 * block_size_id );
+                this->window_length = 0;
+                // the content size, if present, then the checksum of everything from the flags on, which stay in
+                // pending for it
+                this->state = DESCRIPTOR_REST;
+                this->needed = 2 + ( ( flags & 0x08 ) ? 8 : 0 ) + 1;
+                break;
+            }
+
+            case DESCRIPTOR_REST:
+            {
+                if ( descriptor_checksum( step, this->needed - 1 ) != step[ this->needed - 1 ] )
+                {
+                    return this->fail( "LZ4 frame descriptor checksum mismatch" );
+                }
+                this->pending.clear();
+                this->state = BLOCK_SIZE;
+                this->needed = 4;
+                break;
+            }
+
+            case BLOCK_SIZE:
+            {
+                uint32_t size = read_le32( step );
+                this->pending.clear();
+                if ( size == 0 )
+                {
+                    this->state = this->content_checksum ? CONTENT_CHECKSUM : MAGIC;
+                    this->needed = 4;
+                    break;
+                }
+                this->block_stored = ( size & LZ4_STORED_BLOCK ) != 0;
+                size &= ~LZ4_STORED_BLOCK;
+                if ( size > this->block_maximum )
+                {
+                    return this->fail( "LZ4 block larger than its frame allows" );
+                }
+                this->state = BLOCK;
+                this->needed = size;
+                break;
+            }
+
+            case BLOCK:
+            {
+                if (! this->decode_block( output ) )
+                {
+                    return false;
+                }
+                this->pending.clear();
+                this->state = this->block_checksums ? BLOCK_CHECKSUM : BLOCK_SIZE;
+                this->needed = 4;
+                break;
+            }
+
+            case BLOCK_CHECKSUM:
+                this->pending.clear();
+                this->state = BLOCK_SIZE;
+                this->needed = 4;
+                break;
+
+            case CONTENT_CHECKSUM:
+                this->pending.clear();
+                this->state = MAGIC;
+                this->needed = 4;
+                break;
+
+            case SKIPPED:
+            {
+                // the skippable frame's size, then that many bytes to skip, a piece at a time
+                uint32_t size = read_le32( step );
+                this->pending.clear();
+                this->state = SKIPPING;
+                this->needed = size;
+                if ( size == 0 )
+                {
+                    this->state = MAGIC;
+                    this->needed = 4;
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+    return this->state != FAILED;
+}
@@ -0,0 +1,142 @@
+#ifndef LCPEX_LOGCOMPRESSION_H
+#define LCPEX_LOGCOMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Logs are compressed in the LZ4 frame format, so that `lz4 -d` can read them as well as `rex logs cat`.  Rex writes
+// frames of independent blocks of at most 64 KiB, the most a child's output is read in one go, without checksums: a
+// frame is a header, a block for each chunk of output, and an end mark.  A log holds one frame for every time it was
+// written to, one after another, which the format allows.  The compressor is a greedy single-pass LZ4 encoder with no
+// state between blocks.
+
+// the largest block Rex writes
+static const size_t LZ4_BLOCK_SIZE = 64 * 1024;
+
+// the frame header Rex writes, and the mark that ends a frame
+static const size_t LZ4_FRAME_HEADER_SIZE = 7;
+static const size_t LZ4_FRAME_END_SIZE = 4;
+
+// the suffix of a compressed log's name
+static const char * const LZ4_LOG_SUFFIX = ".lz4";
+
+// the entries of the table lz4_frame_block() is given
+static const size_t LZ4_HASH_ENTRIES = 1 << 13;
+
+/**
+ * @brief The most an LZ4 block of a chunk can take in a frame, including its size field.
+ *
+ * @param length The chunk's size, at most LZ4_BLOCK_SIZE.
+ */
+size_t lz4_frame_block_bound( size_t length );
+
+/**
+ * @brief Write the header of a frame of independent blocks of at most LZ4_BLOCK_SIZE.
+ *
+ * @param destination Room for LZ4_FRAME_HEADER_SIZE bytes.
+ *
+ * @return LZ4_FRAME_HEADER_SIZE.
+ */
+size_t lz4_frame_header( char * destination );
+
+/**
+ * @brief Compress a chunk into a block of a frame, stored as it is if it doesn't compress.
+ *
+ * @param source The chunk, at most LZ4_BLOCK_SIZE.
+ * @param length The chunk's size.
+ * @param destination Room for lz4_frame_block_bound( length ) bytes.
+ * @param table A scratch table of LZ4_HASH_ENTRIES entries, which need not be initialised.
+ *
+ * @return The bytes written to destination.
+ */
+size_t lz4_frame_block( const char * source, size_t length, char * destination, uint16_t * table );
+
+/**
+ * @brief Write the mark that ends a frame.
+ *
+ * @param destination Room for LZ4_FRAME_END_SIZE bytes.
+ *
+ * @return LZ4_FRAME_END_SIZE.
+ */
+size_t lz4_frame_end( char * destination );
+
+/**
+ * @brief A whole frame holding some data, for output that doesn't pass through the log writer.
+ *
+ * @param source The data.
+ * @param length Its size, of any length.
+ *
+ * @return The frame.
+ */
+std::string lz4_frame( const char * source, size_t length );
+
+/**
+ * @brief Reads LZ4 frames back, a piece at a time.
+ *
+ * Takes any frames the format allows, not only Rex's own: linked blocks, blocks of up to 4 MiB, content sizes, and
+ * skippable frames.  Checksums are skipped over rather than verified.  Data that doesn't start with a frame is passed
+ * through as it is, so that uncompressed logs read the same way.
+ */
+class Lz4FrameDecoder
+{
+    public:
+        Lz4FrameDecoder();
+
+        /**
+         * @brief Take in the next piece of the input.
+         *
+         * @param data The piece.
+         * @param length Its size.
+         * @param output Receives what it decodes to, appended.
+         *
+         * @return False if the input is corrupt, which error() describes.  Nothing more is decoded after that.
+         */
+        bool feed( const char * data, size_t length, std::string & output );
+
+        /**
+         * @brief Say the input has ended.
+         *
+         * @param output Receives anything still held back, if the input was too short to tell it was plain.
+         *
+         * @return Whether it ended where it may: between frames, or anywhere in plain data.
+         */
+        bool finish( std::string & output );
+
+        /**
+         * @brief Why the input could not be decoded.
+         */
+        const std::string & error() const;
+
+    private:
+        // what is expected next
+        enum STATE { MAGIC, PLAIN, DESCRIPTOR, DESCRIPTOR_REST, BLOCK_SIZE, BLOCK, BLOCK_CHECKSUM, CONTENT_CHECKSUM, SKIPPED, SKIPPING, FAILED };
+
+        // fail, with a reason
+        bool fail( const std::string & reason );
+
+        // decode a block held in pending, after the history kept for linked blocks
+        bool decode_block( std::string & output );
+
+        STATE state;
+        // the input gathered for the current step
+        std::string pending;
+        // how much input the current step needs
+        size_t needed;
+        // the current frame's flags
+        bool linked_blocks;
+        bool block_checksums;
+        bool content_checksum;
+        size_t block_maximum;
+        // whether the block being read is stored rather than compressed
+        bool block_stored;
+        // whether anything has been decoded, after which plain data can't start
+        bool any_frame;
+        // what linked blocks may refer back to: the last 64 KiB decoded, followed by room for a block
+        std::vector<char> window;
+        size_t window_length;
+        std::string failure;
+};
+
+#endif //LCPEX_LOGCOMPRESSION_H
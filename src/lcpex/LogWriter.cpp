@@ -0,0 +1,411 @@
+#include "LogWriter.h"
+#include "LogCompression.h"
+#include "helpers.h"
+#include <algorithm>
+#include <cerrno>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+// the size of each buffer in the ring, the most a child's output is read in one go
+static const size_t SLOT_SIZE = 64 * 1024;
+
+// buffers in the ring, all allocated up front
+static const int SLOT_COUNT = 256;
+
+// the first and the largest amount a log is preallocated ahead of what has been written
+static const off_t FIRST_ALLOCATION = 1024 * 1024;
+static const off_t LARGEST_ALLOCATION = 64 * 1024 * 1024;
+
+// the buffer a batch for a compressed log is compressed into, written out whenever it fills
+static const size_t COMPRESSED_BUFFER_SIZE = 1024 * 1024;
+
+
+LogWriter & LogWriter::shared()
+{
+    // never destroyed, for the same reason as the timeout wheel: the thread only exists in this process
+    static LogWriter * writer = new LogWriter();
+    return *writer;
+}
+
+
+LogWriter::LogWriter():
+    started( false ),
+    storage( new char[ SLOT_SIZE * SLOT_COUNT ] ),
+    slots( SLOT_COUNT ),
+    head( 0 ),
+    used( 0 ),
+    next_handle( 1 ),
+    fsync_policy( LOG_FSYNC_NONE ),
+    fsync_interval( 5 )
+{
+    this->counters = LogWriterStats();
+    this->counters.ring_slots = SLOT_COUNT;
+}
+
+
+void LogWriter::set_fsync_policy( LOG_FSYNC_POLICY policy, int interval_seconds )
+{
+    std::lock_guard<std::mutex> guard( this->lock );
+    this->fsync_policy = policy;
+    this->fsync_interval = std::chrono::seconds( std::max( interval_seconds, 1 ) );
+    this->next_fsync = std::chrono::steady_clock::now() + this->fsync_interval;
+    this->queued.notify_all();
+}
+
+
+void LogWriter::set_compressed( int fd, bool compressed )
+{
+    std::lock_guard<std::mutex> guard( this->lock );
+    if ( compressed )
+    {
+        this->compressed_fds.insert( fd );
+    } else {
+        this->compressed_fds.erase( fd );
+    }
+}
+
+
+bool LogWriter::append( int fd, const char * data, size_t length )
+{
+    if ( length == 0 )
+    {
+        return true;
+    }
+    std::unique_lock<std::mutex> guard( this->lock );
+    bool compressed = this->compressed_fds.count( fd ) > 0;
+    guard.unlock();
+
+    if (! compressed )
+    {
+        return write_all( fd, data, length ) == 0;
+    }
+    std::string frame = lz4_frame( data, length );
+    guard.lock();
+    this->counters.compressed_input_bytes += length;
+    this->counters.compressed_output_bytes += frame.size();
+    guard.unlock();
+    return write_all( fd, frame.data(), frame.size() ) == 0;
+}
+
+
+int LogWriter::attach( int fd )
+{
+    std::lock_guard<std::mutex> guard( this->lock );
+
+    // started on first use
+    if (! this->started )
+    {
+        std::thread( &LogWriter::run, this ).detach();
+        this->started = true;
+    }
+
+    Log log;
+    log.fd = fd;
+    log.offset = lseek( fd, 0, SEEK_CUR );
+    log.allocated = log.offset;
+    log.allocate_step = log.offset == -1 ? 0 : FIRST_ALLOCATION;
+    log.pending = 0;
+    log.syncing = false;
+    log.dirty = false;
+    log.compressed = this->compressed_fds.count( fd ) > 0;
+    log.frame_open = false;
+
+    int handle = this->next_handle++;
+    this->logs[handle] = log;
+    return handle;
+}
+
+
+void LogWriter::release( int handle )
+{
+    std::unique_lock<std::mutex> guard( this->lock );
+    std::unordered_map<int, Log>::iterator found = this->logs.find( handle );
+    this->written.wait( guard, [&found] { return found->second.pending == 0 && ! found->second.syncing; } );
+    Log log = found->second;
+    this->logs.erase( found );
+    bool sync = this->fsync_policy == LOG_FSYNC_TASK && log.dirty;
+    if ( sync )
+    {
+        this->counters.fsync_calls++;
+    }
+    if ( log.frame_open )
+    {
+        this->counters.compressed_output_bytes += LZ4_FRAME_END_SIZE;
+    }
+    guard.unlock();
+
+    // end the frame the output was written in, with nothing left queued to come after it
+    if ( log.frame_open )
+    {
+        char end[LZ4_FRAME_END_SIZE];
+        write_all( log.fd, end, lz4_frame_end( end ) );
+    }
+
+    // give back what was preallocated past the end.  truncating to the current size frees it without changing the file.
+    if ( log.allocated > log.offset )
+    {
+        struct stat log_stat;
+        if ( fstat( log.fd, &log_stat ) == 0 )
+        {
+            int ignored = ftruncate( log.fd, log_stat.st_size );
+            (void) ignored;
+        }
+    }
+    if ( sync )
+    {
+        fdatasync( log.fd );
+    }
+}
+
+
+char * LogWriter::reserve( size_t & capacity )
+{
+    std::unique_lock<std::mutex> guard( this->lock );
+    if ( this->used == SLOT_COUNT )
+    {
+        // the writer has fallen behind, so the children wait for it rather than memory growing
+        std::chrono::steady_clock::time_point waited_from = std::chrono::steady_clock::now();
+        this->written.wait( guard, [this] { return this->used < SLOT_COUNT; } );
+        this->counters.ring_full_waits++;
+        this->counters.ring_full_microseconds += std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - waited_from ).count();
+    }
+    capacity = SLOT_SIZE;
+    return this->storage.get() + ( ( this->head + this->used ) % SLOT_COUNT ) * SLOT_SIZE;
+}
+
+
+void LogWriter::commit( int handle, size_t length )
+{
+    std::lock_guard<std::mutex> guard( this->lock );
+    if ( length == 0 )
+    {
+        return;
+    }
+
+    Slot & slot = this->slots[ ( this->head + this->used ) % SLOT_COUNT ];
+    slot.handle = handle;
+    slot.length = length;
+    this->used++;
+    this->logs[handle].pending++;
+
+    this->counters.chunks++;
+    this->counters.bytes += length;
+    this->counters.peak_slots_used = std::max( this->counters.peak_slots_used, this->used );
+    this->queued.notify_all();
+}
+
+
+LogWriterStats LogWriter::stats()
+{
+    std::lock_guard<std::mutex> guard( this->lock );
+    return this->counters;
+}
+
+
+void LogWriter::preallocate( Log & log, off_t upcoming )
+{
+    if ( log.allocate_step == 0 || log.offset + upcoming <= log.allocated )
+    {
+        return;
+    }
+    off_t length = std::max( log.allocate_step, upcoming );
+    if ( fallocate( log.fd, FALLOC_FL_KEEP_SIZE, log.offset, length ) == 0 )
+    {
+        log.allocated = log.offset + length;
+        log.allocate_step = std::min( log.allocate_step * 2, LARGEST_ALLOCATION );
+    } else {
+        // not supported by this filesystem; don't ask again
+        log.allocate_step = 0;
+    }
+}
+
+
+unsigned long long LogWriter::write_chunks( Log & log, struct iovec * chunks, int count )
+{
+    unsigned long long writev_calls = 0;
+    while ( count > 0 )
+    {
+        ssize_t written = writev( log.fd, chunks, count );
+        writev_calls++;
+        if ( written == -1 )
+        {
+            if ( errno == EINTR ) { continue; }
+            // the disk is full or gone.  like write_all(), give up on this output rather than hold up the child.
+            break;
+        }
+        log.offset += written;
+        while ( count > 0 && (size_t) written >= chunks->iov_len )
+        {
+            written -= chunks->iov_len;
+            chunks++;
+            count--;
+        }
+        if ( count > 0 )
+        {
+            chunks->iov_base = (char *) chunks->iov_base + written;
+            chunks->iov_len -= written;
+        }
+    }
+    return writev_calls;
+}
+
+
+void LogWriter::run()
+{
+    // what one pass writes to one log
+    struct Batch {
+        int handle;
+        Log log;
+        std::vector<struct iovec> chunks;
+        off_t length;
+        int slot_count;
+    };
+    std::vector<Batch> batches;
+    std::vector<int> dirty_fds;
+    std::vector<int> dirty_handles;
+
+    // only this thread compresses, so it keeps the buffers for it
+    std::unique_ptr<char[]> compressed( new char[ COMPRESSED_BUFFER_SIZE ] );
+    std::vector<uint16_t> compress_table( LZ4_HASH_ENTRIES );
+
+    std::unique_lock<std::mutex> guard( this->lock );
+    while ( true )
+    {
+        // checked between batches as well as when idle, as output that never lets up keeps the ring from emptying
+        bool interval = this->fsync_policy == LOG_FSYNC_INTERVAL;
+        if ( interval && std::chrono::steady_clock::now() >= this->next_fsync )
+        {
+            // force out every log written to since the last interval.  released logs wait for this.
+            dirty_fds.clear();
+            dirty_handles.clear();
+            for ( std::unordered_map<int, Log>::iterator log = this->logs.begin(); log != this->logs.end(); log++ )
+            {
+                if ( log->second.dirty )
+                {
+                    log->second.dirty = false;
+                    log->second.syncing = true;
+                    dirty_fds.push_back( log->second.fd );
+                    dirty_handles.push_back( log->first );
+                }
+            }
+            this->next_fsync = std::chrono::steady_clock::now() + this->fsync_interval;
+            guard.unlock();
+            for ( size_t i = 0; i < dirty_fds.size(); i++ )
+            {
+                fdatasync( dirty_fds[i] );
+            }
+            guard.lock();
+            for ( size_t i = 0; i < dirty_handles.size(); i++ )
+            {
+                this->logs[ dirty_handles[i] ].syncing = false;
+            }
+            this->counters.fsync_calls += dirty_fds.size();
+            this->written.notify_all();
+            continue;
+        }
+        if ( this->used == 0 )
+        {
+            if ( interval )
+            {
+                this->queued.wait_until( guard, this->next_fsync );
+            } else {
+                this->queued.wait( guard );
+            }
+            continue;
+        }
+
+        // everything queued so far, gathered per log in the order it was queued
+        int taken = this->used;
+        batches.clear();
+        for ( int i = 0; i < taken; i++ )
+        {
+            int index = ( this->head + i ) % SLOT_COUNT;
+            Slot & slot = this->slots[index];
+            size_t b = 0;
+            while ( b < batches.size() && batches[b].handle != slot.handle )
+            {
+                b++;
+            }
+            if ( b == batches.size() )
+            {
+                Batch batch;
+                batch.handle = slot.handle;
+                batch.log = this->logs[slot.handle];
+                batch.length = 0;
+                batch.slot_count = 0;
+                batches.push_back( batch );
+            }
+            struct iovec chunk;
+            chunk.iov_base = this->storage.get() + index * SLOT_SIZE;
+            chunk.iov_len = slot.length;
+            batches[b].chunks.push_back( chunk );
+            batches[b].length += slot.length;
+            batches[b].slot_count++;
+        }
+        guard.unlock();
+
+        // the queued slots are only ever touched here until they are given back below
+        unsigned long long writev_calls = 0;
+        unsigned long long compressed_input = 0;
+        unsigned long long compressed_output = 0;
+        for ( size_t b = 0; b < batches.size(); b++ )
+        {
+            Batch & batch = batches[b];
+            if (! batch.log.compressed )
+            {
+                this->preallocate( batch.log, batch.length );
+                writev_calls += this->write_chunks( batch.log, batch.chunks.data(), batch.chunks.size() );
+                continue;
+            }
+
+            // a block for each chunk, written out a buffer at a time
+            size_t filled = 0;
+            for ( size_t c = 0; c <= batch.chunks.size(); c++ )
+            {
+                bool last = c == batch.chunks.size();
+                if ( filled > 0 && ( last || filled + LZ4_FRAME_HEADER_SIZE + lz4_frame_block_bound( batch.chunks[c].iov_len ) > COMPRESSED_BUFFER_SIZE ) )
+                {
+                    struct iovec out;
+                    out.iov_base = compressed.get();
+                    out.iov_len = filled;
+                    this->preallocate( batch.log, filled );
+                    writev_calls += this->write_chunks( batch.log, &out, 1 );
+                    compressed_output += filled;
+                    filled = 0;
+                }
+                if ( last )
+                {
+                    break;
+                }
+                if (! batch.log.frame_open )
+                {
+                    filled += lz4_frame_header( compressed.get() + filled );
+                    batch.log.frame_open = true;
+                }
+                filled += lz4_frame_block( (const char *) batch.chunks[c].iov_base, batch.chunks[c].iov_len, compressed.get() + filled, compress_table.data() );
+            }
+            compressed_input += batch.length;
+        }
+
+        guard.lock();
+        for ( size_t b = 0; b < batches.size(); b++ )
+        {
+            Log & log = this->logs[ batches[b].handle ];
+            log.offset = batches[b].log.offset;
+            log.allocated = batches[b].log.allocated;
+            log.allocate_step = batches[b].log.allocate_step;
+            log.frame_open = batches[b].log.frame_open;
+            log.pending -= batches[b].slot_count;
+            log.dirty = true;
+        }
+        this->head = ( this->head + taken ) % SLOT_COUNT;
+        this->used -= taken;
+        this->counters.writev_calls += writev_calls;
+        this->counters.compressed_input_bytes += compressed_input;
+        this->counters.compressed_output_bytes += compressed_output;
+        this->written.notify_all();
+    }
+}
@@ -0,0 +1,203 @@
+#ifndef LCPEX_LOGWRITER_H
+#define LCPEX_LOGWRITER_H
+
+#include <sys/types.h>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// when the log writer forces what it has written out to disk
+enum LOG_FSYNC_POLICY {
+    // never: the kernel writes logs back in its own time
+    LOG_FSYNC_NONE = 0,
+    // once a command's output has ended, before its Task moves on
+    LOG_FSYNC_TASK,
+    // every interval, for every log written to since the last time
+    LOG_FSYNC_INTERVAL
+};
+
+// what the log writer has done so far
+struct LogWriterStats {
+    // chunks and bytes handed to the writer
+    unsigned long long chunks;
+    unsigned long long bytes;
+    // writev() and fdatasync() calls made for them
+    unsigned long long writev_calls;
+    unsigned long long fsync_calls;
+    // how often a chunk had to wait for a free buffer, and for how long in total
+    unsigned long long ring_full_waits;
+    unsigned long long ring_full_microseconds;
+    // the most buffers in use at once, out of ring_slots
+    int peak_slots_used;
+    int ring_slots;
+    // bytes handed to compressed logs, and what they were written as
+    unsigned long long compressed_input_bytes;
+    unsigned long long compressed_output_bytes;
+};
+
+/**
+ * @brief Writes child output to log files on its own thread, so a slow disk doesn't hold up draining the children.
+ *
+ * Output is queued in a bounded ring of buffers, all allocated up front.  The writer thread takes whatever has queued
+ * up, and writes each log's share with a single writev().  A log is preallocated with fallocate() a growing amount
+ * ahead of what has been written, which keeps it contiguous, and trimmed back when it is released.
+ *
+ * When the ring is full, whoever is queueing waits for the writer to free a buffer: memory stays bounded, and the
+ * children are held up just as they would be by writing synchronously.  How often and how long that happens is counted.
+ *
+ * Logs marked as compressed are written as LZ4 frames, compressed on the writer thread: each attach() starts a frame,
+ * each chunk becomes a block of it, and release() ends it.
+ */
+class LogWriter
+{
+    public:
+        /**
+         * @brief The writer shared by every log.
+         */
+        static LogWriter & shared();
+
+        /**
+         * @brief Choose when logs are forced out to disk.
+         *
+         * @param policy The policy.
+         * @param interval_seconds The time between flushes under LOG_FSYNC_INTERVAL.
+         */
+        void set_fsync_policy( LOG_FSYNC_POLICY policy, int interval_seconds );
+
+        /**
+         * @brief Mark a log file as compressed or not, before it is attached or appended to.
+         *
+         * @param fd The log file.
+         * @param compressed Whether what is written to it is compressed.  Unmark it before closing it.
+         */
+        void set_compressed( int fd, bool compressed );
+
+        /**
+         * @brief Write to a log directly, rather than through the ring, as a frame of its own if it is compressed.
+         *
+         * For output that isn't captured from a child.  Not to be used on a log while it is attached.
+         *
+         * @param fd The log file.
+         * @param data What to write.
+         * @param length Its size.
+         *
+         * @return True if all of it was written.
+         */
+        bool append( int fd, const char * data, size_t length );
+
+        /**
+         * @brief Start writing to a log.
+         *
+         * @param fd The log file, positioned where output is to go, and not in append mode.
+         *
+         * @return A handle for reserve() and release().
+         */
+        int attach( int fd );
+
+        /**
+         * @brief Wait until everything queued for a log has been written, and stop writing to it.
+         *
+         * Forces the log out to disk first under LOG_FSYNC_TASK.  The descriptor may be written to directly, or closed,
+         * once this returns.
+         *
+         * @param handle The handle returned by attach().
+         */
+        void release( int handle );
+
+        /**
+         * @brief Reserve the next buffer in the ring, waiting for one to be free if need be.
+         *
+         * Every reserve() must be followed by a commit() before the next reserve().  Only one thread may queue.
+         *
+         * @param capacity Receives the size of the buffer.
+         *
+         * @return The buffer.
+         */
+        char * reserve( size_t & capacity );
+
+        /**
+         * @brief Queue the buffer from the last reserve() for writing.
+         *
+         * @param handle The log to write it to.
+         * @param length How much of the buffer to write.  0 gives the buffer back unused.
+         */
+        void commit( int handle, size_t length );
+
+        /**
+         * @brief What the writer has done so far.
+         */
+        LogWriterStats stats();
+
+    private:
+        LogWriter();
+
+        // the thread writing queued buffers
+        void run();
+
+        // a queued buffer
+        struct Slot {
+            int handle;
+            size_t length;
+        };
+
+        // a log being written to
+        struct Log {
+            int fd;
+            // where the next write lands, and where preallocation ends
+            off_t offset;
+            off_t allocated;
+            // the next preallocation, which doubles each time up to a limit
+            off_t allocate_step;
+            // buffers queued and not yet written
+            int pending;
+            // being forced out to disk by the writer thread
+            bool syncing;
+            // written to since last forced out to disk
+            bool dirty;
+            // written as LZ4 frames, and whether the frame has been started
+            bool compressed;
+            bool frame_open;
+        };
+
+        // preallocate ahead of a log's offset, if what is left is running low
+        void preallocate( Log & log, off_t upcoming );
+
+        // write chunks to a log with as few writev() calls as it takes.  returns the calls made.
+        unsigned long long write_chunks( Log & log, struct iovec * chunks, int count );
+
+        std::mutex lock;
+
+        // signalled when buffers are queued, and when the policy changes
+        std::condition_variable queued;
+
+        // signalled when buffers are written
+        std::condition_variable written;
+
+        bool started;
+
+        // the buffers, one after another.  left uninitialised, so memory is only taken as the ring is first used.
+        std::unique_ptr<char[]> storage;
+        std::vector<Slot> slots;
+
+        // the oldest queued buffer, and how many are in use
+        int head;
+        int used;
+
+        std::unordered_map<int, Log> logs;
+        int next_handle;
+
+        // the descriptors of compressed logs
+        std::unordered_set<int> compressed_fds;
+
+        LOG_FSYNC_POLICY fsync_policy;
+        std::chrono::seconds fsync_interval;
+        std::chrono::steady_clock::time_point next_fsync;
+
+        LogWriterStats counters;
+};
+
+#endif //LCPEX_LOGWRITER_H
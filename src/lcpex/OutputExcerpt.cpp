@@ -0,0 +1,76 @@
+#include "OutputExcerpt.h"
+#include <algorithm>
+#include <cstring>
+
+
+OutputExcerpt::OutputExcerpt( size_t limit ): limit( limit ), head( limit ), head_length( 0 ), tail( limit ), tail_next( 0 ), tail_length( 0 ), total_bytes( 0 ) {}
+
+
+void OutputExcerpt::clear()
+{
+    this->head_length = 0;
+    this->tail_next = 0;
+    this->tail_length = 0;
+    this->total_bytes = 0;
+}
+
+
+void OutputExcerpt::append( const char * data, size_t length )
+{
+    this->total_bytes += length;
+    if ( this->limit == 0 )
+    {
+        return;
+    }
+
+    size_t to_head = std::min( length, this->limit - this->head_length );
+    memcpy( this->head.data() + this->head_length, data, to_head );
+    this->head_length += to_head;
+    data += to_head;
+    length -= to_head;
+    if ( length == 0 )
+    {
+        return;
+    }
+
+    // only the newest limit bytes of a chunk can survive it
+    if ( length > this->limit )
+    {
+        data += length - this->limit;
+        length = this->limit;
+    }
+    size_t first = std::min( length, this->limit - this->tail_next );
+    memcpy( this->tail.data() + this->tail_next, data, first );
+    memcpy( this->tail.data(), data + first, length - first );
+    this->tail_next = ( this->tail_next + length ) % this->limit;
+    this->tail_length = std::min( this->tail_length + length, this->limit );
+}
+
+
+unsigned long long OutputExcerpt::total() const
+{
+    return this->total_bytes;
+}
+
+
+std::string OutputExcerpt::render() const
+{
+    std::string text( this->head.data(), this->head_length );
+
+    unsigned long long omitted = this->total_bytes - this->head_length - this->tail_length;
+    if ( omitted > 0 )
+    {
+        if (! text.empty() && text.back() != '\n' )
+        {
+            text += '\n';
+        }
+        text += "[... " + std::to_string( omitted ) + " bytes omitted ...]\n";
+    }
+
+    // oldest first: from where the next byte would go once the ring has wrapped, otherwise from the start
+    size_t oldest = this->tail_length == this->limit ? this->tail_next : 0;
+    size_t first = std::min( this->tail_length, this->limit - oldest );
+    text.append( this->tail.data() + oldest, first );
+    text.append( this->tail.data(), this->tail_length - first );
+    return text;
+}
@@ -0,0 +1,63 @@
+#ifndef LCPEX_OUTPUTEXCERPT_H
+#define LCPEX_OUTPUTEXCERPT_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The beginning and the end of a stream of output, kept in a fixed amount of memory.
+ *
+ * The first `limit` bytes appended are kept as they are, and after them a ring of the last `limit` bytes, so that
+ * however much a command prints, what it said first and what it said last can be shown when it fails without reading
+ * its logs back.  Both buffers are allocated up front and never grow.
+ *
+ * Only the output reactor's thread appends, and only while a capture is running, so the excerpt needs no lock of its
+ * own: its owner reads it once the capture has finished.
+ */
+class OutputExcerpt
+{
+    public:
+        /**
+         * @param limit The bytes kept from each end.  0 keeps nothing.
+         */
+        explicit OutputExcerpt( size_t limit );
+
+        /**
+         * @brief Forget everything appended, keeping the buffers.
+         */
+        void clear();
+
+        /**
+         * @brief Take in a chunk of output.
+         */
+        void append( const char * data, size_t length );
+
+        /**
+         * @brief The bytes appended since the last clear(), kept or not.
+         */
+        unsigned long long total() const;
+
+        /**
+         * @brief What was kept, with a line in place of whatever was dropped from the middle.
+         *
+         * @return The head, then the tail if anything was appended after the head, in the order it was appended.
+         */
+        std::string render() const;
+
+    private:
+        size_t limit;
+
+        std::vector<char> head;
+        size_t head_length;
+
+        // the ring holds the newest bytes after the head.  tail_next is where the next byte goes, and the ring is full
+        // once tail_length reaches limit.
+        std::vector<char> tail;
+        size_t tail_next;
+        size_t tail_length;
+
+        unsigned long long total_bytes;
+};
+
+#endif //LCPEX_OUTPUTEXCERPT_H
@@ -0,0 +1,514 @@
+#include "OutputReactor.h"
+#include "LogWriter.h"
+#include "helpers.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+// the most the reactor forwards from input in one go
+static const size_t INPUT_CHUNK_SIZE = 4096;
+
+// the chunks one source may read before the others get their turn
+static const int TURN_BUDGET = 16;
+
+// events collected per wait
+static const int MAX_EVENTS = 64;
+
+
+OutputCapture::OutputCapture(): exited( true ), exit_pid( -1 ), exit_timeout_handle( 0 ), exit_outcome( nullptr ), exit_cgroup_kill_fd( -1 ), woken( false ), finished( false ) {}
+
+
+OutputCapture::Source OutputCapture::make_source( OutputCapture * owner, SOURCE_KIND kind, int fd )
+{
+    Source source;
+    source.owner = owner;
+    source.kind = kind;
+    source.fd = fd;
+    source.log_fd = -1;
+    source.log_handle = -1;
+    source.copy_fd = -1;
+    source.open = false;
+    source.queued = false;
+    source.zero_copy = false;
+    source.spliceable = false;
+    source.bytes = 0;
+    source.excerpt = nullptr;
+    return source;
+}
+
+
+void OutputCapture::add_stream( int source_fd, int log_fd, int console_fd, OutputExcerpt * excerpt )
+{
+    Source source = make_source( this, SOURCE_STREAM, source_fd );
+    source.log_fd = log_fd;
+    source.copy_fd = console_fd;
+    source.excerpt = excerpt;
+    this->sources.push_back( source );
+}
+
+
+void OutputCapture::add_input( int source_fd, int destination_fd )
+{
+    if ( source_fd < 0 )
+    {
+        return;
+    }
+    Source source = make_source( this, SOURCE_INPUT, source_fd );
+    source.copy_fd = destination_fd;
+    this->sources.push_back( source );
+}
+
+
+void OutputCapture::watch_exit( int pidfd, pid_t pid, int timeout_handle, CommandOutcome * outcome )
+{
+    if ( pidfd < 0 )
+    {
+        return;
+    }
+    this->sources.push_back( make_source( this, SOURCE_EXIT, pidfd ) );
+    this->exited = false;
+    this->exit_pid = pid;
+    this->exit_timeout_handle = timeout_handle;
+    this->exit_outcome = outcome;
+}
+
+
+void OutputCapture::kill_cgroup_on_exit( int cgroup_kill_fd )
+{
+    this->exit_cgroup_kill_fd = cgroup_kill_fd;
+}
+
+
+void OutputCapture::watch_wake( int wake_fd )
+{
+    if ( wake_fd < 0 )
+    {
+        return;
+    }
+    this->sources.push_back( make_source( this, SOURCE_WAKE, wake_fd ) );
+}
+
+
+bool OutputCapture::was_woken() const
+{
+    return this->woken;
+}
+
+
+unsigned long long OutputCapture::bytes_copied( int source_fd ) const
+{
+    for ( size_t i = 0; i < this->sources.size(); i++ )
+    {
+        if ( this->sources[i].kind == SOURCE_STREAM && this->sources[i].fd == source_fd )
+        {
+            return this->sources[i].bytes;
+        }
+    }
+    return 0;
+}
+
+
+OutputReactor & OutputReactor::shared()
+{
+    // never destroyed, for the same reason as the timeout wheel: the thread only exists in this process
+    static OutputReactor * reactor = new OutputReactor();
+    return *reactor;
+}
+
+
+OutputReactor::OutputReactor(): started( false ), buffer( INPUT_CHUNK_SIZE )
+{
+    this->epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    if ( this->epoll_fd == -1 )
+    {
+        perror( "epoll_create1" );
+        exit( 1 );
+    }
+    if ( pipe2( this->scratch_pipe, O_CLOEXEC ) == -1 )
+    {
+        perror( "scratch pipe" );
+        exit( 1 );
+    }
+}
+
+
+void OutputReactor::capture( OutputCapture & capture )
+{
+    std::unique_lock<std::mutex> guard( this->lock );
+
+    // started on first use
+    if (! this->started )
+    {
+        std::thread( &OutputReactor::run, this ).detach();
+        this->started = true;
+    }
+
+    for ( size_t i = 0; i < capture.sources.size(); i++ )
+    {
+        OutputCapture::Source & source = capture.sources[i];
+        source.owner = &capture;
+
+        struct epoll_event event;
+        event.data.ptr = &source;
+        if ( source.kind == OutputCapture::SOURCE_STREAM )
+        {
+            // edge-triggered, so the source has to be read until it would block
+            fcntl( source.fd, F_SETFL, fcntl( source.fd, F_GETFL ) | O_NONBLOCK );
+            event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+
+            source.log_handle = LogWriter::shared().attach( source.log_fd );
+
+            // tee() needs a pipe to duplicate from
+            struct stat source_stat;
+            source.zero_copy = fstat( source.fd, &source_stat ) == 0 && S_ISFIFO( source_stat.st_mode );
+            source.spliceable = true;
+        } else {
+            // input is ours to share, so it stays blocking and is read once per event; pidfds and eventfds are only
+            // ever reported once before they are unregistered
+            event.events = EPOLLIN;
+        }
+
+        if ( epoll_ctl( this->epoll_fd, EPOLL_CTL_ADD, source.fd, &event ) == -1 )
+        {
+            perror( "epoll_ctl" );
+            exit( 1 );
+        }
+        source.open = true;
+    }
+
+    // a child with nothing to watch is done as soon as it is handed over
+    this->finish_if_done( capture );
+
+    capture.finished_changed.wait( guard, [&capture] { return capture.finished; } );
+    guard.unlock();
+
+    // the logs may be closed or written to directly once this returns
+    for ( size_t i = 0; i < capture.sources.size(); i++ )
+    {
+        if ( capture.sources[i].log_handle != -1 )
+        {
+            LogWriter::shared().release( capture.sources[i].log_handle );
+        }
+    }
+}
+
+
+bool OutputReactor::service( OutputCapture::Source & source, int budget )
+{
+    for ( int chunk = 0; budget < 0 || chunk < budget; chunk++ )
+    {
+        ssize_t byte_count;
+        if ( source.kind == OutputCapture::SOURCE_INPUT )
+        {
+            byte_count = read( source.fd, this->buffer.data(), this->buffer.size() );
+            if ( byte_count > 0 )
+            {
+                // level-triggered: whatever is left is reported again
+                write_all( source.copy_fd, this->buffer.data(), byte_count );
+                return false;
+            }
+        } else {
+            byte_count = this->read_chunk( source );
+            if ( byte_count > 0 )
+            {
+                continue;
+            }
+        }
+
+        if ( byte_count == -1 && errno == EINTR )
+        {
+            continue;
+        }
+        if ( byte_count == -1 && errno == EAGAIN )
+        {
+            return false;
+        }
+
+        // end of file, or an error that will not go away, such as EIO from a PTY master whose slave has closed
+        this->unregister( source );
+        return false;
+    }
+    return true;
+}
+
+
+void OutputReactor::drain_waiting( OutputCapture::Source & source )
+{
+    int waiting = 0;
+    if ( ioctl( source.fd, FIONREAD, &waiting ) == -1 )
+    {
+        // no way of telling, so a turn's worth
+        this->service( source, TURN_BUDGET );
+        return;
+    }
+    unsigned long long until = source.bytes + waiting;
+    while ( source.open && source.bytes < until && this->service( source, 1 ) )
+    {
+    }
+}
+
+
+void OutputReactor::give_up( OutputCapture & capture )
+{
+    // take what is already there, then stop waiting for more.  whatever holds the output open may still be writing,
+    // and every other capture waits on this thread, so the taking is bounded.
+    capture.woken = true;
+    for ( size_t i = 0; i < capture.sources.size(); i++ )
+    {
+        OutputCapture::Source & source = capture.sources[i];
+        if ( source.kind == OutputCapture::SOURCE_STREAM && source.open )
+        {
+            this->drain_waiting( source );
+            this->unregister( source );
+        } else if ( source.kind == OutputCapture::SOURCE_WAKE && source.open ) {
+            this->unregister( source );
+        }
+    }
+}
+
+
+ssize_t OutputReactor::read_chunk( OutputCapture::Source & source )
+{
+    LogWriter & writer = LogWriter::shared();
+    size_t capacity;
+    char * chunk = writer.reserve( capacity );
+
+    // a console that refused splice() is written from the ring like any other
+    if (! source.zero_copy || ! source.spliceable )
+    {
+        ssize_t byte_count = read( source.fd, chunk, capacity );
+        int read_errno = errno;
+        if ( byte_count > 0 )
+        {
+            write_all( source.copy_fd, chunk, byte_count );
+            source.bytes += byte_count;
+            if ( source.excerpt != nullptr )
+            {
+                source.excerpt->append( chunk, byte_count );
+            }
+        }
+        writer.commit( source.log_handle, byte_count > 0 ? byte_count : 0 );
+        errno = read_errno;
+        return byte_count;
+    }
+
+    // duplicating the chunk for the console also finds out how much there is, without consuming it
+    ssize_t available = tee( source.fd, this->scratch_pipe[WRITE_END], capacity, SPLICE_F_NONBLOCK );
+    if ( available <= 0 )
+    {
+        int tee_errno = errno;
+        writer.commit( source.log_handle, 0 );
+        errno = tee_errno;
+        return available;
+    }
+    this->transfer( this->scratch_pipe[READ_END], source.copy_fd, available, source.spliceable );
+
+    // the original goes to the log, which consumes it.  it is already there, so this doesn't wait.
+    size_t taken = 0;
+    while ( taken < (size_t) available )
+    {
+        ssize_t byte_count = read( source.fd, chunk + taken, available - taken );
+        if ( byte_count > 0 )
+        {
+            taken += byte_count;
+        } else if ( byte_count == 0 || errno != EINTR ) {
+            break;
+        }
+    }
+    if ( source.excerpt != nullptr )
+    {
+        source.excerpt->append( chunk, taken );
+    }
+    writer.commit( source.log_handle, taken );
+    source.bytes += available;
+    return available;
+}
+
+
+void OutputReactor::transfer( int pipe_fd, int destination_fd, size_t count, bool & spliceable )
+{
+    char bounce[4096];
+    while ( count > 0 )
+    {
+        ssize_t moved;
+        if ( spliceable )
+        {
+            moved = splice( pipe_fd, nullptr, destination_fd, nullptr, count, SPLICE_F_MOVE );
+            if ( moved == -1 && errno != EINTR && errno != EAGAIN )
+            {
+                // a destination splice() doesn't support, such as a file in append mode, is copied to from now on
+                spliceable = false;
+                continue;
+            }
+        } else {
+            // what is left of the chunk splice() was refused.  the bytes are already waiting, so this doesn't block even
+            // on a blocking pipe; they are consumed whether or not the destination takes them, like write_all() gives
+            // up on a destination that has failed
+            moved = read( pipe_fd, bounce, std::min( count, sizeof( bounce ) ) );
+            if ( moved > 0 )
+            {
+                write_all( destination_fd, bounce, moved );
+            }
+        }
+
+        if ( moved > 0 )
+        {
+            count -= moved;
+        } else if ( moved == 0 || ( errno != EINTR && errno != EAGAIN ) ) {
+            // the bytes are gone from under us, which can't happen to a pipe only we read
+            return;
+        }
+    }
+}
+
+
+void OutputReactor::unregister( OutputCapture::Source & source )
+{
+    if ( source.open )
+    {
+        epoll_ctl( this->epoll_fd, EPOLL_CTL_DEL, source.fd, nullptr );
+        source.open = false;
+    }
+}
+
+
+void OutputReactor::finish_if_done( OutputCapture & capture )
+{
+    if ( capture.finished || ! capture.exited )
+    {
+        return;
+    }
+    for ( size_t i = 0; i < capture.sources.size(); i++ )
+    {
+        if ( capture.sources[i].kind == OutputCapture::SOURCE_STREAM && capture.sources[i].open )
+        {
+            return;
+        }
+    }
+
+    for ( size_t i = 0; i < capture.sources.size(); i++ )
+    {
+        this->unregister( capture.sources[i] );
+    }
+    this->ready.erase(
+            std::remove_if( this->ready.begin(), this->ready.end(), [&capture]( OutputCapture::Source * source ) { return source->owner == &capture; } ),
+            this->ready.end()
+    );
+
+    // the caller may destroy the capture as soon as it wakes, so nothing of it is touched after this
+    capture.finished = true;
+    capture.finished_changed.notify_all();
+}
+
+
+void OutputReactor::run()
+{
+    struct epoll_event events[MAX_EVENTS];
+    std::vector<OutputCapture *> touched;
+
+    while ( true )
+    {
+        // don't sleep while there is data left over from the last round
+        bool pending;
+        {
+            std::lock_guard<std::mutex> guard( this->lock );
+            pending = ! this->ready.empty();
+        }
+
+        int event_count = epoll_wait( this->epoll_fd, events, MAX_EVENTS, pending ? 0 : -1 );
+        if ( event_count == -1 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+            perror( "epoll_wait" );
+            exit( 1 );
+        }
+
+        std::lock_guard<std::mutex> guard( this->lock );
+        touched.clear();
+
+        for ( int i = 0; i < event_count; i++ )
+        {
+            OutputCapture::Source & source = *(OutputCapture::Source *) events[i].data.ptr;
+            OutputCapture & owner = *source.owner;
+
+            // an earlier event in this batch may have finished with it already
+            if ( owner.finished || ! source.open )
+            {
+                continue;
+            }
+            touched.push_back( &owner );
+
+            switch ( source.kind )
+            {
+                case OutputCapture::SOURCE_STREAM:
+                case OutputCapture::SOURCE_INPUT:
+                    if (! source.queued )
+                    {
+                        source.queued = true;
+                        this->ready.push_back( &source );
+                    }
+                    break;
+
+                case OutputCapture::SOURCE_EXIT:
+                    // reaped now, so its usage and running time are what they were when it exited, not once whatever
+                    // it left running lets go of its output.  a pidfd is readable once its process has exited, so
+                    // this doesn't wait.
+                    reap_command( owner.exit_pid, owner.exit_timeout_handle, false, *owner.exit_outcome );
+                    if ( owner.exit_cgroup_kill_fd >= 0 )
+                    {
+                        ssize_t ignored = write( owner.exit_cgroup_kill_fd, "1", 1 );
+                        (void) ignored;
+                    }
+                    owner.exited = true;
+                    this->unregister( source );
+                    // a child that gave way to SIGTERM is reaped before the wheel would kill the rest of its group
+                    // and wake this capture, so whatever outlived it is given up on here instead
+                    if ( owner.exit_outcome->timed_out )
+                    {
+                        this->give_up( owner );
+                    }
+                    break;
+
+                case OutputCapture::SOURCE_WAKE:
+                    // the child has been killed, but something it started may hold its output open
+                    this->give_up( owner );
+                    break;
+            }
+        }
+
+        // one turn for every source that had data, in the order it arrived
+        size_t turns = this->ready.size();
+        for ( size_t i = 0; i < turns && ! this->ready.empty(); i++ )
+        {
+            OutputCapture::Source * source = this->ready.front();
+            this->ready.pop_front();
+            source->queued = false;
+            if ( ! source->open )
+            {
+                continue;
+            }
+            if ( this->service( *source, TURN_BUDGET ) && source->open )
+            {
+                source->queued = true;
+                this->ready.push_back( source );
+            }
+            touched.push_back( source->owner );
+        }
+
+        for ( size_t i = 0; i < touched.size(); i++ )
+        {
+            this->finish_if_done( *touched[i] );
+        }
+    }
+}
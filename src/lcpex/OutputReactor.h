@@ -0,0 +1,210 @@
+#ifndef LCPEX_OUTPUTREACTOR_H
+#define LCPEX_OUTPUTREACTOR_H
+
+#include "helpers.h"
+#include "OutputExcerpt.h"
+#include <sys/types.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief The descriptors of one running child that the reactor services on its behalf.
+ *
+ * Set up with add_stream(), add_input(), watch_exit(), kill_cgroup_on_exit() and watch_wake(), then handed to
+ * OutputReactor::capture(), and not changed afterwards.  The descriptors remain the caller's to close once the capture has finished.
+ */
+class OutputCapture
+{
+    public:
+        OutputCapture();
+
+        /**
+         * @brief Log everything the child writes to a descriptor, and copy it to the console.
+         *
+         * The capture is not finished until the source reaches end of file.  The source is made non-blocking.
+         *
+         * @param source_fd The read end of a pipe from the child, or a PTY master.
+         * @param log_fd The log, written by the log writer, so not in append mode.
+         * @param console_fd Where else the output goes as it arrives.
+         * @param excerpt Keeps the beginning and end of the output, or nullptr.  Must outlive the capture.
+         */
+        void add_stream( int source_fd, int log_fd, int console_fd, OutputExcerpt * excerpt );
+
+        /**
+         * @brief Forward input to the child while it runs, without waiting for the input to end.
+         *
+         * @param source_fd A descriptor of this process's own, such as a copy of its stdin.  Left blocking.
+         * @param destination_fd Where the child reads it from, such as a PTY master.
+         */
+        void add_input( int source_fd, int destination_fd );
+
+        /**
+         * @brief Reap the child with reap_command() as soon as its pidfd reports it has exited, however long its
+         * output stays open after, and don't finish until it has been.
+         *
+         * @param pidfd A pidfd for the child, or -1 to only wait for its output to end and leave reaping to the caller.
+         * @param pid The child's process ID.
+         * @param timeout_handle The child's timeout wheel handle, released as it is reaped, or 0.
+         * @param outcome Receives how the child ended.  Must outlive the capture.
+         */
+        void watch_exit( int pidfd, pid_t pid, int timeout_handle, CommandOutcome * outcome );
+
+        /**
+         * @brief Once the child has been reaped, kill everything left in its cgroup, so that nothing it started can
+         * hold its output open or outlive it.
+         *
+         * Only takes effect along with watch_exit().
+         *
+         * @param cgroup_kill_fd The cgroup.kill of the child's cgroup, or -1.
+         */
+        void kill_cgroup_on_exit( int cgroup_kill_fd );
+
+        /**
+         * @brief Stop waiting for output once a descriptor becomes readable.
+         *
+         * What is already buffered is still copied.
+         *
+         * @param wake_fd A descriptor that becomes readable once there is no point waiting for more, such as an eventfd
+         *                signalled by the timeout wheel once it has killed the child, or -1.
+         */
+        void watch_wake( int wake_fd );
+
+        /**
+         * @brief Whether the capture stopped early because the wake descriptor was signalled.
+         */
+        bool was_woken() const;
+
+        /**
+         * @brief The bytes copied from a stream so far.
+         *
+         * @param source_fd The source the stream was added with.
+         */
+        unsigned long long bytes_copied( int source_fd ) const;
+
+    private:
+        friend class OutputReactor;
+
+        enum SOURCE_KIND { SOURCE_STREAM, SOURCE_INPUT, SOURCE_EXIT, SOURCE_WAKE };
+
+        struct Source {
+            OutputCapture * owner;
+            SOURCE_KIND kind;
+            int fd;
+            // the log written through the log writer, or -1
+            int log_fd;
+            int log_handle;
+            // where the source is also copied directly: the console, or the child for input
+            int copy_fd;
+            // registered with the reactor, and not yet at end of file
+            bool open;
+            // on the reactor's list of sources with data to read
+            bool queued;
+            // whether the source is a pipe, so its data can reach copy_fd without passing through this process
+            bool zero_copy;
+            // whether copy_fd has accepted splice() so far
+            bool spliceable;
+            // read from the source so far
+            unsigned long long bytes;
+            // also given everything read, or nullptr
+            OutputExcerpt * excerpt;
+        };
+
+        // a source of the given kind, not yet registered
+        static Source make_source( OutputCapture * owner, SOURCE_KIND kind, int fd );
+
+        std::vector<Source> sources;
+
+        // whether the child has exited, or its exit isn't being watched
+        bool exited;
+        // the child to reap once it exits, and where its outcome goes
+        pid_t exit_pid;
+        int exit_timeout_handle;
+        CommandOutcome * exit_outcome;
+        int exit_cgroup_kill_fd;
+        bool woken;
+        bool finished;
+        std::condition_variable finished_changed;
+};
+
+
+/**
+ * @brief One event loop, on one thread, copying the output of every running child to its destinations.
+ *
+ * Every source is registered with a single edge-triggered epoll instance, so the cost of waiting does not grow with the
+ * number of children and a source that has hung up is never reported again.  Sources with data are serviced in turn,
+ * a bounded amount at a time, so that one child printing without pause can't hold up the others.
+ *
+ * Output is read straight into the log writer's ring, so a slow disk holds up draining the children only once the
+ * ring is full.  On its way to the console, output arriving on a pipe never passes through this process: tee()
+ * duplicates it and splice() moves the copy.  A console that refuses splice() is written from the ring instead, as is
+ * the output of a PTY master.
+ */
+class OutputReactor
+{
+    public:
+        /**
+         * @brief The reactor shared by all running children.
+         */
+        static OutputReactor & shared();
+
+        /**
+         * @brief Service a child's descriptors until its output has ended and it has exited.
+         *
+         * Blocks the calling thread, without using any CPU, until the capture has finished and everything it logged
+         * has been written.  The child is reaped only if its exit is watched.
+         *
+         * @param capture The child's descriptors.
+         */
+        void capture( OutputCapture & capture );
+
+    private:
+        OutputReactor();
+
+        // the thread running the event loop
+        void run();
+
+        // copy from a stream or input source until it would block, it ends, or the budget is spent.  returns whether
+        // there may be more to read.
+        bool service( OutputCapture::Source & source, int budget );
+
+        // copy what is waiting in a stream when called, and no more, however fast whatever holds it open writes
+        void drain_waiting( OutputCapture::Source & source );
+
+        // stop waiting for the output of a capture whose child was killed for its timeout, once what is waiting in its
+        // streams has been copied
+        void give_up( OutputCapture & capture );
+
+        // read one chunk from a source into the log writer's ring, copying it on the way.  returns the bytes read, 0
+        // at end of file, or -1 with errno set.
+        ssize_t read_chunk( OutputCapture::Source & source );
+
+        // move count bytes that are waiting in a pipe to a destination, by splice() while the destination accepts it
+        void transfer( int pipe_fd, int destination_fd, size_t count, bool & spliceable );
+
+        // stop watching a source
+        void unregister( OutputCapture::Source & source );
+
+        // stop watching every source of a capture that is done, and wake its caller
+        void finish_if_done( OutputCapture & capture );
+
+        std::mutex lock;
+
+        // whether the thread running the event loop is running
+        bool started;
+
+        int epoll_fd;
+
+        // stream sources with data left to read, serviced in turn
+        std::deque<OutputCapture::Source *> ready;
+
+        // for input, which isn't logged
+        std::vector<char> buffer;
+
+        // always empty between chunks.  tee() duplicates a chunk into it for the console, and the original is read
+        // into the log writer's ring.
+        int scratch_pipe[2];
+};
+
+#endif //LCPEX_OUTPUTREACTOR_H
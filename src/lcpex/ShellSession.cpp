@@ -0,0 +1,335 @@
+#include "ShellSession.h"
+#include "Contexts.h"
+#include "OutputReactor.h"
+#include "Spawn.h"
+#include "helpers.h"
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// idle sessions kept at once, across every shell and identity
+static const size_t IDLE_LIMIT = 16;
+
+// what a session's shell runs: every line it is sent, in order, until the control socket closes
+static const char SESSION_LOOP[] = "while IFS= read -r __rex_line; do eval \"$__rex_line\"; done";
+
+
+ShellSessionPool & ShellSessionPool::shared()
+{
+    static ShellSessionPool * pool = new ShellSessionPool();
+    return *pool;
+}
+
+
+ShellSessionPool::ShellSessionPool()
+{
+    this->counters = ShellSessionStats();
+}
+
+
+ShellSessionStats ShellSessionPool::stats()
+{
+    std::lock_guard<std::mutex> guard( this->lock );
+    return this->counters;
+}
+
+
+ShellSessionPool::Session * ShellSessionPool::start(
+        const std::string & key,
+        const std::string & shell_path,
+        const std::string & shell_execution_arg,
+        bool set_working_directory,
+        const std::string & working_directory,
+        bool context_override,
+        const std::string & context_user,
+        const std::string & context_group,
+        bool environment_supplied,
+        const std::vector<std::string> & environment_variables
+)
+{
+    // the shell has to be given the loop as a command
+    if ( shell_execution_arg == "" )
+    {
+        return nullptr;
+    }
+
+    uid_t context_uid = 0;
+    gid_t context_gid = 0;
+    std::vector<gid_t> context_groups;
+    if ( context_override && resolve_identity_context( context_user, context_group, context_uid, context_gid, context_groups ) != IDENTITY_CONTEXT_ERRORS::ERROR_NONE )
+    {
+        return nullptr;
+    }
+
+    const char * temporary = getenv( "TMPDIR" );
+    std::string directory_template = std::string( temporary != nullptr && temporary[0] != '\0' ? temporary : "/tmp" ) + "/rex-session.XXXXXX";
+    std::vector<char> directory( directory_template.begin(), directory_template.end() );
+    directory.push_back( '\0' );
+    if ( mkdtemp( directory.data() ) == nullptr )
+    {
+        return nullptr;
+    }
+    if ( context_override && chown( directory.data(), context_uid, context_gid ) == -1 )
+    {
+        rmdir( directory.data() );
+        return nullptr;
+    }
+
+    int control[2];
+    if ( socketpair( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, control ) == -1 )
+    {
+        rmdir( directory.data() );
+        return nullptr;
+    }
+
+    std::vector<std::string> arguments = { shell_path, shell_execution_arg, SESSION_LOOP };
+    std::vector<char *> argv;
+    for ( size_t i = 0; i < arguments.size(); i++ )
+    {
+        argv.push_back( const_cast<char *>( arguments[i].c_str() ) );
+    }
+    argv.push_back( nullptr );
+    std::vector<char *> environment = environment_supplied ? exact_environment( environment_variables ) : child_environment( environment_variables );
+
+    // the shell's own complaints go to our stderr; its commands' output goes to the FIFOs
+    SpawnRequest request;
+    request.argv = argv.data();
+    request.envp = environment.data();
+    request.stdin_fd = control[1];
+    request.stdout_fd = control[1];
+    request.stderr_fd = -1;
+    request.new_session = false;
+    request.controlling_tty_fd = -1;
+    request.own_process_group = false;
+    request.cgroup_procs_fd = -1;
+    request.working_directory = set_working_directory ? working_directory.c_str() : nullptr;
+    request.set_identity = context_override;
+    request.uid = context_uid;
+    request.gid = context_gid;
+    request.groups = context_groups.data();
+    request.group_count = context_groups.size();
+
+    SPAWN_STAGE failed_stage;
+    int failed_errno;
+    pid_t pid = spawn_process( request, failed_stage, failed_errno );
+    ::close( control[1] );
+
+    Session * session = new Session();
+    session->key = key;
+    session->pid = pid;
+    session->control_fd = control[0];
+    session->directory = directory.data();
+    session->set_identity = context_override;
+    session->uid = context_uid;
+    session->gid = context_gid;
+    session->fifos_reusable = false;
+
+    // the command is run the usual way instead, which reports why
+    if ( pid == -1 || failed_stage != SPAWN_STAGE_NONE )
+    {
+        this->close( session );
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> guard( this->lock );
+    this->counters.started++;
+    return session;
+}
+
+
+void ShellSessionPool::close( Session * session )
+{
+    // the shell's read sees end of file, and its loop ends
+    ::close( session->control_fd );
+    if ( session->pid != -1 )
+    {
+        while ( waitpid( session->pid, nullptr, 0 ) == -1 && errno == EINTR ) {}
+    }
+    unlink( ( session->directory + "/command" ).c_str() );
+    unlink( ( session->directory + "/out" ).c_str() );
+    unlink( ( session->directory + "/err" ).c_str() );
+    rmdir( session->directory.c_str() );
+    delete session;
+}
+
+
+void ShellSessionPool::close_all()
+{
+    std::deque<Session *> closing;
+    {
+        std::lock_guard<std::mutex> guard( this->lock );
+        closing.swap( this->idle );
+    }
+    for ( size_t i = 0; i < closing.size(); i++ )
+    {
+        this->close( closing[i] );
+    }
+}
+
+
+// replace a FIFO in a session's directory with a new one the session's user can open
+static bool make_fifo( const std::string & path, bool set_identity, uid_t uid, gid_t gid )
+{
+    unlink( path.c_str() );
+    return mkfifo( path.c_str(), 0600 ) == 0 && ( ! set_identity || chown( path.c_str(), uid, gid ) == 0 );
+}
+
+
+bool ShellSessionPool::run(
+        const std::string & shell_path,
+        const std::string & shell_execution_arg,
+        const std::string & shell_source_subcommand,
+        bool set_working_directory,
+        const std::string & working_directory,
+        bool context_override,
+        const std::string & context_user,
+        const std::string & context_group,
+        bool environment_supplied,
+        const std::vector<std::string> & environment_variables,
+        const std::string & command,
+        FILE * stdout_log_fh,
+        FILE * stderr_log_fh,
+        OutputExcerpt * stdout_excerpt,
+        OutputExcerpt * stderr_excerpt,
+        int & status,
+        CommandOutcome & outcome
+)
+{
+    std::string key;
+    key.append( shell_path ).push_back( '\0' );
+    key.append( shell_execution_arg ).push_back( '\0' );
+    key.append( set_working_directory ? working_directory : "" ).push_back( '\0' );
+    key.append( context_override ? context_user + ":" + context_group : "" ).push_back( '\0' );
+    key.append( environment_supplied ? "exact" : "added" ).push_back( '\0' );
+    for ( size_t i = 0; i < environment_variables.size(); i++ )
+    {
+        key.append( environment_variables[i] ).push_back( '\0' );
+    }
+
+    // the most recently used idle session with the same settings, or a new one
+    Session * session = nullptr;
+    {
+        std::lock_guard<std::mutex> guard( this->lock );
+        for ( size_t i = this->idle.size(); i > 0 && session == nullptr; i-- )
+        {
+            if ( this->idle[i - 1]->key == key )
+            {
+                session = this->idle[i - 1];
+                this->idle.erase( this->idle.begin() + ( i - 1 ) );
+            }
+        }
+    }
+    if ( session == nullptr )
+    {
+        session = this->start( key, shell_path, shell_execution_arg, set_working_directory, working_directory, context_override, context_user, context_group, environment_supplied, environment_variables );
+        if ( session == nullptr )
+        {
+            return false;
+        }
+    }
+
+    std::string command_path = session->directory + "/command";
+    std::string out_path = session->directory + "/out";
+    std::string err_path = session->directory + "/err";
+
+    // the command is sourced from a file, so no quoting in it can disturb the session
+    bool prepared = false;
+    int command_fd = open( command_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600 );
+    if ( command_fd != -1 )
+    {
+        std::string contents = command + "\n";
+        prepared = write_all( command_fd, contents.c_str(), contents.size() ) == 0
+                && ( ! session->set_identity || fchown( command_fd, session->uid, session->gid ) == 0 );
+        ::close( command_fd );
+    }
+
+    // the FIFOs are kept from one command to the next, unless something the last command started may still have them
+    // open.  a read end opened afresh doesn't report the last command's writers hanging up.
+    if ( prepared && ! session->fifos_reusable )
+    {
+        prepared = make_fifo( out_path, session->set_identity, session->uid, session->gid )
+                && make_fifo( err_path, session->set_identity, session->uid, session->gid );
+        session->fifos_reusable = prepared;
+    }
+    int out_fd = prepared ? open( out_path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC ) : -1;
+    int err_fd = out_fd != -1 ? open( err_path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC ) : -1;
+
+    std::string line = "( " + shell_source_subcommand + " '" + command_path + "' ) </dev/null >'" + out_path + "' 2>'" + err_path + "'; echo \"$?\"\n";
+    bool sent = err_fd != -1 && send( session->control_fd, line.c_str(), line.size(), MSG_NOSIGNAL ) == (ssize_t) line.size();
+    if (! sent )
+    {
+        // nothing has run, so the command can still be run the usual way
+        if ( out_fd != -1 ) { ::close( out_fd ); }
+        if ( err_fd != -1 ) { ::close( err_fd ); }
+        {
+            std::lock_guard<std::mutex> guard( this->lock );
+            this->counters.lost++;
+        }
+        this->close( session );
+        return false;
+    }
+
+    // the output ends when the subshell closes the FIFOs.  once the shell reports the status, whatever the command
+    // left running is not waited for, as with a command that timed out.
+    OutputCapture capture;
+    capture.add_stream( out_fd, stdout_log_fh->_fileno, STDOUT_FILENO, stdout_excerpt );
+    capture.add_stream( err_fd, stderr_log_fh->_fileno, STDERR_FILENO, stderr_excerpt );
+    capture.watch_wake( session->control_fd );
+    OutputReactor::shared().capture( capture );
+    session->fifos_reusable = ! capture.was_woken();
+    outcome.stdout_bytes = capture.bytes_copied( out_fd );
+    outcome.stderr_bytes = capture.bytes_copied( err_fd );
+    ::close( out_fd );
+    ::close( err_fd );
+
+    std::string reply;
+    char character;
+    ssize_t byte_count;
+    while ( ( byte_count = read( session->control_fd, &character, 1 ) ) != 0 )
+    {
+        if ( byte_count == -1 )
+        {
+            if ( errno == EINTR ) { continue; }
+            break;
+        }
+        if ( character == '\n' )
+        {
+            break;
+        }
+        reply.push_back( character );
+    }
+
+    if ( byte_count != 1 || reply.empty() )
+    {
+        // the shell went away while the command ran
+        {
+            std::lock_guard<std::mutex> guard( this->lock );
+            this->counters.lost++;
+        }
+        this->close( session );
+        status = LCPEX_SIGNALLED;
+        return true;
+    }
+    status = atoi( reply.c_str() );
+
+    Session * oldest = nullptr;
+    {
+        std::lock_guard<std::mutex> guard( this->lock );
+        this->counters.commands++;
+        this->idle.push_back( session );
+        if ( this->idle.size() > IDLE_LIMIT )
+        {
+            oldest = this->idle.front();
+            this->idle.pop_front();
+        }
+    }
+    if ( oldest != nullptr )
+    {
+        this->close( oldest );
+    }
+    return true;
+}
@@ -0,0 +1,137 @@
+#ifndef LCPEX_SHELLSESSION_H
+#define LCPEX_SHELLSESSION_H
+
+#include "helpers.h"
+#include "OutputExcerpt.h"
+#include <sys/types.h>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// how the shell sessions have been used so far
+struct ShellSessionStats {
+    // shells started, and commands run in them
+    unsigned long long started;
+    unsigned long long commands;
+    // shells that stopped answering and were closed
+    unsigned long long lost;
+};
+
+/**
+ * @brief Long-lived shells that run one command after another, so each command doesn't pay for starting a shell.
+ *
+ * A session is a shell reading lines from a control socket and evaluating them.  Each command is written to a file in
+ * the session's private directory and sourced in a subshell, so nothing it does, not even `exit`, outlives it.  Its
+ * stdout and stderr go to FIFOs in the same directory, which the output reactor copies to the logs like any pipe, and
+ * the shell writes the subshell's exit status back on the control socket once it has finished.
+ *
+ * Sessions are kept per shell, user, group, working directory and environment, and a command only runs in a session
+ * started with the same ones.  A command in a session reads from /dev/null, and an exit status above 128 may mean it
+ * was killed by a signal.  Idle sessions beyond a limit are closed, oldest first.
+ */
+class ShellSessionPool
+{
+    public:
+        /**
+         * @brief The pool shared by every command.
+         */
+        static ShellSessionPool & shared();
+
+        /**
+         * @brief Run a shell command in a session, logging and echoing its output as execute() does.
+         *
+         * @param shell_path The path to the shell executable.
+         * @param shell_execution_arg The argument used to execute a command in the shell.
+         * @param shell_source_subcommand The shell subcommand used to source a file.
+         * @param set_working_directory Whether the command changes its working directory.
+         * @param working_directory The command's working directory.
+         * @param context_override Whether the command runs as another user and group.
+         * @param context_user The user the command runs as.
+         * @param context_group The group the command runs as.
+         * @param environment_supplied Whether environment_variables is the complete environment.
+         * @param environment_variables NAME=value assignments added to the environment, or the whole of it.
+         * @param command The command, as the shell would be given it.
+         * @param stdout_log_fh The stdout log.
+         * @param stderr_log_fh The stderr log.
+         * @param stdout_excerpt Keeps the beginning and end of the command's stdout, or nullptr.
+         * @param stderr_excerpt Keeps the beginning and end of the command's stderr, or nullptr.
+         * @param status Receives the command's exit status.
+         * @param outcome Receives the bytes of output the command produced.
+         *
+         * @return False if no session could take the command, which has then not run.
+         */
+        bool run(
+                const std::string & shell_path,
+                const std::string & shell_execution_arg,
+                const std::string & shell_source_subcommand,
+                bool set_working_directory,
+                const std::string & working_directory,
+                bool context_override,
+                const std::string & context_user,
+                const std::string & context_group,
+                bool environment_supplied,
+                const std::vector<std::string> & environment_variables,
+                const std::string & command,
+                FILE * stdout_log_fh,
+                FILE * stderr_log_fh,
+                OutputExcerpt * stdout_excerpt,
+                OutputExcerpt * stderr_excerpt,
+                int & status,
+                CommandOutcome & outcome
+        );
+
+        /**
+         * @brief Close every idle session, and wait for its shell to exit.
+         */
+        void close_all();
+
+        /**
+         * @brief How the sessions have been used so far.
+         */
+        ShellSessionStats stats();
+
+    private:
+        ShellSessionPool();
+
+        struct Session {
+            std::string key;
+            pid_t pid;
+            // the socket the shell reads commands from and writes exit statuses to
+            int control_fd;
+            // holds the command file and the FIFOs, and belongs to the session's user
+            std::string directory;
+            bool set_identity;
+            uid_t uid;
+            gid_t gid;
+            // whether the FIFOs exist, and nothing is left holding them open
+            bool fifos_reusable;
+        };
+
+        // start a shell for a session, or return nullptr
+        Session * start(
+                const std::string & key,
+                const std::string & shell_path,
+                const std::string & shell_execution_arg,
+                bool set_working_directory,
+                const std::string & working_directory,
+                bool context_override,
+                const std::string & context_user,
+                const std::string & context_group,
+                bool environment_supplied,
+                const std::vector<std::string> & environment_variables
+        );
+
+        // close a session and wait for its shell to exit
+        void close( Session * session );
+
+        std::mutex lock;
+
+        // idle sessions, the least recently used first
+        std::deque<Session *> idle;
+
+        ShellSessionStats counters;
+};
+
+#endif //LCPEX_SHELLSESSION_H
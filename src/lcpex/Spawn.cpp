@@ -0,0 +1,183 @@
+#include "Spawn.h"
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+// the calls that take 32-bit IDs, on architectures where the plain ones still take 16-bit IDs
+#ifdef SYS_setgid32
+#define SPAWN_SYS_SETGROUPS SYS_setgroups32
+#define SPAWN_SYS_SETGID SYS_setgid32
+#define SPAWN_SYS_SETUID SYS_setuid32
+#else
+#define SPAWN_SYS_SETGROUPS SYS_setgroups
+#define SPAWN_SYS_SETGID SYS_setgid
+#define SPAWN_SYS_SETUID SYS_setuid
+#endif
+
+// room for the child's frames up to and including execvpe(), which builds candidate paths on the stack
+static const size_t CHILD_STACK_SIZE = 256 * 1024;
+
+// the state shared by the parent and a child that is still running in its memory
+struct SpawnContext {
+    const SpawnRequest * request;
+    sigset_t parent_mask;
+    SPAWN_STAGE failed_stage;
+    int failed_errno;
+};
+
+
+// record why the child is giving up, and leave without running anything of the parent's
+static int give_up( SpawnContext * context, SPAWN_STAGE stage )
+{
+    context->failed_errno = errno;
+    context->failed_stage = stage;
+    _exit( stage == SPAWN_STAGE_EXEC ? 255 : 1 );
+}
+
+
+// the child, from clone() to exec.  system calls only: the parent's memory and locks are not ours to touch.
+static int spawned_child( void * argument )
+{
+    SpawnContext * context = (SpawnContext *) argument;
+    const SpawnRequest & request = *context->request;
+
+    // a handler installed by the parent would run on the parent's data, so anything caught before exec gets the
+    // default action.  ignored signals stay ignored across exec, as they would after fork().
+    for ( int signal_number = 1; signal_number < NSIG; signal_number++ ) {
+        struct sigaction current;
+        if ( sigaction( signal_number, nullptr, &current ) == 0 && current.sa_handler != SIG_IGN && current.sa_handler != SIG_DFL ) {
+            struct sigaction reset;
+            memset( &reset, 0, sizeof( reset ) );
+            reset.sa_handler = SIG_DFL;
+            sigaction( signal_number, &reset, nullptr );
+        }
+    }
+
+    if ( request.new_session && setsid() == -1 ) {
+        give_up( context, SPAWN_STAGE_SESSION );
+    }
+    if ( request.controlling_tty_fd >= 0 && ioctl( request.controlling_tty_fd, TIOCSCTTY, 0 ) == -1 ) {
+        give_up( context, SPAWN_STAGE_CONTROLLING_TTY );
+    }
+
+    // before anything else can start, so there is no window in which the parent could signal a group that doesn't
+    // exist yet
+    if ( request.own_process_group ) {
+        setpgid( 0, 0 );
+    }
+
+    // "0" is whoever writes it
+    if ( request.cgroup_procs_fd >= 0 && write( request.cgroup_procs_fd, "0", 1 ) == -1 ) {
+        give_up( context, SPAWN_STAGE_CGROUP );
+    }
+
+    int streams[3] = { request.stdin_fd, request.stdout_fd, request.stderr_fd };
+    for ( int stream = 0; stream < 3; stream++ ) {
+        if ( streams[stream] < 0 ) {
+            continue;
+        }
+        int result;
+        while ( ( result = dup2( streams[stream], stream ) ) == -1 && errno == EINTR ) {}
+        if ( result == -1 ) {
+            give_up( context, SPAWN_STAGE_REDIRECT );
+        }
+    }
+
+    // only the standard streams are the child's business.  close-on-exec already covers Rex's own descriptors, so
+    // a kernel without close_range() loses nothing.
+#ifdef SYS_close_range
+    syscall( SYS_close_range, 3, ~0U, 0 );
+#endif
+
+    if ( request.working_directory != nullptr && chdir( request.working_directory ) == -1 ) {
+        give_up( context, SPAWN_STAGE_WORKING_DIRECTORY );
+    }
+
+    // straight to the kernel: glibc's wrappers would have every thread of the parent change identity along with us,
+    // taking locks the parent may hold.  the child is a process of its own, so changing only itself is enough.
+    if ( request.set_identity ) {
+        if ( request.group_count > 0 && syscall( SPAWN_SYS_SETGROUPS, request.group_count, request.groups ) == -1 ) {
+            give_up( context, SPAWN_STAGE_SETGROUPS );
+        }
+        if ( syscall( SPAWN_SYS_SETGID, request.gid ) == -1 ) {
+            give_up( context, SPAWN_STAGE_SETGID );
+        }
+        if ( syscall( SPAWN_SYS_SETUID, request.uid ) == -1 ) {
+            give_up( context, SPAWN_STAGE_SETUID );
+        }
+    }
+
+    sigprocmask( SIG_SETMASK, &context->parent_mask, nullptr );
+    if ( request.envp != nullptr ) {
+        execvpe( request.argv[0], request.argv, request.envp );
+    } else {
+        execvp( request.argv[0], request.argv );
+    }
+    return give_up( context, SPAWN_STAGE_EXEC );
+}
+
+
+pid_t spawn_process( const SpawnRequest & request, SPAWN_STAGE & failed_stage, int & failed_errno )
+{
+    SpawnContext context;
+    context.request = &request;
+    context.failed_stage = SPAWN_STAGE_NONE;
+    context.failed_errno = 0;
+
+    void * stack = mmap( nullptr, CHILD_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0 );
+    if ( stack == MAP_FAILED ) {
+        failed_stage = SPAWN_STAGE_NONE;
+        failed_errno = errno;
+        return -1;
+    }
+
+    // no handler may run in the child while it shares our memory.  it restores this mask just before exec.
+    sigset_t all_signals;
+    sigfillset( &all_signals );
+    pthread_sigmask( SIG_BLOCK, &all_signals, &context.parent_mask );
+
+    // returns once the child has executed its command or exited
+    pid_t pid = clone( spawned_child, (char *) stack + CHILD_STACK_SIZE, CLONE_VM | CLONE_VFORK | SIGCHLD, &context );
+    int clone_errno = errno;
+
+    pthread_sigmask( SIG_SETMASK, &context.parent_mask, nullptr );
+    munmap( stack, CHILD_STACK_SIZE );
+
+    failed_stage = context.failed_stage;
+    failed_errno = pid == -1 ? clone_errno : context.failed_errno;
+    return pid;
+}
+
+
+std::string describe_spawn_failure( const SpawnRequest & request, SPAWN_STAGE failed_stage, int failed_errno )
+{
+    std::string reason = strerror( failed_errno );
+    switch ( failed_stage ) {
+        case SPAWN_STAGE_SESSION:
+            return "REX: Aborting: could not start a new session: " + reason + "\n";
+        case SPAWN_STAGE_CONTROLLING_TTY:
+            return "REX: Aborting: could not acquire the controlling terminal: " + reason + "\n";
+        case SPAWN_STAGE_CGROUP:
+            return "REX: Aborting: could not join cgroup: " + reason + "\n";
+        case SPAWN_STAGE_REDIRECT:
+            return "REX: Aborting: could not redirect standard streams: " + reason + "\n";
+        case SPAWN_STAGE_WORKING_DIRECTORY:
+            return "REX: Aborting: could not set working directory: " + std::string( request.working_directory ) + ": " + reason + "\n";
+        case SPAWN_STAGE_SETGROUPS:
+            return "REX: Aborting: Setting supplementary groups failed: " + std::to_string( request.group_count ) + " group(s): " + reason + "\n";
+        case SPAWN_STAGE_SETGID:
+            return "REX: Aborting: Setting GID failed: " + std::to_string( request.gid ) + ": " + reason + "\n";
+        case SPAWN_STAGE_SETUID:
+            return "REX: Aborting: Setting UID failed: " + std::to_string( request.uid ) + ": " + reason + "\n";
+        case SPAWN_STAGE_EXEC:
+            return "failed on execvp in child: " + reason + "\n";
+        default:
+            return "";
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef LCPEX_SPAWN_H
+#define LCPEX_SPAWN_H
+
+#include <sys/types.h>
+#include <string>
+
+// the step at which a spawned child gave up before executing its command
+enum SPAWN_STAGE {
+    SPAWN_STAGE_NONE = 0,
+    SPAWN_STAGE_SESSION,
+    SPAWN_STAGE_CONTROLLING_TTY,
+    SPAWN_STAGE_CGROUP,
+    SPAWN_STAGE_REDIRECT,
+    SPAWN_STAGE_WORKING_DIRECTORY,
+    SPAWN_STAGE_SETGROUPS,
+    SPAWN_STAGE_SETGID,
+    SPAWN_STAGE_SETUID,
+    SPAWN_STAGE_EXEC
+};
+
+/**
+ * @brief Everything a spawned child does between being created and executing its command.
+ *
+ * The child shares the parent's memory until it executes, so it can only make system calls: names must already be
+ * resolved to paths, descriptors and numeric IDs here.
+ */
+struct SpawnRequest {
+    // the command and its arguments, terminated by a null pointer
+    char ** argv;
+
+    // the environment, terminated by a null pointer, or nullptr to inherit the parent's
+    char * const * envp;
+
+    // descriptors to become the child's standard streams, or -1 to inherit the parent's
+    int stdin_fd;
+    int stdout_fd;
+    int stderr_fd;
+
+    // whether the child leads a new session
+    bool new_session;
+
+    // a terminal for the child to take as its controlling terminal, or -1.  requires new_session.
+    int controlling_tty_fd;
+
+    // whether the child leads a new process group, so that everything it starts can be signalled together
+    bool own_process_group;
+
+    // a cgroup's cgroup.procs for the child to move itself into, before it starts anything or gives up its identity,
+    // or -1 to stay in the parent's cgroup
+    int cgroup_procs_fd;
+
+    // the directory to change to, or nullptr to inherit the parent's
+    const char * working_directory;
+
+    // the identity to switch to, if set_identity
+    bool set_identity;
+    uid_t uid;
+    gid_t gid;
+
+    // the supplementary groups to switch to, if set_identity.  none leaves them as they are.
+    const gid_t * groups;
+    size_t group_count;
+};
+
+/**
+ * @brief Start a child process as described by a request.
+ *
+ * The child is created with clone( CLONE_VM | CLONE_VFORK ), so no page tables are copied however large the parent has
+ * grown, and the parent resumes once the child has executed its command or given up.  Every descriptor other than the
+ * child's standard streams is closed in the child with close_range(), so nothing one Task opens leaks into another.
+ *
+ * A child that gives up exits with status 1, or 255 if executing the command itself failed, and the step and error are
+ * reported back so the caller can say why.  The child must be reaped by the caller either way.
+ *
+ * @param request What the child is to do.
+ * @param failed_stage Receives the step at which the child gave up, or SPAWN_STAGE_NONE.
+ * @param failed_errno Receives the error of that step.
+ *
+ * @return The child's process ID, or -1 if it could not be created.
+ */
+pid_t spawn_process( const SpawnRequest & request, SPAWN_STAGE & failed_stage, int & failed_errno );
+
+/**
+ * @brief Describe why a spawned child gave up, in the words the child would have used itself.
+ *
+ * @param request The request the child was spawned with.
+ * @param failed_stage The step at which it gave up.
+ * @param failed_errno The error of that step.
+ *
+ * @return A line of text, ending in a newline.
+ */
+std::string describe_spawn_failure( const SpawnRequest & request, SPAWN_STAGE failed_stage, int failed_errno );
+
+#endif //LCPEX_SPAWN_H
@@ -0,0 +1,161 @@
+#include "TimeoutWheel.h"
+#include <algorithm>
+#include <csignal>
+#include <cstdint>
+#include <unistd.h>
+
+// resolution of the wheel.  timeouts are whole seconds, so a tenth of a second of lateness is immaterial.
+static const long long TICK_MILLISECONDS = 100;
+
+// slots in the wheel.  deadlines further away than one revolution stay in their slot until their turn comes round.
+static const int SLOT_COUNT = 1024;
+
+
+TimeoutWheel & TimeoutWheel::shared()
+{
+    // never destroyed: a forked child that calls exit() must not try to join a thread that only exists in its parent
+    static TimeoutWheel * wheel = new TimeoutWheel();
+    return *wheel;
+}
+
+
+TimeoutWheel::TimeoutWheel(): started( false ), next_handle( 1 ), slots( SLOT_COUNT ), processed_tick( 0 )
+{
+    this->epoch = std::chrono::steady_clock::now();
+}
+
+
+long long TimeoutWheel::tick_at( std::chrono::steady_clock::time_point when )
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>( when - this->epoch ).count() / TICK_MILLISECONDS;
+}
+
+
+void TimeoutWheel::insert( int handle, long long expiry_tick )
+{
+    this->slots[ expiry_tick % SLOT_COUNT ].push_back( handle );
+}
+
+
+int TimeoutWheel::watch( pid_t process_group, int timeout_seconds, int kill_grace_seconds, int wake_fd, int cgroup_kill_fd )
+{
+    std::lock_guard<std::mutex> guard( this->lock );
+
+    // started on first use, so runs without any timeouts never have the thread
+    if (! this->started )
+    {
+        std::thread( &TimeoutWheel::run, this ).detach();
+        this->started = true;
+    }
+
+    // the thread doesn't tick while idle, so skip the slots it slept through
+    if ( this->deadlines.empty() )
+    {
+        this->processed_tick = this->tick_at( std::chrono::steady_clock::now() );
+    }
+
+    int handle = this->next_handle++;
+    Deadline deadline;
+    deadline.process_group = process_group;
+    deadline.grace_ticks = kill_grace_seconds * 1000LL / TICK_MILLISECONDS;
+    deadline.wake_fd = wake_fd;
+    deadline.cgroup_kill_fd = cgroup_kill_fd;
+    // never due in a tick that has already been processed
+    deadline.expiry_tick = std::max( this->tick_at( std::chrono::steady_clock::now() ) + timeout_seconds * 1000LL / TICK_MILLISECONDS, this->processed_tick + 1 );
+    deadline.stage = AWAITING_TERM;
+    this->deadlines[handle] = deadline;
+    this->insert( handle, deadline.expiry_tick );
+
+    this->changed.notify_all();
+    return handle;
+}
+
+
+bool TimeoutWheel::release( int handle )
+{
+    std::lock_guard<std::mutex> guard( this->lock );
+    std::unordered_map<int, Deadline>::iterator found = this->deadlines.find( handle );
+    if ( found == this->deadlines.end() )
+    {
+        return false;
+    }
+    bool expired = found->second.stage != AWAITING_TERM;
+    this->deadlines.erase( found );
+    return expired;
+}
+
+
+void TimeoutWheel::expire( int handle, Deadline & deadline, long long now_tick )
+{
+    if ( deadline.stage == AWAITING_TERM )
+    {
+        kill( -deadline.process_group, SIGTERM );
+        deadline.stage = AWAITING_KILL;
+        deadline.expiry_tick = std::max( now_tick + deadline.grace_ticks, this->processed_tick + 1 );
+        this->insert( handle, deadline.expiry_tick );
+        return;
+    }
+
+    kill( -deadline.process_group, SIGKILL );
+    deadline.stage = KILLED;
+    if ( deadline.cgroup_kill_fd >= 0 )
+    {
+        ssize_t ignored = write( deadline.cgroup_kill_fd, "1", 1 );
+        (void) ignored;
+    }
+    if ( deadline.wake_fd >= 0 )
+    {
+        uint64_t one = 1;
+        ssize_t ignored = write( deadline.wake_fd, &one, sizeof( one ) );
+        (void) ignored;
+    }
+}
+
+
+void TimeoutWheel::run()
+{
+    std::unique_lock<std::mutex> guard( this->lock );
+    while ( true )
+    {
+        // only tick while there is something to time
+        if ( this->deadlines.empty() )
+        {
+            this->changed.wait( guard );
+            continue;
+        }
+
+        // catch up on every tick that has passed, in case this thread was held up
+        long long now_tick = this->tick_at( std::chrono::steady_clock::now() );
+        while ( this->processed_tick < now_tick )
+        {
+            this->processed_tick++;
+            std::vector<int> & slot = this->slots[ this->processed_tick % SLOT_COUNT ];
+            std::vector<int> due;
+            std::vector<int> later;
+            for ( size_t i = 0; i < slot.size(); i++ )
+            {
+                std::unordered_map<int, Deadline>::iterator found = this->deadlines.find( slot[i] );
+                if ( found == this->deadlines.end() || found->second.stage == KILLED )
+                {
+                    // released, or finished with
+                    continue;
+                }
+                if ( found->second.expiry_tick > this->processed_tick )
+                {
+                    // due on a later revolution
+                    later.push_back( slot[i] );
+                    continue;
+                }
+                due.push_back( slot[i] );
+            }
+            slot.swap( later );
+
+            for ( size_t i = 0; i < due.size(); i++ )
+            {
+                this->expire( due[i], this->deadlines[ due[i] ], this->processed_tick );
+            }
+        }
+
+        this->changed.wait_until( guard, this->epoch + std::chrono::milliseconds( ( this->processed_tick + 1 ) * TICK_MILLISECONDS ) );
+    }
+}
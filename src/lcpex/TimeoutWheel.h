@@ -0,0 +1,103 @@
+#ifndef LCPEX_TIMEOUTWHEEL_H
+#define LCPEX_TIMEOUTWHEEL_H
+
+#include <sys/types.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Watches the deadlines of every running child process that has a timeout.
+ *
+ * Deadlines are kept in a hashed timing wheel: a ring of slots, one per tick, that a single thread steps through.
+ * Adding or removing a deadline costs the same however many are pending, and the thread only wakes up once per tick
+ * while any are pending.
+ *
+ * When a deadline passes, the child's whole process group is sent SIGTERM.  If it is still being watched after the
+ * grace period, the group is sent SIGKILL and the wake descriptor supplied with the deadline is signalled, so that a
+ * caller waiting on output the group will never finish can give up.  A child running in a cgroup of its own has the
+ * whole cgroup killed along with its group, which catches whatever left the group.
+ */
+class TimeoutWheel
+{
+    public:
+        /**
+         * @brief The wheel shared by all running children.
+         */
+        static TimeoutWheel & shared();
+
+        /**
+         * @brief Start watching a process group.
+         *
+         * @param process_group The process group to signal, which must be led by a child the caller has not reaped.
+         * @param timeout_seconds The time the group has to finish.
+         * @param kill_grace_seconds The time between SIGTERM and SIGKILL.
+         * @param wake_fd An eventfd to signal once SIGKILL has been sent, or -1.
+         * @param cgroup_kill_fd The cgroup.kill of the child's cgroup, written along with SIGKILL, or -1.  Must stay open
+         *                       until the handle is released.
+         *
+         * @return A handle for release().
+         */
+        int watch( pid_t process_group, int timeout_seconds, int kill_grace_seconds, int wake_fd, int cgroup_kill_fd );
+
+        /**
+         * @brief Stop watching a process group.
+         *
+         * Call this before reaping the group leader, so that its process group ID can not have been reused by the
+         * time the wheel signals it.
+         *
+         * @param handle The handle returned by watch().
+         *
+         * @return True if the deadline passed and the group was signalled.
+         */
+        bool release( int handle );
+
+    private:
+        TimeoutWheel();
+
+        // the stages of a watched deadline
+        enum STAGE { AWAITING_TERM, AWAITING_KILL, KILLED };
+
+        struct Deadline {
+            pid_t process_group;
+            long long grace_ticks;
+            int wake_fd;
+            int cgroup_kill_fd;
+            long long expiry_tick;
+            STAGE stage;
+        };
+
+        // the thread stepping through the wheel
+        void run();
+
+        // queue a deadline in the slot for its expiry tick
+        void insert( int handle, long long expiry_tick );
+
+        // signal the group of an expired deadline and move it to its next stage
+        void expire( int handle, Deadline & deadline, long long now_tick );
+
+        // the tick that is current at the given time
+        long long tick_at( std::chrono::steady_clock::time_point when );
+
+        std::mutex lock;
+        std::condition_variable changed;
+
+        // whether the thread stepping through the wheel is running
+        bool started;
+
+        // deadlines by handle.  a handle missing from here has been released, and is dropped from its slot lazily.
+        std::unordered_map<int, Deadline> deadlines;
+        int next_handle;
+
+        // each slot holds the handles expiring on ticks congruent to its index
+        std::vector< std::vector<int> > slots;
+
+        // the last tick whose slot has been processed
+        long long processed_tick;
+        std::chrono::steady_clock::time_point epoch;
+};
+
+#endif //LCPEX_TIMEOUTWHEEL_H
@@ -1,4 +1,12 @@
 #include "helpers.h"
+#include "TimeoutWheel.h"
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+extern char **environ;
 
 ssize_t write_all(int fd, const void *buf, size_t count) {
     const char *p = (const char *)buf;
@@ -12,4 +20,114 @@ ssize_t write_all(int fd, const void *buf, size_t count) {
         p += written;
     }
     return 0;
-}
\ No newline at end of file
+}
+std::vector<char *> child_environment(const std::vector<std::string> &assignments) {
+    std::vector<char *> environment;
+    for (char **variable = environ; *variable != nullptr; variable++) {
+        // dropped if an assignment replaces it
+        size_t name_length = strcspn(*variable, "=");
+        bool replaced = false;
+        for (size_t i = 0; i < assignments.size() && !replaced; i++) {
+            replaced = assignments[i].compare(0, name_length + 1, *variable, name_length + 1) == 0;
+        }
+        if (!replaced) {
+            environment.push_back(*variable);
+        }
+    }
+    for (size_t i = 0; i < assignments.size(); i++) {
+        environment.push_back(const_cast<char *>(assignments[i].c_str()));
+    }
+    environment.push_back(nullptr);
+    return environment;
+}
+
+std::vector<char *> exact_environment(const std::vector<std::string> &variables) {
+    std::vector<char *> environment;
+    for (size_t i = 0; i < variables.size(); i++) {
+        environment.push_back(const_cast<char *>(variables[i].c_str()));
+    }
+    environment.push_back(nullptr);
+    return environment;
+}
+
+int open_process_fd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    // always close-on-exec
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    return -1;
+#endif
+}
+
+CommandOutcome start_outcome() {
+    CommandOutcome outcome = CommandOutcome();
+    outcome.started = std::chrono::steady_clock::now();
+    return outcome;
+}
+
+// the storage bytes /proc/<pid>/io counts for a process, or false if it can't be read
+static bool read_process_io(pid_t pid, unsigned long long &read_bytes, unsigned long long &write_bytes) {
+    std::string path = "/proc/" + std::to_string(pid) + "/io";
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    char buffer[512];
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer) - 1)) == -1 && errno == EINTR) {}
+    close(fd);
+    if (length <= 0) {
+        return false;
+    }
+    buffer[length] = '\0';
+
+    // lines of "name: value", in which storage reads and writes are read_bytes and write_bytes
+    const char *read_line = strstr(buffer, "\nread_bytes: ");
+    const char *write_line = strstr(buffer, "\nwrite_bytes: ");
+    if (read_line == nullptr || write_line == nullptr) {
+        return false;
+    }
+    read_bytes = strtoull(read_line + strlen("\nread_bytes: "), nullptr, 10);
+    write_bytes = strtoull(write_line + strlen("\nwrite_bytes: "), nullptr, 10);
+    return true;
+}
+
+bool reap_command(pid_t pid, int timeout_handle, bool block, CommandOutcome &outcome) {
+    // seen to have exited without being reaped, so the timeout wheel can be released while the ID can't be reused
+    siginfo_t exited;
+    exited.si_pid = 0;
+    while (waitid(P_PID, pid, &exited, WEXITED | WNOWAIT | (block ? 0 : WNOHANG)) == -1 && errno == EINTR) {}
+    if (exited.si_pid != pid) {
+        return false;
+    }
+    if (timeout_handle != 0) {
+        outcome.timed_out = TimeoutWheel::shared().release(timeout_handle);
+    }
+
+    // only readable until the command is reaped.  it already includes the descendants the command waited for.
+    bool io_counted = read_process_io(pid, outcome.read_bytes, outcome.write_bytes);
+
+    while (wait4(pid, &outcome.status, 0, &outcome.usage) == -1 && errno == EINTR) {}
+    if (!io_counted) {
+        // the same storage accounting, in the 512-byte blocks getrusage() reports
+        outcome.read_bytes = (unsigned long long) outcome.usage.ru_inblock * 512;
+        outcome.write_bytes = (unsigned long long) outcome.usage.ru_oublock * 512;
+    }
+    outcome.reaped = true;
+    outcome.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - outcome.started).count();
+    return true;
+}
+
+int outcome_return_code(const CommandOutcome &outcome) {
+    if (outcome.timed_out) {
+        return LCPEX_TIMED_OUT;
+    }
+    if (WIFEXITED(outcome.status)) {
+        return WEXITSTATUS(outcome.status);
+    }
+    return LCPEX_SIGNALLED;
+}
+
+int outcome_signal(const CommandOutcome &outcome) {
+    return outcome.reaped && WIFSIGNALED(outcome.status) ? WTERMSIG(outcome.status) : 0;
+}
@@ -3,6 +3,10 @@
 
 #include <unistd.h>
 #include "errno.h"
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
 
 // helper for sanity
 enum PIPE_ENDS {
@@ -17,8 +21,67 @@ enum CHILD_PIPE_NAMES {
     STDERR_READ = 1
 };
 
+// results of executing a command that are not its exit code
+enum LCPEX_RESULTS {
+    // the command was terminated by a signal, which its CommandOutcome names
+    LCPEX_SIGNALLED = -617,
+    // the command outran its timeout and its process group was killed
+    LCPEX_TIMED_OUT = -618
+};
+
+// how a command ended, beyond its return code
+struct CommandOutcome {
+    // whether this process reaped the command itself, so that status and usage are known
+    bool reaped;
+    // the wait status
+    int status;
+    // whether it outran its timeout and its process group was killed
+    bool timed_out;
+    // what the command, and the descendants it waited for, used
+    struct rusage usage;
+    // bytes they read from and wrote to storage, as /proc/<pid>/io counts them
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    // bytes of output the command produced on stdout and stderr
+    unsigned long long stdout_bytes;
+    unsigned long long stderr_bytes;
+    // when the command was started, and how long it ran until it exited
+    std::chrono::steady_clock::time_point started;
+    double wall_seconds;
+    // whether the command ran in a cgroup of its own, which measured everything it started, waited for or not: CPU
+    // time in microseconds, and the most memory the cgroup held at once in bytes, or 0 without the memory controller
+    bool cgroup_measured;
+    unsigned long long cgroup_user_usec;
+    unsigned long long cgroup_system_usec;
+    unsigned long long cgroup_memory_peak;
+};
+
 #define BUFFER_SIZE 1024
 
 ssize_t write_all(int fd, const void *buf, size_t count);
 
+// the environment for a child: this process's, with each NAME=value assignment added or replacing the variable of the
+// same name.  the result points into environ and into assignments, and is terminated by a null pointer.
+std::vector<char *> child_environment(const std::vector<std::string> &assignments);
+
+// a complete environment for a child, made of exactly these NAME=value strings, terminated by a null pointer
+std::vector<char *> exact_environment(const std::vector<std::string> &variables);
+
+// a pidfd for a child this process has not yet reaped, or -1 if the kernel has no pidfds
+int open_process_fd(pid_t pid);
+
+// the outcome of a command that is about to be started, and has not been reaped
+CommandOutcome start_outcome();
+
+// reap a command with wait4(), recording its outcome.  its timeout wheel handle, or 0, is released first, while its
+// process group ID can't be reused.  without block, a command that hasn't exited is left alone.  returns whether it
+// was reaped.
+bool reap_command(pid_t pid, int timeout_handle, bool block, CommandOutcome &outcome);
+
+// what lcpex() returns for a reaped command: its exit status, LCPEX_SIGNALLED or LCPEX_TIMED_OUT
+int outcome_return_code(const CommandOutcome &outcome);
+
+// the signal that terminated a reaped command, or 0
+int outcome_signal(const CommandOutcome &outcome);
+
 #endif //LCPEX_HELPERS_H
@@ -49,22 +49,84 @@ int lcpex(
         bool context_override,
         std::string context_user,
         std::string context_group,
+        bool set_working_directory,
+        std::string working_directory,
+        int timeout_seconds,
+        int kill_grace_seconds,
         bool force_pty,
         bool is_shell_command,
         std::string shell_path,
         std::string shell_execution_arg,
         bool supply_environment,
         std::string shell_source_subcommand,
-        std::string environment_file_path
+        std::string environment_file_path,
+        const std::vector<std::string> & environment_variables,
+        bool shell_session,
+        OutputExcerpt * stdout_excerpt,
+        OutputExcerpt * stderr_excerpt,
+        const CgroupSettings & cgroup,
+        CommandOutcome & outcome
 ) {
 
+    // the environment file is sourced once per run, and the command is given what it produced.  if that can't be
+    // done, the command sources the file itself, as it always has.
+    std::vector<std::string> sourced_environment;
+    bool environment_sourced = is_shell_command && supply_environment && EnvironmentCache::shared().capture(
+            shell_path,
+            shell_execution_arg,
+            shell_source_subcommand,
+            environment_file_path,
+            set_working_directory,
+            working_directory,
+            context_override,
+            context_user,
+            context_group,
+            environment_variables,
+            timeout_seconds,
+            stdout_log_fh->_fileno,
+            stderr_log_fh->_fileno,
+            sourced_environment
+    );
+    const std::vector<std::string> & environment = environment_sourced ? sourced_environment : environment_variables;
+
+    // a session's shell is shared with other commands, so a command that may have to be killed, that wants a
+    // terminal, or that runs in a cgroup of its own, gets its own
+    if ( shell_session && is_shell_command && ! force_pty && timeout_seconds == 0 && ! cgroup.enabled && ( environment_sourced || ! supply_environment ) )
+    {
+        // the session's shell runs the command in a subshell of its own, so only the exit status comes back from it
+        outcome = start_outcome();
+        int status;
+        if ( ShellSessionPool::shared().run(
+                shell_path,
+                shell_execution_arg,
+                shell_source_subcommand,
+                set_working_directory,
+                working_directory,
+                context_override,
+                context_user,
+                context_group,
+                environment_sourced,
+                environment,
+                command,
+                stdout_log_fh,
+                stderr_log_fh,
+                stdout_excerpt,
+                stderr_excerpt,
+                status,
+                outcome
+        ) ) {
+            outcome.wall_seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - outcome.started ).count();
+            return status;
+        }
+    }
+
     // generate the prefix
     std::string prefix = prefix_generator(
             command,
             is_shell_command,
             shell_path,
             shell_execution_arg,
-            supply_environment,
+            supply_environment && ! environment_sourced,
             shell_source_subcommand,
             environment_file_path
     );
@@ -73,93 +135,13 @@ int lcpex(
     // if we are forcing a pty, then we will use the vpty library
     if( force_pty )
     {
-        return exec_pty( command, stdout_log_fh, stderr_log_fh, context_override, context_user, context_group, supply_environment );
+        return exec_pty( command, stdout_log_fh, stderr_log_fh, context_override, context_user, context_group, set_working_directory, working_directory, timeout_seconds, kill_grace_seconds, environment_sourced, environment, stdout_excerpt, stderr_excerpt, cgroup, outcome );
     }
 
     // otherwise, we will use the execute function
-    return execute( command, stdout_log_fh, stderr_log_fh, context_override, context_user, context_group, supply_environment );
-}
-
-/**
- * @brief Set the close-on-exec flag of a file descriptor
- *
- * This function uses the `fcntl` function to set the close-on-exec flag
- * of the specified file descriptor `fd`. If the `fcntl` call fails,
- * the function will print an error message to `stderr` and exit with status 1.
- *
- * @param fd The file descriptor for which to set the close-on-exec flag
- */
-void set_cloexec_flag(int fd)
-{
-    if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
-    {
-        perror("fcntl");
-        exit(1);
-    }
-}
-
-/**
- * @brief This function is executed by the child process to run a shell command
- *
- * @param context_override Indicates whether to override the current execution context
- * @param context_user The user to switch to for execution context
- * @param context_group The group to switch to for execution context
- * @param processed_command The command to be executed, after processing
- * @param fd_child_stdout_pipe The file descriptor for the child process's standard output pipe
- * @param fd_child_stderr_pipe The file descriptor for the child process's standard error pipe
- *
- * The run_child_process() function takes the parameters context_override, context_user, context_group, processed_command,
- * fd_child_stdout_pipe and fd_child_stderr_pipe.
- *
- * If context_override is set to true, the child process will run under the specified context_user and context_group.
- * If either the context_user or context_group does not exist, an error message will be displayed and the process will exit.
- *
- * The function first redirects the child process's standard output and standard error to pipes.
- *
- * If context_override is set to true, the child process sets its identity context using the set_identity_context() function.
- * If an error occurs while setting the identity context, a message will be displayed and the process will exit.
- *
- * Finally, the child process calls execvp() with the processed_command to run the shell command.
- * If the execvp() function fails, an error message is displayed.
- */
-void run_child_process(bool context_override, const char* context_user, const char* context_group, char* processed_command[], int fd_child_stdout_pipe[], int fd_child_stderr_pipe[]) {
-    while ((dup2(fd_child_stdout_pipe[WRITE_END], STDOUT_FILENO) == -1) && (errno == EINTR)) {}
-    while ((dup2(fd_child_stderr_pipe[WRITE_END], STDERR_FILENO) == -1) && (errno == EINTR)) {}
-
-    if ( context_override ) {
-        int context_result = set_identity_context(context_user, context_group);
-        switch (context_result) {
-            case IDENTITY_CONTEXT_ERRORS::ERROR_NONE:
-                break;
-            case IDENTITY_CONTEXT_ERRORS::ERROR_NO_SUCH_USER:
-                std::cerr << "REX: Aborting: context user not found: " << context_user << std::endl;
-                exit(1);
-                break;
-            case IDENTITY_CONTEXT_ERRORS::ERROR_NO_SUCH_GROUP:
-                std::cerr << "REX: Aborting: context group not found: " << context_group << std::endl;
-                exit(1);
-                break;
-            case IDENTITY_CONTEXT_ERRORS::ERROR_SETGID_FAILED:
-                std::cerr << "REX: Aborting: Setting GID failed: " << context_user << "/" << context_group << std::endl;
-                exit(1);
-                break;
-            case IDENTITY_CONTEXT_ERRORS::ERROR_SETUID_FAILED:
-                std::cerr << "REX: Aborting: Setting UID failed: " << context_user << "/" << context_group << std::endl;
-                exit(1);
-                break;
-            default:
-                std::cerr << "REX: Aborting: Unknown error while setting identity context." << std::endl;
-                exit(1);
-                break;
-        }
-    }
-
-    int exit_code = execvp(processed_command[0], processed_command);
-    perror("failed on execvp in child");
-    exit(exit_code);
+    return execute( command, stdout_log_fh, stderr_log_fh, context_override, context_user, context_group, set_working_directory, working_directory, timeout_seconds, kill_grace_seconds, environment_sourced, environment, stdout_excerpt, stderr_excerpt, cgroup, outcome );
 }
 
-
 int execute(
         std::string command,
         FILE * stdout_log_fh,
@@ -167,186 +149,185 @@ int execute(
         bool context_override,
         std::string context_user,
         std::string context_group,
-        bool environment_supplied
+        bool set_working_directory,
+        std::string working_directory,
+        int timeout_seconds,
+        int kill_grace_seconds,
+        bool environment_supplied,
+        const std::vector<std::string> & environment_variables,
+        OutputExcerpt * stdout_excerpt,
+        OutputExcerpt * stderr_excerpt,
+        const CgroupSettings & cgroup,
+        CommandOutcome & outcome
 ){
     // this does three things:
     //  - execute a dang string as a subprocess command
     //  - capture child stdout/stderr to respective log files
     //  - TEE child stdout/stderr to parent stdout/stderr
 
-    // turn our command string into something execvp can consume
-    char ** processed_command = expand_env(command );
+    outcome = start_outcome();
+
+    // the child shares our memory until it executes, so it can't consult the user and group databases: the identity
+    // is resolved here, and the child only applies the IDs
+    uid_t context_uid = 0;
+    gid_t context_gid = 0;
+    std::vector<gid_t> context_groups;
+    if ( context_override ) {
+        int context_result = resolve_identity_context( context_user, context_group, context_uid, context_gid, context_groups );
+        if ( context_result != IDENTITY_CONTEXT_ERRORS::ERROR_NONE ) {
+            std::string message = describe_identity_error( context_result, context_user, context_group );
+            LogWriter::shared().append( stderr_log_fh->_fileno, message.c_str(), message.size() );
+            write_all( STDERR_FILENO, message.c_str(), message.size() );
+            return 1;
+        }
+    }
+
+    // the cgroup is ready before the child starts, so nothing the command does escapes its limits
+    CommandCgroup command_cgroup;
+    if ( cgroup.enabled ) {
+        std::string message;
+        if (! command_cgroup.create( cgroup, message ) ) {
+            LogWriter::shared().append( stderr_log_fh->_fileno, message.c_str(), message.size() );
+            write_all( STDERR_FILENO, message.c_str(), message.size() );
+            return 1;
+        }
+    }
+
+    // turn our command string into something execvp can consume.  each thread keeps its own, so the memory the
+    // arguments take is reused from one execution to the next.
+    thread_local CommandArgv processed_command;
+    std::string split_error;
+    if (! processed_command.split( command, split_error ) || processed_command.size() == 0 ) {
+        std::string message = "REX: Aborting: could not split the command into arguments: " + ( split_error.empty() ? std::string( "it is empty" ) : split_error ) + "\n";
+        LogWriter::shared().append( stderr_log_fh->_fileno, message.c_str(), message.size() );
+        write_all( STDERR_FILENO, message.c_str(), message.size() );
+        return 1;
+    }
 
-    // if the user chose to supply the environment, then we need to clear the environment
-    // before we fork the process, so that the child process will inherit the environment
-    // from the parent process
+    // the child can't allocate, so its environment is put together here: either all of it, as captured from an
+    // environment file, or only what is added to ours
+    std::vector<char *> environment;
     if ( environment_supplied ) {
-        // this breaks reuse of env variables in between executions
-        //clearenv();
+        environment = exact_environment( environment_variables );
+    } else if ( ! environment_variables.empty() ) {
+        environment = child_environment( environment_variables );
     }
 
     // create the pipes for the child process to write and read from using its stdin/stdout/stderr
     int fd_child_stdout_pipe[2];
     int fd_child_stderr_pipe[2];
 
-    if ( pipe(fd_child_stdout_pipe ) == -1 ) {
+    // using O_CLOEXEC to ensure that the child process closes the file descriptors.
+    // this must be set atomically: another Task may spawn between pipe() and fcntl(), and a sibling holding our write
+    // end open would keep us from ever seeing EOF.
+    if ( pipe2( fd_child_stdout_pipe, O_CLOEXEC ) == -1 ) {
         perror( "child stdout pipe" );
         exit( 1 );
     }
 
-    if ( pipe( fd_child_stderr_pipe ) == -1 ) {
+    if ( pipe2( fd_child_stderr_pipe, O_CLOEXEC ) == -1 ) {
         perror( "child stderr pipe" );
         exit( 1 );
     }
 
-    // using O_CLOEXEC to ensure that the child process closes the file descriptors
-    set_cloexec_flag( fd_child_stdout_pipe[READ_END] );
-    set_cloexec_flag( fd_child_stderr_pipe[READ_END] );
-    set_cloexec_flag( fd_child_stdout_pipe[WRITE_END] );
-    set_cloexec_flag( fd_child_stderr_pipe[WRITE_END] );
+    // signalled by the timeout wheel once it has killed the child, so we stop waiting on pipes that something the child
+    // started may still be holding open
+    int fd_timeout_wake = -1;
+    if ( timeout_seconds > 0 ) {
+        fd_timeout_wake = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+        if ( fd_timeout_wake == -1 ) {
+            perror( "timeout eventfd" );
+            exit( 1 );
+        }
+    }
 
-    // status result basket for the parent process to capture the child's exit status
-    int status = 616;
-    pid_t pid = fork();
+    // the child redirects its output to the pipes, moves into the working directory and identity, and executes
+    SpawnRequest request;
+    request.argv = processed_command.argv();
+    request.envp = environment.empty() ? nullptr : environment.data();
+    request.stdin_fd = -1;
+    request.stdout_fd = fd_child_stdout_pipe[WRITE_END];
+    request.stderr_fd = fd_child_stderr_pipe[WRITE_END];
+    request.new_session = false;
+    request.controlling_tty_fd = -1;
+    request.cgroup_procs_fd = command_cgroup.procs_fd();
+    request.own_process_group = timeout_seconds > 0;
+    request.working_directory = set_working_directory ? working_directory.c_str() : nullptr;
+    request.set_identity = context_override;
+    request.uid = context_uid;
+    request.gid = context_gid;
+    request.groups = context_groups.data();
+    request.group_count = context_groups.size();
+
+    SPAWN_STAGE failed_stage;
+    int failed_errno;
+    pid_t pid = spawn_process( request, failed_stage, failed_errno );
 
     switch( pid ) {
         case -1:
         {
-            // fork failed
-            perror("fork failure");
+            // spawn failed
+            errno = failed_errno;
+            perror("spawn failure");
             exit(1);
         }
 
-        case 0:
-        {
-            // child process
-            run_child_process(
-                    context_override,
-                    context_user.c_str(),
-                    context_group.c_str(),
-                    processed_command,
-                    fd_child_stdout_pipe,
-                    fd_child_stderr_pipe
-            );
-        }
-
         default:
         {
             // parent process
 
+            // the child has already executed or given up, so its process group exists before the wheel can signal it
+            int timeout_handle = 0;
+            if ( timeout_seconds > 0 ) {
+                timeout_handle = TimeoutWheel::shared().watch( pid, timeout_seconds, kill_grace_seconds, fd_timeout_wake, command_cgroup.kill_fd() );
+            }
+
+            // a child that gave up before executing couldn't say why itself, so it is said on its behalf
+            if ( failed_stage != SPAWN_STAGE_NONE ) {
+                std::string message = describe_spawn_failure( request, failed_stage, failed_errno );
+                write_all( fd_child_stderr_pipe[WRITE_END], message.c_str(), message.size() );
+            }
+
             // The parent process has no need to access the entrance to the pipe, so fd_child_*_pipe[1|0] should be closed
             // within that process too:
             close(fd_child_stdout_pipe[WRITE_END]);
             close(fd_child_stderr_pipe[WRITE_END]);
 
-            // attempt to write to stdout,stderr from child as well as to write each to file
-            char buf[BUFFER_SIZE];
-
-            // contains the byte count of the last read from the pipe
-            ssize_t byte_count;
-
-            // watched_fds for poll() to wait on
-            struct pollfd watched_fds[2];
-
-            // populate the watched_fds array
-
-            // child STDOUT to parent
-            watched_fds[CHILD_PIPE_NAMES::STDOUT_READ].fd = fd_child_stdout_pipe[READ_END];
-            watched_fds[CHILD_PIPE_NAMES::STDOUT_READ].events = POLLIN;
-
-            // child STDERR to parent
-            watched_fds[CHILD_PIPE_NAMES::STDERR_READ].fd = fd_child_stderr_pipe[READ_END];
-            watched_fds[CHILD_PIPE_NAMES::STDERR_READ].events = POLLIN;
-
-            // number of files poll() reports as ready
-            int num_files_readable;
-
-            // loop flag
-            bool break_out = false;
-
-            // loop until we've read all the data from the child process
-            while ( ! break_out ) {
-                num_files_readable = poll(watched_fds, sizeof(watched_fds) / sizeof(watched_fds[0]), -1);
-                // after the poll() call, add a check to see if both pipes are closed
-                if (!(watched_fds[CHILD_PIPE_NAMES::STDOUT_READ].events & POLLIN) &&
-                    !(watched_fds[CHILD_PIPE_NAMES::STDERR_READ].events & POLLIN)) {
-                    break_out = true;
-                }
-
-                if (num_files_readable == -1) {
-                    // error occurred in poll()
-                    perror("poll");
-                    exit(1);
-                }
-                if (num_files_readable == 0) {
-                    // poll reports no files readable
-                    break_out = true;
-                    break;
-                }
-                for (int this_fd = 0; this_fd < 2; this_fd++) {
-                    if (watched_fds[this_fd].revents & POLLIN) {
-                        // this pipe is readable
-                        byte_count = read(watched_fds[this_fd].fd, buf, BUFFER_SIZE);
-
-                        if (byte_count == -1) {
-                            if (errno == EAGAIN) { continue; } else {
-                                // error reading from pipe
-                                perror("read");
-                                exit(EXIT_FAILURE);
-                            }
-
-                        } else if (byte_count == 0) {
-                            // reached EOF on one of the streams but not a HUP
-                            // we've read all we can this cycle, so go to the next fd in the for loop
-                            continue;
-                        } else {
-                            // byte count was sane
-                            // write to stdout,stderr
-                            if (this_fd == CHILD_PIPE_NAMES::STDOUT_READ) {
-                                // the child's stdout pipe is readable
-                                write_all(stdout_log_fh->_fileno, buf, byte_count);
-                                write_all(STDOUT_FILENO, buf, byte_count);
-                            } else if (this_fd == CHILD_PIPE_NAMES::STDERR_READ) {
-                                // the child's stderr pipe is readable
-                                write_all(stderr_log_fh->_fileno, buf, byte_count);
-                                write_all(STDERR_FILENO, buf, byte_count);
-                            } else {
-                                // this should never happen
-                                perror("Logic error!");
-                                exit(EXIT_FAILURE);
-                            }
-                        }
-                    }
-                    if (watched_fds[this_fd].revents & POLLERR) {
-                        close(watched_fds[this_fd].fd);
-                        break_out = true;
-                    }
-                    if (watched_fds[this_fd].revents & POLLHUP) {
-                        // this pipe has hung up
-                        // don't close the file descriptor yet, there might still be data to read
-                        // instead, remove the POLLIN event to avoid getting a POLLHUP event in the next poll() call
-                        watched_fds[this_fd].events &= ~POLLIN;
-                    }
-                }
+            // the shared reactor copies the child's output to the logs and the console, alongside every other
+            // running child's, until both pipes have ended and the child has exited
+            int fd_child_exit = open_process_fd( pid );
+            OutputCapture capture;
+            capture.add_stream( fd_child_stdout_pipe[READ_END], stdout_log_fh->_fileno, STDOUT_FILENO, stdout_excerpt );
+            capture.add_stream( fd_child_stderr_pipe[READ_END], stderr_log_fh->_fileno, STDERR_FILENO, stderr_excerpt );
+            capture.watch_exit( fd_child_exit, pid, timeout_handle, &outcome );
+            capture.kill_cgroup_on_exit( command_cgroup.kill_fd() );
+            capture.watch_wake( fd_timeout_wake );
+            OutputReactor::shared().capture( capture );
+            outcome.stdout_bytes = capture.bytes_copied( fd_child_stdout_pipe[READ_END] );
+            outcome.stderr_bytes = capture.bytes_copied( fd_child_stderr_pipe[READ_END] );
+
+            // the reactor reaps the child as it exits, but without a pidfd it can't tell when that is
+            if (! outcome.reaped ) {
+                reap_command( pid, timeout_handle, true, outcome );
             }
-            // wait for child to exit, capture status
-            waitpid(pid, &status, 0);
 
-            // Drain the pipes before exiting
-            while ((byte_count = read(fd_child_stdout_pipe[READ_END], buf, BUFFER_SIZE)) > 0) {
-                write_all(stdout_log_fh->_fileno, buf, byte_count);
-                write_all(STDOUT_FILENO, buf, byte_count);
+            // whatever the command left running goes with it, and is counted in what its cgroup measured
+            std::string cgroup_message = command_cgroup.finish( outcome );
+            if (! cgroup_message.empty() ) {
+                LogWriter::shared().append( stderr_log_fh->_fileno, cgroup_message.c_str(), cgroup_message.size() );
+                write_all( STDERR_FILENO, cgroup_message.c_str(), cgroup_message.size() );
             }
-            while ((byte_count = read(fd_child_stderr_pipe[READ_END], buf, BUFFER_SIZE)) > 0) {
-                write_all(stderr_log_fh->_fileno, buf, byte_count);
-                write_all(STDERR_FILENO, buf, byte_count);
+            if ( fd_timeout_wake != -1 ) {
+                close( fd_timeout_wake );
             }
 
-            if WIFEXITED(status) {
-                return WEXITSTATUS(status);
-            } else {
-                return -617;
+            close(fd_child_stdout_pipe[READ_END]);
+            close(fd_child_stderr_pipe[READ_END]);
+            if ( fd_child_exit != -1 ) {
+                close( fd_child_exit );
             }
+
+            return outcome_return_code( outcome );
         }
     }
 }
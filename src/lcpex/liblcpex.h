@@ -14,6 +14,14 @@
 #include "vpty/pty_fork_mod/tty_functions.h"
 #include "vpty/pty_fork_mod/pty_fork.h"
 #include "vpty/libclpex_tty.h"
+#include "TimeoutWheel.h"
+#include "Spawn.h"
+#include "OutputReactor.h"
+#include "LogWriter.h"
+#include "EnvironmentCache.h"
+#include "ShellSession.h"
+#include "Cgroup.h"
+#include <sys/eventfd.h>
 
 
 /**
@@ -22,7 +30,19 @@
  * @param context_override Indicates whether to override the current execution context
  * @param context_user The user to switch to for execution context
  * @param context_group The group to switch to for execution context
+ * @param set_working_directory Indicates whether the child should change its working directory before executing
+ * @param working_directory The working directory for the child process
+ * @param timeout_seconds The time the command has to finish, or 0 to wait indefinitely
+ * @param kill_grace_seconds The time between sending the command SIGTERM and SIGKILL once it times out
  * @param processed_command The command to be executed, after processing
+ * @param environment_supplied Indicates whether environment_variables is the command's complete environment, as captured
+ *                             from an environment file, rather than additions to this process's
+ * @param environment_variables NAME=value assignments added to the environment the command inherits, or the whole of it
+ * @param stdout_excerpt Keeps the beginning and end of the command's stdout, or nullptr
+ * @param stderr_excerpt Keeps the beginning and end of the command's stderr, or nullptr
+ * @param cgroup The transient cgroup the command runs in, if enabled
+ * @param outcome Receives how the command ended: its wait status, including the signal that terminated it, and its
+ *                resource usage, collected with wait4() as soon as it exits
  * @param fd_child_stdout_pipe The file descriptor for the child process's standard output pipe
  * @param fd_child_stderr_pipe The file descriptor for the child process's standard error pipe
  *
@@ -31,11 +51,23 @@
  *
  * The function first redirects the child process's standard output and standard error to pipes.
  *
- * If context_override is set to true, the child process sets its identity context using the set_identity_context() function.
- * If an error occurs while setting the identity context, a message will be displayed and the process will exit.
+ * The working directory is only ever changed in the child, so concurrently executing Tasks do not disturb each other.
+ *
+ * A command with a timeout runs in its own process group, so that it and everything it started can be signalled
+ * together.
+ *
+ * A command run in a cgroup of its own joins it before it starts anything.  Once it exits, everything it left running
+ * in the cgroup is killed, and the cgroup's measurements of the whole tree are added to outcome before it is removed.
+ *
+ * The child is started with spawn_process(), which does not copy the parent's page tables, so launching stays cheap
+ * however large Rex grows.  The identity named by context_user and context_group is resolved before the child is
+ * started, and the child only applies the numeric IDs.
+ *
+ * The command is split into arguments by CommandArgv, as a shell would split a simple command but without starting
+ * one.  A command that can't be split, or that splits into nothing, fails with a message instead of starting.
  *
  * Finally, the child process calls execvp() with the processed_command to run the shell command.
- * If the execvp() function fails, an error message is displayed.
+ * If the child gives up before or at execvp(), the reason is written to its stderr on its behalf.
  */
 int execute(
         std::string command,
@@ -44,7 +76,16 @@ int execute(
         bool context_override,
         std::string context_user,
         std::string context_group,
-        bool environment_supplied
+        bool set_working_directory,
+        std::string working_directory,
+        int timeout_seconds,
+        int kill_grace_seconds,
+        bool environment_supplied,
+        const std::vector<std::string> & environment_variables,
+        OutputExcerpt * stdout_excerpt,
+        OutputExcerpt * stderr_excerpt,
+        const CgroupSettings & cgroup,
+        CommandOutcome & outcome
 );
 
 
@@ -57,6 +98,10 @@ int execute(
  * @param context_override Indicates whether to override the current execution context
  * @param context_user The user to switch to for execution context
  * @param context_group The group to switch to for execution context
+ * @param set_working_directory Indicates whether the child should change its working directory before executing
+ * @param working_directory The working directory for the child process
+ * @param timeout_seconds The time the command has to finish, or 0 to wait indefinitely
+ * @param kill_grace_seconds The time between sending the command SIGTERM and SIGKILL once it times out
  * @param force_pty Indicates whether to force a pseudoterminal (pty) for the command execution
  * @param is_shell_command Indicates whether the command is a shell command
  * @param shell_path The path to the shell executable
@@ -64,8 +109,21 @@ int execute(
  * @param supply_environment Indicates whether to supply an environment
  * @param shell_source_subcommand The shell subcommand used to source the environment file
  * @param environment_file_path The path to the environment file
+ * @param environment_variables NAME=value assignments added to the environment the command inherits
+ * @param shell_session Indicates whether a shell command may run in a long-lived shell from the ShellSessionPool
+ * @param stdout_excerpt Keeps the beginning and end of the command's stdout, for reporting a failure, or nullptr
+ * @param stderr_excerpt Keeps the beginning and end of the command's stderr, or nullptr
+ * @param cgroup The transient cgroup the command runs in, if enabled
+ * @param outcome Receives how the command ended.  A command run in a shell session is not reaped by Rex, so only its
+ *                running time is known.
+ *
+ * @return The exit status of the executed command, LCPEX_SIGNALLED if it was terminated by a signal, which outcome
+ *         names, or LCPEX_TIMED_OUT if it outran its timeout
  *
- * @return The exit status of the executed command
+ * An environment file is sourced once per run and the command given the environment it produced, through the
+ * EnvironmentCache; the command only sources the file itself if that fails.  A shell command allowed a shell session
+ * runs in one if it has no timeout, doesn't need a pty or a cgroup, and its environment file was captured; otherwise,
+ * or if no session can take it, it gets a shell of its own.
  *
  * This function executes a command with logging and optional context switching. The function generates
  * a prefix for the command using the `prefix_generator` function, which sets up a shell execution if
@@ -81,13 +139,23 @@ int lcpex(
         bool context_override,
         std::string context_user,
         std::string context_group,
+        bool set_working_directory,
+        std::string working_directory,
+        int timeout_seconds,
+        int kill_grace_seconds,
         bool force_pty,
         bool is_shell_command,
         std::string shell_path,
         std::string shell_execution_arg,
         bool supply_environment,
         std::string shell_source_subcommand,
-        std::string environment_file_path
+        std::string environment_file_path,
+        const std::vector<std::string> & environment_variables,
+        bool shell_session,
+        OutputExcerpt * stdout_excerpt,
+        OutputExcerpt * stderr_excerpt,
+        const CgroupSettings & cgroup,
+        CommandOutcome & outcome
 );
 
 /**
@@ -1,26 +1,503 @@
 #include "string_expansion.h"
+#include <glob.h>
+#include <pwd.h>
+#include <unistd.h>
 
 
+// the start of a parameter name, and the rest of it
+static bool name_start( char character )
+{
+    return character == '_' || ( character >= 'a' && character <= 'z' ) || ( character >= 'A' && character <= 'Z' );
+}
+
+static bool name_character( char character )
+{
+    return name_start( character ) || ( character >= '0' && character <= '9' );
+}
+
+// a character of a login name in a tilde-prefix
+static bool login_character( char character )
+{
+    return name_character( character ) || character == '.' || character == '-';
+}
+
+// what a backslash escapes inside double quotes.  before any other character it is kept.
+static bool escapable_in_double_quotes( char character )
+{
+    return character == '$' || character == '`' || character == '"' || character == '\\' || character == '\n';
+}
+
+// what splitting a command line has to stop at, outside quotes
+static bool special_character( char character )
+{
+    switch ( character ) {
+        case ' ': case '\t': case '\n': case '|': case '&': case ';': case '<': case '>': case '(': case ')': case '{':
+        case '}': case '`': case '\\': case '\'': case '"': case '$': case '~':
+            return true;
+        default:
+            return false;
+    }
+}
 
-// convert a string to a char** representing our artificial argv to be consumed by execvp
-char ** expand_env(const std::string& var, int flags )
+// what means something in a pattern
+static bool pattern_character( char character )
 {
-    std::vector<std::string> vars;
+    return character == '*' || character == '?' || character == '[' || character == ']' || character == '\\';
+}
 
-    wordexp_t p;
-    if(!wordexp(var.c_str(), &p, flags))
-    {
-        if(p.we_wordc)
-            for(char** exp = p.we_wordv; *exp; ++exp)
-                vars.push_back(exp[0]);
-        wordfree(&p);
+// the value of a parameter.  there are no positional parameters, as in a shell given no arguments.
+static std::string parameter_value( const std::string & name )
+{
+    if ( name == "$" ) {
+        return std::to_string( getpid() );
     }
+    if ( name == "#" ) {
+        return "0";
+    }
+    if ( name == "*" || name == "@" || ( name[0] >= '0' && name[0] <= '9' ) ) {
+        return "";
+    }
+    const char * value = getenv( name.c_str() );
+    return value == nullptr ? "" : value;
+}
+
+
+CommandArgv::CommandArgv() : word_open( false ), word_globs( false ), word_begin( 0 ), first_word( true ), deferred( false )
+{
+    this->pointers.push_back( nullptr );
+}
+
+bool CommandArgv::split( const std::string & command, std::string & error )
+{
+    this->storage.clear();
+    this->starts.clear();
+    this->pointers.clear();
+
+    const char * ifs = getenv( "IFS" );
+    memset( this->separator, SEPARATOR_NONE, sizeof( this->separator ) );
+    for ( const char * c = ifs == nullptr ? " \t\n" : ifs; *c != '\0'; c++ ) {
+        this->separator[ (unsigned char) *c ] = ( *c == ' ' || *c == '\t' || *c == '\n' ) ? SEPARATOR_WHITE : SEPARATOR_OTHER;
+    }
+
+    SPLIT_RESULT result = this->split_words( command, error );
+    if ( result == SPLIT_DEFERRED ) {
+        this->storage.clear();
+        this->starts.clear();
+        result = this->split_wordexp( command, error ) ? SPLIT_DONE : SPLIT_FAILED;
+    }
+    if ( result == SPLIT_FAILED ) {
+        this->storage.clear();
+        this->starts.clear();
+    }
+
+    // storage has stopped growing, so the arguments stay where they are
+    for ( size_t i = 0; i < this->starts.size(); i++ ) {
+        this->pointers.push_back( &this->storage[ this->starts[i] ] );
+    }
+    this->pointers.push_back( nullptr );
+    return result == SPLIT_DONE;
+}
+
+char ** CommandArgv::argv()
+{
+    return this->pointers.data();
+}
+
+size_t CommandArgv::size() const
+{
+    return this->pointers.size() - 1;
+}
+
+CommandArgv::SPLIT_RESULT CommandArgv::split_words( const std::string & command, std::string & error )
+{
+    this->word.clear();
+    this->pattern.clear();
+    this->word_open = false;
+    this->word_globs = false;
+
+    this->word_begin = 0;
+    this->first_word = true;
+    this->deferred = false;
+
+    size_t length = command.size();
+    size_t position = 0;
+    while ( position < length ) {
+        char character = command[position];
+        switch ( character ) {
+            case ' ':
+            case '\t':
+                this->end_word();
+                if ( position > this->word_begin ) {
+                    this->first_word = false;
+                }
+                this->word_begin = ++position;
+                break;
+
+            // what would make this more than a simple command
+            case '\n':
+            case '|':
+            case '&':
+            case ';':
+            case '<':
+            case '>':
+            case '(':
+            case ')':
+            case '{':
+            case '}':
+                error = "unquoted " + ( character == '\n' ? std::string( "newline" ) : "'" + std::string( 1, character ) + "'" ) + " at offset " + std::to_string( position );
+                return SPLIT_FAILED;
+
+            case '`':
+                error = "command substitution at offset " + std::to_string( position ) + " is not supported";
+                return SPLIT_FAILED;
+
+            case '\\':
+                if ( position + 1 == length ) {
+                    error = "trailing backslash";
+                    return SPLIT_FAILED;
+                }
+                // an escaped newline joins the lines either side of it
+                if ( command[position + 1] != '\n' ) {
+                    this->add_character( command[position + 1], true );
+                }
+                position += 2;
+                break;
+
+            case '\'':
+            {
+                size_t end = command.find( '\'', position + 1 );
+                if ( end == std::string::npos ) {
+                    error = "unterminated single quote at offset " + std::to_string( position );
+                    return SPLIT_FAILED;
+                }
+                this->word_open = true;
+                this->add_run( command.data() + position + 1, end - position - 1, true );
+                position = end + 1;
+                break;
+            }
+
+            case '"':
+            {
+                size_t opened = position++;
+                this->word_open = true;
+                while ( true ) {
+                    if ( position == length ) {
+                        error = "unterminated double quote at offset " + std::to_string( opened );
+                        return SPLIT_FAILED;
+                    }
+                    char quoted = command[position];
+                    if ( quoted == '"' ) {
+                        position++;
+                        break;
+                    }
+                    if ( quoted == '\\' && position + 1 < length && escapable_in_double_quotes( command[position + 1] ) ) {
+                        if ( command[position + 1] != '\n' ) {
+                            this->add_character( command[position + 1], true );
+                        }
+                        position += 2;
+                    } else if ( quoted == '$' ) {
+                        SPLIT_RESULT result = this->expand_parameter( command, position, true, error );
+                        if ( result != SPLIT_DONE ) {
+                            return result;
+                        }
+                    } else if ( quoted == '`' ) {
+                        error = "command substitution at offset " + std::to_string( position ) + " is not supported";
+                        return SPLIT_FAILED;
+                    } else {
+                        size_t end = position + 1;
+                        while ( end < length && command[end] != '"' && command[end] != '\\' && command[end] != '$' && command[end] != '`' ) { end++; }
+                        this->add_run( command.data() + position, end - position, true );
+                        position = end;
+                    }
+                }
+                break;
+            }
+
+            case '$':
+            {
+                SPLIT_RESULT result = this->expand_parameter( command, position, false, error );
+                if ( result != SPLIT_DONE ) {
+                    return result;
+                }
+                break;
+            }
+
+            case '~':
+                if ( this->expand_tilde( command, position ) ) {
+                    break;
+                }
+                this->add_character( character, false );
+                position++;
+                break;
 
-    char ** arr = new char*[vars.size() + 1];
-    for(size_t i = 0; i < vars.size(); i++){
-        arr[i] = new char[vars[i].size() + 1];
-        strcpy(arr[i], vars[i].c_str());
+            default:
+            {
+                // everything up to the next character that means something is taken as it is
+                size_t end = position + 1;
+                while ( end < length && ! special_character( command[end] ) ) { end++; }
+                this->add_run( command.data() + position, end - position, false );
+                position = end;
+            }
+        }
+    }
+    this->end_word();
+    return this->deferred ? SPLIT_DEFERRED : SPLIT_DONE;
+}
+
+CommandArgv::SPLIT_RESULT CommandArgv::expand_parameter( const std::string & command, size_t & position, bool quoted, std::string & error )
+{
+    size_t length = command.size();
+    size_t next = position + 1;
+    char character = next < length ? command[next] : '\0';
+    std::string name;
+
+    if ( character == '{' ) {
+        size_t start = next + 1;
+        size_t end = start;
+        if ( end < length && name_start( command[end] ) ) {
+            while ( end < length && name_character( command[end] ) ) { end++; }
+        } else if ( end < length && command[end] >= '0' && command[end] <= '9' ) {
+            while ( end < length && command[end] >= '0' && command[end] <= '9' ) { end++; }
+        } else if ( end < length && ( command[end] == '$' || command[end] == '*' || command[end] == '@' ) ) {
+            end++;
+        } else if ( end + 1 < length && command[end] == '#' && command[end + 1] == '}' ) {
+            end++;
+        } else if ( end < length && command[end] == '#' ) {
+            // the length of a parameter
+            return this->defer( command, position, "}", error );
+        }
+        if ( end == length ) {
+            error = "unterminated '${' at offset " + std::to_string( position );
+            return SPLIT_FAILED;
+        }
+        if ( command[end] != '}' || end == start ) {
+            // a parameter with an operator, such as ${NAME:-word}
+            if ( end > start && strchr( ":-=?+%#/^,", command[end] ) != nullptr ) {
+                return this->defer( command, position, "}", error );
+            }
+            error = "bad substitution at offset " + std::to_string( position );
+            return SPLIT_FAILED;
+        }
+        name = command.substr( start, end - start );
+        position = end + 1;
+    } else if ( character == '(' ) {
+        // arithmetic expansion
+        if ( next + 1 < length && command[next + 1] == '(' ) {
+            return this->defer( command, position, "))", error );
+        }
+        error = "command substitution at offset " + std::to_string( position ) + " is not supported";
+        return SPLIT_FAILED;
+    } else if ( name_start( character ) ) {
+        size_t end = next;
+        while ( end < length && name_character( command[end] ) ) { end++; }
+        name = command.substr( next, end - next );
+        position = end;
+    } else if ( ( character >= '0' && character <= '9' ) || character == '$' || character == '*' || character == '@' || character == '#' ) {
+        name = std::string( 1, character );
+        position = next + 1;
+    } else {
+        // a '$' that starts nothing is just a '$'
+        this->add_character( '$', quoted );
+        position = next;
+        return SPLIT_DONE;
+    }
+
+    this->add_expansion( parameter_value( name ), quoted );
+    return SPLIT_DONE;
+}
+
+CommandArgv::SPLIT_RESULT CommandArgv::defer( const std::string & command, size_t & position, const char * terminator, std::string & error )
+{
+    size_t end = command.find( terminator, position + 2 );
+    if ( end == std::string::npos ) {
+        error = "unterminated '" + command.substr( position, 2 ) + "' at offset " + std::to_string( position );
+        return SPLIT_FAILED;
+    }
+    position = end + strlen( terminator );
+    this->deferred = true;
+    return SPLIT_DONE;
+}
+
+bool CommandArgv::expand_tilde( const std::string & command, size_t & position )
+{
+    // at the start of a word of the command line, or, as wordexp() does, after the '=' or a ':' of an assignment in
+    // the first
+    if ( position != this->word_begin ) {
+        size_t name_end = this->word_begin;
+        while ( name_end < position && name_character( command[name_end] ) ) { name_end++; }
+        bool assignment = this->first_word && name_end > this->word_begin && name_start( command[this->word_begin] ) && name_end < position && command[name_end] == '=';
+        if (! assignment || ( command[position - 1] != '=' && command[position - 1] != ':' ) ) {
+            return false;
+        }
+    }
+
+    // a tilde-prefix with anything quoted or expanded in it is left as it is
+    size_t length = command.size();
+    size_t end = position + 1;
+    while ( end < length && login_character( command[end] ) ) { end++; }
+    if ( end < length && command[end] != '/' && command[end] != ':' && command[end] != ' ' && command[end] != '\t' ) {
+        return false;
+    }
+
+    std::string home;
+    if ( end == position + 1 && getenv( "HOME" ) != nullptr ) {
+        home = getenv( "HOME" );
+    } else {
+        long buffer_size = sysconf( _SC_GETPW_R_SIZE_MAX );
+        std::vector<char> buffer( buffer_size > 0 ? buffer_size : 16384 );
+        struct passwd entry;
+        struct passwd * found = nullptr;
+        if ( end == position + 1 ) {
+            getpwuid_r( getuid(), &entry, buffer.data(), buffer.size(), &found );
+        } else {
+            std::string login = command.substr( position + 1, end - position - 1 );
+            getpwnam_r( login.c_str(), &entry, buffer.data(), buffer.size(), &found );
+        }
+        if ( found == nullptr ) {
+            return false;
+        }
+        home = found->pw_dir;
+    }
+
+    // the directory is taken as it is, neither split nor matched as a pattern
+    this->word_open = true;
+    this->add_run( home.data(), home.size(), true );
+    position = end;
+    return true;
+}
+
+void CommandArgv::add_character( char character, bool quoted )
+{
+    this->word_open = true;
+    this->word += character;
+    if ( quoted && ( character == '*' || character == '?' || character == '[' || character == ']' ) ) {
+        this->pattern += '\\';
+    } else if (! quoted && ( character == '*' || character == '?' || character == '[' ) ) {
+        this->word_globs = true;
+    }
+    // only an expansion can leave an unquoted backslash, which matches itself
+    if ( character == '\\' ) {
+        this->pattern += '\\';
+    }
+    this->pattern += character;
+}
+
+void CommandArgv::add_run( const char * run, size_t length, bool quoted )
+{
+    // up to the first character that means something to glob(), the run is added as it is.  from there on characters
+    // are added one at a time, so that they are escaped or noticed.
+    size_t plain = 0;
+    while ( plain < length && ! pattern_character( run[plain] ) ) {
+        plain++;
+    }
+    this->word_open = true;
+    this->word.append( run, plain );
+    this->pattern.append( run, plain );
+    for ( size_t i = plain; i < length; i++ ) {
+        this->add_character( run[i], quoted );
+    }
+}
+
+void CommandArgv::add_expansion( const std::string & value, bool quoted )
+{
+    if ( quoted ) {
+        this->add_run( value.data(), value.size(), true );
+        return;
+    }
+
+    // IFS whitespace separates fields.  any other IFS character ends one, along with the whitespace around it, and
+    // so makes an empty field where there is nothing else between two of them.
+    bool delimited_by_white = false;
+    size_t length = value.size();
+    size_t position = 0;
+    while ( position < length ) {
+        unsigned char separator = this->separator[ (unsigned char) value[position] ];
+        if ( separator == SEPARATOR_WHITE ) {
+            if ( this->word_open ) {
+                this->end_word();
+                delimited_by_white = true;
+            }
+            position++;
+        } else if ( separator == SEPARATOR_OTHER ) {
+            if ( this->word_open ) {
+                this->end_word();
+            } else if (! delimited_by_white ) {
+                this->push_word( "", 0 );
+            }
+            delimited_by_white = false;
+            position++;
+        } else {
+            size_t end = position + 1;
+            while ( end < length && this->separator[ (unsigned char) value[end] ] == SEPARATOR_NONE ) { end++; }
+            this->add_run( value.data() + position, end - position, false );
+            delimited_by_white = false;
+            position = end;
+        }
+    }
+}
+
+void CommandArgv::end_word()
+{
+    if (! this->word_open ) {
+        return;
+    }
+
+    // a pattern that matches nothing is left as it is
+    bool matched = false;
+    if ( this->word_globs ) {
+        glob_t matches;
+        memset( &matches, 0, sizeof( matches ) );
+        if ( glob( this->pattern.c_str(), 0, nullptr, &matches ) == 0 ) {
+            for ( size_t i = 0; i < matches.gl_pathc; i++ ) {
+                this->push_word( matches.gl_pathv[i], strlen( matches.gl_pathv[i] ) );
+            }
+            matched = true;
+        }
+        globfree( &matches );
+    }
+    if (! matched ) {
+        this->push_word( this->word.data(), this->word.size() );
+    }
+
+    this->word.clear();
+    this->pattern.clear();
+    this->word_open = false;
+    this->word_globs = false;
+}
+
+void CommandArgv::push_word( const char * word, size_t length )
+{
+    this->starts.push_back( this->storage.size() );
+    this->storage.append( word, length );
+    this->storage.push_back( '\0' );
+}
+
+bool CommandArgv::split_wordexp( const std::string & command, std::string & error )
+{
+    wordexp_t expansion;
+    int result = wordexp( command.c_str(), &expansion, WRDE_NOCMD );
+    switch ( result ) {
+        case 0:
+            for ( size_t i = 0; i < expansion.we_wordc; i++ ) {
+                this->push_word( expansion.we_wordv[i], strlen( expansion.we_wordv[i] ) );
+            }
+            wordfree( &expansion );
+            return true;
+        case WRDE_BADCHAR:
+            error = "unquoted special character";
+            return false;
+        case WRDE_CMDSUB:
+            error = "command substitution is not supported";
+            return false;
+        case WRDE_SYNTAX:
+            error = "syntax error";
+            return false;
+        case WRDE_NOSPACE:
+            wordfree( &expansion );
+            error = "out of memory";
+            return false;
+        default:
+            error = "wordexp() failed with " + std::to_string( result );
+            return false;
     }
-    arr[vars.size()] = (char * ) nullptr;
-    return arr;
 }
@@ -4,26 +4,118 @@
 #include <wordexp.h>
 #include <vector>
 #include <cstring>
+#include <string>
 #include <iostream>
 
 /**
- * @brief Convert a string to a 'char**' representing an argument list
+ * @brief Splits a command line into an argument list, the way a POSIX shell splits the words of a simple command
  *
- * This function takes a string 'var' and converts it into a 'char**'
- * representing an argument list. The argument list can be consumed by
- * functions like 'execvp'.
+ * Handles single and double quotes, backslash escapes, `$NAME` and `${NAME}` from this process's environment, `$$`,
+ * tilde expansion, field splitting of unquoted expansions on IFS, and pathname expansion of unquoted patterns that
+ * match something.  No shell is started: command substitution is refused, and the unquoted characters that would make
+ * the line more than a simple command are refused as wordexp() refuses them.  Positional parameters expand to nothing,
+ * as in a shell given no arguments.  The rarer parameter expansions with operators, such as `${NAME:-word}`, and
+ * arithmetic expansion, are left to wordexp(), without command substitution.
  *
- * @param[in] var The string to be converted
- * @param[in] flags Flags controlling the behavior of the conversion
- *
- * @return A 'char**' representing the argument list
- *
- * The function uses the 'wordexp' function to perform the conversion. The
- * 'flags' argument controls the behavior of the 'wordexp' function. The
- * returned 'char**' is dynamically allocated, and must be freed by the
- * caller using 'delete[]'.
+ * The arguments belong to the object, and last until the next split() or until it is destroyed.  An object can be
+ * reused: each split() keeps the memory the last one took.
  */
-char ** expand_env(const std::string& var, int flags = 0);
+class CommandArgv
+{
+    public:
+        CommandArgv();
+
+        // argv() points into the object
+        CommandArgv( const CommandArgv & ) = delete;
+        CommandArgv & operator=( const CommandArgv & ) = delete;
+
+        /**
+         * @brief Split a command line, replacing whatever the last split() produced
+         *
+         * @param[in] command The command line.
+         * @param[out] error Why the command line couldn't be split, if it couldn't.
+         *
+         * @return True if it was split, even if into no arguments at all.
+         */
+        bool split( const std::string & command, std::string & error );
+
+        /**
+         * @brief The arguments, as execvp() takes them
+         *
+         * @return The arguments, followed by a null pointer.
+         */
+        char ** argv();
+
+        /**
+         * @brief The number of arguments
+         */
+        size_t size() const;
+
+    private:
+        // how far splitting got
+        enum SPLIT_RESULT { SPLIT_DONE, SPLIT_FAILED, SPLIT_DEFERRED };
+
+        // split everything but what is left to wordexp().  the whole line is checked before anything is left to it,
+        // as wordexp() can crash on some malformed lines.
+        SPLIT_RESULT split_words( const std::string & command, std::string & error );
+
+        // split with wordexp(), for what split_words() doesn't handle
+        bool split_wordexp( const std::string & command, std::string & error );
+
+        // expand the parameter whose '$' is at position, leaving position after it
+        SPLIT_RESULT expand_parameter( const std::string & command, size_t & position, bool quoted, std::string & error );
+
+        // skip the expansion at position, up to its terminator, and leave the line to wordexp()
+        SPLIT_RESULT defer( const std::string & command, size_t & position, const char * terminator, std::string & error );
+
+        // expand the tilde-prefix at position, if there is one to expand, leaving position after it
+        bool expand_tilde( const std::string & command, size_t & position );
+
+        // add a character to the argument being put together.  unquoted ones may be part of a pattern.
+        void add_character( char character, bool quoted );
+
+        // add a run of characters, quoted or not, to the argument being put together
+        void add_run( const char * run, size_t length, bool quoted );
+
+        // add the value of an expansion to the argument being put together, splitting it into fields if unquoted
+        void add_expansion( const std::string & value, bool quoted );
+
+        // finish the argument being put together, if one has been started
+        void end_word();
+
+        // add a finished argument
+        void push_word( const char * word, size_t length );
+
+        // every argument, each followed by a NUL
+        std::string storage;
+
+        // where each argument starts in storage
+        std::vector<size_t> starts;
+
+        // the arguments, as execvp() takes them, once splitting is done
+        std::vector<char *> pointers;
+
+        // the argument being put together, and the same as a pattern, with its quoted characters escaped
+        std::string word;
+        std::string pattern;
+
+        // an argument has been started, if only by an empty pair of quotes
+        bool word_open;
+
+        // the argument has an unquoted '*', '?' or '['
+        bool word_globs;
+
+        // where the word of the command line being split began, and whether it is the first
+        size_t word_begin;
+        bool first_word;
+
+        // the line has something only wordexp() can expand
+        bool deferred;
+
+        // what each character is in IFS: not in it, IFS whitespace, or another field separator
+        enum SEPARATOR { SEPARATOR_NONE = 0, SEPARATOR_WHITE, SEPARATOR_OTHER };
+        unsigned char separator[256];
+};
 
 
 #endif //LCPEX_STRING_EXPANSION_H
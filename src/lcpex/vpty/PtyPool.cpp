@@ -0,0 +1,135 @@
+#include "PtyPool.h"
+#include "pty_fork_mod/pty_fork.h"
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+PtyPool & PtyPool::shared()
+{
+    static PtyPool pool;
+    return pool;
+}
+
+PtyPool::PtyPool() : capacity( 0 ), counters()
+{
+}
+
+// lock or unlock a master's slave, so that nothing can open it while the master waits in the pool
+static int lock_slave( int master_fd, bool locked )
+{
+#ifdef TIOCSPTLCK
+    int lock = locked ? 1 : 0;
+    return ioctl( master_fd, TIOCSPTLCK, &lock );
+#else
+    return locked ? 0 : unlockpt( master_fd );
+#endif
+}
+
+bool PtyPool::open_master( Master & master )
+{
+    char slave_name[MAX_SNAME];
+    master.fd = ptyMasterOpen( slave_name, MAX_SNAME );
+    if ( master.fd == -1 ) {
+        return false;
+    }
+    master.slave_name = slave_name;
+
+    std::lock_guard<std::mutex> guard( this->lock );
+    this->counters.opened++;
+    return true;
+}
+
+size_t PtyPool::prepare( size_t size )
+{
+    std::unique_lock<std::mutex> guard( this->lock );
+    this->capacity = size;
+    while ( this->idle.size() < size ) {
+        guard.unlock();
+        Master master;
+        bool opened = this->open_master( master );
+        guard.lock();
+        if (! opened ) {
+            break;
+        }
+        lock_slave( master.fd, true );
+        this->idle.push_back( master );
+    }
+    return this->idle.size();
+}
+
+int PtyPool::open( int & master_fd, int & slave_fd, const struct termios * attributes, const struct winsize * window )
+{
+    Master master;
+    bool pooled = false;
+    {
+        std::lock_guard<std::mutex> guard( this->lock );
+        if (! this->idle.empty() ) {
+            master = this->idle.back();
+            this->idle.pop_back();
+            this->counters.pooled++;
+            pooled = true;
+        }
+    }
+    if (! pooled && ! this->open_master( master ) ) {
+        return -1;
+    }
+    if ( pooled && lock_slave( master.fd, false ) == -1 ) {
+        int saved_errno = errno;
+        close( master.fd );
+        errno = saved_errno;
+        return -1;
+    }
+
+    // not our controlling tty: the child acquires it once it leads a session
+    int fd = ::open( master.slave_name.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC );
+    if ( fd == -1 || tcsetattr( fd, TCSANOW, attributes ) == -1 || ioctl( fd, TIOCSWINSZ, window ) == -1 ) {
+        int saved_errno = errno;
+        if ( fd != -1 ) {
+            close( fd );
+        }
+        close( master.fd );
+        errno = saved_errno;
+        return -1;
+    }
+
+    master_fd = master.fd;
+    slave_fd = fd;
+    return 0;
+}
+
+void PtyPool::release( int master_fd )
+{
+    // with no slave open a master's reads fail with EIO at once.  anything else means something still holds the slave,
+    // or wrote to it after the command's output was drained.
+    int flags = fcntl( master_fd, F_GETFL );
+    fcntl( master_fd, F_SETFL, flags | O_NONBLOCK );
+    char probe;
+    bool hung_up = read( master_fd, &probe, 1 ) == -1 && errno == EIO;
+    fcntl( master_fd, F_SETFL, flags );
+
+    char slave_name[MAX_SNAME];
+    if ( hung_up && ptsname_r( master_fd, slave_name, MAX_SNAME ) == 0 && lock_slave( master_fd, true ) == 0 ) {
+        tcflush( master_fd, TCIOFLUSH );
+
+        std::lock_guard<std::mutex> guard( this->lock );
+        if ( this->idle.size() < this->capacity ) {
+            Master master;
+            master.fd = master_fd;
+            master.slave_name = slave_name;
+            this->idle.push_back( master );
+            this->counters.kept++;
+            return;
+        }
+    } else {
+        std::lock_guard<std::mutex> guard( this->lock );
+        this->counters.discarded++;
+    }
+    close( master_fd );
+}
+
+PtyPoolStats PtyPool::stats()
+{
+    std::lock_guard<std::mutex> guard( this->lock );
+    return this->counters;
+}
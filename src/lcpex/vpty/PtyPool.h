@@ -0,0 +1,94 @@
+#ifndef LCPEX_PTYPOOL_H
+#define LCPEX_PTYPOOL_H
+
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// how the pty pool has been used so far
+struct PtyPoolStats {
+    // masters opened, and of the masters handed out, those that were waiting in the pool
+    unsigned long long opened;
+    unsigned long long pooled;
+    // masters given back and kept for another command, and those closed because something still held their slave
+    unsigned long long kept;
+    unsigned long long discarded;
+};
+
+/**
+ * @brief Keeps pseudo-terminal masters open and ready, so commands forcing a PTY don't each open one as they start.
+ *
+ * Masters are opened and granted ahead of time by prepare(), and handed out by open() alongside a freshly
+ * opened slave.  A master given back is kept for another command only once nothing holds its slave any more, which its
+ * reads failing with EIO shows, and after whatever was left queued on it has been flushed.  One whose slave is still
+ * held, by something the command left running, is closed, so another command never sees that output.  While a master
+ * waits in the pool its slave is locked, so nothing can open it in the meantime.
+ */
+class PtyPool
+{
+    public:
+        /**
+         * @brief The pool shared by every command.
+         */
+        static PtyPool & shared();
+
+        /**
+         * @brief Open masters until the pool holds some number of them, and keep that many given back from now on.
+         *
+         * @param size The number of masters to hold.
+         *
+         * @return The number of masters the pool holds, which is less than size if the system ran out.
+         */
+        size_t prepare( size_t size );
+
+        /**
+         * @brief Get a pseudo-terminal pair, taking the master from the pool if it has one.
+         *
+         * Both descriptors are close-on-exec, and the slave is not made the caller's controlling terminal.
+         *
+         * @param master_fd Receives the master.  Give it back with release() rather than closing it.
+         * @param slave_fd Receives the slave.
+         * @param attributes The slave's terminal attributes.
+         * @param window The slave's window size.
+         *
+         * @return 0 on success, or -1 with errno set.
+         */
+        int open( int & master_fd, int & slave_fd, const struct termios * attributes, const struct winsize * window );
+
+        /**
+         * @brief Give back a master from open(), once every copy of its slave the caller had is closed.
+         *
+         * @param master_fd The master.  It is kept or closed: either way the caller is done with it.
+         */
+        void release( int master_fd );
+
+        /**
+         * @brief How the pool has been used so far.
+         */
+        PtyPoolStats stats();
+
+    private:
+        PtyPool();
+
+        // a master nobody is using, with the path of its slave
+        struct Master {
+            int fd;
+            std::string slave_name;
+        };
+
+        // open, grant and unlock a master.  returns false with errno set if it can't be.
+        bool open_master( Master & master );
+
+        std::mutex lock;
+
+        std::vector<Master> idle;
+
+        // the most masters kept
+        size_t capacity;
+
+        PtyPoolStats counters;
+};
+
+#endif //LCPEX_PTYPOOL_H
@@ -18,74 +18,46 @@ void safe_perror( const char * msg, struct termios * ttyOrig )
     exit(1);
 }
 
-
-/**
- * @brief Executes the child process
- *
- * @param fd_child_stderr_pipe A file descriptor array for the child process's stderr pipe
- * @param processed_command An array of char pointers representing the command and its arguments to be executed
- * @param ttyOrig A pointer to a struct termios representing the original terminal settings
- * @param context_override A flag indicating whether to override the process's execution context
- * @param context_user The username to use for the execution context if `context_override` is `true`
- * @param context_group The group name to use for the execution context if `context_override` is `true`
- *
- * This function takes an array of file descriptors `fd_child_stderr_pipe` for the child process's stderr pipe,
- * an array of char pointers `processed_command` representing the command and its arguments to be executed,
- * a pointer to a struct termios `ttyOrig` representing the original terminal settings,
- * a flag `context_override` indicating whether to override the process's execution context,
- * a string `context_user` representing the username to use for the execution context if `context_override` is `true`,
- * and a string `context_group` representing the group name to use for the execution context if `context_override` is `true`.
- *
- * The function first redirects the child process's stderr to the write end of the stderr pipe.
- * If `context_override` is `true`, the function sets the process's execution context using `set_identity_context()`.
- * If `context_override` is `false`, the function does nothing.
- * Finally, the function executes the command specified in `processed_command` using `execvp()`.
- * If the execution of `execvp()` fails, the function calls `safe_perror()` to print a message and exit the program.
- */
-void run_child_process( int fd_child_stderr_pipe[2], char * processed_command[], struct termios * ttyOrig, bool context_override, std::string context_user, std::string context_group )
+bool pty_headless()
 {
-    // redirect stderr to the write end of the stderr pipe
-    // close the file descriptor STDERR_FILENO if it was previously open, then (re)open it as a copy of
-    while ((dup2(fd_child_stderr_pipe[WRITE_END], STDERR_FILENO) == -1) && (errno == EINTR)) {}
-
-    // close the write end of the stderr pipe
-    close( fd_child_stderr_pipe[WRITE_END] );
-
-    // if the user has specified a context override, set the context
-    if ( context_override )
-    {
-        int context_result = set_identity_context(context_user, context_group);
-        switch (context_result) {
-            case IDENTITY_CONTEXT_ERRORS::ERROR_NONE:
-                break;
-            case IDENTITY_CONTEXT_ERRORS::ERROR_NO_SUCH_USER:
-                std::cerr << "lcpex: Aborting: context user not found: " << context_user << std::endl;
-                exit(1);
-                break;
-            case IDENTITY_CONTEXT_ERRORS::ERROR_NO_SUCH_GROUP:
-                std::cerr << "lcpex: Aborting: context group not found: " << context_group << std::endl;
-                exit(1);
-                break;
-            case IDENTITY_CONTEXT_ERRORS::ERROR_SETGID_FAILED:
-                std::cerr << "lcpex: Aborting: Setting GID failed: " << context_user << "/" << context_group << std::endl;
-                exit(1);
-                break;
-            case IDENTITY_CONTEXT_ERRORS::ERROR_SETUID_FAILED:
-                std::cerr << "lcpex: Aborting: Setting UID failed: " << context_user << "/" << context_group << std::endl;
-                exit(1);
-                break;
-            default:
-                std::cerr << "lcpex: Aborting: Unknown error while setting identity context." << std::endl;
-                exit(1);
-                break;
-        }
-    }
+    static const bool headless = [](){
+        struct termios attributes;
+        struct winsize window;
+        return tcgetattr( STDIN_FILENO, &attributes ) == -1 || ioctl( STDIN_FILENO, TIOCGWINSZ, &window ) == -1;
+    }();
+    return headless;
+}
 
-    // execute the dang command, print to stdout, stderr (of parent), and dump to file for each!!!!
-    // (and capture exit code in parent)
-    int exit_code = execvp( processed_command[0], processed_command );
-    safe_perror("failed on execvp in child", ttyOrig );
-    exit(exit_code);
+// the attributes and window size a headless pty starts with: what `stty sane` leaves a terminal with, at 38400 baud
+static void headless_terminal( struct termios * attributes, struct winsize * window )
+{
+    memset( attributes, 0, sizeof( *attributes ) );
+    attributes->c_iflag = BRKINT | ICRNL | IMAXBEL | IXON;
+#ifdef IUTF8
+    attributes->c_iflag |= IUTF8;
+#endif
+    attributes->c_oflag = OPOST | ONLCR;
+    attributes->c_cflag = CS8 | CREAD | HUPCL;
+    attributes->c_lflag = ISIG | ICANON | IEXTEN | ECHO | ECHOE | ECHOK | ECHOCTL | ECHOKE;
+    attributes->c_cc[VINTR] = 003;
+    attributes->c_cc[VQUIT] = 034;
+    attributes->c_cc[VERASE] = 0177;
+    attributes->c_cc[VKILL] = 025;
+    attributes->c_cc[VEOF] = 004;
+    attributes->c_cc[VSTART] = 021;
+    attributes->c_cc[VSTOP] = 023;
+    attributes->c_cc[VSUSP] = 032;
+    attributes->c_cc[VREPRINT] = 022;
+    attributes->c_cc[VWERASE] = 027;
+    attributes->c_cc[VLNEXT] = 026;
+    attributes->c_cc[VMIN] = 1;
+    attributes->c_cc[VTIME] = 0;
+    cfsetispeed( attributes, B38400 );
+    cfsetospeed( attributes, B38400 );
+
+    memset( window, 0, sizeof( *window ) );
+    window->ws_col = PTY_HEADLESS_COLUMNS;
+    window->ws_row = PTY_HEADLESS_ROWS;
 }
 
 // this does three things:
@@ -99,20 +71,66 @@ int exec_pty(
         bool context_override,
         std::string context_user,
         std::string context_group,
-        bool environment_supplied
+        bool set_working_directory,
+        std::string working_directory,
+        int timeout_seconds,
+        int kill_grace_seconds,
+        bool environment_supplied,
+        const std::vector<std::string> & environment_variables,
+        OutputExcerpt * stdout_excerpt,
+        OutputExcerpt * stderr_excerpt,
+        const CgroupSettings & cgroup,
+        CommandOutcome & outcome
 ) {
     // initialize the terminal settings obj
     struct termios ttyOrig;
 
-    // if the user chose to supply the environment, then we need to clear the environment
-    // before we fork the process, so that the child process will inherit the environment
-    // from the parent process
-    if ( environment_supplied ) {
-        //clearenv();
+    outcome = start_outcome();
+
+    // the child shares our memory until it executes, so its identity is resolved here
+    uid_t context_uid = 0;
+    gid_t context_gid = 0;
+    std::vector<gid_t> context_groups;
+    if ( context_override ) {
+        int context_result = resolve_identity_context( context_user, context_group, context_uid, context_gid, context_groups );
+        if ( context_result != IDENTITY_CONTEXT_ERRORS::ERROR_NONE ) {
+            std::string message = describe_identity_error( context_result, context_user, context_group );
+            LogWriter::shared().append( stderr_log_fh->_fileno, message.c_str(), message.size() );
+            write_all( STDERR_FILENO, message.c_str(), message.size() );
+            return 1;
+        }
+    }
+
+    // the cgroup is ready before the child starts, so nothing the command does escapes its limits
+    CommandCgroup command_cgroup;
+    if ( cgroup.enabled ) {
+        std::string message;
+        if (! command_cgroup.create( cgroup, message ) ) {
+            LogWriter::shared().append( stderr_log_fh->_fileno, message.c_str(), message.size() );
+            write_all( STDERR_FILENO, message.c_str(), message.size() );
+            return 1;
+        }
+    }
+
+    // turn our command string into something execvp can consume.  each thread keeps its own, so the memory the
+    // arguments take is reused from one execution to the next.
+    thread_local CommandArgv processed_command;
+    std::string split_error;
+    if (! processed_command.split( command, split_error ) || processed_command.size() == 0 ) {
+        std::string message = "REX: Aborting: could not split the command into arguments: " + ( split_error.empty() ? std::string( "it is empty" ) : split_error ) + "\n";
+        LogWriter::shared().append( stderr_log_fh->_fileno, message.c_str(), message.size() );
+        write_all( STDERR_FILENO, message.c_str(), message.size() );
+        return 1;
     }
 
-    // turn our command string into something execvp can consume
-    char ** processed_command = expand_env( command );
+    // the child can't allocate, so its environment is put together here: either all of it, as captured from an
+    // environment file, or only what is added to ours
+    std::vector<char *> environment;
+    if ( environment_supplied ) {
+        environment = exact_environment( environment_variables );
+    } else if ( ! environment_variables.empty() ) {
+        environment = child_environment( environment_variables );
+    }
 
     if ( stdout_log_fh == NULL ) {
         safe_perror( "Error opening STDOUT log file.  Aborting.", &ttyOrig );
@@ -128,182 +146,163 @@ int exec_pty(
     // create the pipes for the child process to write and read from using its stderr
     int fd_child_stderr_pipe[2];
 
-    if ( pipe( fd_child_stderr_pipe ) == -1 ) {
+    // using O_CLOEXEC to ensure that the child process closes the file descriptors, set atomically so that a
+    // concurrently spawning Task cannot inherit them
+    if ( pipe2( fd_child_stderr_pipe, O_CLOEXEC ) == -1 ) {
         safe_perror( "child stderr pipe", &ttyOrig );
         exit( 1 );
     }
 
-    // using O_CLOEXEC to ensure that the child process closes the file descriptors
-    if ( fcntl( fd_child_stderr_pipe[READ_END], F_SETFD, FD_CLOEXEC ) == -1 ) { perror("fcntl"); exit(1); }
-
-    //    // same for stderr write
-    if ( fcntl( fd_child_stderr_pipe[WRITE_END], F_SETFD, FD_CLOEXEC ) == -1 ) { perror("fcntl"); exit(1); }
-
-    // status result basket for the parent process to capture the child's exit status
-    int status = 616;
+    // signalled by the timeout wheel once it has killed the child's session
+    int fd_timeout_wake = -1;
+    if ( timeout_seconds > 0 ) {
+        fd_timeout_wake = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+        if ( fd_timeout_wake == -1 ) {
+            safe_perror( "timeout eventfd", &ttyOrig );
+        }
+    }
 
     // start ptyfork integration
-    char slaveName[MAX_SNAME];
     int masterFd;
+    int slaveFd;
     struct winsize ws;
 
-    /* Retrieve the attributes of terminal on which we are started */
-    if (tcgetattr(STDIN_FILENO, &ttyOrig) == -1)
-        safe_perror("tcgetattr", &ttyOrig);
-    if (ioctl(STDIN_FILENO, TIOCGWINSZ, &ws) < 0)
-        safe_perror("ioctl-TIOCGWINSZ", &ttyOrig );
+    // without a terminal to take after, the pty gets one of its own making
+    bool headless = pty_headless();
+    if ( headless ) {
+        headless_terminal( &ttyOrig, &ws );
+    } else {
+        /* Retrieve the attributes of terminal on which we are started */
+        if (tcgetattr(STDIN_FILENO, &ttyOrig) == -1)
+            safe_perror("tcgetattr", &ttyOrig);
+        if (ioctl(STDIN_FILENO, TIOCGWINSZ, &ws) < 0)
+            safe_perror("ioctl-TIOCGWINSZ", &ttyOrig );
+    }
+
+    // the terminal hasn't been touched yet, so failing here only fails this command
+    if ( PtyPool::shared().open( masterFd, slaveFd, &ttyOrig, &ws ) == -1 ) {
+        std::string message = std::string( "REX: Aborting: could not open a pseudo-terminal: " ) + strerror( errno ) + "\n";
+        LogWriter::shared().append( stderr_log_fh->_fileno, message.c_str(), message.size() );
+        write_all( STDERR_FILENO, message.c_str(), message.size() );
+        close( fd_child_stderr_pipe[READ_END] );
+        close( fd_child_stderr_pipe[WRITE_END] );
+        if ( fd_timeout_wake != -1 ) {
+            close( fd_timeout_wake );
+        }
+        return 1;
+    }
 
-    pid_t pid = ptyFork( &masterFd, slaveName, MAX_SNAME, &ttyOrig, &ws );
+    // the child leads a new session with the pty as its controlling terminal, its stdin and its stdout.  stderr stays
+    // a pipe, so that it can be logged apart from stdout.
+    SpawnRequest request;
+    request.argv = processed_command.argv();
+    request.envp = environment.empty() ? nullptr : environment.data();
+    request.stdin_fd = slaveFd;
+    request.stdout_fd = slaveFd;
+    request.stderr_fd = fd_child_stderr_pipe[WRITE_END];
+    request.new_session = true;
+    request.controlling_tty_fd = slaveFd;
+    request.cgroup_procs_fd = command_cgroup.procs_fd();
+    request.own_process_group = false;
+    request.working_directory = set_working_directory ? working_directory.c_str() : nullptr;
+    request.set_identity = context_override;
+    request.uid = context_uid;
+    request.gid = context_gid;
+    request.groups = context_groups.data();
+    request.group_count = context_groups.size();
+
+    SPAWN_STAGE failed_stage;
+    int failed_errno;
+    pid_t pid = spawn_process( request, failed_stage, failed_errno );
+
+    // only the child has any use for the slave, and the master only sees it hang up once nobody else holds it
+    close( slaveFd );
 
     switch( pid ) {
         case -1:
         {
-            // fork failed
-            safe_perror("ptyfork failure", &ttyOrig );
-            exit(1);
-        }
-
-        case 0:
-        {
-            // child process
-            run_child_process( fd_child_stderr_pipe, processed_command, &ttyOrig, context_override, context_user, context_group );
+            // spawn failed, before the terminal was touched
+            std::string message = std::string( "REX: Aborting: could not start a process on a pseudo-terminal: " ) + strerror( failed_errno ) + "\n";
+            LogWriter::shared().append( stderr_log_fh->_fileno, message.c_str(), message.size() );
+            write_all( STDERR_FILENO, message.c_str(), message.size() );
+            PtyPool::shared().release( masterFd );
+            close( fd_child_stderr_pipe[READ_END] );
+            close( fd_child_stderr_pipe[WRITE_END] );
+            if ( fd_timeout_wake != -1 ) {
+                close( fd_timeout_wake );
+            }
+            return 1;
         }
 
         default:
         {
             // parent process
+            // the child leads a new session, and so its own process group
+            int timeout_handle = 0;
+            if ( timeout_seconds > 0 ) {
+                timeout_handle = TimeoutWheel::shared().watch( pid, timeout_seconds, kill_grace_seconds, fd_timeout_wake, command_cgroup.kill_fd() );
+            }
+
+            // a child that gave up before executing couldn't say why itself, so it is said on its behalf
+            if ( failed_stage != SPAWN_STAGE_NONE ) {
+                std::string message = describe_spawn_failure( request, failed_stage, failed_errno );
+                write_all( fd_child_stderr_pipe[WRITE_END], message.c_str(), message.size() );
+            }
+
             // start ptyfork integration
-            ttySetRaw(STDIN_FILENO, &ttyOrig);
+            if (! headless ) {
+                ttySetRaw(STDIN_FILENO, &ttyOrig);
+            }
 
 
             // The parent process has no need to access the entrance to the pipe
             close(fd_child_stderr_pipe[WRITE_END]);
 
-            // attempt to write to stdout,stderr from child as well as to write each to file
-            char buf[BUFFER_SIZE];
-
-            // contains the byte count of the last read from the pipe
-            ssize_t byte_count;
-
-            // watched_fds for poll() to wait on
-            struct pollfd watched_fds[3];
-
-            // populate the watched_fds array
-
-            // child in to parent
-            watched_fds[0].fd = STDIN_FILENO;
-            watched_fds[0].events = POLLIN;
-
-            // child pty to parent (stdout)
-            watched_fds[1].fd = masterFd;
-            watched_fds[1].events = POLLIN;
-
-            // child stderr to parent
-            watched_fds[2].fd = fd_child_stderr_pipe[READ_END];
-            watched_fds[2].events = POLLIN;
-
-            // number of files poll() reports as ready
-            int num_files_readable;
-
-            // loop flag
-            bool break_out = false;
-
-            // loop until we've read all the data from the child process
-            while ( ! break_out ) {
-                num_files_readable = poll(watched_fds, sizeof(watched_fds) / sizeof(watched_fds[0]), -1);
-                // after the poll() call, add a check to see if both pipes are closed
-                if (!(watched_fds[1].events & POLLIN) &&
-                    !(watched_fds[2].events & POLLIN)) {
-                    break_out = true;
-                }
-
-                if (num_files_readable == -1) {
-                    // error occurred in poll()
-                    safe_perror("poll", &ttyOrig );
-                    exit(1);
-                }
-
-                if (num_files_readable == 0) {
-                    // poll reports no files readable
-                    break_out = true;
-                    break;
-                }
-
-                for (int this_fd = 0; this_fd < 3; this_fd++) {
-                    if (watched_fds[this_fd].revents & POLLIN) {
-                        // this pipe is readable
-                        byte_count = read(watched_fds[this_fd].fd, buf, BUFFER_SIZE);
-
-                        if (byte_count == -1) {
-                            if (errno == EAGAIN) { continue; } else {
-                                // error reading from pipe
-                                safe_perror("read", &ttyOrig );
-                                exit(EXIT_FAILURE);
-                            }
-                        } else if (byte_count == 0) {
-                            // reached EOF on one of the streams but not a HUP
-                            // we've read all we can this cycle, so go to the next fd in the for loop
-                            continue;
-                        } else {
-                            // byte count was sane
-                            // write to stdout,stderr
-
-                            if (this_fd == 0) {
-                                // parent stdin received, write to child pty (stdin)
-                                write_all(masterFd, buf, byte_count);
-                            } else if (this_fd == 1 ) {
-                                // child pty sent some stuff, write to parent stdout and log
-                                write_all(stdout_log_fh->_fileno, buf, byte_count);
-                                write_all(STDOUT_FILENO, buf, byte_count);
-                            } else if ( this_fd == 2 ){
-                                //the child's stderr pipe sent some stuff, write to parent stderr and log
-                                write_all(stderr_log_fh->_fileno, buf, byte_count);
-                                write_all(STDERR_FILENO, buf, byte_count);
-                            } else {
-                                // this should never happen
-                                perror("Logic error!");
-                                exit(EXIT_FAILURE);
-                            }
-                        }
-                    }
-                    if (watched_fds[this_fd].revents & POLLERR) {
-                        //close(watched_fds[this_fd].fd);
-                        break_out = true;
-                        //continue;
-                    }
-//                    if (watched_fds[this_fd].revents & POLLHUP) {
-//                        // this pipe has hung up
-//                        close(watched_fds[this_fd].fd);
-//                        break_out = true;
-//                        break;
-//                    }
-                    if (watched_fds[this_fd].revents & POLLHUP) {
-                        // this pipe has hung up
-                        // don't close the file descriptor yet, there might still be data to read
-                        // instead, remove the POLLIN event to avoid getting a POLLHUP event in the next poll() call
-                        watched_fds[this_fd].events &= ~POLLIN;
-                    }
-                }
+            // the shared reactor copies the terminal's output to the stdout log and the console and the stderr pipe to
+            // the stderr log and the console, alongside every other running child's, and forwards what is typed to the
+            // terminal.  stdin is shared with the rest of Rex, so the reactor watches a copy of it.  nothing is forwarded
+            // to a headless terminal.
+            int fd_child_exit = open_process_fd( pid );
+            int fd_stdin_copy = headless ? -1 : fcntl( STDIN_FILENO, F_DUPFD_CLOEXEC, 0 );
+            OutputCapture capture;
+            capture.add_stream( masterFd, stdout_log_fh->_fileno, STDOUT_FILENO, stdout_excerpt );
+            capture.add_stream( fd_child_stderr_pipe[READ_END], stderr_log_fh->_fileno, STDERR_FILENO, stderr_excerpt );
+            capture.add_input( fd_stdin_copy, masterFd );
+            capture.watch_exit( fd_child_exit, pid, timeout_handle, &outcome );
+            capture.kill_cgroup_on_exit( command_cgroup.kill_fd() );
+            capture.watch_wake( fd_timeout_wake );
+            OutputReactor::shared().capture( capture );
+            outcome.stdout_bytes = capture.bytes_copied( masterFd );
+            outcome.stderr_bytes = capture.bytes_copied( fd_child_stderr_pipe[READ_END] );
+
+            // the reactor reaps the child as it exits, but without a pidfd it can't tell when that is
+            if (! outcome.reaped ) {
+                reap_command( pid, timeout_handle, true, outcome );
             }
-            // wait for child to exit, capture status
-            waitpid(pid, &status, 0);
 
-            while ((byte_count = read(watched_fds[1].fd, buf, BUFFER_SIZE)) > 0) {
-                write_all(stdout_log_fh->_fileno, buf, byte_count);
-                write_all(STDOUT_FILENO, buf, byte_count);
+            // whatever the command left running goes with it, and is counted in what its cgroup measured
+            std::string cgroup_message = command_cgroup.finish( outcome );
+            if (! cgroup_message.empty() ) {
+                LogWriter::shared().append( stderr_log_fh->_fileno, cgroup_message.c_str(), cgroup_message.size() );
+                write_all( STDERR_FILENO, cgroup_message.c_str(), cgroup_message.size() );
+            }
+            if ( fd_timeout_wake != -1 ) {
+                close( fd_timeout_wake );
             }
 
-            while ((byte_count = read(fd_child_stderr_pipe[READ_END], buf, BUFFER_SIZE)) > 0) {
-                write_all(stderr_log_fh->_fileno, buf, byte_count);
-                write_all(STDERR_FILENO, buf, byte_count);
+            PtyPool::shared().release( masterFd );
+            close( fd_child_stderr_pipe[READ_END] );
+            if ( fd_stdin_copy != -1 ) {
+                close( fd_stdin_copy );
+            }
+            if ( fd_child_exit != -1 ) {
+                close( fd_child_exit );
             }
 
-            ttyResetExit( &ttyOrig);
-            if WIFEXITED(status) {
-                return WEXITSTATUS(status);
-            } else {
-                return -617;
+            if (! headless ) {
+                ttyResetExit( &ttyOrig);
             }
+            return outcome_return_code( outcome );
         }
     }
 }
\ No newline at end of file
@@ -19,6 +19,29 @@
 #include "../vpty/pty_fork_mod/pty_fork.h"
 #include <sys/ioctl.h>
 #include <string>
+#include <sys/eventfd.h>
+#include "../TimeoutWheel.h"
+#include "../Spawn.h"
+#include "../OutputReactor.h"
+#include "../Cgroup.h"
+#include "../LogWriter.h"
+#include "PtyPool.h"
+
+// the window size of a headless pseudo-terminal
+#define PTY_HEADLESS_COLUMNS 80
+#define PTY_HEADLESS_ROWS 24
+
+/**
+ * @brief Whether commands forcing a PTY run headless, because this process has no terminal on stdin.
+ *
+ * Decided once, from whether stdin's terminal attributes and window size can be read, as they can't under cron, CI or
+ * a service manager.  A headless PTY starts with sane attributes and a window of PTY_HEADLESS_COLUMNS by
+ * PTY_HEADLESS_ROWS instead of the terminal's, and nothing is forwarded to it, so that any number of them can run at
+ * once.
+ *
+ * @return True if there is no terminal to take over.
+ */
+bool pty_headless();
 
 /**
  * @brief Execute a string as a subprocess command, capture its stdout/stderr to log files, and TEE its output to the parent process's stdout/stderr.
@@ -27,14 +50,29 @@
  * - Capture the child process's stdout and stderr to respective log files.
  * - TEE the child process's stdout and stderr to the parent process's stdout and stderr.
  *
+ * The PTY takes the terminal's attributes and window size, and what is typed is forwarded to it, with the terminal in
+ * raw mode until the child is done.  Without a terminal, see pty_headless(), it is headless instead.
+ *
  * @param command The command to be executed as a subprocess.
  * @param stdout_log_file The file path where the child process's stdout will be logged.
  * @param stderr_log_file The file path where the child process's stderr will be logged.
  * @param context_override Specify whether to override the process's execution context.
  * @param context_user The user context to run the process as, if context_override is true.
  * @param context_group The group context to run the process as, if context_override is true.
- * @param environment_supplied Specify whether the environment is supplied.
- * @return The exit status of the child process. If the child process terminated due to a signal, returns -617.
+ * @param set_working_directory Specify whether the child should change its working directory before executing.
+ * @param working_directory The working directory for the child process, if set_working_directory is true.
+ * @param timeout_seconds The time the child has to finish, or 0 to wait indefinitely.
+ * @param kill_grace_seconds The time between sending the child's session SIGTERM and SIGKILL once it times out.
+ * @param environment_supplied Specify whether environment_variables is the child's complete environment, as captured
+ *                             from an environment file, rather than additions to this process's.
+ * @param environment_variables NAME=value assignments added to the environment the command inherits, or the whole of it.
+ * @param stdout_excerpt Keeps the beginning and end of what the child writes to the terminal, or nullptr.
+ * @param stderr_excerpt Keeps the beginning and end of the child's stderr, or nullptr.
+ * @param cgroup The transient cgroup the child runs in, if enabled.  Whatever the child leaves running in it is killed
+ *               once the child exits.
+ * @param outcome Receives how the child ended, as wait4() reported it once the child exited.
+ * @return The exit status of the child process. If the child process terminated due to a signal, returns
+ *         LCPEX_SIGNALLED, with the signal in outcome, and if it timed out, LCPEX_TIMED_OUT.
  */
 int exec_pty(
         std::string command,
@@ -43,7 +81,16 @@ int exec_pty(
         bool context_override,
         std::string context_user,
         std::string context_group,
-        bool environment_supplied
+        bool set_working_directory,
+        std::string working_directory,
+        int timeout_seconds,
+        int kill_grace_seconds,
+        bool environment_supplied,
+        const std::vector<std::string> & environment_variables,
+        OutputExcerpt * stdout_excerpt,
+        OutputExcerpt * stderr_excerpt,
+        const CgroupSettings & cgroup,
+        CommandOutcome & outcome
 );
 
 
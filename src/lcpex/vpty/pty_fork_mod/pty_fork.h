@@ -11,29 +11,30 @@
 #define MAX_SNAME 1000
 
 /**
- * @brief Fork a child process with a pseudo-terminal
+ * @brief Open a pseudo-terminal for a child process to be spawned on
  *
- * This function forks a child process and returns the child's process ID. The
- * child process is attached to a pseudo-terminal and its standard input,
- * output, and error streams are redirected to the slave side of the pseudo-terminal.
+ * This function opens a pseudo-terminal pair.  Both descriptors are close-on-exec,
+ * and the slave is opened without becoming the caller's controlling terminal: the
+ * child is to start a new session, acquire the slave as its controlling terminal
+ * with TIOCSCTTY, and duplicate it onto its standard streams.  The caller closes
+ * its copy of the slave once the child is started, so that the master sees the
+ * child hang up.
  *
  * @param[out] masterFd Pointer to store the file descriptor of the master pty
+ * @param[out] slaveFd Pointer to store the file descriptor of the slave pty
  * @param[out] slaveName Buffer to store the name of the slave pty
  * @param[in] snLen Length of the 'slaveName' buffer
  * @param[in] slaveTermios Terminal attributes for the slave pty (optional)
  * @param[in] slaveWS Window size for the slave pty (optional)
  *
- * @return Process ID of the child process on success, or -1 on error
+ * @return 0 on success, or -1 on error
  *
- * On success, the file descriptor of the master pty is stored in the location
- * pointed to by 'masterFd', and the name of the slave pty is stored in the buffer
- * pointed to by 'slaveName'. If the buffer is too small to hold the name of the
- * slave, an error of type 'EOVERFLOW' is returned. If 'slaveTermios' is non-NULL,
- * the terminal attributes specified by it will be set for the slave pty. If
- * 'slaveWS' is non-NULL, the window size specified by it will be set for the slave
- * pty.
+ * If the buffer is too small to hold the name of the slave, an error of type
+ * 'EOVERFLOW' is returned. If 'slaveTermios' is non-NULL, the terminal attributes
+ * specified by it will be set for the slave pty. If 'slaveWS' is non-NULL, the
+ * window size specified by it will be set for the slave pty.
  */
-pid_t ptyFork(int *masterFd, char *slaveName, size_t snLen, const struct termios *slaveTermios, const struct winsize *slaveWS);
+int ptyOpen(int *masterFd, int *slaveFd, char *slaveName, size_t snLen, const struct termios *slaveTermios, const struct winsize *slaveWS);
 
 
 #endif //LCPEX_PTY_FORK_H
@@ -38,7 +38,9 @@ int ptyMasterOpen(char *slaveName, size_t snLen)
     int masterFd, savedErrno;
     char *p;
 
-    masterFd = posix_openpt(O_RDWR | O_NOCTTY);         /* Open pty master */
+    /* Open pty master; close-on-exec so concurrently spawned children
+       never hold it open and mask the hangup */
+    masterFd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
     if (masterFd == -1)
         return -1;
 
@@ -20,6 +20,9 @@
 */
 #include "Logger.h"
 
+// serialises writes from concurrently executing tasks so lines don't interleave
+static std::mutex log_mutex;
+
 Logger::Logger( int LOG_LEVEL, std::string mask )
 {
     this->LOG_LEVEL = LOG_LEVEL;
@@ -42,11 +45,14 @@ void Logger::log( int LOG_LEVEL, std::string msg )
 
         std::string s_msg = "[" + ERR + "] " + msg;
 
+        std::string line = "[" + get_8601() + "] [" + ERR + "] " + "[" + this->mask + "] " + msg + "\n";
+
+        std::lock_guard<std::mutex> guard( log_mutex );
         if ( LOG_LEVEL == E_FATAL | LOG_LEVEL == E_WARN )
         {
-            std::cerr << "[" << get_8601() << "] [" << ERR << "] " << "[" << this->mask << "] " << msg.c_str() << std::endl;
+            std::cerr << line << std::flush;
         } else {
-            std::cout << "[" << get_8601() << "] [" << ERR << "] " << "[" << this->mask << "] " << msg.c_str() << std::endl;
+            std::cout << line << std::flush;
         }
     }
 }
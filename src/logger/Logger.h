@@ -26,6 +26,7 @@
 #include <iostream>
 #include <iomanip>
 #include <sstream>
+#include <mutex>
 #include "../misc/helpers.h"
 
 enum L_LVL {
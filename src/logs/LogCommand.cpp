@@ -0,0 +1,500 @@
+/*
+    Rex - A configuration management and workflow automation tool that
+    compiles and runs in minimal environments.
+
+    © SILO GROUP and Chris Punches, 2020.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+#include "LogCommand.h"
+#include "LogSegments.h"
+#include "../lcpex/LogCompression.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <regex.h>
+#include <unistd.h>
+
+
+/**
+ * @brief Describe how `rex logs` is used, on stderr.
+ */
+static void print_logs_usage()
+{
+    fprintf( stderr, "\nUsage:\n" );
+    fprintf( stderr, "\trex logs cat FILE...\n" );
+    fprintf( stderr, "\trex logs runs LOGS_PATH\n" );
+    fprintf( stderr, "\trex logs show LOGS_PATH TASK [ --run RUN ] [ --stream stdout|stderr ] [ --lines FIRST[:LAST] ]\n" );
+    fprintf( stderr, "\trex logs grep LOGS_PATH PATTERN [ --run RUN ] [ --task TASK ] [ --stream stdout|stderr ]\n\n" );
+    fprintf( stderr, "  %-10s %s\n", "cat", "Write each log to stdout, decompressing those written with 'log_compression'.  '-' reads stdin." );
+    fprintf( stderr, "  %-10s %s\n", "runs", "List the runs whose logs are kept in segments under LOGS_PATH, oldest first." );
+    fprintf( stderr, "  %-10s %s\n", "show", "Write a Task's stdout, or stderr, from the newest run that executed it, or from RUN." );
+    fprintf( stderr, "  %-10s %s\n", "grep", "Write the lines matching an extended regular expression, from every run, or from RUN." );
+    fprintf( stderr, "\n" );
+}
+
+
+/**
+ * @brief Write an entire buffer to stdout, retrying short and interrupted writes.
+ *
+ * @return True if every byte was written.
+ */
+static bool write_stdout( const std::string & data )
+{
+    const char * p = data.data();
+    size_t length = data.size();
+    while ( length > 0 )
+    {
+        ssize_t written = write( STDOUT_FILENO, p, length );
+        if ( written < 0 )
+        {
+            if ( errno == EINTR ) { continue; }
+            return false;
+        }
+        p += written;
+        length -= written;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Decode one log to stdout.
+ *
+ * @param path The log, or `-` for stdin.
+ *
+ * @return True if all of it was read, decoded and written.  What decoded before a problem is still written.
+ */
+static bool cat_log( const std::string & path )
+{
+    int in = path == "-" ? STDIN_FILENO : open( path.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( in < 0 )
+    {
+        fprintf( stderr, "rex logs: %s: %s\n", path.c_str(), strerror( errno ) );
+        return false;
+    }
+
+    Lz4FrameDecoder decoder;
+    std::string decoded;
+    char buffer[65536];
+    bool complete = true;
+    while ( true )
+    {
+        ssize_t got = read( in, buffer, sizeof( buffer ) );
+        if ( got < 0 )
+        {
+            if ( errno == EINTR ) { continue; }
+            fprintf( stderr, "rex logs: %s: %s\n", path.c_str(), strerror( errno ) );
+            complete = false;
+            break;
+        }
+        if ( got == 0 )
+        {
+            if (! decoder.finish( decoded ) )
+            {
+                fprintf( stderr, "rex logs: %s: ends part way through a frame, as a log still being written would\n", path.c_str() );
+                complete = false;
+            }
+            write_stdout( decoded );
+            break;
+        }
+
+        decoded.clear();
+        bool decodable = decoder.feed( buffer, got, decoded );
+        if (! write_stdout( decoded ) )
+        {
+            fprintf( stderr, "rex logs: writing to stdout: %s\n", strerror( errno ) );
+            complete = false;
+            break;
+        }
+        if (! decodable )
+        {
+            fprintf( stderr, "rex logs: %s: %s\n", path.c_str(), decoder.error().c_str() );
+            complete = false;
+            break;
+        }
+        decoded.clear();
+    }
+
+    if ( in != STDIN_FILENO )
+    {
+        close( in );
+    }
+    return complete;
+}
+
+
+/**
+ * @brief The options of the segment subcommands.
+ */
+struct SegmentQuery {
+    std::string run;
+    std::string task;
+    std::string stream;
+    unsigned long long first_line;
+    unsigned long long last_line;
+};
+
+
+/**
+ * @brief Read the options after a segment subcommand's positional arguments.
+ *
+ * @return False if an option is unknown, lacks its value, or has one that makes no sense.
+ */
+static bool parse_query_options( int argc, char * argv[], int first, SegmentQuery & query )
+{
+    query.first_line = 1;
+    query.last_line = 0;
+    for ( int i = first; i < argc; i++ )
+    {
+        std::string option = argv[i];
+        if ( i + 1 >= argc || ( option != "--run" && option != "--task" && option != "--stream" && option != "--lines" ) )
+        {
+            fprintf( stderr, "rex logs: unknown option, or option without a value: '%s'\n", option.c_str() );
+            return false;
+        }
+        std::string value = argv[++i];
+        if ( option == "--run" )
+        {
+            query.run = value;
+        } else if ( option == "--task" ) {
+            query.task = value;
+        } else if ( option == "--stream" ) {
+            if ( value != "stdout" && value != "stderr" )
+            {
+                fprintf( stderr, "rex logs: --stream must be 'stdout' or 'stderr', not '%s'\n", value.c_str() );
+                return false;
+            }
+            query.stream = value;
+        } else {
+            char * end;
+            query.first_line = strtoull( value.c_str(), &end, 10 );
+            query.last_line = *end == ':' ? strtoull( end + 1, &end, 10 ) : query.first_line;
+            if ( *end != '\0' || query.first_line == 0 || query.last_line < query.first_line )
+            {
+                fprintf( stderr, "rex logs: --lines must be FIRST or FIRST:LAST, counting from 1, not '%s'\n", value.c_str() );
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+/**
+ * @brief Splits an extent into numbered lines as it is read, for the subcommands that work a line at a time.
+ */
+class LineReader
+{
+    public:
+        // each is called with every line and its number, without its newline.  returns false to stop.
+        LineReader( unsigned long long number, const std::function<bool( unsigned long long, const std::string & )> & each ):
+            number( number ), each( each ) {}
+
+        bool feed( const char * data, size_t length )
+        {
+            const char * end = data + length;
+            while ( data < end )
+            {
+                const char * newline = (const char *) memchr( data, '\n', end - data );
+                if ( newline == NULL )
+                {
+                    this->partial.append( data, end - data );
+                    return true;
+                }
+                this->partial.append( data, newline - data );
+                data = newline + 1;
+                if (! this->each( this->number++, this->partial ) )
+                {
+                    return false;
+                }
+                this->partial.clear();
+            }
+            return true;
+        }
+
+        // the last line, if it has no newline
+        void finish()
+        {
+            if (! this->partial.empty() )
+            {
+                this->each( this->number, this->partial );
+            }
+        }
+
+    private:
+        unsigned long long number;
+        std::function<bool( unsigned long long, const std::string & )> each;
+        std::string partial;
+};
+
+
+/**
+ * @brief Open a run's segment and read its index.
+ *
+ * @return The segment, or -1 if either could not be read, which has been reported.
+ */
+static int open_run( const std::string & directory, const std::string & run, std::vector<SegmentExtent> & extents )
+{
+    std::string index_path = directory + "/" + run + SEGMENT_INDEX_SUFFIX;
+    if (! load_segment_index( index_path, extents ) )
+    {
+        fprintf( stderr, "rex logs: could not read the index '%s'\n", index_path.c_str() );
+        return -1;
+    }
+    std::string segment_path = directory + "/" + run + SEGMENT_SUFFIX;
+    int segment_fd = open( segment_path.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( segment_fd < 0 )
+    {
+        fprintf( stderr, "rex logs: %s: %s\n", segment_path.c_str(), strerror( errno ) );
+    }
+    return segment_fd;
+}
+
+
+/**
+ * @brief `rex logs runs`: list the runs with segments, with what each holds.
+ */
+static int list_runs( const std::string & directory )
+{
+    std::vector<std::string> runs = list_segment_runs( directory );
+    for ( size_t r = 0; r < runs.size(); r++ )
+    {
+        std::vector<SegmentExtent> extents;
+        if (! load_segment_index( directory + "/" + runs[r] + SEGMENT_INDEX_SUFFIX, extents ) )
+        {
+            continue;
+        }
+        std::set<std::string> tasks;
+        unsigned long long bytes = 0;
+        for ( size_t e = 0; e < extents.size(); e++ )
+        {
+            tasks.insert( extents[e].task );
+            bytes += extents[e].length;
+        }
+        printf( "%s\t%zu task(s)\t%zu log(s)\t%llu bytes\n", runs[r].c_str(), tasks.size(), extents.size(), bytes );
+    }
+    return 0;
+}
+
+
+/**
+ * @brief `rex logs show`: write a Task's output from one run, all of it or a range of its lines.
+ */
+static int show_task( const std::string & directory, const SegmentQuery & query )
+{
+    std::string stream = query.stream.empty() ? "stdout" : query.stream;
+    std::vector<std::string> runs = list_segment_runs( directory );
+
+    // the newest run that executed the task, unless one is named
+    std::vector<SegmentExtent> extents;
+    std::string run;
+    for ( size_t r = runs.size(); r > 0 && run.empty(); r-- )
+    {
+        if (! query.run.empty() && runs[r - 1] != query.run )
+        {
+            continue;
+        }
+        std::vector<SegmentExtent> candidates;
+        load_segment_index( directory + "/" + runs[r - 1] + SEGMENT_INDEX_SUFFIX, candidates );
+        for ( size_t e = 0; e < candidates.size() && run.empty(); e++ )
+        {
+            if ( candidates[e].task == query.task )
+            {
+                run = runs[r - 1];
+            }
+        }
+    }
+    if ( run.empty() )
+    {
+        fprintf( stderr, "rex logs: no logs of task '%s' in %s%s\n", query.task.c_str(), query.run.empty() ? "any run" : "run ", query.run.c_str() );
+        return 1;
+    }
+
+    int segment_fd = open_run( directory, run, extents );
+    if ( segment_fd < 0 )
+    {
+        return 1;
+    }
+
+    // every execution of the task in the run, in the order they finished
+    bool complete = true;
+    bool whole = query.first_line == 1 && query.last_line == 0;
+    for ( size_t e = 0; e < extents.size(); e++ )
+    {
+        if ( extents[e].task != query.task || extents[e].stream != stream )
+        {
+            continue;
+        }
+        std::string error;
+        bool read;
+        if ( whole )
+        {
+            read = read_segment_extent( segment_fd, extents[e], 0, []( const char * data, size_t length ) {
+                return write_stdout( std::string( data, length ) );
+            }, error );
+        } else {
+            // a range of lines, each with its newline, found through the index
+            unsigned long long position;
+            unsigned long long number = seek_segment_extent( extents[e], query.first_line, position );
+            LineReader lines( number, [&query]( unsigned long long line, const std::string & text ) {
+                if ( line < query.first_line )
+                {
+                    return true;
+                }
+                return line <= query.last_line && write_stdout( text + "\n" );
+            } );
+            read = read_segment_extent( segment_fd, extents[e], position, [&lines]( const char * data, size_t length ) {
+                return lines.feed( data, length );
+            }, error );
+            lines.finish();
+        }
+        if (! read )
+        {
+            fprintf( stderr, "rex logs: %s: %s: %s\n", run.c_str(), query.task.c_str(), error.c_str() );
+            complete = false;
+        }
+    }
+    close( segment_fd );
+    return complete ? 0 : 1;
+}
+
+
+/**
+ * @brief `rex logs grep`: write the lines matching a pattern, from the Tasks and streams asked for, in every run asked
+ * for.  The index finds each Task's output without reading anyone else's.
+ */
+static int grep_runs( const std::string & directory, const std::string & pattern, const SegmentQuery & query )
+{
+    regex_t expression;
+    int compiled = regcomp( &expression, pattern.c_str(), REG_EXTENDED | REG_NOSUB );
+    if ( compiled != 0 )
+    {
+        char message[256];
+        regerror( compiled, &expression, message, sizeof( message ) );
+        fprintf( stderr, "rex logs: bad pattern '%s': %s\n", pattern.c_str(), message );
+        return 2;
+    }
+
+    bool complete = true;
+    bool matched = false;
+    std::vector<std::string> runs = list_segment_runs( directory );
+    for ( size_t r = 0; r < runs.size(); r++ )
+    {
+        if (! query.run.empty() && runs[r] != query.run )
+        {
+            continue;
+        }
+        std::vector<SegmentExtent> extents;
+        int segment_fd = open_run( directory, runs[r], extents );
+        if ( segment_fd < 0 )
+        {
+            complete = false;
+            continue;
+        }
+        for ( size_t e = 0; e < extents.size(); e++ )
+        {
+            const SegmentExtent & extent = extents[e];
+            if ( ( ! query.task.empty() && extent.task != query.task ) || ( ! query.stream.empty() && extent.stream != query.stream ) || extent.length == 0 )
+            {
+                continue;
+            }
+            std::string prefix = runs[r] + "\t" + extent.task + "\t" + extent.stream + ":";
+            LineReader lines( 1, [&]( unsigned long long line, const std::string & text ) {
+                if ( regexec( &expression, text.c_str(), 0, NULL, 0 ) != 0 )
+                {
+                    return true;
+                }
+                matched = true;
+                return write_stdout( prefix + std::to_string( line ) + ":" + text + "\n" );
+            } );
+            std::string error;
+            bool read = read_segment_extent( segment_fd, extent, 0, [&lines]( const char * data, size_t length ) {
+                return lines.feed( data, length );
+            }, error );
+            lines.finish();
+            if (! read )
+            {
+                fprintf( stderr, "rex logs: %s: %s: %s\n", runs[r].c_str(), extent.task.c_str(), error.c_str() );
+                complete = false;
+            }
+        }
+        close( segment_fd );
+    }
+    regfree( &expression );
+
+    // like grep: 0 for a match, 1 for none, 2 for trouble
+    return complete ? ( matched ? 0 : 1 ) : 2;
+}
+
+
+int logs_command( int argc, char * argv[] )
+{
+    if ( argc < 2 )
+    {
+        print_logs_usage();
+        return 2;
+    }
+
+    std::string subcommand = argv[1];
+    if ( subcommand == "cat" )
+    {
+        if ( argc < 3 )
+        {
+            print_logs_usage();
+            return 2;
+        }
+        bool complete = true;
+        for ( int i = 2; i < argc; i++ )
+        {
+            complete = cat_log( argv[i] ) && complete;
+        }
+        return complete ? 0 : 1;
+    }
+
+    // the rest work on the segments kept in a logs_path
+    if ( subcommand == "runs" && argc == 3 )
+    {
+        return list_runs( std::string( argv[2] ) + "/" + SEGMENT_DIRECTORY );
+    }
+    SegmentQuery query;
+    if ( ( subcommand == "show" || subcommand == "grep" ) && argc >= 4 )
+    {
+        if (! parse_query_options( argc, argv, 4, query ) )
+        {
+            print_logs_usage();
+            return 2;
+        }
+        std::string directory = std::string( argv[2] ) + "/" + SEGMENT_DIRECTORY;
+        if ( subcommand == "show" )
+        {
+            query.task = argv[3];
+            return show_task( directory, query );
+        }
+        return grep_runs( directory, argv[3], query );
+    }
+
+    if ( subcommand != "-h" && subcommand != "--help" && subcommand != "runs" && subcommand != "show" && subcommand != "grep" )
+    {
+        fprintf( stderr, "rex logs: unknown subcommand '%s'\n", subcommand.c_str() );
+    }
+    print_logs_usage();
+    return subcommand == "-h" || subcommand == "--help" ? 0 : 2;
+}
@@ -0,0 +1,45 @@
+/*
+    Rex - A configuration management and workflow automation tool that
+    compiles and runs in minimal environments.
+
+    © SILO GROUP and Chris Punches, 2020.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef REX_LOGCOMMAND_H
+#define REX_LOGCOMMAND_H
+
+/**
+ * @brief Run `rex logs`, which reads back the logs Tasks leave, compressed or not, in files or in segments.
+ *
+ * Subcommands:
+ *   cat FILE...              Write each file to stdout as what it decodes to, in order.  `-` reads stdin.  Plain logs
+ *                            are copied as they are.
+ *   runs LOGS_PATH           List the runs with log segments.
+ *   show LOGS_PATH TASK      Write a Task's output from the newest run that executed it, or from `--run`, all of it
+ *                            or `--lines`.
+ *   grep LOGS_PATH PATTERN   Write the lines matching an extended regular expression, with their run, Task, stream
+ *                            and line number, from every run or `--run`, for every Task or `--task`.
+ *
+ * @param argc The arguments' count, from `logs` on.
+ * @param argv The arguments, starting with `logs`.
+ *
+ * @return The exit status: 0 if everything was read and decoded, 1 if anything was missing or corrupt, 2 for a
+ *         misuse.  `grep` returns 1 if nothing matched, and 2 if anything could not be read.
+ */
+int logs_command( int argc, char * argv[] );
+
+#endif //REX_LOGCOMMAND_H
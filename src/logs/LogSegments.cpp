@@ -0,0 +1,479 @@
+/*
+    Rex - A configuration management and workflow automation tool that
+    compiles and runs in minimal environments.
+
+    © SILO GROUP and Chris Punches, 2020.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+#include "LogSegments.h"
+#include "../misc/helpers.h"
+#include "../lcpex/LogCompression.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+/**
+ * @brief The first line of the index of a run of a plan.
+ */
+static std::string index_header( const std::string & plan_path )
+{
+    return "rex-segments 1 " + plan_path + "\n";
+}
+
+
+/**
+ * @brief Write an entire buffer to a file descriptor at an offset, retrying short and interrupted writes.
+ *
+ * @return True if every byte was written.
+ */
+static bool write_fully_at( int fd, const char * data, size_t length, off_t offset )
+{
+    while ( length > 0 )
+    {
+        ssize_t written = pwrite( fd, data, length, offset );
+        if ( written < 0 )
+        {
+            if ( errno == EINTR ) { continue; }
+            return false;
+        }
+        data += written;
+        length -= written;
+        offset += written;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Count the lines in a piece of an extent, noting where each SEGMENT_LINE_INTERVAL-th line ends.
+ *
+ * @param data The piece.
+ * @param length Its size.
+ * @param position Where the piece starts in the extent.
+ * @param newlines The newlines counted so far, added to.
+ * @param line_offsets Where lines start, added to, or NULL to not note them.
+ */
+static void count_lines( const char * data, size_t length, unsigned long long position, unsigned long long & newlines, std::vector<unsigned long long> * line_offsets )
+{
+    const char * end = data + length;
+    for ( const char * p = data; ( p = (const char *) memchr( p, '\n', end - p ) ) != NULL; p++ )
+    {
+        newlines++;
+        if ( line_offsets != NULL && newlines % SEGMENT_LINE_INTERVAL == 0 )
+        {
+            line_offsets->push_back( position + ( p - data ) + 1 );
+        }
+    }
+}
+
+
+LogSegmentStore & LogSegmentStore::shared()
+{
+    static LogSegmentStore * store = new LogSegmentStore();
+    return *store;
+}
+
+
+LogSegmentStore::LogSegmentStore(): segment_fd( -1 ), index_fd( -1 ), sync( false ), end( 0 )
+{
+    this->counters = LogSegmentStats();
+}
+
+
+bool LogSegmentStore::open( const std::string & directory, const std::string & run, const std::string & plan_path, bool sync, std::string & error )
+{
+    std::lock_guard<std::mutex> guard( this->lock );
+    if (! createDirectory( directory ) )
+    {
+        error = "could not create '" + directory + "'";
+        return false;
+    }
+
+    std::string segment = directory + "/" + run + SEGMENT_SUFFIX;
+    std::string index = directory + "/" + run + SEGMENT_INDEX_SUFFIX;
+    int segment_fd = ::open( segment.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644 );
+    if ( segment_fd < 0 )
+    {
+        error = "could not create '" + segment + "': " + strerror( errno );
+        return false;
+    }
+    int index_fd = ::open( index.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644 );
+    std::string header = index_header( plan_path );
+    if ( index_fd < 0 || ! write_fully_at( index_fd, header.data(), header.size(), 0 ) )
+    {
+        error = "could not create '" + index + "': " + strerror( errno );
+        ::close( segment_fd );
+        if ( index_fd >= 0 ) { ::close( index_fd ); }
+        unlink( segment.c_str() );
+        unlink( index.c_str() );
+        return false;
+    }
+
+    this->directory = directory;
+    this->path = segment;
+    this->segment_fd = segment_fd;
+    this->index_fd = index_fd;
+    this->sync = sync;
+    this->end = 0;
+    return true;
+}
+
+
+bool LogSegmentStore::is_open()
+{
+    std::lock_guard<std::mutex> guard( this->lock );
+    return this->segment_fd != -1;
+}
+
+
+std::string LogSegmentStore::segment_path()
+{
+    std::lock_guard<std::mutex> guard( this->lock );
+    return this->path;
+}
+
+
+FILE * LogSegmentStore::create_log()
+{
+    std::unique_lock<std::mutex> guard( this->lock );
+    std::string directory = this->directory;
+    guard.unlock();
+
+    // never linked into the directory, so it leaves nothing behind however the run ends
+    int fd = ::open( directory.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600 );
+    if ( fd == -1 )
+    {
+        // not every filesystem has unnamed files
+        std::string name_template = directory + "/.log.XXXXXX";
+        std::vector<char> name( name_template.begin(), name_template.end() );
+        name.push_back( '\0' );
+        fd = mkostemp( name.data(), O_CLOEXEC );
+        if ( fd == -1 )
+        {
+            return NULL;
+        }
+        unlink( name.data() );
+    }
+    FILE * fh = fdopen( fd, "r+" );
+    if ( fh == NULL )
+    {
+        ::close( fd );
+    }
+    return fh;
+}
+
+
+bool LogSegmentStore::add( const std::string & task, const std::string & stream, const std::string & started, int fd, bool compressed )
+{
+    struct stat log_stat;
+    if ( fstat( fd, &log_stat ) != 0 )
+    {
+        std::lock_guard<std::mutex> guard( this->lock );
+        this->counters.failed++;
+        return false;
+    }
+    unsigned long long length = log_stat.st_size;
+
+    // claim the space, so that other logs can be added while this one is copied
+    std::unique_lock<std::mutex> guard( this->lock );
+    if ( this->segment_fd == -1 )
+    {
+        return false;
+    }
+    int segment_fd = this->segment_fd;
+    unsigned long long offset = this->end;
+    this->end += length;
+    guard.unlock();
+
+    // copy it over, counting its lines as it goes by
+    bool copied = true;
+    unsigned long long newlines = 0;
+    std::vector<unsigned long long> line_offsets;
+    Lz4FrameDecoder decoder;
+    std::string decoded;
+    unsigned long long decoded_position = 0;
+    char last = '\n';
+    char buffer[65536];
+    unsigned long long position = 0;
+    while ( copied && position < length )
+    {
+        ssize_t got = pread( fd, buffer, std::min( (unsigned long long) sizeof( buffer ), length - position ), position );
+        if ( got <= 0 )
+        {
+            if ( got < 0 && errno == EINTR ) { continue; }
+            copied = false;
+            break;
+        }
+        copied = write_fully_at( segment_fd, buffer, got, offset + position );
+        if ( compressed )
+        {
+            // the lines of a compressed log are counted, but where they start is no use without decoding from the start
+            decoded.clear();
+            decoder.feed( buffer, got, decoded );
+            count_lines( decoded.data(), decoded.size(), decoded_position, newlines, NULL );
+            decoded_position += decoded.size();
+            if (! decoded.empty() ) { last = decoded.back(); }
+        } else {
+            count_lines( buffer, got, position, newlines, &line_offsets );
+            last = buffer[ got - 1 ];
+        }
+        position += got;
+    }
+    if ( copied && this->sync )
+    {
+        copied = fdatasync( segment_fd ) == 0;
+    }
+
+    std::string record = "E\t" + task + "\t" + stream + "\t" + started + "\t" + ( compressed ? "lz4" : "none" ) + "\t" +
+            std::to_string( offset ) + "\t" + std::to_string( length ) + "\t" + std::to_string( newlines + ( last != '\n' ? 1 : 0 ) ) + "\t";
+    for ( size_t i = 0; i < line_offsets.size(); i++ )
+    {
+        record += ( i > 0 ? "," : "" ) + std::to_string( line_offsets[i] );
+    }
+    record += "\n";
+
+    guard.lock();
+    if ( copied && this->index_fd != -1 )
+    {
+        // the index is in append mode, where pwrite() ignores the offset
+        copied = write_fully_at( this->index_fd, record.data(), record.size(), 0 );
+    }
+    if ( copied )
+    {
+        this->counters.extents++;
+        this->counters.bytes += length;
+    } else {
+        this->counters.failed++;
+    }
+    return copied;
+}
+
+
+void LogSegmentStore::close()
+{
+    std::lock_guard<std::mutex> guard( this->lock );
+    if ( this->segment_fd != -1 )
+    {
+        if ( this->sync )
+        {
+            fdatasync( this->index_fd );
+        }
+        ::close( this->segment_fd );
+        ::close( this->index_fd );
+        this->segment_fd = -1;
+        this->index_fd = -1;
+    }
+}
+
+
+LogSegmentStats LogSegmentStore::stats()
+{
+    std::lock_guard<std::mutex> guard( this->lock );
+    return this->counters;
+}
+
+
+std::vector<std::string> list_segment_runs( const std::string & directory )
+{
+    std::vector<std::string> runs;
+    DIR * listing = opendir( directory.c_str() );
+    if ( listing == NULL )
+    {
+        return runs;
+    }
+    size_t suffix_length = strlen( SEGMENT_INDEX_SUFFIX );
+    struct dirent * entry;
+    while ( ( entry = readdir( listing ) ) != NULL )
+    {
+        std::string name = entry->d_name;
+        if ( name.size() > suffix_length && name.compare( name.size() - suffix_length, suffix_length, SEGMENT_INDEX_SUFFIX ) == 0 )
+        {
+            runs.push_back( name.substr( 0, name.size() - suffix_length ) );
+        }
+    }
+    closedir( listing );
+
+    // named after when they started, which sorts in time order
+    std::sort( runs.begin(), runs.end() );
+    return runs;
+}
+
+
+/**
+ * @brief Split a line of an index at its tabs.
+ */
+static std::vector<std::string> split_fields( const char * line, const char * end )
+{
+    std::vector<std::string> fields;
+    const char * start = line;
+    for ( const char * p = line; p <= end; p++ )
+    {
+        if ( p == end || *p == '\t' )
+        {
+            fields.push_back( std::string( start, p ) );
+            start = p + 1;
+        }
+    }
+    return fields;
+}
+
+
+bool load_segment_index( const std::string & index_path, std::vector<SegmentExtent> & extents )
+{
+    extents.clear();
+    int in = ::open( index_path.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( in < 0 )
+    {
+        return false;
+    }
+    std::string contents;
+    char buffer[65536];
+    ssize_t got;
+    while ( ( got = read( in, buffer, sizeof( buffer ) ) ) != 0 )
+    {
+        if ( got < 0 )
+        {
+            if ( errno == EINTR ) { continue; }
+            ::close( in );
+            return false;
+        }
+        contents.append( buffer, got );
+    }
+    ::close( in );
+
+    std::string header = index_header( "" );
+    if ( contents.compare( 0, header.size() - 1, header, 0, header.size() - 1 ) != 0 )
+    {
+        return false;
+    }
+
+    size_t position = contents.find( '\n' );
+    while ( position != std::string::npos && position + 1 < contents.size() )
+    {
+        const char * line = contents.data() + position + 1;
+        const char * end = (const char *) memchr( line, '\n', contents.size() - position - 1 );
+        if ( end == NULL )
+        {
+            // cut short as it was written
+            break;
+        }
+        position = end - contents.data();
+
+        std::vector<std::string> fields = split_fields( line, end );
+        if ( fields.size() != 9 || fields[0] != "E" )
+        {
+            continue;
+        }
+        SegmentExtent extent;
+        extent.task = fields[1];
+        extent.stream = fields[2];
+        extent.started = fields[3];
+        extent.codec = fields[4];
+        extent.offset = strtoull( fields[5].c_str(), NULL, 10 );
+        extent.length = strtoull( fields[6].c_str(), NULL, 10 );
+        extent.lines = strtoull( fields[7].c_str(), NULL, 10 );
+        const char * offsets = fields[8].c_str();
+        while ( *offsets != '\0' )
+        {
+            char * next;
+            unsigned long long line_offset = strtoull( offsets, &next, 10 );
+            if ( next == offsets )
+            {
+                break;
+            }
+            extent.line_offsets.push_back( line_offset );
+            offsets = *next == ',' ? next + 1 : next;
+        }
+        extents.push_back( extent );
+    }
+    return true;
+}
+
+
+unsigned long long seek_segment_extent( const SegmentExtent & extent, unsigned long long line, unsigned long long & position )
+{
+    // a compressed extent can only be decoded from its start
+    size_t skipped = std::min( (size_t) ( line > 0 ? ( line - 1 ) / SEGMENT_LINE_INTERVAL : 0 ), extent.line_offsets.size() );
+    if ( extent.codec == "lz4" || skipped == 0 )
+    {
+        position = 0;
+        return 1;
+    }
+    position = std::min( extent.line_offsets[ skipped - 1 ], extent.length );
+    return skipped * SEGMENT_LINE_INTERVAL + 1;
+}
+
+
+bool read_segment_extent(
+        int segment_fd,
+        const SegmentExtent & extent,
+        unsigned long long position,
+        const std::function<bool( const char *, size_t )> & each,
+        std::string & error
+)
+{
+    bool decode = extent.codec == "lz4";
+    if (! decode && extent.codec != "none" )
+    {
+        error = "unknown encoding '" + extent.codec + "'";
+        return false;
+    }
+
+    Lz4FrameDecoder decoder;
+    std::string decoded;
+    char buffer[65536];
+    while ( position < extent.length )
+    {
+        ssize_t got = pread( segment_fd, buffer, std::min( (unsigned long long) sizeof( buffer ), extent.length - position ), extent.offset + position );
+        if ( got <= 0 )
+        {
+            if ( got < 0 && errno == EINTR ) { continue; }
+            error = got < 0 ? strerror( errno ) : "the segment is shorter than its index says";
+            return false;
+        }
+        position += got;
+        if (! decode )
+        {
+            if (! each( buffer, got ) ) { return true; }
+            continue;
+        }
+        decoded.clear();
+        if (! decoder.feed( buffer, got, decoded ) )
+        {
+            error = decoder.error();
+            return false;
+        }
+        if (! each( decoded.data(), decoded.size() ) ) { return true; }
+    }
+
+    if ( decode )
+    {
+        decoded.clear();
+        if (! decoder.finish( decoded ) )
+        {
+            error = "ends part way through a frame";
+            return false;
+        }
+        each( decoded.data(), decoded.size() );
+    }
+    return true;
+}
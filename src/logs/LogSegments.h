@@ -0,0 +1,211 @@
+/*
+    Rex - A configuration management and workflow automation tool that
+    compiles and runs in minimal environments.
+
+    © SILO GROUP and Chris Punches, 2020.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef REX_LOGSEGMENTS_H
+#define REX_LOGSEGMENTS_H
+
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// the directory in logs_path segments are kept in
+static const char * const SEGMENT_DIRECTORY = "segments";
+
+// the suffixes of a run's segment and of its index
+static const char * const SEGMENT_SUFFIX = ".segment";
+static const char * const SEGMENT_INDEX_SUFFIX = ".index";
+
+// an extent's index has the offset of the start of every this many lines
+static const unsigned long long SEGMENT_LINE_INTERVAL = 4096;
+
+// what the segment store has done so far
+struct LogSegmentStats {
+    // the logs added to the segment, and their bytes
+    unsigned long long extents;
+    unsigned long long bytes;
+    // the logs that could not be added
+    unsigned long long failed;
+};
+
+/**
+ * @brief One execution's stdout or stderr, as it lies in a run's segment.
+ */
+struct SegmentExtent {
+    std::string task;
+    // "stdout" or "stderr"
+    std::string stream;
+    // when the execution started, as the name of its log file would have it
+    std::string started;
+    // "lz4" if it was written compressed, otherwise "none"
+    std::string codec;
+    // where it is in the segment, and its size there
+    unsigned long long offset;
+    unsigned long long length;
+    // the lines it holds, counting a last line without a newline
+    unsigned long long lines;
+    // where line SEGMENT_LINE_INTERVAL * ( i + 1 ) + 1 starts, from the start of the extent, for each i.  empty for a
+    // compressed extent, which can only be read from its start.
+    std::vector<unsigned long long> line_offsets;
+};
+
+/**
+ * @brief Keeps the logs of a run in one append-only segment file, with an index of what is where.
+ *
+ * Logging a file per stream per execution leaves millions of small files behind after enough runs.  With a segment
+ * store, each log is written to an unnamed temporary file while its execution runs, exactly as a log file of its own
+ * would be, and appended to the run's segment as one extent when the execution is over.  Each extent adds a line to
+ * the run's index naming its task, stream and start time, where it is, and where every SEGMENT_LINE_INTERVAL-th line
+ * of it starts.  A run leaves two files however many Tasks it executes.
+ *
+ * The space for an extent is claimed under a lock and filled without it, so Tasks finishing together don't wait for
+ * each other's copies.  An extent is only in the index once it has been written in full, so a run cut short leaves at
+ * most some unindexed bytes at the end of its segment.
+ */
+class LogSegmentStore
+{
+    public:
+        /**
+         * @brief The store shared by every Task.
+         */
+        static LogSegmentStore & shared();
+
+        /**
+         * @brief Start the segment and index of a run.
+         *
+         * @param directory The directory to keep them in, created if need be.
+         * @param run The run's name, which both files are named after.
+         * @param plan_path The plan being executed, recorded in the index.
+         * @param sync Whether each extent is forced out to disk before it is indexed.
+         * @param error Receives why the store could not be started.
+         *
+         * @return False if it could not, in which case logs are files of their own.
+         */
+        bool open( const std::string & directory, const std::string & run, const std::string & plan_path, bool sync, std::string & error );
+
+        /**
+         * @brief Whether a run's segment is open.
+         */
+        bool is_open();
+
+        /**
+         * @brief Create a log to be added to the segment once its execution is over.
+         *
+         * @return An unnamed file in the segment's directory, read-write and close-on-exec, or NULL.
+         */
+        FILE * create_log();
+
+        /**
+         * @brief Append a log to the segment, and index it.
+         *
+         * @param task The Task the log is from.
+         * @param stream "stdout" or "stderr".
+         * @param started When the execution started.
+         * @param fd The log, from create_log().  Read from its start, whatever its offset.
+         * @param compressed Whether the log is written in LZ4 frames.
+         *
+         * @return True if it was added.
+         */
+        bool add( const std::string & task, const std::string & stream, const std::string & started, int fd, bool compressed );
+
+        /**
+         * @brief Close the segment and index.
+         */
+        void close();
+
+        /**
+         * @brief The path of the open segment, for messages.
+         */
+        std::string segment_path();
+
+        /**
+         * @brief What the store has done so far.
+         */
+        LogSegmentStats stats();
+
+    private:
+        LogSegmentStore();
+
+        std::mutex lock;
+
+        std::string directory;
+        std::string path;
+        int segment_fd;
+        int index_fd;
+        bool sync;
+
+        // where the next extent goes
+        unsigned long long end;
+
+        LogSegmentStats counters;
+};
+
+/**
+ * @brief The runs with segments in a directory.
+ *
+ * @param directory The directory the segments are kept in.
+ *
+ * @return The runs' names, oldest first.
+ */
+std::vector<std::string> list_segment_runs( const std::string & directory );
+
+/**
+ * @brief Read back the index of a run.
+ *
+ * @param index_path The index file.
+ * @param extents Receives the extents, in the order they were added.  A last line cut short is ignored.
+ *
+ * @return False if the index could not be read, or isn't an index.
+ */
+bool load_segment_index( const std::string & index_path, std::vector<SegmentExtent> & extents );
+
+/**
+ * @brief Find where to start reading an extent to get to a line: the nearest indexed line at or before it.
+ *
+ * @param extent The extent.
+ * @param line The line wanted, from 1.
+ * @param position Receives where to start reading, for read_segment_extent().
+ *
+ * @return The number of the line that starts there.
+ */
+unsigned long long seek_segment_extent( const SegmentExtent & extent, unsigned long long line, unsigned long long & position );
+
+/**
+ * @brief Read an extent back, decoded.
+ *
+ * @param segment_fd The segment.
+ * @param extent The extent.
+ * @param position Where to start, from seek_segment_extent(), or 0 for the start.
+ * @param each Called with each piece of what the extent decodes to, in order.  Returns false to stop reading.
+ * @param error Receives why the extent could not be read.
+ *
+ * @return False if the extent could not be read or decoded.
+ */
+bool read_segment_extent(
+        int segment_fd,
+        const SegmentExtent & extent,
+        unsigned long long position,
+        const std::function<bool( const char *, size_t )> & each,
+        std::string & error
+);
+
+#endif //REX_LOGSEGMENTS_H
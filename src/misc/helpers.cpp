@@ -1,4 +1,5 @@
 #include "helpers.h"
+#include <cerrno>
 
 /**
  * @brief Determines if a file or directory exists
@@ -49,8 +50,7 @@ std::string get_working_path()
 bool is_file( std::string path)
 {
     struct stat buf;
-    stat( path.c_str(), &buf );
-    return S_ISREG(buf.st_mode);
+    return stat( path.c_str(), &buf ) == 0 && S_ISREG(buf.st_mode);
 }
 
 
@@ -68,8 +68,49 @@ bool is_file( std::string path)
 bool is_dir( std::string path )
 {
     struct stat buf;
-    stat( path.c_str(), &buf );
-    return S_ISDIR(buf.st_mode);
+    return stat( path.c_str(), &buf ) == 0 && S_ISDIR(buf.st_mode);
+}
+
+
+/**
+ * @brief Creates a directory and any of its parents that do not exist
+ *
+ * A directory that is created by someone else between the check and the `mkdir` call counts as created, so
+ * concurrently executing Tasks may prepare log directories under the same parent.
+ *
+ * @param path The directory to create
+ *
+ * @return `true` if the directory exists when the function returns, `false` otherwise
+ */
+bool createDirectory( const std::string& path )
+{
+    // Check if the directory already exists
+    struct stat info;
+    if ( stat( path.c_str(), &info ) == 0 && S_ISDIR( info.st_mode ) )
+    {
+        return true;
+    }
+
+    // Create the parents
+    size_t pos = 0;
+    std::string dir;
+    while ( ( pos = path.find_first_of( '/', pos + 1 ) ) != std::string::npos )
+    {
+        dir = path.substr( 0, pos );
+        if ( mkdir( dir.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH ) != 0 && errno != EEXIST )
+        {
+            return false;
+        }
+    }
+
+    // Create the final directory
+    if ( mkdir( path.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH ) != 0 && errno != EEXIST )
+    {
+        return false;
+    }
+
+    // something other than a directory may have been in the way
+    return stat( path.c_str(), &info ) == 0 && S_ISDIR( info.st_mode );
 }
 
 
@@ -86,8 +127,11 @@ std::string get_8601()
 {
     auto now = std::chrono::system_clock::now();
     auto itt = std::chrono::system_clock::to_time_t(now);
+    // every worker logs, so the broken-down time is kept here rather than in localtime()'s shared buffer
+    struct tm local;
+    localtime_r(&itt, &local);
     char buf[20];
-    strftime(buf, sizeof(buf), "%Y-%m-%d_%H:%M:%S", localtime(&itt));
+    strftime(buf, sizeof(buf), "%Y-%m-%d_%H:%M:%S", &local);
     return buf;
 }
 
@@ -115,12 +159,33 @@ std::string get_8601()
 //}
 void interpolate( std::string & text )
 {
+    interpolate( text, std::map<std::string, std::string>() );
+}
+
+/**
+ * @brief Interpolates variables in the input text, looking them up first in the given map and then in the environment
+ *
+ * This lets a Task's own parameters take part in interpolation without being set in Rex's environment, which is
+ * shared by every Task executing alongside it.
+ *
+ * @param text The input text to be processed
+ * @param variables Values that take precedence over the environment
+ */
+void interpolate( std::string & text, const std::map<std::string, std::string> & variables )
+{
+    // most text has nothing to interpolate, and compiling the patterns costs far more than this scan
+    if ( text.find( '$' ) == std::string::npos )
+    {
+        return;
+    }
+
     std::regex env1( "\\$\\{([^}]+)\\}" );
     std::regex env2( "\\$([^/]+)" ); // matches $VAR_NAME until a / is found
     std::smatch match;
     while ( std::regex_search( text, match, env1 ) || std::regex_search( text, match, env2 ) )
     {
-        const char * s = getenv( match[1].str().c_str() );
+        std::map<std::string, std::string>::const_iterator found = variables.find( match[1].str() );
+        const char * s = found != variables.end() ? found->second.c_str() : getenv( match[1].str().c_str() );
         const std::string var( s == NULL ? "" : s );
         text.replace( match[0].first, match[0].second, var );
     }
@@ -36,6 +36,7 @@
 #include <iomanip>
 #include <sstream>
 #include <vector>
+#include <map>
 #include <regex>
 
 
@@ -47,8 +48,12 @@ bool is_file( std::string );
 
 bool is_dir( std::string );
 
+// create a directory and any missing parents.  safe to call concurrently for overlapping paths.
+bool createDirectory( const std::string& path );
+
 // expand environment variables in string
 void interpolate( std::string & text);
+void interpolate( std::string & text, const std::map<std::string, std::string> & variables );
 
 std::string get_8601();
 
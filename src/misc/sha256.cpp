@@ -0,0 +1,198 @@
+/*
+    Rex - A configuration management and workflow automation tool that
+    compiles and runs in minimal environments.
+
+    © SILO GROUP and Chris Punches, 2020.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+#include "sha256.h"
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// FIPS 180-4 round constants
+static const uint32_t round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotate_right( uint32_t value, int bits )
+{
+    return ( value >> bits ) | ( value << ( 32 - bits ) );
+}
+
+
+Sha256::Sha256()
+{
+    this->state[0] = 0x6a09e667;
+    this->state[1] = 0xbb67ae85;
+    this->state[2] = 0x3c6ef372;
+    this->state[3] = 0xa54ff53a;
+    this->state[4] = 0x510e527f;
+    this->state[5] = 0x9b05688c;
+    this->state[6] = 0x1f83d9ab;
+    this->state[7] = 0x5be0cd19;
+    this->block_used = 0;
+    this->total_length = 0;
+}
+
+
+/**
+ * @brief Mix one 64 byte chunk into the state.
+ */
+void Sha256::compress( const unsigned char * chunk )
+{
+    uint32_t schedule[64];
+    for ( int i = 0; i < 16; i++ )
+    {
+        schedule[i] = ( (uint32_t) chunk[i * 4] << 24 ) | ( (uint32_t) chunk[i * 4 + 1] << 16 ) | ( (uint32_t) chunk[i * 4 + 2] << 8 ) | chunk[i * 4 + 3];
+    }
+    for ( int i = 16; i < 64; i++ )
+    {
+        uint32_t s0 = rotate_right( schedule[i - 15], 7 ) ^ rotate_right( schedule[i - 15], 18 ) ^ ( schedule[i - 15] >> 3 );
+        uint32_t s1 = rotate_right( schedule[i - 2], 17 ) ^ rotate_right( schedule[i - 2], 19 ) ^ ( schedule[i - 2] >> 10 );
+        schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+    }
+
+    uint32_t a = this->state[0], b = this->state[1], c = this->state[2], d = this->state[3];
+    uint32_t e = this->state[4], f = this->state[5], g = this->state[6], h = this->state[7];
+    for ( int i = 0; i < 64; i++ )
+    {
+        uint32_t S1 = rotate_right( e, 6 ) ^ rotate_right( e, 11 ) ^ rotate_right( e, 25 );
+        uint32_t choice = ( e & f ) ^ ( ~e & g );
+        uint32_t temp1 = h + S1 + choice + round_constants[i] + schedule[i];
+        uint32_t S0 = rotate_right( a, 2 ) ^ rotate_right( a, 13 ) ^ rotate_right( a, 22 );
+        uint32_t majority = ( a & b ) ^ ( a & c ) ^ ( b & c );
+        uint32_t temp2 = S0 + majority;
+        h = g; g = f; f = e; e = d + temp1;
+        d = c; c = b; b = a; a = temp1 + temp2;
+    }
+
+    this->state[0] += a; this->state[1] += b; this->state[2] += c; this->state[3] += d;
+    this->state[4] += e; this->state[5] += f; this->state[6] += g; this->state[7] += h;
+}
+
+
+void Sha256::update( const void * data, size_t length )
+{
+    const unsigned char * bytes = (const unsigned char *) data;
+    this->total_length += length;
+
+    // top up a partial block first
+    if ( this->block_used > 0 )
+    {
+        size_t take = 64 - this->block_used;
+        if ( take > length ) { take = length; }
+        memcpy( this->block + this->block_used, bytes, take );
+        this->block_used += take;
+        bytes += take;
+        length -= take;
+        if ( this->block_used < 64 ) { return; }
+        this->compress( this->block );
+        this->block_used = 0;
+    }
+
+    // whole blocks straight from the input
+    while ( length >= 64 )
+    {
+        this->compress( bytes );
+        bytes += 64;
+        length -= 64;
+    }
+
+    memcpy( this->block, bytes, length );
+    this->block_used = length;
+}
+
+
+void Sha256::update( const std::string & data )
+{
+    this->update( data.data(), data.size() );
+}
+
+
+void Sha256::update_field( const std::string & field )
+{
+    this->update( std::to_string( field.size() ) + ":" );
+    this->update( field );
+}
+
+
+bool Sha256::update_file( const std::string & path )
+{
+    int fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+    {
+        return false;
+    }
+
+    struct stat info;
+    if ( fstat( fd, &info ) != 0 || ! S_ISREG( info.st_mode ) )
+    {
+        close( fd );
+        return false;
+    }
+    this->update( std::to_string( info.st_size ) + ":" );
+
+    char buffer[65536];
+    ssize_t got;
+    while ( ( got = read( fd, buffer, sizeof( buffer ) ) ) != 0 )
+    {
+        if ( got < 0 )
+        {
+            if ( errno == EINTR ) { continue; }
+            close( fd );
+            return false;
+        }
+        this->update( buffer, got );
+    }
+    close( fd );
+    return true;
+}
+
+
+std::string Sha256::hex_digest()
+{
+    uint64_t bit_length = this->total_length * 8;
+
+    // pad with a 1 bit, zeroes, and the message length in bits, to a whole number of blocks
+    unsigned char padding[72] = { 0x80 };
+    size_t padding_length = ( this->block_used < 56 ) ? 56 - this->block_used : 120 - this->block_used;
+    for ( int i = 0; i < 8; i++ )
+    {
+        padding[padding_length + i] = (unsigned char) ( bit_length >> ( 56 - i * 8 ) );
+    }
+    this->update( padding, padding_length + 8 );
+
+    static const char hex[] = "0123456789abcdef";
+    std::string digest;
+    for ( int i = 0; i < 8; i++ )
+    {
+        for ( int shift = 28; shift >= 0; shift -= 4 )
+        {
+            digest += hex[ ( this->state[i] >> shift ) & 0xf ];
+        }
+    }
+    return digest;
+}
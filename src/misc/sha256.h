@@ -0,0 +1,61 @@
+/*
+    Rex - A configuration management and workflow automation tool that
+    compiles and runs in minimal environments.
+
+    © SILO GROUP and Chris Punches, 2020.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef REX_SHA256_H
+#define REX_SHA256_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @class Sha256
+ * @brief Incremental SHA-256 digest, so Rex can fingerprint files without depending on a crypto library.
+ */
+class Sha256
+{
+    public:
+        Sha256();
+
+        // add bytes to the digest
+        void update( const void * data, size_t length );
+        void update( const std::string & data );
+
+        // add a string prefixed by its length, so that consecutive fields can't run into each other
+        void update_field( const std::string & field );
+
+        // add the contents of a regular file, prefixed by its size.
+        // returns false if the file can't be read, after which the digest is meaningless.
+        bool update_file( const std::string & path );
+
+        // finish the digest and return it as 64 lowercase hex characters.  the object can't be updated afterwards.
+        std::string hex_digest();
+
+    private:
+        uint32_t state[8];
+        unsigned char block[64];
+        size_t block_used;
+        uint64_t total_length;
+
+        void compress( const unsigned char * chunk );
+};
+
+#endif //REX_SHA256_H
@@ -0,0 +1,158 @@
+/*
+    Rex - A configuration management and workflow automation tool that
+    compiles and runs in minimal environments.
+    © SILO GROUP and Chris Punches, 2020.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "DurationHistory.h"
+
+
+/**
+ * @brief Constructor for DurationHistory class.
+ *
+ * @param LOG_LEVEL The logging level to use.
+ */
+DurationHistory::DurationHistory( int LOG_LEVEL ): JSON_Loader( LOG_LEVEL ), slog( LOG_LEVEL, "_history_" )
+{
+    this->LOG_LEVEL = LOG_LEVEL;
+}
+
+
+/**
+ * @brief Load estimates recorded by previous runs.
+ *
+ * The file holds a single object, `durations`, mapping task names to their estimated duration in milliseconds.
+ * A missing or unreadable history file is not an error; every task simply has no history.
+ *
+ * @param path The path of the history file.
+ */
+void DurationHistory::load( std::string path )
+{
+    this->estimates.clear();
+
+    if (! exists( path ) )
+    {
+        this->slog.log( E_DEBUG, "No duration history at '" + path + "'." );
+        return;
+    }
+
+    Json::Value jbuff;
+    try {
+        this->load_json_file( path );
+        if ( this->get_serialized( jbuff, "durations" ) != 0 || ! jbuff.isObject() )
+        {
+            this->slog.log( E_WARN, "Ignoring malformed duration history at '" + path + "'." );
+            return;
+        }
+    } catch ( std::exception& e ) {
+        this->slog.log( E_WARN, "Ignoring unreadable duration history at '" + path + "': " + e.what() );
+        return;
+    }
+
+    for ( Json::Value::const_iterator it = jbuff.begin(); it != jbuff.end(); it++ )
+    {
+        if ( it->isIntegral() && it->asInt64() >= 0 )
+        {
+            this->estimates[ it.name() ] = it->asInt64();
+        }
+    }
+    this->slog.log( E_DEBUG, "Loaded duration history for " + std::to_string( this->estimates.size() ) + " task(s)." );
+}
+
+
+/**
+ * @brief Retrieve the estimated duration of a task.
+ *
+ * @param name The name of the task.
+ * @param default_ms The estimate to use for a task with no history.
+ *
+ * @return The estimated duration in milliseconds.
+ */
+long long DurationHistory::get_estimate( const std::string & name, long long default_ms )
+{
+    std::unordered_map<std::string, long long>::const_iterator found = this->estimates.find( name );
+    if ( found == this->estimates.end() )
+    {
+        return default_ms;
+    }
+    return found->second;
+}
+
+
+/**
+ * @brief Fold a measured duration into the estimate for a task.
+ *
+ * The new estimate is 70% of the previous estimate and 30% of the measurement, so one unusually slow or fast run
+ * moves the estimate without replacing it.  A task's first measurement becomes its estimate.
+ *
+ * @param name The name of the task.
+ * @param duration_ms The measured duration in milliseconds.
+ */
+void DurationHistory::record( const std::string & name, long long duration_ms )
+{
+    std::unordered_map<std::string, long long>::iterator found = this->estimates.find( name );
+    if ( found == this->estimates.end() )
+    {
+        this->estimates[ name ] = duration_ms;
+    } else {
+        found->second = ( found->second * 7 + duration_ms * 3 ) / 10;
+    }
+}
+
+
+/**
+ * @brief Write the estimates to disk, replacing the previous history atomically.
+ *
+ * The history is written next to its final location and renamed over it, so a run interrupted while saving leaves the
+ * previous history intact.
+ *
+ * @param path The path of the history file.
+ *
+ * @return True if the history was written.
+ */
+bool DurationHistory::save( std::string path )
+{
+    Json::Value durations( Json::objectValue );
+    for ( std::unordered_map<std::string, long long>::const_iterator it = this->estimates.begin(); it != this->estimates.end(); it++ )
+    {
+        durations[ it->first ] = (Json::Int64) it->second;
+    }
+
+    Json::Value root( Json::objectValue );
+    root["durations"] = durations;
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    std::string serialized = Json::writeString( builder, root );
+
+    std::string staging_path = path + ".tmp";
+    FILE * fh = fopen( staging_path.c_str(), "we" );
+    if ( fh == NULL )
+    {
+        this->slog.log( E_WARN, "Could not write duration history to '" + staging_path + "'." );
+        return false;
+    }
+
+    bool written = fwrite( serialized.data(), 1, serialized.size(), fh ) == serialized.size();
+    written = ( fclose( fh ) == 0 ) && written;
+
+    if (! written || rename( staging_path.c_str(), path.c_str() ) != 0 )
+    {
+        this->slog.log( E_WARN, "Could not write duration history to '" + path + "'." );
+        unlink( staging_path.c_str() );
+        return false;
+    }
+
+    this->slog.log( E_DEBUG, "Saved duration history for " + std::to_string( this->estimates.size() ) + " task(s) to '" + path + "'." );
+    return true;
+}
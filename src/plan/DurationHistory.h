@@ -0,0 +1,90 @@
+/*
+    Rex - A configuration management and workflow automation tool that
+    compiles and runs in minimal environments.
+    © SILO GROUP and Chris Punches, 2020.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef REX_DURATIONHISTORY_H
+#define REX_DURATIONHISTORY_H
+
+#include "../json_support/JSON.h"
+#include "../logger/Logger.h"
+#include <string>
+#include <unordered_map>
+#include <cstdio>
+
+/**
+ * @class DurationHistory
+ * @brief Per-task execution times carried over from previous runs.
+ *
+ * The Plan uses these estimates to find the critical path through its dependency graph.  Each task keeps a single
+ * estimate that is a weighted average of its measured durations, favouring recent runs.  History is keyed by task
+ * name, so it survives reordering or editing of the plan file.
+ */
+class DurationHistory: public JSON_Loader
+{
+    public:
+        /**
+         * @brief Constructor for DurationHistory class.
+         *
+         * @param LOG_LEVEL The logging level to use.
+         */
+        DurationHistory( int LOG_LEVEL );
+
+        /**
+         * @brief Load estimates recorded by previous runs.
+         *
+         * A missing or unreadable history file is not an error; every task simply has no history.
+         *
+         * @param path The path of the history file.
+         */
+        void load( std::string path );
+
+        /**
+         * @brief Retrieve the estimated duration of a task.
+         *
+         * @param name The name of the task.
+         * @param default_ms The estimate to use for a task with no history.
+         *
+         * @return The estimated duration in milliseconds.
+         */
+        long long get_estimate( const std::string & name, long long default_ms );
+
+        /**
+         * @brief Fold a measured duration into the estimate for a task.
+         *
+         * @param name The name of the task.
+         * @param duration_ms The measured duration in milliseconds.
+         */
+        void record( const std::string & name, long long duration_ms );
+
+        /**
+         * @brief Write the estimates to disk, replacing the previous history atomically.
+         *
+         * @param path The path of the history file.
+         *
+         * @return True if the history was written.
+         */
+        bool save( std::string path );
+
+    private:
+        /// estimated duration in milliseconds, by task name
+        std::unordered_map<std::string, long long> estimates;
+
+        /// The logging level to use.
+        int LOG_LEVEL;
+        /// A logger for logging messages.
+        Logger slog;
+};
+
+#endif //REX_DURATIONHISTORY_H
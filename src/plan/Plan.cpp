@@ -19,6 +19,9 @@
 
 */
 #include "Plan.h"
+#include "../logs/LogSegments.h"
+#include <algorithm>
+#include <chrono>
 
 
 /**
@@ -165,6 +168,145 @@ protected:
 };
 
 
+/**
+ * @class Plan_Cyclic_Dependency
+ * @brief Exception thrown when the dependencies of the Tasks in a Plan form a cycle.
+ *
+ * This class is derived from std::runtime_error and is used to indicate that no Task in a cycle could ever execute.
+ * The message names the Tasks that make up the cycle.
+ */
+class Plan_Cyclic_Dependency : public std::runtime_error {
+    public:
+        /**
+         * @brief Constructs a Plan_Cyclic_Dependency object.
+         *
+         * @param cycle A description of the Tasks forming the cycle.
+         */
+        explicit Plan_Cyclic_Dependency(const std::string& cycle) : std::runtime_error("Plan: Dependency cycle: " + cycle) {}
+};
+
+
+/**
+ * @class Plan_Resource_Unsatisfiable
+ * @brief Exception thrown when a Task claims resource tokens that the configuration can never provide.
+ *
+ * This class is derived from std::runtime_error and is used to indicate that a Task claims a resource that is not
+ * declared in the configuration, or more tokens of it than its capacity, and so could never be started.
+ */
+class Plan_Resource_Unsatisfiable : public std::runtime_error {
+    public:
+        /**
+         * @brief Constructs a Plan_Resource_Unsatisfiable object.
+         *
+         * @param problem A description of the offending claim.
+         */
+        explicit Plan_Resource_Unsatisfiable(const std::string& problem) : std::runtime_error("Plan: Unsatisfiable resource claim: " + problem) {}
+};
+
+
+/**
+ * @class Plan_Invalid_Matrix
+ * @brief Exception thrown when the matrix of a plan entry can not be expanded.
+ *
+ * This class is derived from std::runtime_error and is used to indicate that a matrix is not an object of variable
+ * names to non-empty arrays of string values.
+ */
+class Plan_Invalid_Matrix : public std::runtime_error {
+    public:
+        /**
+         * @brief Constructs a Plan_Invalid_Matrix object.
+         *
+         * @param problem A description of what is wrong with the matrix.
+         */
+        explicit Plan_Invalid_Matrix(const std::string& problem) : std::runtime_error("Plan: Invalid matrix: " + problem) {}
+};
+
+
+/**
+ * @class Plan_Preflight_Failed
+ * @brief Exception thrown when the preflight checks find tasks that could not execute.
+ *
+ * This class is derived from std::runtime_error.  The problems themselves have already been logged; the message only
+ * counts them.
+ */
+class Plan_Preflight_Failed : public std::runtime_error {
+    public:
+        /**
+         * @brief Constructs a Plan_Preflight_Failed object.
+         *
+         * @param problem_count The number of problems found.
+         */
+        explicit Plan_Preflight_Failed(int problem_count) : std::runtime_error("Plan: Preflight found " + std::to_string( problem_count ) + " problem(s).") {}
+};
+
+
+/**
+ * @brief The number of tasks a plan entry expands into: one per combination of its matrix values, or one without a matrix.
+ */
+static size_t instance_count( const Json::Value & entry )
+{
+    if (! entry.isObject() || ! entry.isMember("matrix") || ! entry["matrix"].isObject() )
+    {
+        return 1;
+    }
+    size_t count = 1;
+    for ( Json::Value::const_iterator it = entry["matrix"].begin(); it != entry["matrix"].end(); it++ )
+    {
+        count *= it->isArray() ? it->size() : 1;
+    }
+    return count;
+}
+
+
+/**
+ * @brief Whether a matrix variable name can be exported to a child's environment.
+ */
+static bool is_variable_name( const std::string & name )
+{
+    if ( name.empty() || isdigit( (unsigned char) name[0] ) )
+    {
+        return false;
+    }
+    for ( int i = 0; i < name.size(); i++ )
+    {
+        if (! isalnum( (unsigned char) name[i] ) && name[i] != '_' )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * @brief Why a matrix value can't be part of a Task's name, or nothing if it can.
+ *
+ * The name of an instance is a directory of its logs, and a field of the lines of the run journal and the duration
+ * history, so a value must not climb out of logs_path, end a line or a field, or be mistaken for the punctuation the
+ * name is put together with.
+ */
+static std::string matrix_value_problem( const std::string & value )
+{
+    if ( value.find( ".." ) != std::string::npos )
+    {
+        return "'..'";
+    }
+    for ( size_t i = 0; i < value.size(); i++ )
+    {
+        unsigned char c = value[i];
+        if ( c < 0x20 || c == 0x7f )
+        {
+            return "a control character";
+        }
+        if ( c == '/' || c == '[' || c == ']' || c == ',' || c == '=' )
+        {
+            return std::string( "'" ) + value[i] + "'";
+        }
+    }
+    return "";
+}
+
+
 /**
  * @brief Constructor for Plan class.
  *
@@ -175,7 +317,7 @@ protected:
  * @param configuration A pointer to a Conf object that holds the configuration information.
  * @param LOG_LEVEL The logging level for the plan.
  */
-Plan::Plan(Conf * configuration, int LOG_LEVEL ): JSON_Loader(LOG_LEVEL ), slog(LOG_LEVEL, "_plan_" )
+Plan::Plan(Conf * configuration, int LOG_LEVEL ): JSON_Loader(LOG_LEVEL ), slog(LOG_LEVEL, "_plan_" ), history( LOG_LEVEL ), journal( LOG_LEVEL )
 {
     this->configuration = configuration;
     this->LOG_LEVEL = LOG_LEVEL;
@@ -189,6 +331,8 @@ Plan::Plan(Conf * configuration, int LOG_LEVEL ): JSON_Loader(LOG_LEVEL ), slog(
  */
 void Plan::load_plan_file( std::string filename )
 {
+    this->plan_path = filename;
+
     // plan always loads from file
     this->load_json_file( filename );
 
@@ -202,14 +346,246 @@ void Plan::load_plan_file( std::string filename )
     }
 
     // iterate through the json::value members that have been loaded.  append to this->tasks vector
-    // buffer for tasks to append:
-    Task tmp_T = Task( this->LOG_LEVEL );
+    // tasks are constructed in place, as large plans make copying a buffer Task measurable.
+    size_t expanded_size = this->tasks.size();
     for ( int index = 0; index < this->json_root.size(); index++ )
     {
-        tmp_T.load_root( this->json_root[ index ] );
-        this->tasks.push_back( tmp_T );
-        this->slog.log( LOG_INFO, "Added task \"" + tmp_T.get_name() + "\" to Plan." );
+        expanded_size += instance_count( this->json_root[ index ] );
     }
+    this->tasks.reserve( expanded_size );
+    for ( int index = 0; index < this->json_root.size(); index++ )
+    {
+        if ( this->json_root[ index ].isMember("matrix") )
+        {
+            this->expand_matrix( this->json_root[ index ] );
+            continue;
+        }
+
+        this->tasks.emplace_back( this->LOG_LEVEL );
+        this->tasks.back().load_root( this->json_root[ index ] );
+        this->slog.log( LOG_INFO, "Added task \"" + this->tasks.back().get_name() + "\" to Plan." );
+    }
+
+    this->build_graph();
+}
+
+
+/**
+ * @brief Append one task for every combination of values in the matrix of a plan entry.
+ *
+ * A matrix maps variable names to arrays of values, as in { "arch": [ "x86_64", "aarch64" ], "distro": [ "el8", "el9" ] },
+ * which expands into four tasks.  Every instance executes the unit named by the entry and has the entry's dependencies,
+ * and receives its values as environment variables of the same names.
+ *
+ * @param entry The plan entry.
+ *
+ * @throws Plan_Invalid_Matrix if the matrix is not an object of variable names to non-empty arrays of strings, or a value
+ *         contains '/', '..', a control character, '[', ']', ',' or '='.
+ */
+void Plan::expand_matrix( const Json::Value & entry )
+{
+    std::string name = entry.get( "name", "?" ).asString();
+    const Json::Value & matrix = entry["matrix"];
+    if (! matrix.isObject() || matrix.empty() )
+    {
+        throw Plan_Invalid_Matrix( "The matrix of \"" + name + "\" must be an object of variable names to arrays of values." );
+    }
+
+    std::vector<std::string> variables = matrix.getMemberNames();
+    for ( int v = 0; v < variables.size(); v++ )
+    {
+        if (! is_variable_name( variables[v] ) )
+        {
+            throw Plan_Invalid_Matrix( "The matrix of \"" + name + "\" has variable \"" + variables[v] + "\", which is not a valid environment variable name." );
+        }
+        const Json::Value & values = matrix[ variables[v] ];
+        if (! values.isArray() || values.empty() )
+        {
+            throw Plan_Invalid_Matrix( "Variable \"" + variables[v] + "\" in the matrix of \"" + name + "\" must be a non-empty array of values." );
+        }
+        for ( Json::ArrayIndex i = 0; i < values.size(); i++ )
+        {
+            if (! values[i].isString() )
+            {
+                throw Plan_Invalid_Matrix( "Variable \"" + variables[v] + "\" in the matrix of \"" + name + "\" must be an array of strings." );
+            }
+            std::string problem = matrix_value_problem( values[i].asString() );
+            if (! problem.empty() )
+            {
+                throw Plan_Invalid_Matrix( "Variable \"" + variables[v] + "\" in the matrix of \"" + name + "\" has a value containing " + problem + ", which can't be part of a Task name." );
+            }
+        }
+    }
+
+    // count through the combinations like an odometer, the last variable turning fastest
+    std::vector<Json::ArrayIndex> position( variables.size(), 0 );
+    std::vector<int> & instances = this->matrix_instances[ name ];
+    std::map<std::string, std::string> parameters;
+    while ( true )
+    {
+        for ( int v = 0; v < variables.size(); v++ )
+        {
+            parameters[ variables[v] ] = matrix[ variables[v] ][ position[v] ].asString();
+        }
+
+        this->tasks.emplace_back( this->LOG_LEVEL );
+        this->tasks.back().load_root( entry );
+        this->tasks.back().set_parameters( parameters );
+        instances.push_back( this->tasks.size() - 1 );
+        this->slog.log( LOG_INFO, "Added task \"" + this->tasks.back().get_name() + "\" to Plan." );
+
+        int v = variables.size() - 1;
+        while ( v >= 0 && ++position[v] == matrix[ variables[v] ].size() )
+        {
+            position[v] = 0;
+            v--;
+        }
+        if ( v < 0 )
+        {
+            break;
+        }
+    }
+}
+
+
+/**
+ * @brief Build the dependency graph of the plan.
+ *
+ * Names are resolved to indices once, here, so that nothing during execution has to search the Task vector.  The
+ * graph is stored as two compressed adjacency lists (dependencies and dependents of each task) and sorted
+ * topologically with Kahn's algorithm, which also detects cycles: any task left unsorted is on, or behind, a cycle.
+ *
+ * A dependency on the name of a matrix entry is a dependency on every instance of it.
+ *
+ * @throws Plan_Task_Missing_Dependency if a task depends on a task that is not in the plan.
+ * @throws Plan_Cyclic_Dependency if the dependencies of the plan form a cycle.
+ */
+void Plan::build_graph()
+{
+    int task_count = this->tasks.size();
+
+    this->task_index.clear();
+    this->task_index.reserve( task_count );
+    for ( int i = 0; i < task_count; i++ )
+    {
+        if (! this->task_index.emplace( this->tasks[i].get_name(), i ).second )
+        {
+            this->slog.log( E_WARN, "Task \"" + this->tasks[i].get_name() + "\" appears more than once in the Plan.  Dependencies on it refer to its first occurrence." );
+        }
+    }
+
+    // resolve every dependency name, counting dependents as we go
+    this->dependency_offsets.assign( task_count + 1, 0 );
+    this->dependency_list.clear();
+    this->in_degree.assign( task_count, 0 );
+    std::vector<int> dependent_counts( task_count, 0 );
+
+    for ( int i = 0; i < task_count; i++ )
+    {
+        this->dependency_offsets[i] = this->dependency_list.size();
+
+        std::vector<std::string> deps = this->tasks[i].get_dependencies();
+        for ( int d = 0; d < deps.size(); d++ )
+        {
+            std::unordered_map<std::string, int>::const_iterator found = this->task_index.find( deps[d] );
+            if ( found != this->task_index.end() )
+            {
+                this->dependency_list.push_back( found->second );
+                dependent_counts[ found->second ]++;
+                this->in_degree[i]++;
+                continue;
+            }
+
+            std::unordered_map<std::string, std::vector<int> >::const_iterator fan_in = this->matrix_instances.find( deps[d] );
+            if ( fan_in == this->matrix_instances.end() )
+            {
+                this->slog.log( E_FATAL, "[ '" + this->tasks[i].get_name() + "' ] Depends on \"" + deps[d] + "\", which is not in the Plan.  Please revise your plan." );
+                throw Plan_Task_Missing_Dependency( "Task \"" + this->tasks[i].get_name() + "\" depends on undefined task \"" + deps[d] + "\"." );
+            }
+            for ( int m = 0; m < fan_in->second.size(); m++ )
+            {
+                this->dependency_list.push_back( fan_in->second[m] );
+                dependent_counts[ fan_in->second[m] ]++;
+                this->in_degree[i]++;
+            }
+        }
+    }
+    this->dependency_offsets[ task_count ] = this->dependency_list.size();
+
+    // invert into the dependents list
+    this->dependent_offsets.assign( task_count + 1, 0 );
+    for ( int i = 0; i < task_count; i++ )
+    {
+        this->dependent_offsets[i + 1] = this->dependent_offsets[i] + dependent_counts[i];
+    }
+    this->dependent_list.assign( this->dependency_list.size(), 0 );
+    std::vector<int> fill( this->dependent_offsets.begin(), this->dependent_offsets.end() - 1 );
+    for ( int i = 0; i < task_count; i++ )
+    {
+        for ( int e = this->dependency_offsets[i]; e < this->dependency_offsets[i + 1]; e++ )
+        {
+            this->dependent_list[ fill[ this->dependency_list[e] ]++ ] = i;
+        }
+    }
+
+    // Kahn's algorithm
+    this->topological_order.clear();
+    this->topological_order.reserve( task_count );
+    std::vector<int> remaining( this->in_degree );
+    for ( int i = 0; i < task_count; i++ )
+    {
+        if ( remaining[i] == 0 )
+        {
+            this->topological_order.push_back( i );
+        }
+    }
+    for ( int head = 0; head < this->topological_order.size(); head++ )
+    {
+        int current = this->topological_order[head];
+        for ( int e = this->dependent_offsets[current]; e < this->dependent_offsets[current + 1]; e++ )
+        {
+            if ( --remaining[ this->dependent_list[e] ] == 0 )
+            {
+                this->topological_order.push_back( this->dependent_list[e] );
+            }
+        }
+    }
+
+    if ( this->topological_order.size() != task_count )
+    {
+        // every unsorted task still has an unsorted dependency, so following those must eventually revisit a task.
+        int start = 0;
+        while ( remaining[start] == 0 ) { start++; }
+
+        std::vector<int> visited_at( task_count, -1 );
+        std::vector<int> path;
+        int current = start;
+        while ( visited_at[current] == -1 )
+        {
+            visited_at[current] = path.size();
+            path.push_back( current );
+            for ( int e = this->dependency_offsets[current]; e < this->dependency_offsets[current + 1]; e++ )
+            {
+                if ( remaining[ this->dependency_list[e] ] != 0 )
+                {
+                    current = this->dependency_list[e];
+                    break;
+                }
+            }
+        }
+
+        std::string cycle;
+        for ( int p = visited_at[current]; p < path.size(); p++ )
+        {
+            cycle += "\"" + this->tasks[ path[p] ].get_name() + "\" -> ";
+        }
+        cycle += "\"" + this->tasks[current].get_name() + "\"";
+
+        this->slog.log( E_FATAL, "The dependencies in this Plan form a cycle: " + cycle + ".  Please revise your plan." );
+        throw Plan_Cyclic_Dependency( cycle );
+    }
+
+    this->slog.log( E_DEBUG, "Built dependency graph of " + std::to_string( task_count ) + " task(s) and " + std::to_string( this->dependency_list.size() ) + " dependency edge(s)." );
 }
 
 
@@ -223,7 +599,7 @@ void Plan::load_plan_file( std::string filename )
  */
 void Plan::get_task(Task & result, int index )
 {
-    if ( index <= this->tasks.size() )
+    if ( index >= 0 && index < this->tasks.size() )
     {
         result = this->tasks[ index ];
     } else {
@@ -237,7 +613,7 @@ void Plan::get_task(Task & result, int index )
  *
  * @param unit_definitions The Suite to load definitions from.
  */
-void Plan::load_definitions( Suite unit_definitions )
+void Plan::load_definitions( Suite & unit_definitions )
 {
     // placeholder Unit
     Unit tmp_U = Unit( this->LOG_LEVEL );
@@ -246,40 +622,168 @@ void Plan::load_definitions( Suite unit_definitions )
     for (int i = 0; i < this->tasks.size(); i++ )
     {
         // load the tmp_U corresponding to that task name
-        unit_definitions.get_unit( tmp_U, this->tasks[i].get_name() );
+        unit_definitions.get_unit( tmp_U, this->tasks[i].get_unit_name() );
 
         // then have that task attach a copy of tmp_U
         this->tasks[i].load_definition( tmp_U );
     }
+
+    this->resolve_resources();
 }
 
 
 /**
- * @brief Retrieve a task by name.
+ * @brief Load the units of every task and check that every task could execute, before anything does.
  *
- * @param result The variable receiving the value.
- * @param provided_name The name to find a task by.
+ * Problems that would otherwise surface one at a time, possibly hours into a run, are all found here: units that are
+ * not defined, resource claims that can never be granted, and whatever Task::preflight finds.  The per-task checks
+ * mostly wait on the filesystem and the user database, so they are spread across threads.  Problems are logged in
+ * plan order.
  *
- * @throws Plan_InvalidTaskName if a task with the provided name is not found.
+ * @param unit_definitions The Suite to load definitions from.
+ *
+ * @throws Plan_Preflight_Failed if any task could not execute.
  */
-void Plan::get_task(Task & result, std::string provided_name )
+void Plan::preflight( Suite & unit_definitions )
 {
-    bool foundMatch = false;
+    int task_count = this->tasks.size();
+
+    // units that are not defined are left for Task::preflight to report
+    Unit tmp_U = Unit( this->LOG_LEVEL );
+    for ( int i = 0; i < task_count; i++ )
+    {
+        if ( unit_definitions.has_unit( this->tasks[i].get_unit_name() ) )
+        {
+            unit_definitions.get_unit( tmp_U, this->tasks[i].get_unit_name() );
+            this->tasks[i].load_definition( tmp_U );
+        }
+    }
 
+    std::vector<std::string> resource_problems;
+    this->resolve_resources( &resource_problems );
+
+    std::vector< std::vector<std::string> > problems( task_count );
+    std::atomic<int> next_task( 0 );
+    int checkers = std::max( this->configuration->get_jobs(), (int) std::thread::hardware_concurrency() );
+    checkers = std::max( 1, std::min( checkers, task_count ) );
+
+    std::vector<std::thread> threads;
+    for ( int t = 0; t < checkers; t++ )
+    {
+        threads.emplace_back( [&]() {
+            int i;
+            while ( ( i = next_task++ ) < task_count )
+            {
+                problems[i] = this->tasks[i].preflight( this->configuration );
+            }
+        } );
+    }
+    for ( int t = 0; t < threads.size(); t++ )
+    {
+        threads[t].join();
+    }
+
+    int problem_count = resource_problems.size();
+    for ( int i = 0; i < task_count; i++ )
+    {
+        for ( int p = 0; p < problems[i].size(); p++ )
+        {
+            this->slog.log( E_FATAL, "[ '" + this->tasks[i].get_name() + "' ] " + problems[i][p] );
+            problem_count++;
+        }
+    }
+    for ( int p = 0; p < resource_problems.size(); p++ )
+    {
+        this->slog.log( E_FATAL, resource_problems[p] );
+    }
+
+    if ( problem_count > 0 )
+    {
+        throw Plan_Preflight_Failed( problem_count );
+    }
+    this->slog.log( E_INFO, "Preflight: " + std::to_string( task_count ) + " task(s) checked, no problems found." );
+}
+
+
+/**
+ * @brief Resolve the resource claims of every task against the capacities declared in the configuration.
+ *
+ * Claims are converted to indices once here so that the scheduler only compares integers while it runs.  A claim
+ * that can never be granted is rejected now rather than leaving the task waiting forever.
+ *
+ * @param problems If supplied, receives a description of every claim that can never be granted, instead of the first
+ *        one being thrown.  Tasks without a definition are skipped.
+ *
+ * @throws Plan_Resource_Unsatisfiable if a task claims an undeclared resource or more tokens than its capacity.
+ */
+void Plan::resolve_resources( std::vector<std::string> * problems )
+{
+    this->resource_names.clear();
+    this->resource_capacity.clear();
+    std::unordered_map<std::string, int> resource_index;
+
+    std::map<std::string, int> capacities = this->configuration->get_resources();
+    for ( std::map<std::string, int>::iterator it = capacities.begin(); it != capacities.end(); it++ )
+    {
+        resource_index[ it->first ] = this->resource_names.size();
+        this->resource_names.push_back( it->first );
+        this->resource_capacity.push_back( it->second );
+    }
+
+    this->resource_claims.assign( this->tasks.size(), std::vector< std::pair<int, int> >() );
     for ( int i = 0; i < this->tasks.size(); i++ )
     {
-        if ( this->tasks[i].get_name() == provided_name )
+        if ( problems != nullptr && ! this->tasks[i].has_definition() )
         {
-            result = this->tasks[i];
-            foundMatch = true;
-            break;
+            continue;
+        }
+
+        std::map<std::string, int> claims = this->tasks[i].get_resources();
+        for ( std::map<std::string, int>::iterator it = claims.begin(); it != claims.end(); it++ )
+        {
+            std::string problem;
+            std::unordered_map<std::string, int>::const_iterator found = resource_index.find( it->first );
+            if ( found == resource_index.end() )
+            {
+                problem = "Task '" + this->tasks[i].get_name() + "' claims resource '" + it->first + "', which is not declared in the configuration.";
+            } else if ( it->second > this->resource_capacity[ found->second ] ) {
+                problem = "Task '" + this->tasks[i].get_name() + "' claims " + std::to_string( it->second ) + " token(s) of resource '" + it->first + "', which only has " + std::to_string( this->resource_capacity[ found->second ] ) + ".";
+            }
+            if (! problem.empty() )
+            {
+                if ( problems == nullptr )
+                {
+                    throw Plan_Resource_Unsatisfiable( problem );
+                }
+                problems->push_back( problem );
+                continue;
+            }
+            if ( it->second > 0 )
+            {
+                this->resource_claims[i].push_back( std::make_pair( found->second, it->second ) );
+            }
         }
     }
-    if (! foundMatch )
+}
+
+
+/**
+ * @brief Retrieve a task by name.
+ *
+ * @param result The variable receiving the value.
+ * @param provided_name The name to find a task by.
+ *
+ * @throws Plan_InvalidTaskName if a task with the provided name is not found.
+ */
+void Plan::get_task(Task & result, std::string provided_name )
+{
+    int index = this->index_of( provided_name );
+    if ( index == -1 )
     {
         this->slog.log( E_FATAL, "Task name \"" + provided_name + "\" was referenced but not defined!" );
         throw Plan_InvalidTaskName();
     }
+    result = this->tasks[index];
 }
 
 
@@ -292,22 +796,17 @@ void Plan::get_task(Task & result, std::string provided_name )
  */
 bool Plan::all_dependencies_complete(std::string name)
 {
-    // get the task by name
-    Task named_task = Task( this->LOG_LEVEL );
-    this->get_task( named_task, name );
-
-    // get the dependencies of that task
-    std::vector<std::string> deps = named_task.get_dependencies();
+    int index = this->index_of( name );
+    if ( index == -1 )
+    {
+        this->slog.log( E_FATAL, "Task name \"" + name + "\" was referenced but not defined!" );
+        throw Plan_InvalidTaskName();
+    }
 
-    // create an empty task to assign values to during iteration
-    Task tmpTask = Task( this->LOG_LEVEL );
-    // iterate through its dependencies
-    for ( int i = 0; i < deps.size(); i++ )
+    for ( int e = this->dependency_offsets[index]; e < this->dependency_offsets[index + 1]; e++ )
     {
-        this->get_task( tmpTask, deps[i]);
-        if (! tmpTask.is_complete() )
+        if (! this->tasks[ this->dependency_list[e] ].is_complete() )
         {
-            // error message?
             return false;
         }
     }
@@ -316,28 +815,494 @@ bool Plan::all_dependencies_complete(std::string name)
 
 
 /**
- * @brief Iterate through all tasks in the plan and execute them.
+ * @brief Find the position of a named task in the Task vector.
+ *
+ * @param name The name of the task to find.
+ *
+ * @return The index of the task, or -1 if the plan has no task with that name.
  */
-void Plan::execute()
+int Plan::index_of( const std::string & name )
 {
-    // for each task in this plan
-    for ( int i = 0; i < this->tasks.size(); i++ )
+    std::unordered_map<std::string, int>::const_iterator found = this->task_index.find( name );
+    if ( found == this->task_index.end() )
     {
-        if (this->all_dependencies_complete(this->tasks[i].get_name()) )
+        return -1;
+    }
+    return found->second;
+}
+
+
+/**
+ * @brief Estimate the remaining path of every task.
+ *
+ * The remaining path of a task is its own estimated duration plus the longest remaining path among the tasks that
+ * depend on it, i.e. the least time the plan can still take once that task starts.  Walking the topological order
+ * backwards visits every dependent before the tasks it depends on.
+ *
+ * @return The estimated remaining path of each task, in milliseconds.
+ */
+std::vector<long long> Plan::compute_remaining_paths()
+{
+    long long default_ms = (long long) this->configuration->get_default_task_estimate() * 1000;
+
+    std::vector<long long> remaining_path( this->tasks.size(), 0 );
+    for ( int t = (int) this->topological_order.size() - 1; t >= 0; t-- )
+    {
+        int current = this->topological_order[t];
+
+        long long longest_dependent = 0;
+        for ( int e = this->dependent_offsets[current]; e < this->dependent_offsets[current + 1]; e++ )
         {
+            if ( remaining_path[ this->dependent_list[e] ] > longest_dependent )
+            {
+                longest_dependent = remaining_path[ this->dependent_list[e] ];
+            }
+        }
+        remaining_path[current] = this->history.get_estimate( this->tasks[current].get_name(), default_ms ) + longest_dependent;
+    }
+    return remaining_path;
+}
 
-            this->slog.log( E_INFO, "[ '" + this->tasks[i].get_name() + "' ] Executing..." );
-            try {
-                this->tasks[i].execute( this->configuration );
+
+/**
+ * @brief Orders the ready heap of the scheduler.
+ *
+ * The task with the longest remaining path is on top; ties go to the task earliest in the plan file so that dispatch
+ * order is deterministic.
+ */
+struct CriticalPathFirst
+{
+    const std::vector<long long> * remaining_path;
+
+    bool operator()( int a, int b ) const
+    {
+        if ( (*remaining_path)[a] != (*remaining_path)[b] )
+        {
+            return (*remaining_path)[a] < (*remaining_path)[b];
+        }
+        return a > b;
+    }
+};
+
+
+/**
+ * @brief Execute all tasks in the plan, dispatching each to a worker pool once its dependencies are complete.
+ *
+ * The calling thread acts as the scheduler: it hands ready tasks to a fixed pool of workers and retires them as they
+ * finish.  Each task keeps a count of its unfinished dependencies, taken from the graph built at load time; completing
+ * a task decrements the counts of its dependents, and a task becomes ready when its count reaches zero.
+ *
+ * Among ready tasks, the one with the longest remaining path (see compute_remaining_paths()) is dispatched first, so
+ * the chain that bounds the plan's wall-clock time is never left waiting behind short side branches.  Durations are
+ * measured as tasks complete and saved to the logs directory for the next run.  Tasks forcing a PTY take over the
+ * controlling terminal, so at most one of them runs at a time, unless there is no terminal and they run headless.  Once
+ * a task fails in a way that halts the plan, nothing new is dispatched, but tasks already running are allowed to finish
+ * so their logs are intact.
+ *
+ * Results are reported in plan-file order after the pool has drained, so the same failures produce the same report
+ * no matter which worker finished first.
+ */
+void Plan::execute( bool resume )
+{
+    int task_count = this->tasks.size();
+
+    std::string history_path = this->configuration->get_logs_root() + "/.durations.json";
+    this->history.load( history_path );
+    std::vector<long long> remaining_path = this->compute_remaining_paths();
+    if ( task_count > 0 )
+    {
+        this->slog.log( E_INFO, "Estimated critical path: " + std::to_string( *std::max_element( remaining_path.begin(), remaining_path.end() ) / 1000 ) + "s." );
+    }
+
+    std::string logs_root = this->configuration->get_logs_root();
+    createDirectory( logs_root );
+    std::string plan_name = this->plan_path.substr( this->plan_path.find_last_of( '/' ) + 1 );
+    std::string journal_path = logs_root + "/." + plan_name + ".journal";
+    std::unordered_set<std::string> previously_completed;
+    if ( resume && ! this->journal.load( journal_path, this->plan_path, previously_completed ) )
+    {
+        this->slog.log( E_WARN, "No journal of a previous run of this plan at '" + journal_path + "'.  Executing every task." );
+    }
+
+    int jobs = this->configuration->get_jobs();
+    if ( jobs > task_count ) { jobs = task_count; }
+    if ( jobs < 1 ) { jobs = 1; }
+    this->slog.log( E_INFO, "Executing " + std::to_string( task_count ) + " task(s) with " + std::to_string( jobs ) + " worker(s)." );
+
+    std::string log_fsync = this->configuration->get_log_fsync();
+    LogWriter::shared().set_fsync_policy(
+            log_fsync == "task" ? LOG_FSYNC_TASK : log_fsync == "interval" ? LOG_FSYNC_INTERVAL : LOG_FSYNC_NONE,
+            this->configuration->get_log_fsync_interval()
+    );
+
+    // the run's logs go in one segment, or each in a file of its own if it can't be made
+    if ( this->configuration->get_log_store() == "segments" )
+    {
+        std::string segment_error;
+        if ( LogSegmentStore::shared().open( logs_root + "/" + SEGMENT_DIRECTORY, get_8601() + "." + plan_name, this->plan_path, log_fsync == "task", segment_error ) )
+        {
+            this->slog.log( E_INFO, "Logging to segment '" + LogSegmentStore::shared().segment_path() + "'." );
+        } else {
+            this->slog.log( E_WARN, "Could not start a log segment (" + segment_error + ").  Logging to a file per execution." );
+        }
+    }
+
+    // scheduler state, all guarded by queue_lock
+    std::vector<int> state( task_count, TASK_PENDING );
+    std::vector<std::string> reports( task_count );
+    std::vector<long long> durations( task_count, 0 );
+    std::deque<int> work_queue;
+    std::deque<int> done_queue;
+    bool shutting_down = false;
+
+    std::mutex queue_lock;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+
+    std::vector<std::thread> workers;
+    for ( int w = 0; w < jobs; w++ )
+    {
+        workers.emplace_back( [&]() {
+            while ( true )
+            {
+                int index;
+                {
+                    std::unique_lock<std::mutex> guard( queue_lock );
+                    work_ready.wait( guard, [&]() { return shutting_down || ! work_queue.empty(); } );
+                    if ( work_queue.empty() )
+                    {
+                        return;
+                    }
+                    index = work_queue.front();
+                    work_queue.pop_front();
+                }
+
+                bool failed = false;
+                std::string report;
+                std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+                try {
+                    this->tasks[index].execute( this->configuration );
+                }
+                catch ( std::exception& e ) {
+                    failed = true;
+                    report = e.what();
+                }
+                catch ( ... ) {
+                    failed = true;
+                    report = "Unknown error.";
+                }
+
+                long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - started ).count();
+
+                {
+                    std::lock_guard<std::mutex> guard( queue_lock );
+                    durations[index] = elapsed;
+                    if ( failed )
+                    {
+                        state[index] = TASK_FAILED;
+                        reports[index] = report;
+                    } else if ( this->tasks[index].retry_pending() ) {
+                        state[index] = TASK_BACKOFF;
+                    } else {
+                        state[index] = this->tasks[index].is_complete() ? TASK_COMPLETE : TASK_INCOMPLETE;
+                    }
+                    done_queue.push_back( index );
+                }
+                work_done.notify_one();
+            }
+        } );
+    }
+
+    // unfinished dependency counts, and the tasks whose count has reached zero
+    std::vector<int> remaining( this->in_degree );
+
+    // tasks completed by a previous run count as complete, as long as everything they depend on does too.
+    // walking in topological order settles each task's dependencies before the task itself.
+    std::vector<std::string> carried_over;
+    for ( int t = 0; t < this->topological_order.size() && ! previously_completed.empty(); t++ )
+    {
+        int i = this->topological_order[t];
+        if ( remaining[i] != 0 || previously_completed.find( this->tasks[i].get_name() ) == previously_completed.end() )
+        {
+            continue;
+        }
+        state[i] = TASK_COMPLETE;
+        this->tasks[i].mark_complete();
+        carried_over.push_back( this->tasks[i].get_name() );
+        this->slog.log( E_DEBUG, "[ '" + this->tasks[i].get_name() + "' ] Completed by a previous run." );
+        for ( int e = this->dependent_offsets[i]; e < this->dependent_offsets[i + 1]; e++ )
+        {
+            remaining[ this->dependent_list[e] ]--;
+        }
+    }
+    if ( resume )
+    {
+        this->slog.log( E_INFO, "Resuming: " + std::to_string( carried_over.size() ) + " task(s) completed by a previous run will be skipped." );
+    }
+
+    // the journal is rewritten before anything runs, so that a crash from here on can be resumed
+    this->journal.start( journal_path, this->plan_path, carried_over );
+
+    CriticalPathFirst order = { &remaining_path };
+    std::priority_queue<int, std::vector<int>, CriticalPathFirst> ready( order );
+    for ( int i = 0; i < task_count; i++ )
+    {
+        if ( remaining[i] == 0 && state[i] == TASK_PENDING )
+        {
+            ready.push( i );
+        }
+    }
+
+    // tasks that need the controlling terminal run one at a time.  without one they run headless, as many at once as
+    // any other task, on pseudo-terminals opened ahead of time.
+    std::vector<bool> takes_terminal( task_count );
+    int pty_tasks = 0;
+    for ( int i = 0; i < task_count; i++ )
+    {
+        if ( this->tasks[i].get_force_pty() ) { pty_tasks++; }
+        takes_terminal[i] = this->tasks[i].get_force_pty() && ! pty_headless();
+    }
+    bool terminal_held = false;
+    if ( pty_tasks > 0 )
+    {
+        size_t pty_pool_size = std::min( this->configuration->get_pty_pool_size(), pty_headless() ? std::min( pty_tasks, jobs ) : 1 );
+        size_t prepared = PtyPool::shared().prepare( pty_pool_size );
+        if ( pty_headless() )
+        {
+            this->slog.log( E_INFO, "No terminal on stdin: " + std::to_string( pty_tasks ) + " task(s) forcing a PTY run headless." );
+        }
+        if ( prepared < pty_pool_size )
+        {
+            this->slog.log( E_WARN, "Could only open " + std::to_string( prepared ) + " of " + std::to_string( pty_pool_size ) + " pseudo-terminal(s) ahead of time." );
+        }
+    }
+
+    // tokens of each resource not held by a running task
+    std::vector<int> available( this->resource_capacity );
+
+    // ready tasks passed over because the terminal or their resource tokens were taken.
+    // retried whenever a running task releases what it held.
+    std::vector<int> held_back;
+
+    // tasks waiting out the delay before a retry, soonest due first.  they hold no worker, terminal or tokens.
+    typedef std::pair<std::chrono::steady_clock::time_point, int> Retry;
+    std::priority_queue<Retry, std::vector<Retry>, std::greater<Retry> > backoff;
+
+    int running = 0;
+    bool halted = false;
+
+    std::unique_lock<std::mutex> guard( queue_lock );
+    while ( true )
+    {
+        // retire finished tasks
+        while (! done_queue.empty() )
+        {
+            int index = done_queue.front();
+            done_queue.pop_front();
+            running--;
+            if ( takes_terminal[index] )
+            {
+                terminal_held = false;
+            }
+            for ( int c = 0; c < this->resource_claims[index].size(); c++ )
+            {
+                available[ this->resource_claims[index][c].first ] += this->resource_claims[index][c].second;
+            }
+            for ( int w = 0; w < held_back.size(); w++ ) { ready.push( held_back[w] ); }
+            held_back.clear();
+
+            if ( state[index] == TASK_BACKOFF )
+            {
+                backoff.push( Retry( std::chrono::steady_clock::now() + std::chrono::milliseconds( this->tasks[index].get_retry_delay_ms() ), index ) );
+                continue;
+            }
+
+            this->journal.record( state[index] == TASK_COMPLETE ? JOURNAL_COMPLETE : state[index] == TASK_INCOMPLETE ? JOURNAL_INCOMPLETE : JOURNAL_FAILED, this->tasks[index].get_name() );
+
+            if ( state[index] == TASK_COMPLETE )
+            {
+                for ( int e = this->dependent_offsets[index]; e < this->dependent_offsets[index + 1]; e++ )
+                {
+                    if ( --remaining[ this->dependent_list[e] ] == 0 )
+                    {
+                        ready.push( this->dependent_list[e] );
+                    }
+                }
+            }
+
+            if ( state[index] == TASK_FAILED && ! halted )
+            {
+                halted = true;
+                this->slog.log( E_FATAL, "[ '" + this->tasks[index].get_name() + "' ] Failed.  Waiting for " + std::to_string( running ) + " running task(s) to finish." );
+            }
+        }
+
+        // retries whose delay is up compete with the other ready tasks
+        while ( ! halted && ! backoff.empty() && backoff.top().first <= std::chrono::steady_clock::now() )
+        {
+            ready.push( backoff.top().second );
+            backoff.pop();
+        }
+
+        // dispatch everything that has become ready
+        // only as many as there are idle workers, so a task that becomes ready later isn't queued behind these
+        while ( ! halted && ! ready.empty() && running < jobs )
+        {
+            int i = ready.top();
+            ready.pop();
+
+            bool admissible = ! ( takes_terminal[i] && terminal_held );
+            for ( int c = 0; admissible && c < this->resource_claims[i].size(); c++ )
+            {
+                admissible = available[ this->resource_claims[i][c].first ] >= this->resource_claims[i][c].second;
             }
-            catch (std::exception& e) {
-                this->slog.log( E_FATAL, "[ '" + this->tasks[i].get_name() + "' ] Report: " + e.what() );
-                throw Plan_Task_GeneralExecutionException("Could not execute task.");
+            if ( ! admissible )
+            {
+                // let a lower priority task that fits use the idle worker instead
+                held_back.push_back( i );
+                continue;
             }
+
+            state[i] = TASK_RUNNING;
+            running++;
+            if ( takes_terminal[i] ) { terminal_held = true; }
+            for ( int c = 0; c < this->resource_claims[i].size(); c++ )
+            {
+                available[ this->resource_claims[i][c].first ] -= this->resource_claims[i][c].second;
+            }
+
+            this->slog.log( E_INFO, "[ '" + this->tasks[i].get_name() + "' ] Executing..." );
+            this->journal.record( JOURNAL_STARTED, this->tasks[i].get_name() );
+            work_queue.push_back( i );
+            work_ready.notify_one();
+        }
+
+        // one sync covers every transition since the last pass.  the journal belongs to this thread, so workers
+        // can hand over results while it waits on the disk.
+        guard.unlock();
+        this->journal.flush();
+        guard.lock();
+
+        if ( running == 0 && ( halted || backoff.empty() ) )
+        {
+            break;
+        }
+
+        if ( backoff.empty() )
+        {
+            work_done.wait( guard, [&]() { return ! done_queue.empty(); } );
         } else {
-            // not all deps met for this task
+            work_done.wait_until( guard, backoff.top().first, [&]() { return ! done_queue.empty(); } );
+        }
+    }
+
+    // a halted plan doesn't make the retries it was waiting on
+    while (! backoff.empty() )
+    {
+        int index = backoff.top().second;
+        backoff.pop();
+        state[index] = TASK_FAILED;
+        reports[index] = "Not retried, as the plan halted.";
+        this->journal.record( JOURNAL_FAILED, this->tasks[index].get_name() );
+    }
+    shutting_down = true;
+    guard.unlock();
+    work_ready.notify_all();
+    this->journal.close();
+
+    for ( int w = 0; w < workers.size(); w++ )
+    {
+        workers[w].join();
+    }
+
+    // a writer that can't keep up holds up the children, which is worth knowing about
+    LogWriterStats log_stats = LogWriter::shared().stats();
+    if ( log_stats.ring_full_waits > 0 )
+    {
+        this->slog.log( E_WARN, "Log writer fell behind: its buffers filled " + std::to_string( log_stats.ring_full_waits ) + " time(s), holding up output for " + std::to_string( log_stats.ring_full_microseconds / 1000 ) + "ms in total (peak " + std::to_string( log_stats.peak_slots_used ) + " of " + std::to_string( log_stats.ring_slots ) + " buffers)." );
+    } else {
+        this->slog.log( E_DEBUG, "Log writer: " + std::to_string( log_stats.bytes ) + " bytes in " + std::to_string( log_stats.chunks ) + " chunk(s), " + std::to_string( log_stats.writev_calls ) + " writev(s), " + std::to_string( log_stats.fsync_calls ) + " fsync(s), peak " + std::to_string( log_stats.peak_slots_used ) + " of " + std::to_string( log_stats.ring_slots ) + " buffers." );
+    }
+    if ( log_stats.compressed_input_bytes > 0 )
+    {
+        this->slog.log( E_DEBUG, "Log compression: " + std::to_string( log_stats.compressed_input_bytes ) + " bytes written as " + std::to_string( log_stats.compressed_output_bytes ) + "." );
+    }
+
+    if ( LogSegmentStore::shared().is_open() )
+    {
+        LogSegmentStore::shared().close();
+        LogSegmentStats segment_stats = LogSegmentStore::shared().stats();
+        this->slog.log( E_DEBUG, "Log segment: " + std::to_string( segment_stats.extents ) + " log(s), " + std::to_string( segment_stats.bytes ) + " bytes." );
+        if ( segment_stats.failed > 0 )
+        {
+            this->slog.log( E_WARN, std::to_string( segment_stats.failed ) + " log(s) could not be added to the log segment." );
+        }
+    }
+
+    PtyPoolStats pty_stats = PtyPool::shared().stats();
+    if ( pty_stats.opened > 0 )
+    {
+        this->slog.log( E_DEBUG, "Pseudo-terminals: opened " + std::to_string( pty_stats.opened ) + ", " + std::to_string( pty_stats.pooled ) + " handed out from the pool, " + std::to_string( pty_stats.kept ) + " kept for reuse, " + std::to_string( pty_stats.discarded ) + " closed while still held." );
+    }
+
+    ShellSessionPool::shared().close_all();
+    ShellSessionStats session_stats = ShellSessionPool::shared().stats();
+    if ( session_stats.started > 0 )
+    {
+        this->slog.log( E_DEBUG, "Shell sessions: " + std::to_string( session_stats.commands ) + " command(s) in " + std::to_string( session_stats.started ) + " shell(s), " + std::to_string( session_stats.lost ) + " lost." );
+    }
+
+    EnvironmentCacheStats environment_stats = EnvironmentCache::shared().stats();
+    if ( environment_stats.sourced + environment_stats.failed > 0 )
+    {
+        this->slog.log( E_DEBUG, "Environment files: sourced " + std::to_string( environment_stats.sourced ) + " time(s), reused " + std::to_string( environment_stats.reused ) + " time(s) (" + std::to_string( environment_stats.revalidated ) + " after checking an unchanged file), " + std::to_string( environment_stats.failed ) + " left to the command." );
+    }
+
+    // only successful runs are representative of how long a task takes
+    for ( int i = 0; i < task_count; i++ )
+    {
+        if ( state[i] == TASK_COMPLETE )
+        {
+            this->history.record( this->tasks[i].get_name(), durations[i] );
+        }
+    }
+    this->history.save( history_path );
+
+    // what every task used, so that the expensive ones can be found
+    ResourceAccounting accounting( this->LOG_LEVEL );
+    for ( int i = 0; i < task_count; i++ )
+    {
+        std::string ended = state[i] == TASK_COMPLETE ? "complete" : state[i] == TASK_INCOMPLETE ? "incomplete" : state[i] == TASK_FAILED ? "failed" : "not executed";
+        accounting.record( this->tasks[i].get_name(), this->tasks[i].get_unit_name(), ended, this->tasks[i].get_executions() );
+    }
+    accounting.save( logs_root + "/" + plan_name + ".accounting.json", this->plan_path );
+
+    // report in plan-file order
+    bool any_failed = false;
+    for ( int i = 0; i < task_count; i++ )
+    {
+        if ( state[i] == TASK_FAILED )
+        {
+            this->slog.log( E_FATAL, "[ '" + this->tasks[i].get_name() + "' ] Report: " + reports[i] );
+            any_failed = true;
+        }
+    }
+    if ( any_failed )
+    {
+        throw Plan_Task_GeneralExecutionException("Could not execute task.");
+    }
+
+    bool any_unmet = false;
+    for ( int i = 0; i < task_count; i++ )
+    {
+        if ( state[i] == TASK_PENDING )
+        {
             this->slog.log( E_FATAL, "[ '" + this->tasks[i].get_name() + "' ] This task was specified in the Plan but not executed due to missing dependencies.  Please revise your plan."  );
-            throw Plan_Task_Missing_Dependency( "Unmet dependency for task." );
+            any_unmet = true;
         }
     }
+    if ( any_unmet )
+    {
+        throw Plan_Task_Missing_Dependency( "Unmet dependency for task." );
+    }
 }
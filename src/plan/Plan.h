@@ -26,7 +26,36 @@
 #include "../logger/Logger.h"
 #include "../config/Config.h"
 #include "Task.h"
+#include "DurationHistory.h"
+#include "RunJournal.h"
+#include "ResourceAccounting.h"
 #include <string>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// the state of a Task while its Plan is executing
+enum TASK_STATE {
+    TASK_PENDING = 0,
+    TASK_RUNNING,
+    // executed and marked complete
+    TASK_COMPLETE,
+    // executed and failed, but was not required
+    TASK_INCOMPLETE,
+    // failed an attempt, and waiting to be executed again under its retry policy
+    TASK_BACKOFF,
+    // failed in a way that halts the Plan
+    TASK_FAILED
+};
 
 /**
  * @class Plan
@@ -45,6 +74,61 @@ class Plan: public JSON_Loader
         int LOG_LEVEL;
         Logger slog;
 
+        // the dependency graph, built once by load_plan_file().
+        // task_index maps a task name to its position in this->tasks (first occurrence wins).
+        std::unordered_map<std::string, int> task_index;
+
+        // the instances each matrix entry of the plan expanded into, by the entry's name.  a dependency on the entry
+        // is a dependency on every one of them.
+        std::unordered_map<std::string, std::vector<int> > matrix_instances;
+
+        // adjacency lists in compressed form: the dependencies of task i are
+        // dependency_list[ dependency_offsets[i] .. dependency_offsets[i+1] ), and likewise for the tasks that depend on
+        // task i in dependent_list.
+        std::vector<int> dependency_offsets;
+        std::vector<int> dependency_list;
+        std::vector<int> dependent_offsets;
+        std::vector<int> dependent_list;
+
+        // number of dependencies of each task
+        std::vector<int> in_degree;
+
+        // every task index, ordered so that each task comes after all of its dependencies
+        std::vector<int> topological_order;
+
+        // how long each task took in previous runs
+        DurationHistory history;
+
+        // the path of the loaded plan file
+        std::string plan_path;
+
+        // state transitions of this run, kept in the logs directory so an interrupted run can be resumed
+        RunJournal journal;
+
+        // the resources declared in the configuration, and the tokens of each that may be held at once
+        std::vector<std::string> resource_names;
+        std::vector<int> resource_capacity;
+
+        // the tokens each task holds while it executes, as ( index into resource_names, count ) pairs.
+        // resolved by load_definitions() or preflight().
+        std::vector< std::vector< std::pair<int, int> > > resource_claims;
+
+        // resolve the resource claims of every task against the declared capacities.  claims that can never be
+        // granted are thrown, or collected in problems if it is supplied.
+        void resolve_resources( std::vector<std::string> * problems = nullptr );
+
+        // estimated time from the start of each task to the end of the plan, along its longest chain of dependents
+        std::vector<long long> compute_remaining_paths();
+
+        // index of the task with the given name, or -1 if no such task is in the plan
+        int index_of( const std::string & name );
+
+        // resolve dependency names, build the adjacency lists and sort the graph
+        void build_graph();
+
+        // append one task for every combination of values in the matrix of a plan entry
+        void expand_matrix( const Json::Value & entry );
+
     public:
         /**
          * @brief Constructor for Plan class.
@@ -55,9 +139,13 @@ class Plan: public JSON_Loader
         Plan(Conf * configuration, int LOG_LEVEL );
 
         /**
-         * @brief Load the plan from a file and append tasks to the task vector.
+         * @brief Load the plan from a file, append tasks to the task vector and build the dependency graph.
          *
          * @param filename The filename to load the plan from.
+         *
+         * @throws Plan_Task_Missing_Dependency if a task depends on a task that is not in the plan.
+         * @throws Plan_Cyclic_Dependency if the dependencies of the plan form a cycle.
+         * @throws Plan_Invalid_Matrix if the matrix of a plan entry is malformed.
          */
         void load_plan_file( std::string filename );
 
@@ -85,8 +173,21 @@ class Plan: public JSON_Loader
          * @brief Load the units corresponding to each task in the plan from the given Suite.
          *
          * @param unit_definitions The Suite to load definitions from.
+         *
+         * @throws Plan_Resource_Unsatisfiable if a task claims an undeclared resource or more tokens than exist.
          */
-        void load_definitions( Suite unit_definitions );
+        void load_definitions( Suite & unit_definitions );
+
+        /**
+         * @brief Load the units of every task and check that every task could execute, before anything does.
+         *
+         * Each check is made for every task, whatever the others find, and every problem is logged before returning.
+         *
+         * @param unit_definitions The Suite to load definitions from.
+         *
+         * @throws Plan_Preflight_Failed if any task could not execute.
+         */
+        void preflight( Suite & unit_definitions );
 
         /**
          * @brief Check whether all dependencies for a task with the given name are complete.
@@ -98,8 +199,21 @@ class Plan: public JSON_Loader
         bool all_dependencies_complete(std::string name);
 
         /**
-         * @brief Iterate through all tasks in the plan and execute them.
+         * @brief Execute all tasks in the plan, dispatching each to a worker pool once its dependencies are complete.
+         *
+         * The pool is sized by Conf::get_jobs().  Of the ready tasks, the one with the longest estimated path to the
+         * end of the plan is dispatched first, using task durations recorded by previous runs.  A ready task whose
+         * resource tokens are held by running tasks is passed over until they are released.  Failures are
+         * reported in plan-file order once all running tasks have drained, independent of completion order.
+         *
+         * Every state transition is journaled in the logs directory.  When resuming, tasks the journal records as
+         * completed by a previous run of the same plan file are skipped, unless a task they depend on has to run again.
+         *
+         * @param resume Whether to skip the tasks completed by a previous run.
+         *
+         * @throws Plan_Task_GeneralExecutionException if a task failed in a way that halts the plan.
+         * @throws Plan_Task_Missing_Dependency if tasks could not execute because their dependencies did not complete.
          */
-        void execute();
+        void execute( bool resume );
 };
 #endif //REX_PLAN_H
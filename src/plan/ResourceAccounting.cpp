@@ -0,0 +1,181 @@
+/*
+    Rex - A configuration management and workflow automation tool that
+    compiles and runs in minimal environments.
+    © SILO GROUP and Chris Punches, 2020.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ResourceAccounting.h"
+#include <cstdio>
+#include <unistd.h>
+
+
+/**
+ * @brief Constructor for ResourceAccounting class.
+ *
+ * @param LOG_LEVEL The logging level to use.
+ */
+ResourceAccounting::ResourceAccounting( int LOG_LEVEL ): tasks( Json::arrayValue ), slog( LOG_LEVEL, "_accounting_" )
+{
+    this->LOG_LEVEL = LOG_LEVEL;
+}
+
+
+/**
+ * @brief Seconds held in a timeval, as a JSON number.
+ */
+static double seconds_of( const struct timeval & duration )
+{
+    return duration.tv_sec + duration.tv_usec / 1e6;
+}
+
+
+/**
+ * @brief Add a task to the summary.
+ *
+ * Measurements an execution doesn't have are left out of it: an execution run in a shell session only has its running
+ * time and output volume, as its process was never Rex's to reap.  An execution run in a cgroup of its own also has
+ * what the cgroup measured, which includes whatever it started and did not wait for.
+ *
+ * @param name The name of the task.
+ * @param unit_name The name of the unit the task executes.
+ * @param state How the task ended: "complete", "incomplete", "failed" or "not executed".
+ * @param executions The task's executions.
+ */
+void ResourceAccounting::record( const std::string & name, const std::string & unit_name, const std::string & state, const std::vector<TaskExecution> & executions )
+{
+    Json::Value task( Json::objectValue );
+    task["task"] = name;
+    task["unit"] = unit_name;
+    task["state"] = state;
+
+    double wall_seconds = 0;
+    double user_seconds = 0;
+    double system_seconds = 0;
+    long max_rss_kib = 0;
+    unsigned long long read_bytes = 0;
+    unsigned long long write_bytes = 0;
+    unsigned long long stdout_bytes = 0;
+    unsigned long long stderr_bytes = 0;
+
+    Json::Value listed( Json::arrayValue );
+    for ( size_t i = 0; i < executions.size(); i++ )
+    {
+        const CommandOutcome & outcome = executions[i].outcome;
+
+        Json::Value execution( Json::objectValue );
+        execution["phase"] = executions[i].phase;
+        execution["attempt"] = executions[i].attempt;
+        execution["return_code"] = executions[i].return_code;
+        execution["wall_seconds"] = outcome.wall_seconds;
+        execution["stdout_bytes"] = (Json::UInt64) outcome.stdout_bytes;
+        execution["stderr_bytes"] = (Json::UInt64) outcome.stderr_bytes;
+        if ( outcome.reaped )
+        {
+            execution["signal"] = outcome_signal( outcome );
+            execution["timed_out"] = outcome.timed_out;
+            execution["user_cpu_seconds"] = seconds_of( outcome.usage.ru_utime );
+            execution["system_cpu_seconds"] = seconds_of( outcome.usage.ru_stime );
+            execution["max_rss_kib"] = (Json::Int64) outcome.usage.ru_maxrss;
+            execution["voluntary_context_switches"] = (Json::Int64) outcome.usage.ru_nvcsw;
+            execution["involuntary_context_switches"] = (Json::Int64) outcome.usage.ru_nivcsw;
+            execution["read_bytes"] = (Json::UInt64) outcome.read_bytes;
+            execution["write_bytes"] = (Json::UInt64) outcome.write_bytes;
+
+            user_seconds += seconds_of( outcome.usage.ru_utime );
+            system_seconds += seconds_of( outcome.usage.ru_stime );
+            if ( outcome.usage.ru_maxrss > max_rss_kib )
+            {
+                max_rss_kib = outcome.usage.ru_maxrss;
+            }
+            read_bytes += outcome.read_bytes;
+            write_bytes += outcome.write_bytes;
+        }
+        if ( outcome.cgroup_measured )
+        {
+            Json::Value cgroup( Json::objectValue );
+            cgroup["user_cpu_seconds"] = outcome.cgroup_user_usec / 1e6;
+            cgroup["system_cpu_seconds"] = outcome.cgroup_system_usec / 1e6;
+            cgroup["memory_peak_bytes"] = (Json::UInt64) outcome.cgroup_memory_peak;
+            execution["cgroup"] = cgroup;
+        }
+        listed.append( execution );
+
+        wall_seconds += outcome.wall_seconds;
+        stdout_bytes += outcome.stdout_bytes;
+        stderr_bytes += outcome.stderr_bytes;
+    }
+
+    // the peak is the largest of the executions', not a sum
+    Json::Value totals( Json::objectValue );
+    totals["wall_seconds"] = wall_seconds;
+    totals["user_cpu_seconds"] = user_seconds;
+    totals["system_cpu_seconds"] = system_seconds;
+    totals["max_rss_kib"] = (Json::Int64) max_rss_kib;
+    totals["read_bytes"] = (Json::UInt64) read_bytes;
+    totals["write_bytes"] = (Json::UInt64) write_bytes;
+    totals["stdout_bytes"] = (Json::UInt64) stdout_bytes;
+    totals["stderr_bytes"] = (Json::UInt64) stderr_bytes;
+
+    task["totals"] = totals;
+    task["executions"] = listed;
+    this->tasks.append( task );
+}
+
+
+/**
+ * @brief Write the summary to disk, replacing any previous one atomically.
+ *
+ * The file holds a single object, `accounting`, with the plan's path and the list of its tasks in plan-file order.  It
+ * is written next to its final location and renamed over it, so a reader never sees half of it.
+ *
+ * @param path The path of the summary file.
+ * @param plan_path The path of the plan the run executed.
+ *
+ * @return True if the summary was written.
+ */
+bool ResourceAccounting::save( std::string path, std::string plan_path )
+{
+    Json::Value accounting( Json::objectValue );
+    accounting["plan"] = plan_path;
+    accounting["tasks"] = this->tasks;
+
+    Json::Value root( Json::objectValue );
+    root["accounting"] = accounting;
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = " ";
+    // microseconds are the finest any measurement is taken to
+    builder["precision"] = 9;
+    std::string serialized = Json::writeString( builder, root ) + "\n";
+
+    std::string staging_path = path + ".tmp";
+    FILE * fh = fopen( staging_path.c_str(), "we" );
+    if ( fh == NULL )
+    {
+        this->slog.log( E_WARN, "Could not write resource accounting to '" + staging_path + "'." );
+        return false;
+    }
+
+    bool written = fwrite( serialized.data(), 1, serialized.size(), fh ) == serialized.size();
+    written = ( fclose( fh ) == 0 ) && written;
+
+    if (! written || rename( staging_path.c_str(), path.c_str() ) != 0 )
+    {
+        this->slog.log( E_WARN, "Could not write resource accounting to '" + path + "'." );
+        unlink( staging_path.c_str() );
+        return false;
+    }
+
+    this->slog.log( E_INFO, "Wrote resource accounting for " + std::to_string( this->tasks.size() ) + " task(s) to '" + path + "'." );
+    return true;
+}
@@ -0,0 +1,74 @@
+/*
+    Rex - A configuration management and workflow automation tool that
+    compiles and runs in minimal environments.
+    © SILO GROUP and Chris Punches, 2020.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef REX_RESOURCEACCOUNTING_H
+#define REX_RESOURCEACCOUNTING_H
+
+#include "../json_support/JSON.h"
+#include "../logger/Logger.h"
+#include "Task.h"
+#include <string>
+#include <vector>
+
+/**
+ * @class ResourceAccounting
+ * @brief What each task of a run used, written out as a summary once the run is over.
+ *
+ * Every execution of a task's target or rectifier is listed with its running time, user and system CPU time, peak
+ * resident memory, context switches, storage I/O and output volume, so that the expensive units of a plan can be
+ * found without reading its logs.  Each task also carries the totals of its executions.
+ */
+class ResourceAccounting
+{
+    public:
+        /**
+         * @brief Constructor for ResourceAccounting class.
+         *
+         * @param LOG_LEVEL The logging level to use.
+         */
+        ResourceAccounting( int LOG_LEVEL );
+
+        /**
+         * @brief Add a task to the summary.
+         *
+         * @param name The name of the task.
+         * @param unit_name The name of the unit the task executes.
+         * @param state How the task ended: "complete", "incomplete", "failed" or "not executed".
+         * @param executions The task's executions.
+         */
+        void record( const std::string & name, const std::string & unit_name, const std::string & state, const std::vector<TaskExecution> & executions );
+
+        /**
+         * @brief Write the summary to disk, replacing any previous one atomically.
+         *
+         * @param path The path of the summary file.
+         * @param plan_path The path of the plan the run executed.
+         *
+         * @return True if the summary was written.
+         */
+        bool save( std::string path, std::string plan_path );
+
+    private:
+        /// the tasks recorded so far, in the order they were recorded
+        Json::Value tasks;
+
+        /// The logging level to use.
+        int LOG_LEVEL;
+        /// A logger for logging messages.
+        Logger slog;
+};
+
+#endif //REX_RESOURCEACCOUNTING_H
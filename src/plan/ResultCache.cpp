@@ -0,0 +1,251 @@
+/*
+    Rex - A configuration management and workflow automation tool that
+    compiles and runs in minimal environments.
+
+    © SILO GROUP and Chris Punches, 2020.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+#include "ResultCache.h"
+#include "../misc/helpers.h"
+#include "../lcpex/LogCompression.h"
+#include "../lcpex/LogWriter.h"
+#include <cerrno>
+#include <cstdlib>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+/**
+ * @brief Write an entire buffer to a file descriptor, retrying short and interrupted writes.
+ *
+ * @return True if every byte was written.
+ */
+static bool write_fully( int fd, const char * data, size_t length )
+{
+    while ( length > 0 )
+    {
+        ssize_t written = write( fd, data, length );
+        if ( written < 0 )
+        {
+            if ( errno == EINTR ) { continue; }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Copy the contents of an open file to a log, and to another file descriptor.
+ *
+ * @param in The file to copy, read from start whatever its offset.  A compressed log is copied as what it decodes to.
+ * @param start Where in the file to start.  In a compressed log, the start of a frame.
+ * @param log_fd A log to write to through the log writer, which compresses it if the log is compressed, or -1.
+ * @param fd A file descriptor to write to as it is, or -1.
+ *
+ * @return True if the whole file was read, decoded, and written to every destination.
+ */
+static bool copy_fd_to( int in, off_t start, int log_fd, int fd )
+{
+    bool copied = true;
+    Lz4FrameDecoder decoder;
+    std::string decoded;
+    char buffer[65536];
+    off_t offset = start;
+    ssize_t got;
+    while ( copied && ( got = pread( in, buffer, sizeof( buffer ), offset ) ) != 0 )
+    {
+        if ( got < 0 )
+        {
+            if ( errno == EINTR ) { continue; }
+            copied = false;
+            break;
+        }
+        offset += got;
+        decoded.clear();
+        copied = decoder.feed( buffer, got, decoded );
+        if ( log_fd != -1 )
+        {
+            copied = LogWriter::shared().append( log_fd, decoded.data(), decoded.size() ) && copied;
+        }
+        if ( fd != -1 )
+        {
+            copied = write_fully( fd, decoded.data(), decoded.size() ) && copied;
+        }
+    }
+
+    // what a plain file too short to tell apart from a frame is held back until now
+    decoded.clear();
+    copied = decoder.finish( decoded ) && copied;
+    if ( log_fd != -1 )
+    {
+        copied = LogWriter::shared().append( log_fd, decoded.data(), decoded.size() ) && copied;
+    }
+    if ( fd != -1 )
+    {
+        copied = write_fully( fd, decoded.data(), decoded.size() ) && copied;
+    }
+    return copied;
+}
+
+
+/**
+ * @brief Copy the contents of a file to a log, and to another file descriptor, as copy_fd_to() does.
+ *
+ * @return True if the file could be opened, and was copied.
+ */
+static bool copy_file_to( const std::string & path, int log_fd, int fd )
+{
+    int in = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( in < 0 )
+    {
+        return false;
+    }
+    bool copied = copy_fd_to( in, 0, log_fd, fd );
+    close( in );
+    return copied;
+}
+
+
+/**
+ * @brief Remove a staged entry that could not be put in place.
+ */
+static void discard_entry( const std::string & staging )
+{
+    unlink( ( staging + "/stdout" ).c_str() );
+    unlink( ( staging + "/stderr" ).c_str() );
+    rmdir( staging.c_str() );
+}
+
+
+/**
+ * @brief Constructor for ResultCache class.
+ *
+ * @param root The directory holding the cache entries.
+ * @param LOG_LEVEL The logging level to use.
+ */
+ResultCache::ResultCache( std::string root, int LOG_LEVEL ): slog( LOG_LEVEL, "_cache_" )
+{
+    this->root = root;
+    this->LOG_LEVEL = LOG_LEVEL;
+}
+
+
+/**
+ * @brief The directory of the entry for a digest.
+ *
+ * Entries are spread over subdirectories named after the first two characters of their digest, so that no single
+ * directory grows too large to search quickly.
+ */
+std::string ResultCache::entry_path( const std::string & key )
+{
+    return this->root + "/" + key.substr( 0, 2 ) + "/" + key;
+}
+
+
+/**
+ * @brief Check for a successful execution stored under a digest.
+ *
+ * @param key The digest of the execution's inputs.
+ *
+ * @return True if there is an entry for the digest.
+ */
+bool ResultCache::contains( const std::string & key )
+{
+    return is_dir( this->entry_path( key ) );
+}
+
+
+/**
+ * @brief Store the output of a successful execution under a digest.
+ *
+ * @param key The digest of the execution's inputs.
+ * @param stdout_log_fh The log the execution's stdout was written to.
+ * @param stdout_start Where the execution's stdout starts in its log, which may hold earlier attempts before it.
+ * @param stderr_log_fh The log the execution's stderr was written to.
+ * @param stderr_start Where the execution's stderr starts in its log.
+ *
+ * @return True if the entry was stored.
+ */
+bool ResultCache::store( const std::string & key, FILE * stdout_log_fh, off_t stdout_start, FILE * stderr_log_fh, off_t stderr_start )
+{
+    std::string shard = this->root + "/" + key.substr( 0, 2 );
+    if (! createDirectory( shard ) )
+    {
+        this->slog.log( E_WARN, "Could not create cache directory '" + shard + "'." );
+        return false;
+    }
+
+    // assemble the entry under a unique name, then move it into place in one step
+    std::string staging_template = shard + "/." + key + ".XXXXXX";
+    std::vector<char> staging_buffer( staging_template.begin(), staging_template.end() );
+    staging_buffer.push_back( '\0' );
+    if ( mkdtemp( staging_buffer.data() ) == NULL )
+    {
+        this->slog.log( E_WARN, "Could not stage cache entry in '" + shard + "'." );
+        return false;
+    }
+    std::string staging = staging_buffer.data();
+
+    const char * streams[2] = { "stdout", "stderr" };
+    int sources[2] = { fileno( stdout_log_fh ), fileno( stderr_log_fh ) };
+    off_t starts[2] = { stdout_start, stderr_start };
+    for ( int s = 0; s < 2; s++ )
+    {
+        int out = open( ( staging + "/" + streams[s] ).c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644 );
+        bool copied = out >= 0 && copy_fd_to( sources[s], starts[s], -1, out );
+        if ( out >= 0 ) { copied = ( close( out ) == 0 ) && copied; }
+        if ( ! copied )
+        {
+            this->slog.log( E_WARN, "Could not store " + std::string( streams[s] ) + " in cache entry " + key + "." );
+            discard_entry( staging );
+            return false;
+        }
+    }
+
+    if ( rename( staging.c_str(), this->entry_path( key ).c_str() ) != 0 )
+    {
+        // another Task with the same inputs got there first, which is just as good
+        int rename_error = errno;
+        discard_entry( staging );
+        return rename_error == EEXIST || rename_error == ENOTEMPTY;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Write the output stored under a digest to the logs of this execution, and optionally the console.
+ *
+ * @param key The digest of the execution's inputs.
+ * @param stdout_log_fh The stdout log of this execution.
+ * @param stderr_log_fh The stderr log of this execution.
+ * @param to_console Whether to also write the stored output to Rex's own stdout and stderr.
+ */
+void ResultCache::replay( const std::string & key, FILE * stdout_log_fh, FILE * stderr_log_fh, bool to_console )
+{
+    std::string entry = this->entry_path( key );
+
+    if (! copy_file_to( entry + "/stdout", fileno( stdout_log_fh ), to_console ? STDOUT_FILENO : -1 ) ||
+        ! copy_file_to( entry + "/stderr", fileno( stderr_log_fh ), to_console ? STDERR_FILENO : -1 ) )
+    {
+        this->slog.log( E_WARN, "Could not replay all of the output stored in cache entry " + key + "." );
+    }
+}
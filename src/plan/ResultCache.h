@@ -0,0 +1,96 @@
+/*
+    Rex - A configuration management and workflow automation tool that
+    compiles and runs in minimal environments.
+
+    © SILO GROUP and Chris Punches, 2020.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef REX_RESULTCACHE_H
+#define REX_RESULTCACHE_H
+
+#include "../logger/Logger.h"
+#include <string>
+#include <cstdio>
+#include <sys/types.h>
+
+/**
+ * @class ResultCache
+ * @brief A local store of successful Task executions, addressed by a digest of everything that determined them.
+ *
+ * Each entry is a directory named after the digest, holding the stdout and stderr of the execution that produced it,
+ * uncompressed whether or not its logs were, so that an entry replays into logs of either kind.
+ * An entry only exists once it is complete: it is assembled under a temporary name and renamed into place, so
+ * concurrently executing Tasks, or a run that is interrupted, never see a partial entry.  Deleting the cache directory
+ * is always safe.
+ */
+class ResultCache
+{
+    public:
+        /**
+         * @brief Constructor for ResultCache class.
+         *
+         * @param root The directory holding the cache entries.
+         * @param LOG_LEVEL The logging level to use.
+         */
+        ResultCache( std::string root, int LOG_LEVEL );
+
+        /**
+         * @brief Check for a successful execution stored under a digest.
+         *
+         * @param key The digest of the execution's inputs.
+         *
+         * @return True if there is an entry for the digest.
+         */
+        bool contains( const std::string & key );
+
+        /**
+         * @brief Store the output of a successful execution under a digest.
+         *
+         * Failing to store an entry is reported but is not an error; the Task simply executes again next time.
+         *
+         * @param key The digest of the execution's inputs.
+         * @param stdout_log_fh The log the execution's stdout was written to.
+         * @param stdout_start Where the execution's stdout starts in its log, which may hold earlier attempts before it.
+         * @param stderr_log_fh The log the execution's stderr was written to.
+         * @param stderr_start Where the execution's stderr starts in its log.
+         *
+         * @return True if the entry was stored.
+         */
+        bool store( const std::string & key, FILE * stdout_log_fh, off_t stdout_start, FILE * stderr_log_fh, off_t stderr_start );
+
+        /**
+         * @brief Write the output stored under a digest to the logs of this execution, and optionally the console.
+         *
+         * @param key The digest of the execution's inputs.
+         * @param stdout_log_fh The stdout log of this execution.
+         * @param stderr_log_fh The stderr log of this execution.
+         * @param to_console Whether to also write the stored output to Rex's own stdout and stderr.
+         */
+        void replay( const std::string & key, FILE * stdout_log_fh, FILE * stderr_log_fh, bool to_console );
+
+    private:
+        // the directory holding the cache entries
+        std::string root;
+
+        // the directory of the entry for a digest
+        std::string entry_path( const std::string & key );
+
+        int LOG_LEVEL;
+        Logger slog;
+};
+
+#endif //REX_RESULTCACHE_H
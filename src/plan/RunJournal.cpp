@@ -0,0 +1,285 @@
+/*
+    Rex - A configuration management and workflow automation tool that
+    compiles and runs in minimal environments.
+
+    © SILO GROUP and Chris Punches, 2020.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+#include "RunJournal.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+/**
+ * @brief Constructor for RunJournal class.
+ *
+ * @param LOG_LEVEL The logging level to use.
+ */
+RunJournal::RunJournal( int LOG_LEVEL ): slog( LOG_LEVEL, "_journal_" )
+{
+    this->LOG_LEVEL = LOG_LEVEL;
+    this->fd = -1;
+}
+
+RunJournal::~RunJournal()
+{
+    this->close();
+}
+
+
+/**
+ * @brief Write an entire buffer to a file descriptor, retrying short and interrupted writes.
+ *
+ * @return True if every byte was written.
+ */
+static bool write_all( int fd, const char * data, size_t length )
+{
+    while ( length > 0 )
+    {
+        ssize_t written = write( fd, data, length );
+        if ( written < 0 )
+        {
+            if ( errno == EINTR ) { continue; }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+
+/**
+ * @brief The first line of the journal of a plan.
+ */
+static std::string journal_header( const std::string & plan_path )
+{
+    return "rex-journal 1 " + plan_path + "\n";
+}
+
+
+/**
+ * @brief Read back the tasks that completed in previous runs of a plan.
+ *
+ * The last transition recorded for a task wins.  A final line cut short by a crash is ignored.
+ *
+ * @param path The path of the journal file.
+ * @param plan_path The path of the plan file being executed.
+ * @param completed Receives the names of the completed tasks.
+ *
+ * @return False if there is no readable journal for this plan.
+ */
+bool RunJournal::load( std::string path, std::string plan_path, std::unordered_set<std::string> & completed )
+{
+    std::string header = journal_header( plan_path );
+    completed.clear();
+
+    int in = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( in < 0 )
+    {
+        return false;
+    }
+
+    // read the whole journal at once; it is compacted on every run so it stays small
+    std::string contents;
+    struct stat info;
+    if ( fstat( in, &info ) == 0 )
+    {
+        contents.reserve( info.st_size );
+    }
+    char buffer[65536];
+    ssize_t got;
+    while ( ( got = read( in, buffer, sizeof( buffer ) ) ) != 0 )
+    {
+        if ( got < 0 )
+        {
+            if ( errno == EINTR ) { continue; }
+            ::close( in );
+            return false;
+        }
+        contents.append( buffer, got );
+    }
+    ::close( in );
+
+    if ( contents.compare( 0, header.size(), header ) != 0 )
+    {
+        return false;
+    }
+
+    // a task is started and finished, so roughly every other line is a completion
+    completed.reserve( std::count( contents.begin(), contents.end(), '\n' ) / 2 );
+
+    std::string name;
+    size_t position = header.size();
+    while ( position < contents.size() )
+    {
+        const char * line = contents.data() + position;
+        const char * end = (const char *) memchr( line, '\n', contents.size() - position );
+        if ( end == NULL )
+        {
+            break;
+        }
+
+        // "<record>\t<name>"
+        if ( end - line > 2 && line[1] == '\t' )
+        {
+            name.assign( line + 2, end );
+            if ( line[0] == JOURNAL_COMPLETE )
+            {
+                completed.insert( name );
+            } else if ( ! completed.empty() ) {
+                completed.erase( name );
+            }
+        }
+        position += end - line + 1;
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Start the journal for a run of a plan, replacing any previous journal.
+ *
+ * @param path The path of the journal file.
+ * @param plan_path The path of the plan file being executed.
+ * @param carried_over The names of the tasks that a resumed run treats as already complete.
+ */
+void RunJournal::start( std::string path, std::string plan_path, const std::vector<std::string> & carried_over )
+{
+    this->close();
+    this->path = path;
+
+    if (! this->rewrite( journal_header( plan_path ), carried_over ) )
+    {
+        this->slog.log( E_WARN, "Could not write the run journal at '" + path + "'.  This run can not be resumed." );
+        return;
+    }
+
+    this->fd = ::open( path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC );
+    if ( this->fd < 0 )
+    {
+        this->slog.log( E_WARN, "Could not open the run journal at '" + path + "'.  This run can not be resumed." );
+    }
+}
+
+
+/**
+ * @brief Replace the journal with a header and the given completion records.
+ *
+ * The new journal is written beside the old one and renamed over it, so a crash here leaves one or the other.
+ *
+ * @param header The header line.
+ * @param completed The names of the completed tasks to carry over.
+ *
+ * @return True if the journal was replaced.
+ */
+bool RunJournal::rewrite( const std::string & header, const std::vector<std::string> & completed )
+{
+    std::string contents = header;
+    for ( size_t i = 0; i < completed.size(); i++ )
+    {
+        contents += (char) JOURNAL_COMPLETE;
+        contents += '\t';
+        contents += completed[i];
+        contents += '\n';
+    }
+
+    std::string staging_path = this->path + ".tmp";
+    int out = ::open( staging_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if ( out < 0 )
+    {
+        return false;
+    }
+
+    bool written = write_all( out, contents.data(), contents.size() ) && fdatasync( out ) == 0;
+    written = ( ::close( out ) == 0 ) && written;
+    if (! written || rename( staging_path.c_str(), this->path.c_str() ) != 0 )
+    {
+        unlink( staging_path.c_str() );
+        return false;
+    }
+
+    // make the rename itself durable
+    std::string directory = this->path.substr( 0, this->path.find_last_of( '/' ) + 1 );
+    int dir = ::open( directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    if ( dir >= 0 )
+    {
+        fsync( dir );
+        ::close( dir );
+    }
+    return true;
+}
+
+
+/**
+ * @brief Queue a state transition of a task.  Nothing is written until flush().
+ *
+ * @param record The transition.
+ * @param name The name of the task.
+ */
+void RunJournal::record( JOURNAL_RECORD record, const std::string & name )
+{
+    if ( this->fd < 0 )
+    {
+        return;
+    }
+    this->pending += (char) record;
+    this->pending += '\t';
+    this->pending += name;
+    this->pending += '\n';
+}
+
+
+/**
+ * @brief Write the queued records and sync them to disk.
+ *
+ * A journal that can not be written to is abandoned with a warning rather than failing the run.
+ */
+void RunJournal::flush()
+{
+    if ( this->fd < 0 || this->pending.empty() )
+    {
+        return;
+    }
+
+    if (! write_all( this->fd, this->pending.data(), this->pending.size() ) || fdatasync( this->fd ) != 0 )
+    {
+        this->slog.log( E_WARN, "Could not write to the run journal at '" + this->path + "': " + strerror( errno ) + ".  This run can not be resumed." );
+        ::close( this->fd );
+        this->fd = -1;
+    }
+    this->pending.clear();
+}
+
+
+/**
+ * @brief Flush any queued records and close the journal.
+ */
+void RunJournal::close()
+{
+    this->flush();
+    if ( this->fd >= 0 )
+    {
+        ::close( this->fd );
+        this->fd = -1;
+    }
+}
@@ -0,0 +1,121 @@
+/*
+    Rex - A configuration management and workflow automation tool that
+    compiles and runs in minimal environments.
+
+    © SILO GROUP and Chris Punches, 2020.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef REX_RUNJOURNAL_H
+#define REX_RUNJOURNAL_H
+
+#include "../logger/Logger.h"
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// the state transitions recorded in a journal
+enum JOURNAL_RECORD {
+    JOURNAL_STARTED = 'R',
+    JOURNAL_COMPLETE = 'C',
+    JOURNAL_INCOMPLETE = 'I',
+    JOURNAL_FAILED = 'F'
+};
+
+/**
+ * @class RunJournal
+ * @brief An append-only record of the state transitions of the Tasks in a Plan.
+ *
+ * Each transition is one line holding a record type and a task name.  Records are buffered and written out in
+ * batches, with a single fdatasync per batch, so a Plan with many short tasks does not wait on the disk once per
+ * transition.  A record that was not synced before a crash only costs re-running that task.
+ *
+ * The first line names the plan file the journal belongs to, so a journal is never applied to a different plan.
+ */
+class RunJournal
+{
+    public:
+        /**
+         * @brief Constructor for RunJournal class.
+         *
+         * @param LOG_LEVEL The logging level to use.
+         */
+        RunJournal( int LOG_LEVEL );
+
+        ~RunJournal();
+
+        /**
+         * @brief Read back the tasks that completed in previous runs of a plan.
+         *
+         * The last transition recorded for a task wins.  A final line cut short by a crash is ignored.
+         *
+         * @param path The path of the journal file.
+         * @param plan_path The path of the plan file being executed.
+         * @param completed Receives the names of the completed tasks.
+         *
+         * @return False if there is no readable journal for this plan.
+         */
+        bool load( std::string path, std::string plan_path, std::unordered_set<std::string> & completed );
+
+        /**
+         * @brief Start the journal for a run of a plan, replacing any previous journal.
+         *
+         * The completion records of tasks carried over from a previous run are written first, which keeps the
+         * journal proportional to the plan however many times a run is resumed.  A journal that can not be written
+         * is reported and the run continues without one.
+         *
+         * @param path The path of the journal file.
+         * @param plan_path The path of the plan file being executed.
+         * @param carried_over The names of the tasks that a resumed run treats as already complete.
+         */
+        void start( std::string path, std::string plan_path, const std::vector<std::string> & carried_over );
+
+        /**
+         * @brief Queue a state transition of a task.  Nothing is written until flush().
+         *
+         * @param record The transition.
+         * @param name The name of the task.
+         */
+        void record( JOURNAL_RECORD record, const std::string & name );
+
+        /**
+         * @brief Write the queued records and sync them to disk.
+         */
+        void flush();
+
+        /**
+         * @brief Flush any queued records and close the journal.
+         */
+        void close();
+
+    private:
+        // the open journal, or -1
+        int fd;
+
+        // records queued since the last flush
+        std::string pending;
+
+        // the path of the journal file, for messages
+        std::string path;
+
+        // replace the journal with a header and the given completion records
+        bool rewrite( const std::string & header, const std::vector<std::string> & completed );
+
+        int LOG_LEVEL;
+        Logger slog;
+};
+
+#endif //REX_RUNJOURNAL_H
@@ -1,4 +1,13 @@
 #include "Task.h"
+#include <cmath>
+#include <random>
+#include <cstring>
+#include <pwd.h>
+#include <grp.h>
+#include <fcntl.h>
+#include "../misc/sha256.h"
+#include "../lcpex/LogCompression.h"
+#include "../logs/LogSegments.h"
 
 /*
     Rex - A configuration management and workflow automation tool that
@@ -17,6 +26,8 @@
 */
 
 #include "Task.h"
+#include <cmath>
+#include <random>
 
 
 /**
@@ -130,8 +141,8 @@ class TaskException: public std::exception
  * @param LOG_LEVEL The log level for this Task object.
  */
 Task::Task( int LOG_LEVEL ):
-        slog( LOG_LEVEL, "_task_" ),
-        definition( LOG_LEVEL )
+        definition( LOG_LEVEL ),
+        slog( LOG_LEVEL, "_task_" )
 {
     // it hasn't executed yet.
     this->complete = false;
@@ -139,6 +150,10 @@ Task::Task( int LOG_LEVEL ):
     // it hasn't been matched with a definition yet.
     this->defined = false;
 
+    // it hasn't been attempted yet.
+    this->attempts_made = 0;
+    this->retry_delay_ms = -1;
+
     this->LOG_LEVEL = LOG_LEVEL;
 }
 
@@ -160,6 +175,11 @@ void Task::load_root(Json::Value loader_root )
         throw Task_InvalidDataStructure();
     }
 
+    // the same Task may be reused as a loading buffer, so start from a clean slate
+    this->dependencies.clear();
+    this->unit_name = this->name;
+    this->parameters.clear();
+
     // fetch as Json::Value array obj
     Json::Value des_dep_root = loader_root.get("dependencies", 0);
 
@@ -169,7 +189,7 @@ void Task::load_root(Json::Value loader_root )
         if ( des_dep_root[i].asString() != "" )
         {
             this->dependencies.push_back( des_dep_root[i].asString() );
-            this->slog.log( E_INFO,  "Added dependency \"" + des_dep_root[i].asString() + "\" to task \"" + this->get_name() + "\"." );
+            this->slog.log( E_DEBUG, "Added dependency \"" + des_dep_root[i].asString() + "\" to task \"" + this->get_name() + "\"." );
         }
     }
 }
@@ -184,6 +204,36 @@ std::string Task::get_name()
     return this->name;
 }
 
+/**
+ * @brief Retrieves the name of the Unit the Task executes.
+ *
+ * @return The name of the Unit, which is also the name of the Task unless the Task is an instance of a matrix entry.
+ */
+std::string Task::get_unit_name()
+{
+    return this->unit_name;
+}
+
+/**
+ * @brief Makes the Task one instance of a matrix entry in the Plan.
+ *
+ * The Task is renamed after its parameters, as in "build[arch=x86_64,distro=el9]", so that every instance has its own
+ * name in the logs, the journal and the duration history.  It still executes the Unit it was loaded with.
+ *
+ * @param parameters The values of the instance, by variable name.
+ */
+void Task::set_parameters( const std::map<std::string, std::string> & parameters )
+{
+    this->parameters = parameters;
+    this->name = this->unit_name + "[";
+    for ( std::map<std::string, std::string>::const_iterator it = parameters.begin(); it != parameters.end(); it++ )
+    {
+        if ( it != parameters.begin() ) { this->name += ","; }
+        this->name += it->first + "=" + it->second;
+    }
+    this->name += "]";
+}
+
 /**
  * @brief Loads a unit to a local member. Used to tie Units to Tasks.
  *
@@ -217,6 +267,91 @@ void Task::mark_complete()
 }
 
 
+/**
+ * @brief Indicates if the last execution failed an attempt that the retry policy allows to be made again.
+ *
+ * The Plan waits out get_retry_delay_ms() and then executes the task again, without holding up other tasks.
+ *
+ * @return True if a retry is due.
+ */
+bool Task::retry_pending()
+{
+    return this->retry_delay_ms >= 0;
+}
+
+
+/**
+ * @brief Returns how long to wait before making the pending retry.
+ *
+ * @return The wait in milliseconds.
+ */
+long long Task::get_retry_delay_ms()
+{
+    return this->retry_delay_ms;
+}
+
+
+/**
+ * @brief Describes what an execution used, for the task's log.
+ *
+ * @param outcome How the execution ended.
+ *
+ * @return A sentence such as "Ran for 1.20s using 0.80s user and 0.10s system CPU time and 12 MiB of memory.", with
+ *         only the running time for an execution Rex did not reap itself.
+ */
+static std::string describe_usage( const CommandOutcome & outcome )
+{
+    char described[160];
+    if ( outcome.reaped )
+    {
+        snprintf(
+                described,
+                sizeof( described ),
+                "Ran for %.2fs using %.2fs user and %.2fs system CPU time and %ld MiB of memory.",
+                outcome.wall_seconds,
+                outcome.usage.ru_utime.tv_sec + outcome.usage.ru_utime.tv_usec / 1e6,
+                outcome.usage.ru_stime.tv_sec + outcome.usage.ru_stime.tv_usec / 1e6,
+                outcome.usage.ru_maxrss / 1024
+        );
+    } else {
+        snprintf( described, sizeof( described ), "Ran for %.2fs.", outcome.wall_seconds );
+    }
+    return described;
+}
+
+
+/**
+ * @brief Returns every execution of the target and rectifier so far, with what each used.
+ *
+ * @return The executions, in order.
+ */
+const std::vector<TaskExecution> & Task::get_executions()
+{
+    return this->executions;
+}
+
+
+/**
+ * @brief Keeps the measurements of an execution for the resource accounting, and logs them.
+ *
+ * @param phase "target", "rectifier" or "re-execution".
+ * @param attempt The attempt of the target the execution was part of.
+ * @param return_code The result of lcpex().
+ * @param outcome How the execution ended.
+ */
+void Task::record_execution( const std::string & phase, int attempt, int return_code, const CommandOutcome & outcome )
+{
+    TaskExecution execution;
+    execution.phase = phase;
+    execution.attempt = attempt;
+    execution.return_code = return_code;
+    execution.outcome = outcome;
+    this->executions.push_back( execution );
+
+    this->slog.log_task( E_DEBUG, this->name, describe_usage( outcome ) );
+}
+
+
 /**
  * @brief Returns a pointer to the dependencies vector.
  *
@@ -228,6 +363,39 @@ std::vector<std::string> Task::get_dependencies()
 }
 
 
+/**
+ * @brief Indicates if the task's definition requires a pseudoterminal.
+ *
+ * Tasks that take over the controlling terminal cannot share it, so the Plan uses this to keep them from executing
+ * alongside one another.
+ *
+ * @return True if the attached definition forces a PTY, false otherwise.
+ */
+bool Task::get_force_pty()
+{
+    if ( ! this->has_definition() )
+    {
+        throw Task_NotReady();
+    }
+    return this->definition.get_force_pty();
+}
+
+
+/**
+ * @brief Retrieves the resource tokens the task's definition holds while executing.
+ *
+ * @return A map of resource names to the number of tokens claimed.
+ */
+std::map<std::string, int> Task::get_resources()
+{
+    if ( ! this->has_definition() )
+    {
+        throw Task_NotReady();
+    }
+    return this->definition.get_resources();
+}
+
+
 /**
  * @brief Indicates if the task has attached its definition from a Suite.
  *
@@ -278,35 +446,378 @@ std::string path_from_str( const std::string &inputString )
 }
 
 
-bool createDirectory(const std::string& path) {
-    // Check if the directory already exists
-    struct stat info;
-    if (stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
-        return true; // Directory already exists
+/**
+ * @brief Describes why an execution failed, for the task's log.
+ *
+ * @param return_code The result of lcpex().
+ * @param timeout_seconds The timeout the execution ran under.
+ * @param outcome How the execution ended.
+ *
+ * @return A phrase such as "failed with exit code 2" or "timed out after 30 seconds".
+ */
+static std::string describe_failure( int return_code, int timeout_seconds, const CommandOutcome & outcome )
+{
+    switch ( return_code )
+    {
+        case LCPEX_TIMED_OUT:
+            return "timed out after " + std::to_string( timeout_seconds ) + " second(s)";
+        case LCPEX_SIGNALLED:
+        {
+            int signal_number = outcome_signal( outcome );
+            if ( signal_number == 0 )
+            {
+                return "was terminated by a signal";
+            }
+            std::string described = "was terminated by signal " + std::to_string( signal_number ) + " (" + strsignal( signal_number ) + ")";
+            if ( WCOREDUMP( outcome.status ) )
+            {
+                described += ", dumping core";
+            }
+            return described;
+        }
+        default:
+            return "failed with exit code " + std::to_string( return_code );
     }
+}
+
 
-    // Create the directory recursively
-    size_t pos = 0;
-    std::string dir;
-    while ((pos = path.find_first_of('/', pos + 1)) != std::string::npos) {
-        dir = path.substr(0, pos);
-        if (stat(dir.c_str(), &info) != 0) { // Directory does not exist
-            if (mkdir(dir.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) != 0) {
-                return false; // Failed to create directory
+/**
+ * @brief Describes what the failed execution printed, for the failure report.
+ *
+ * @param stdout_excerpt The beginning and end of its stdout.
+ * @param stderr_excerpt The beginning and end of its stderr.
+ *
+ * @return A line naming each stream that had output, followed by what was kept of it, each on lines of their own after
+ *         the report's first.  Empty if the execution printed nothing.
+ */
+static std::string describe_output( const OutputExcerpt & stdout_excerpt, const OutputExcerpt & stderr_excerpt )
+{
+    const OutputExcerpt * excerpts[2] = { &stdout_excerpt, &stderr_excerpt };
+    const char * names[2] = { "stdout", "stderr" };
+
+    std::string described;
+    for ( int i = 0; i < 2; i++ )
+    {
+        if ( excerpts[i]->total() == 0 )
+        {
+            continue;
+        }
+        std::string text = excerpts[i]->render();
+        if (! text.empty() && text.back() == '\n' )
+        {
+            text.pop_back();
+        }
+        described += "\n--- " + std::string( names[i] ) + " (" + std::to_string( excerpts[i]->total() ) + " bytes) ---\n" + text;
+    }
+    return described;
+}
+
+
+/**
+ * @brief Closes a log file handle however Task::execute leaves, forgetting whether it was compressed first.
+ *
+ * A log kept in the run's log segment is added to it first, as it is complete once its execution is over.
+ */
+struct LogFileCloser
+{
+    FILE * fh;
+    // the Task and stream the log is indexed under in the segment, or an empty task for a log file of its own
+    std::string segment_task;
+    const char * stream;
+    std::string started;
+    bool compressed;
+    ~LogFileCloser()
+    {
+        if ( fh != NULL )
+        {
+            if (! segment_task.empty() )
+            {
+                LogSegmentStore::shared().add( segment_task, stream, started, fileno( fh ), compressed );
             }
-        } else if (!S_ISDIR(info.st_mode)) {
-            return false; // Path segment exists but is not a directory
+            LogWriter::shared().set_compressed( fileno( fh ), false );
+            fclose( fh );
         }
     }
+};
+
 
-    // Create the final directory
-    if (mkdir(path.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) != 0) {
-        return false; // Failed to create directory
+/**
+ * @brief Open a log file to add to, creating it if need be.
+ *
+ * Not in append mode, as the log writer takes the file's position when the log is registered and preallocates ahead of
+ * it, and a file opened for appending reports the start until it is first written to.  Rex is the only writer of its
+ * logs, so starting at the end once is equivalent.
+ *
+ * @param path The log file.
+ *
+ * @return A handle to the file, close-on-exec and positioned at its end, or NULL if it could not be opened.
+ */
+static FILE * open_log_file( const std::string & path )
+{
+    int fd = open( path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666 );
+    if ( fd == -1 )
+    {
+        return NULL;
+    }
+    lseek( fd, 0, SEEK_END );
+    FILE * fh = fdopen( fd, "r+" );
+    if ( fh == NULL )
+    {
+        close( fd );
     }
+    return fh;
+}
 
+
+/**
+ * @brief Digest everything that determines the result of executing the definition.
+ *
+ * This covers the definition itself after interpolation, the shell it runs in, and the contents of the target,
+ * rectifier and environment files and of every declared input.  The target is the first word of the command; if that
+ * is not a file, as with a shell builtin, the command line alone is used.  A declared input that does not exist
+ * contributes that fact, so creating it later changes the digest.
+ *
+ * @param key Receives the digest as a hex string.
+ *
+ * @return False if a file that exists could not be read.
+ */
+bool Task::fingerprint(
+        std::string & key,
+        Conf * configuration,
+        const std::string & command,
+        const Shell & shell_definition,
+        const std::string & new_working_dir,
+        const std::string & rectifier,
+        const std::string & user,
+        const std::string & group,
+        const std::string & environment_file
+)
+{
+    Sha256 digest;
+    digest.update_field( "rex-result-cache 1" );
+
+    digest.update_field( this->definition.get_name() );
+    digest.update_field( command );
+    digest.update_field( this->definition.get_is_shell_command() ? "shell" : "exec" );
+    digest.update_field( shell_definition.path );
+    digest.update_field( shell_definition.execution_arg );
+    digest.update_field( shell_definition.source_cmd );
+    digest.update_field( this->definition.get_force_pty() ? "pty" : "pipes" );
+    digest.update_field( this->definition.get_set_working_directory() ? new_working_dir : "" );
+    digest.update_field( this->definition.get_rectify() ? rectifier : "" );
+    digest.update_field( this->definition.get_set_user_context() ? user + ":" + group : "" );
+    digest.update_field( this->definition.get_supply_environment() ? environment_file : "" );
+    for ( std::map<std::string, std::string>::iterator it = this->parameters.begin(); it != this->parameters.end(); it++ )
+    {
+        digest.update_field( it->first + "=" + it->second );
+    }
+
+    std::vector<std::string> files;
+    files.push_back( path_from_str( command ) );
+    if ( this->definition.get_rectify() ) { files.push_back( path_from_str( rectifier ) ); }
+    if ( this->definition.get_supply_environment() ) { files.push_back( environment_file ); }
+
+    std::vector<std::string> inputs = this->definition.get_cache_inputs();
+    for ( int i = 0; i < inputs.size(); i++ )
+    {
+        interpolate( inputs[i], this->parameters );
+        if (! is_abs_path( inputs[i] ) )
+        {
+            inputs[i] = configuration->get_project_root() + "/" + inputs[i];
+        }
+        files.push_back( inputs[i] );
+    }
+
+    for ( int i = 0; i < files.size(); i++ )
+    {
+        digest.update_field( files[i] );
+        if (! exists( files[i] ) )
+        {
+            digest.update_field( "absent" );
+        } else if (! digest.update_file( files[i] ) ) {
+            this->slog.log_task( E_WARN, this->definition.get_name(), "Could not read '" + files[i] + "' to check for a stored result." );
+            return false;
+        }
+    }
+
+    key = digest.hex_digest();
     return true;
 }
 
+
+/**
+ * @brief The wait before a retry: exponential in the number of attempts made, with a random spread.
+ *
+ * @param policy The retry policy of the definition.
+ * @param attempts_made The attempts made so far, at least 1.
+ *
+ * @return The wait in milliseconds.
+ */
+static long long backoff_delay_ms( const RetryPolicy & policy, int attempts_made )
+{
+    // tasks execute on several threads at once, so each gets its own generator
+    thread_local std::mt19937 generator( std::random_device{}() );
+    std::uniform_real_distribution<double> spread( -policy.jitter, policy.jitter );
+
+    double delay = policy.delay_seconds * std::pow( policy.multiplier, attempts_made - 1 );
+    delay *= 1 + spread( generator );
+    return (long long) ( delay * 1000 );
+}
+
+
+/**
+ * @brief Report a target or rectifier that could not be executed.
+ *
+ * @param role What the file is for, as it should appear in the report.
+ * @param path The absolute path of the file.
+ * @param problems Receives the report, if any.
+ */
+static void check_executable( const std::string & role, const std::string & path, std::vector<std::string> & problems )
+{
+    if (! exists( path ) )
+    {
+        problems.push_back( "The " + role + " '" + path + "' does not exist." );
+    } else if ( is_dir( path ) || access( path.c_str(), X_OK ) != 0 ) {
+        problems.push_back( "The " + role + " '" + path + "' is not executable." );
+    }
+}
+
+
+/**
+ * @brief Check that a user and group exist, with the lookups executing the task would make.
+ *
+ * @param user The name of the user.
+ * @param group The name of the group.
+ * @param problems Receives a report for each that does not exist.
+ */
+static void check_identity( const std::string & user, const std::string & group, std::vector<std::string> & problems )
+{
+    int uid;
+    if (! username_to_uid( user, uid ) )
+    {
+        problems.push_back( "The user '" + user + "' does not exist." );
+    }
+
+    int gid;
+    if (! groupname_to_gid( group, gid ) )
+    {
+        problems.push_back( "The group '" + group + "' does not exist." );
+    }
+}
+
+
+/**
+ * @brief Find everything that would keep the task's definition from executing, without executing anything.
+ *
+ * Everything Task::execute resolves lazily is resolved here the same way: the shell, the identity context, and the
+ * target, rectifier, environment file and working directory after interpolation.  Nothing is logged, so that checks
+ * of many tasks can run at once and be reported together.
+ *
+ * @param configuration The configuration the task would execute under.
+ *
+ * @return A description of each problem found.  Empty if the task is ready to execute.
+ */
+std::vector<std::string> Task::preflight( Conf * configuration )
+{
+    std::vector<std::string> problems;
+    if (! this->has_definition() )
+    {
+        problems.push_back( "The unit \"" + this->unit_name + "\" is not defined." );
+        return problems;
+    }
+
+    if (! this->definition.get_active() )
+    {
+        problems.push_back( "The unit \"" + this->unit_name + "\" is not active." );
+    }
+
+    // Task::execute looks the shell up for every definition, not only shell commands
+    std::string shell_name = this->definition.get_shell_definition();
+    interpolate( shell_name, this->parameters );
+    try {
+        configuration->get_shell_by_name( shell_name );
+    }
+    catch ( std::exception & e ) {
+        problems.push_back( e.what() );
+    }
+
+    if ( this->definition.get_supply_environment() && ! this->definition.get_is_shell_command() )
+    {
+        problems.push_back( "An environment file is supplied for a target that is not a shell command." );
+    }
+
+    std::string target = this->definition.get_target();
+    interpolate( target, this->parameters );
+    target = path_from_str( target );
+    if (! is_abs_path( target ) )
+    {
+        target = configuration->get_project_root() + "/" + target;
+    }
+    check_executable( "target", target, problems );
+
+    if ( this->definition.get_rectify() )
+    {
+        std::string rectifier = this->definition.get_rectifier();
+        interpolate( rectifier, this->parameters );
+        rectifier = path_from_str( rectifier );
+        if (! is_abs_path( rectifier ) )
+        {
+            rectifier = configuration->get_project_root() + "/" + rectifier;
+        }
+        check_executable( "rectifier", rectifier, problems );
+    }
+
+    if ( this->definition.get_supply_environment() )
+    {
+        std::string environment_file = this->definition.get_environment_file();
+        interpolate( environment_file, this->parameters );
+        if (! is_abs_path( environment_file ) )
+        {
+            environment_file = configuration->get_project_root() + "/" + environment_file;
+        }
+        if (! is_file( environment_file ) || access( environment_file.c_str(), R_OK ) != 0 )
+        {
+            problems.push_back( "The environment file '" + environment_file + "' does not exist or can not be read." );
+        }
+    }
+
+    if ( this->definition.get_set_working_directory() )
+    {
+        std::string working_directory = this->definition.get_working_directory();
+        interpolate( working_directory, this->parameters );
+        if (! is_abs_path( working_directory ) )
+        {
+            working_directory = configuration->get_project_root() + "/" + working_directory;
+        }
+        if (! is_dir( working_directory ) )
+        {
+            problems.push_back( "The working directory '" + working_directory + "' does not exist." );
+        }
+    }
+
+    if ( this->definition.get_set_user_context() )
+    {
+        std::string user = this->definition.get_user();
+        std::string group = this->definition.get_group();
+        interpolate( user, this->parameters );
+        interpolate( group, this->parameters );
+        check_identity( user, group, problems );
+    }
+
+    if ( this->definition.get_cgroup() )
+    {
+        std::string cgroup_root = configuration->get_cgroup_root();
+        std::string problem = cgroup_root.empty() ? "The unit runs in a cgroup, but no 'cgroup_root' is configured." : check_cgroup_root( cgroup_root );
+        if (! problem.empty() )
+        {
+            problems.push_back( problem );
+        }
+    }
+
+    return problems;
+}
+
+
 bool Task::prepare_logs( std::string task_name, std::string logs_root )
 {
     std::string full_path = logs_root + "/" + task_name;
@@ -334,6 +845,9 @@ void Task::execute( Conf * configuration )
         throw Task_NotReady();
     }
 
+    // cleared here so a failure that isn't retried never looks like one that is
+    this->retry_delay_ms = -1;
+
     bool override_working_dir = this->definition.get_set_working_directory();
     bool is_shell_command = this->definition.get_is_shell_command();
     bool supply_environment = this->definition.get_supply_environment();
@@ -342,8 +856,18 @@ void Task::execute( Conf * configuration )
     bool required = this->definition.get_required();
     bool set_user_context = this->definition.get_set_user_context();
     bool force_pty = this->definition.get_force_pty();
-
-    std::string task_name = this->definition.get_name();
+    int timeout_seconds = this->definition.get_timeout_seconds();
+    int kill_grace_seconds = this->definition.get_kill_grace_seconds();
+    bool shell_session = configuration->get_shell_sessions() && ! this->definition.get_isolated();
+
+    // the target and rectifier each run in a transient cgroup of their own, named after the task
+    CgroupSettings cgroup;
+    cgroup.enabled = this->definition.get_cgroup();
+    cgroup.root = configuration->get_cgroup_root();
+    cgroup.label = this->name;
+    cgroup.limits = this->definition.get_cgroup_limits();
+
+    std::string task_name = this->name;
     std::string command = this->definition.get_target();
     std::string shell_name = this->definition.get_shell_definition();
     Shell shell_definition = configuration->get_shell_by_name( shell_name );
@@ -354,17 +878,24 @@ void Task::execute( Conf * configuration )
     std::string environment_file = this->definition.get_environment_file();
     std::string logs_root = configuration->get_logs_path();
 
-    interpolate(task_name);
-    this->slog.log_task( E_DEBUG, task_name, "Using unit definition: \"" + task_name + "\"." );
-
-    interpolate(command);
-    interpolate(shell_name);
-    interpolate(user);
-    interpolate(group);
-    interpolate(environment_file);
-    interpolate(new_working_dir);
-    interpolate(rectifier);
-    interpolate(logs_root);
+    interpolate(task_name, this->parameters);
+    this->slog.log_task( E_DEBUG, task_name, "Using unit definition: \"" + this->definition.get_name() + "\"." );
+
+    interpolate(command, this->parameters);
+    interpolate(shell_name, this->parameters);
+    interpolate(user, this->parameters);
+    interpolate(group, this->parameters);
+    interpolate(environment_file, this->parameters);
+    interpolate(new_working_dir, this->parameters);
+    interpolate(rectifier, this->parameters);
+    interpolate(logs_root, this->parameters);
+
+    // the parameters of a matrix instance reach the target and rectifier through their environment
+    std::vector<std::string> environment_variables;
+    for ( std::map<std::string, std::string>::iterator it = this->parameters.begin(); it != this->parameters.end(); it++ )
+    {
+        environment_variables.push_back( it->first + "=" + it->second );
+    }
 
 
     // sanitize all path inputs from unit definition to be either absolute paths or relative to
@@ -424,24 +955,56 @@ void Task::execute( Conf * configuration )
      * create the logs dir here
      */
 
-    if (! this->prepare_logs( task_name, logs_root ) )
+    // a run keeping its logs in a segment has no directory per task
+    bool segmented = LogSegmentStore::shared().is_open();
+    if (! segmented && ! this->prepare_logs( task_name, logs_root ) )
     {
         throw TaskException("Could not prepare logs for task execution at '" + logs_root + "'.");
     }
 
     std::string timestamp = get_8601();
-    std::string stdout_log_file = logs_root + "/" + task_name + "/" + timestamp + ".stdout.log";
-    std::string stderr_log_file = logs_root + "/" + task_name + "/" + timestamp + ".stderr.log";
+    // compressed logs are named for it, so that they are recognised for what they are
+    bool compress_logs = configuration->get_log_compression() == "lz4";
+    std::string log_suffix = compress_logs ? std::string( ".log" ) + LZ4_LOG_SUFFIX : std::string( ".log" );
+    std::string stdout_log_file = logs_root + "/" + task_name + "/" + timestamp + ".stdout" + log_suffix;
+    std::string stderr_log_file = logs_root + "/" + task_name + "/" + timestamp + ".stderr" + log_suffix;
 
     // open file handles to the two log files we need to create for each execution
-    FILE * stdout_log_fh = fopen( stdout_log_file.c_str(), "a+" );
-    FILE * stderr_log_fh = fopen( stderr_log_file.c_str(), "a+" );
+    // (close-on-exec, so Tasks executing concurrently don't inherit each other's logs)
+    FILE * stdout_log_fh = segmented ? LogSegmentStore::shared().create_log() : open_log_file( stdout_log_file );
+    FILE * stderr_log_fh = segmented ? LogSegmentStore::shared().create_log() : open_log_file( stderr_log_file );
+    LogFileCloser stdout_log_closer = { stdout_log_fh, segmented ? task_name : "", "stdout", timestamp, compress_logs };
+    LogFileCloser stderr_log_closer = { stderr_log_fh, segmented ? task_name : "", "stderr", timestamp, compress_logs };
+    if ( stdout_log_fh == NULL || stderr_log_fh == NULL )
+    {
+        if ( segmented )
+        {
+            throw TaskException("Could not create logs for task execution in '" + LogSegmentStore::shared().segment_path() + "'.");
+        }
+        throw TaskException("Could not open log files for task execution at '" + logs_root + "/" + task_name + "'.");
+    }
+    if ( compress_logs )
+    {
+        LogWriter::shared().set_compressed( fileno( stdout_log_fh ), true );
+        LogWriter::shared().set_compressed( fileno( stderr_log_fh ), true );
+    }
+
+    // a previous execution with exactly the same inputs succeeded, so this one would too
+    std::string cache_key;
+    bool cacheable = this->definition.get_cache() && this->fingerprint( cache_key, configuration, command, shell_definition, new_working_dir, rectifier, user, group, environment_file );
+    ResultCache cache( configuration->get_cache_root(), this->LOG_LEVEL );
+    if ( cacheable && cache.contains( cache_key ) )
+    {
+        this->slog.log_task( E_INFO, task_name, "Up to date with stored result " + cache_key.substr( 0, 12 ) + ".  Skipping target and marking as complete." );
+        cache.replay( cache_key, stdout_log_fh, stderr_log_fh, this->definition.get_cache_replay() );
+        this->mark_complete();
+        return;
+    }
 
     // check if working directory is to be set
     if ( override_working_dir )
     {
-        // if so, set the CWD.
-        chdir( new_working_dir.c_str() );
+        // the CWD is set in the child only, as other Tasks may be executing alongside this one.
         this->slog.log_task( E_INFO, task_name, "Setting working directory: " + new_working_dir );
     }
 
@@ -455,8 +1018,24 @@ void Task::execute( Conf * configuration )
     // TODO ...sourcing on the shell for variables and environment population doesn't have a good smell.
     // it does prevent unexpected behaviour from reimplementing what bash does though
 
+    // the beginning and end of the latest execution's output, for the report if the task fails.  kept in memory as the
+    // output goes by, so a failure is explained without reading the logs back.
+    size_t excerpt_bytes = configuration->get_output_excerpt_kib() * 1024;
+    OutputExcerpt stdout_excerpt( excerpt_bytes );
+    OutputExcerpt stderr_excerpt( excerpt_bytes );
+    OutputExcerpt * stdout_kept = excerpt_bytes > 0 ? &stdout_excerpt : nullptr;
+    OutputExcerpt * stderr_kept = excerpt_bytes > 0 ? &stderr_excerpt : nullptr;
+
     this->slog.log_task( E_INFO, task_name, "Executing target: \"" + command + "\"." );
+    RetryPolicy retry = this->definition.get_retry_policy();
+    this->attempts_made++;
+    int attempt = this->attempts_made;
+
+    // attempts starting within the same second share their logs, so only what this one adds to them is its result
+    off_t stdout_log_start = lseek( fileno( stdout_log_fh ), 0, SEEK_CUR );
+    off_t stderr_log_start = lseek( fileno( stderr_log_fh ), 0, SEEK_CUR );
 
+    CommandOutcome outcome;
     int return_code = lcpex(
             command,
             stdout_log_fh,
@@ -464,14 +1043,25 @@ void Task::execute( Conf * configuration )
             set_user_context,
             user,
             group,
+            override_working_dir,
+            new_working_dir,
+            timeout_seconds,
+            kill_grace_seconds,
             force_pty,
             is_shell_command,
             shell_definition.path,
             shell_definition.execution_arg,
             supply_environment,
             shell_definition.source_cmd,
-            environment_file
+            environment_file,
+            environment_variables,
+            shell_session,
+            stdout_kept,
+            stderr_kept,
+            cgroup,
+            outcome
     );
+    this->record_execution( "target", attempt, return_code, outcome );
 
     // **********************************************
     // d[0] Error Code Check
@@ -482,6 +1072,12 @@ void Task::execute( Conf * configuration )
         this->slog.log_task( E_INFO, task_name, "Target succeeded.  Marking as complete." );
 
         this->mark_complete();
+        this->attempts_made = 0;
+
+        if ( cacheable && cache.store( cache_key, stdout_log_fh, stdout_log_start, stderr_log_fh, stderr_log_start ) )
+        {
+            this->slog.log_task( E_DEBUG, task_name, "Stored result " + cache_key.substr( 0, 12 ) + "." );
+        }
 
         // a[1] NEXT
         return;
@@ -490,7 +1086,18 @@ void Task::execute( Conf * configuration )
     if ( return_code != 0 )
     {
         // d[0].1 NON-ZERO
-        this->slog.log_task( E_WARN,  task_name, "Target failed with exit code " + std::to_string( return_code ) + "." );
+        this->slog.log_task( E_WARN,  task_name, "Target " + describe_failure( return_code, timeout_seconds, outcome ) + "." );
+
+        // the Plan waits out the delay and executes this task again, so nothing else is held up meanwhile
+        if ( this->attempts_made < retry.attempts )
+        {
+            this->retry_delay_ms = backoff_delay_ms( retry, this->attempts_made );
+            char delay[32];
+            snprintf( delay, sizeof( delay ), "%.1f", this->retry_delay_ms / 1000.0 );
+            this->slog.log_task( E_WARN, task_name, "Attempt " + std::to_string( this->attempts_made ) + " of " + std::to_string( retry.attempts ) + " failed.  Retrying in " + delay + " second(s)." );
+            return;
+        }
+        this->attempts_made = 0;
 
         // **********************************************
         // d[1] Rectify Check
@@ -511,7 +1118,7 @@ void Task::execute( Conf * configuration )
                 // d[2].1 TRUE
                 // a[3] EXCEPTION
                 this->slog.log_task( E_FATAL, task_name, "Task is required, and failed, and rectification is not enabled." );
-                throw TaskException( "Task failed: " + task_name );
+                throw TaskException( ( return_code == LCPEX_TIMED_OUT ? "Task timed out: " : "Task failed: " ) + task_name + describe_output( stdout_excerpt, stderr_excerpt ) );
             }
             // **********************************************
             // end - d[2] Required Check
@@ -526,6 +1133,9 @@ void Task::execute( Conf * configuration )
 
             // a[4] Execute RECTIFIER
             this->slog.log_task( E_INFO, task_name, "Executing rectification: " + rectifier + "." );
+            stdout_excerpt.clear();
+            stderr_excerpt.clear();
+            CommandOutcome rectifier_outcome;
             int rectifier_error = lcpex(
                     rectifier,
                     stdout_log_fh,
@@ -533,14 +1143,25 @@ void Task::execute( Conf * configuration )
                     set_user_context,
                     user,
                     group,
+                    override_working_dir,
+                    new_working_dir,
+                    timeout_seconds,
+                    kill_grace_seconds,
                     force_pty,
                     is_shell_command,
                     shell_definition.path,
                     shell_definition.execution_arg,
                     supply_environment,
                     shell_definition.source_cmd,
-                    environment_file
+                    environment_file,
+                    environment_variables,
+                    shell_session,
+                    stdout_kept,
+                    stderr_kept,
+                    cgroup,
+                    rectifier_outcome
             );
+            this->record_execution( "rectifier", attempt, rectifier_error, rectifier_outcome );
 
             // **********************************************
             // d[3] Error Code Check for Rectifier
@@ -548,7 +1169,7 @@ void Task::execute( Conf * configuration )
             if ( rectifier_error != 0 )
             {
                 // d[3].1 Non-Zero
-                this->slog.log_task(  E_WARN, task_name, "Rectification failed with exit code " + std::to_string( rectifier_error ) + "." );
+                this->slog.log_task(  E_WARN, task_name, "Rectification " + describe_failure( rectifier_error, timeout_seconds, rectifier_outcome ) + "." );
 
                 // **********************************************
                 // d[4] Required Check
@@ -562,7 +1183,7 @@ void Task::execute( Conf * configuration )
                     // d[4].1 TRUE
                     // a[6] EXCEPTION
                     this->slog.log_task( E_FATAL, task_name, "Task is required, but failed, and rectification failed.  Lost cause." );
-                    throw TaskException( "Lost cause, task failure." );
+                    throw TaskException( "Lost cause, task failure." + describe_output( stdout_excerpt, stderr_excerpt ) );
                 }
                 // **********************************************
                 // end - d[4] Required Check
@@ -578,6 +1199,9 @@ void Task::execute( Conf * configuration )
                 // a[7] Re-execute Target
                 this->slog.log_task( E_INFO, task_name, "Re-Executing target '" + command + "'." );
 
+                stdout_excerpt.clear();
+                stderr_excerpt.clear();
+                CommandOutcome retry_outcome;
                 int retry_code = lcpex(
                         command,
                         stdout_log_fh,
@@ -585,14 +1209,25 @@ void Task::execute( Conf * configuration )
                         set_user_context,
                         user,
                         group,
+                        override_working_dir,
+                        new_working_dir,
+                        timeout_seconds,
+                        kill_grace_seconds,
                         force_pty,
                         is_shell_command,
                         shell_definition.path,
                         shell_definition.execution_arg,
                         supply_environment,
                         shell_definition.source_cmd,
-                        environment_file
+                        environment_file,
+                        environment_variables,
+                        shell_session,
+                        stdout_kept,
+                        stderr_kept,
+                        cgroup,
+                        retry_outcome
                 );
+                this->record_execution( "re-execution", attempt, retry_code, retry_outcome );
 
                 // **********************************************
                 // d[5] Error Code Check
@@ -601,11 +1236,12 @@ void Task::execute( Conf * configuration )
                 {
                     // d[5].0 ZERO
                     // a[8] NEXT
-                    this->slog.log_task( E_INFO, task_name, "Re-execution was successful." );
+                    this->slog.log_task( E_INFO, task_name, "Re-execution was successful.  Marking as complete." );
+                    this->mark_complete();
                     return;
                 } else {
                     // d[5].1 NON-ZERO
-                    this->slog.log_task( E_WARN, task_name, "Re-execution failed with exit code " + std::to_string( retry_code ) + "." );
+                    this->slog.log_task( E_WARN, task_name, "Re-execution " + describe_failure( retry_code, timeout_seconds, retry_outcome ) + "." );
 
                     // **********************************************
                     // d[6] Required Check
@@ -620,7 +1256,7 @@ void Task::execute( Conf * configuration )
                         // d[6].1 TRUE
                         // a[10] EXCEPTION
                         this->slog.log_task( E_FATAL, task_name, "Task is required, and failed, then rectified but rectifier did not heal the condition causing the target to fail.  Cannot proceed with Plan." );
-                        throw TaskException( "Lost cause, task failure." );
+                        throw TaskException( "Lost cause, task failure." + describe_output( stdout_excerpt, stderr_excerpt ) );
                     }
                     // **********************************************
                     // end - d[6] Required Check
@@ -633,7 +1269,4 @@ void Task::execute( Conf * configuration )
         // end d[1] Rectify Check
         // **********************************************
     }
-    // close the log file handles
-    fclose(stdout_log_fh);
-    fclose(stderr_log_fh);
 }
\ No newline at end of file
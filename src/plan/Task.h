@@ -22,18 +22,37 @@
 #include "../config/Config.h"
 #include "../misc/helpers.h"
 #include "../lcpex/liblcpex.h"
+#include "ResultCache.h"
 #include <string>
 #include <unistd.h>
 #include <stdio.h>
 #include <sys/stat.h>
 
 
+// one execution of a Task's target or rectifier, as measured for the resource accounting
+struct TaskExecution {
+    // "target", "rectifier" or "re-execution"
+    std::string phase;
+    // the attempt of the target it was part of, under the retry policy
+    int attempt;
+    // the result of lcpex()
+    int return_code;
+    CommandOutcome outcome;
+};
+
 class Task
 {
     protected:
         // the name of this task
         std::string name;
 
+        // the name of the unit this task executes.  the same as the task's name, unless the task is one instance of
+        // a matrix entry in the plan.
+        std::string unit_name;
+
+        // the parameters of a matrix instance, passed to its executions as environment variables
+        std::map<std::string, std::string> parameters;
+
         // names of tasks that must have successfully executed before this task can execute its own unit.
         std::vector<std::string> dependencies;
 
@@ -47,8 +66,34 @@ class Task
         // the readiness of this task to execute
         bool defined;
 
+        // executions of the target so far under the definition's retry policy
+        int attempts_made;
+
+        // milliseconds to wait before executing again after a failed attempt, or -1 if no retry is due
+        long long retry_delay_ms;
+
+        // every execution of the target and rectifier so far, in order
+        std::vector<TaskExecution> executions;
+
+        // keep the measurements of an execution
+        void record_execution( const std::string & phase, int attempt, int return_code, const CommandOutcome & outcome );
+
         bool prepare_logs( std::string task_name, std::string logs_root );
 
+        // digest everything that determines the result of executing the definition, for the result cache.
+        // returns false if one of those inputs can't be read, in which case the result can't be reused.
+        bool fingerprint(
+                std::string & key,
+                Conf * configuration,
+                const std::string & command,
+                const Shell & shell_definition,
+                const std::string & new_working_dir,
+                const std::string & rectifier,
+                const std::string & user,
+                const std::string & group,
+                const std::string & environment_file
+        );
+
 
 public:
         // constructor
@@ -63,14 +108,39 @@ public:
         bool is_complete();
         bool has_definition();
 
+        // whether the attached definition needs the controlling terminal
+        bool get_force_pty();
+
+        // the resource tokens the attached definition holds while executing
+        std::map<std::string, int> get_resources();
+
         // fetch the name of a task
         std::string get_name();
 
+        // fetch the name of the unit the task executes
+        std::string get_unit_name();
+
+        // make this task the instance of a matrix entry with the given parameters
+        void set_parameters( const std::map<std::string, std::string> & parameters );
+
         // execute this task's definition
         void execute( Conf * configuration );
 
+        // everything that would keep this task's definition from executing, found without executing anything.
+        // safe to call for several tasks at once.
+        std::vector<std::string> preflight( Conf * configuration );
+
         void mark_complete();
 
+        // whether the last execution failed an attempt that the retry policy allows to be made again
+        bool retry_pending();
+
+        // milliseconds to wait before making the pending retry
+        long long get_retry_delay_ms();
+
+        // every execution of the target and rectifier so far, with what each used
+        const std::vector<TaskExecution> & get_executions();
+
         // returns a pointer to the dependencies vector
         std::vector<std::string> get_dependencies();
 
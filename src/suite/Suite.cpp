@@ -191,6 +191,7 @@ void Suite::load_units_file( std::string units_path )
             tmp_U.load_root( this->json_root[ index ] );
             if ( tmp_U.get_active() ) {
                 // append to this->units
+                this->unit_index.emplace( tmp_U.get_name(), this->units.size() );
                 this->units.push_back( tmp_U );
                 this->slog.log( E_INFO, "Added unit \"" + tmp_U.get_name() + "\" to Suite.");
             }
@@ -209,22 +210,26 @@ void Suite::load_units_file( std::string units_path )
  */
 void Suite::get_unit(Unit & result, std::string provided_name)
 {
-    bool foundMatch = false;
+    // the first definition of a name wins, as with a front-to-back search
+    std::unordered_map<std::string, int>::const_iterator found = this->unit_index.find( provided_name );
 
-    for ( int i = 0; i < this->units.size(); i++ )
-    {
-        std::string unit_name = this->units[i].get_name();
-        if ( unit_name == provided_name )
-        {
-            result = this->units[i];
-            foundMatch = true;
-            break;
-        }
-    }
-
-    if (! foundMatch )
+    if ( found != this->unit_index.end() )
     {
+        result = this->units[ found->second ];
+    } else {
         this->slog.log( E_FATAL, "Unit name \"" + provided_name + "\" was referenced but not defined!" );
         throw SuiteException( "Undefined unit referenced." );
     }
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Checks whether a Unit with the `provided_name` attribute is contained, without reporting it if not.
+ *
+ * @param provided_name The name of the unit being looked for.
+ *
+ * @return True if the unit is defined.
+ */
+bool Suite::has_unit(const std::string & provided_name)
+{
+    return this->unit_index.find( provided_name ) != this->unit_index.end();
+}
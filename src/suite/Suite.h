@@ -25,6 +25,7 @@
 #include <syslog.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <unordered_map>
 
 
 /**
@@ -43,6 +44,9 @@ class Suite: public JSON_Loader
         /// storage for the definitions we are amassing from the unit definition files
         std::vector<Unit> units;
 
+        /// position of each unit in `units` by name, so Plans can resolve their Tasks without a search
+        std::unordered_map<std::string, int> unit_index;
+
     public:
         /**
          * @brief Constructor for Suite class.
@@ -66,6 +70,15 @@ class Suite: public JSON_Loader
          */
         void get_unit(Unit & result, std::string provided_name);
 
+        /**
+         * @brief Check whether a unit is defined.
+         *
+         * @param provided_name The name of the unit to look for.
+         *
+         * @return True if the suite has a unit with the provided name.
+         */
+        bool has_unit(const std::string & provided_name);
+
     private:
         /**
          * @brief Get a list of unit definition files from a directory.
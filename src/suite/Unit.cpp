@@ -15,6 +15,8 @@
 */
 
 #include "Unit.h"
+#include "../lcpex/Contexts.h"
+#include "../lcpex/Cgroup.h"
 
 
 /**
@@ -125,6 +127,11 @@ int Unit::load_root(Json::Value loader_root)
     { this->set_working_directory = loader_root.get("set_working_directory", errmsg).asBool(); } else
         throw UnitException("No 'set_working_directory' attribute specified when loading a unit.");
 
+    if ( loader_root.isMember("working_directory") )
+    { this->working_directory = loader_root.get("working_directory", errmsg).asString(); } else if ( this->set_working_directory )
+        throw UnitException("No 'working_directory' attribute specified for a unit that sets its working directory.");
+    else this->working_directory = "";
+
     if ( loader_root.isMember("rectify") )
     { this->rectify = loader_root.get("rectify", errmsg).asBool(); } else
         throw UnitException("No 'rectify' boolean attribute specified when loading a unit.");
@@ -145,42 +152,25 @@ int Unit::load_root(Json::Value loader_root)
     { this->set_user_context = loader_root.get("set_user_context", errmsg).asBool(); } else
         throw UnitException("No 'set_user_context' attribute specified when loading a unit.");
 
-    // TODO functionize this
-    int uid = getuid();
-    struct passwd * upw;
-
+    // if no user or group field is specified then default to the currently executing user and group.  these are
+    // looked up once, however many units are loaded.
     std::string errmsg_user;
-
-    // if no user field is specified then default to the currently executing user
-    if ( ( upw = getpwuid(uid) ) == nullptr )
+    if (! uid_to_username( getuid(), errmsg_user ) )
     {
         throw UnitException( "Could not retrieve current user." );
-    } else {
-        errmsg_user = upw->pw_name;
     }
-    // -TODO
 
     if ( loader_root.isMember( "user" ) )
     { this->user = loader_root.get( "user", errmsg_user ).asString(); } else this->user = errmsg_user;
 
-    // TODO functionalize this
-    // get the current context gid as a backup value
-    int gid = getgid();
-    // declare the grp object to pull the name from once populated
-    struct group * grp;
-    // storage for backup value once retrieved
     std::string errmsg_group;
-
-    // get the backup value and store it to errmsg_group
-    if ( ( grp = getgrgid( gid ) ) == nullptr )
+    if (! gid_to_groupname( getgid(), errmsg_group ) )
     {
         throw UnitException("Could not retrieve current group");
-    } else {
-        errmsg_group = grp->gr_name;
     }
 
     if ( loader_root.isMember( "group" ) )
-    { this->group = loader_root.get( "group", errmsg_group ).asString(); } else this->group = grp->gr_name;
+    { this->group = loader_root.get( "group", errmsg_group ).asString(); } else this->group = errmsg_group;
 
     if ( loader_root.isMember("supply_environment") )
     {
@@ -196,6 +186,155 @@ int Unit::load_root(Json::Value loader_root)
         throw UnitException("No 'environment' attribute specified when loading a unit.");
     }
 
+    // optional
+    this->resources.clear();
+    if ( loader_root.isMember("resources") )
+    {
+        Json::Value claims = loader_root["resources"];
+        if (! claims.isObject() )
+        {
+            throw UnitException("The 'resources' attribute of unit '" + this->name + "' must be an object of resource names to token counts.");
+        }
+        for ( Json::Value::const_iterator it = claims.begin(); it != claims.end(); it++ )
+        {
+            if (! it->isInt() || it->asInt() < 0 )
+            {
+                throw UnitException("Resource '" + it.name() + "' of unit '" + this->name + "' must claim a non-negative integer number of tokens.");
+            }
+            this->resources[ it.name() ] = it->asInt();
+        }
+    }
+
+    // optional
+    this->cache = false;
+    if ( loader_root.isMember("cache") )
+    { this->cache = loader_root.get("cache", errmsg).asBool(); }
+
+    // optional
+    this->cache_inputs.clear();
+    if ( loader_root.isMember("cache_inputs") )
+    {
+        Json::Value inputs = loader_root["cache_inputs"];
+        if (! inputs.isArray() )
+        {
+            throw UnitException("The 'cache_inputs' attribute of unit '" + this->name + "' must be an array of paths.");
+        }
+        for ( Json::ArrayIndex i = 0; i < inputs.size(); i++ )
+        {
+            if (! inputs[i].isString() )
+            {
+                throw UnitException("The 'cache_inputs' attribute of unit '" + this->name + "' must be an array of paths.");
+            }
+            this->cache_inputs.push_back( inputs[i].asString() );
+        }
+    }
+
+    // optional
+    this->cache_replay = false;
+    if ( loader_root.isMember("cache_replay") )
+    { this->cache_replay = loader_root.get("cache_replay", errmsg).asBool(); }
+
+    // optional
+    this->isolated = false;
+    if ( loader_root.isMember("isolated") )
+    { this->isolated = loader_root.get("isolated", errmsg).asBool(); }
+
+    // optional
+    this->timeout_seconds = 0;
+    if ( loader_root.isMember("timeout_seconds") )
+    {
+        if (! loader_root["timeout_seconds"].isInt() || loader_root["timeout_seconds"].asInt() < 0 )
+        {
+            throw UnitException("The 'timeout_seconds' attribute of unit '" + this->name + "' must be a non-negative integer.");
+        }
+        this->timeout_seconds = loader_root["timeout_seconds"].asInt();
+    }
+
+    // optional
+    this->kill_grace_seconds = 10;
+    if ( loader_root.isMember("kill_grace_seconds") )
+    {
+        if (! loader_root["kill_grace_seconds"].isInt() || loader_root["kill_grace_seconds"].asInt() < 0 )
+        {
+            throw UnitException("The 'kill_grace_seconds' attribute of unit '" + this->name + "' must be a non-negative integer.");
+        }
+        this->kill_grace_seconds = loader_root["kill_grace_seconds"].asInt();
+    }
+
+    // optional.  even an empty object runs each execution in a cgroup of its own, for its accounting and teardown.
+    this->cgroup = false;
+    this->cgroup_limits.clear();
+    if ( loader_root.isMember("cgroup") )
+    {
+        Json::Value limits = loader_root["cgroup"];
+        if (! limits.isObject() )
+        {
+            throw UnitException("The 'cgroup' attribute of unit '" + this->name + "' must be an object of cgroup interface files to values.");
+        }
+        for ( Json::Value::const_iterator it = limits.begin(); it != limits.end(); it++ )
+        {
+            if ( cgroup_limit_controller( it.name() ).empty() )
+            {
+                throw UnitException("Unit '" + this->name + "' can not set the cgroup interface file '" + it.name() + "': only cpu.max, memory.max, io.weight and pids.max may be set.");
+            }
+            if ( it->isString() )
+            {
+                this->cgroup_limits[ it.name() ] = it->asString();
+            } else if ( it->isIntegral() ) {
+                this->cgroup_limits[ it.name() ] = std::to_string( it->asLargestInt() );
+            } else {
+                throw UnitException("The cgroup limit '" + it.name() + "' of unit '" + this->name + "' must be a string or an integer.");
+            }
+        }
+        this->cgroup = true;
+    }
+
+    // optional
+    this->retry.attempts = 1;
+    this->retry.delay_seconds = 1;
+    this->retry.multiplier = 2;
+    this->retry.jitter = 0.1;
+    if ( loader_root.isMember("retry") )
+    {
+        Json::Value policy = loader_root["retry"];
+        if (! policy.isObject() )
+        {
+            throw UnitException("The 'retry' attribute of unit '" + this->name + "' must be an object.");
+        }
+        if ( policy.isMember("attempts") )
+        {
+            if (! policy["attempts"].isInt() || policy["attempts"].asInt() < 1 )
+            {
+                throw UnitException("The retry 'attempts' of unit '" + this->name + "' must be a positive integer.");
+            }
+            this->retry.attempts = policy["attempts"].asInt();
+        }
+        if ( policy.isMember("delay_seconds") )
+        {
+            if (! policy["delay_seconds"].isNumeric() || policy["delay_seconds"].asDouble() < 0 )
+            {
+                throw UnitException("The retry 'delay_seconds' of unit '" + this->name + "' must be a non-negative number.");
+            }
+            this->retry.delay_seconds = policy["delay_seconds"].asDouble();
+        }
+        if ( policy.isMember("multiplier") )
+        {
+            if (! policy["multiplier"].isNumeric() || policy["multiplier"].asDouble() < 1 )
+            {
+                throw UnitException("The retry 'multiplier' of unit '" + this->name + "' must be a number no less than 1.");
+            }
+            this->retry.multiplier = policy["multiplier"].asDouble();
+        }
+        if ( policy.isMember("jitter") )
+        {
+            if (! policy["jitter"].isNumeric() || policy["jitter"].asDouble() < 0 || policy["jitter"].asDouble() > 1 )
+            {
+                throw UnitException("The retry 'jitter' of unit '" + this->name + "' must be a number from 0 to 1.");
+            }
+            this->retry.jitter = policy["jitter"].asDouble();
+        }
+    }
+
     this->populated = true;
 
     return 0;
@@ -418,3 +557,143 @@ std::string Unit::get_environment_file()
     return this->env_vars_file;
 }
 
+
+/**
+ * @brief Retrieves the resource tokens the unit holds while executing.
+ *
+ * @return A map of resource names to the number of tokens claimed.  Empty if the unit claims none.
+ *
+ * @throws UnitException if the unit has not been populated.
+ */
+std::map<std::string, int> Unit::get_resources()
+{
+    if ( ! this->populated ) { throw UnitException("Attempted to access an unpopulated unit."); }
+    return this->resources;
+}
+
+
+/**
+ * @brief Retrieves whether a successful execution of the unit may be reused while its inputs are unchanged.
+ *
+ * @return The value of the cache flag.
+ *
+ * @throws UnitException if the unit has not been populated.
+ */
+bool Unit::get_cache()
+{
+    if ( ! this->populated ) { throw UnitException("Attempted to access an unpopulated unit."); }
+    return this->cache;
+}
+
+
+/**
+ * @brief Retrieves the files the result of the unit depends on, besides its target, rectifier and environment file.
+ *
+ * @return The paths of the declared inputs, as written in the unit definition.
+ *
+ * @throws UnitException if the unit has not been populated.
+ */
+std::vector<std::string> Unit::get_cache_inputs()
+{
+    if ( ! this->populated ) { throw UnitException("Attempted to access an unpopulated unit."); }
+    return this->cache_inputs;
+}
+
+
+/**
+ * @brief Retrieves whether a reused execution of the unit echoes its stored output to the console.
+ *
+ * @return The value of the cache_replay flag.
+ *
+ * @throws UnitException if the unit has not been populated.
+ */
+bool Unit::get_cache_replay()
+{
+    if ( ! this->populated ) { throw UnitException("Attempted to access an unpopulated unit."); }
+    return this->cache_replay;
+}
+
+
+/**
+ * @brief Retrieves whether the unit's target and rectifier always get a shell of their own.
+ *
+ * @return The value of the isolated flag.
+ *
+ * @throws UnitException if the unit has not been populated.
+ */
+bool Unit::get_isolated()
+{
+    if ( ! this->populated ) { throw UnitException("Attempted to access an unpopulated unit."); }
+    return this->isolated;
+}
+
+
+/**
+ * @brief Retrieves how long each execution of the unit's target or rectifier may run.
+ *
+ * @return The timeout in seconds, or 0 if executions are not limited.
+ *
+ * @throws UnitException if the unit has not been populated.
+ */
+int Unit::get_timeout_seconds()
+{
+    if ( ! this->populated ) { throw UnitException("Attempted to access an unpopulated unit."); }
+    return this->timeout_seconds;
+}
+
+
+/**
+ * @brief Retrieves how long a timed out execution is given to terminate before it is killed.
+ *
+ * @return The grace period in seconds.
+ *
+ * @throws UnitException if the unit has not been populated.
+ */
+int Unit::get_kill_grace_seconds()
+{
+    if ( ! this->populated ) { throw UnitException("Attempted to access an unpopulated unit."); }
+    return this->kill_grace_seconds;
+}
+
+
+/**
+ * @brief Retrieves whether each execution of the unit runs in a transient cgroup of its own.
+ *
+ * @return True if the unit has a cgroup attribute.
+ *
+ * @throws UnitException if the unit has not been populated.
+ */
+bool Unit::get_cgroup()
+{
+    if ( ! this->populated ) { throw UnitException("Attempted to access an unpopulated unit."); }
+    return this->cgroup;
+}
+
+
+/**
+ * @brief Retrieves the limits applied to the cgroup of each execution of the unit.
+ *
+ * @return A map of cgroup interface files, such as "memory.max", to the values written to them.  Empty if the unit
+ *         sets none.
+ *
+ * @throws UnitException if the unit has not been populated.
+ */
+std::map<std::string, std::string> Unit::get_cgroup_limits()
+{
+    if ( ! this->populated ) { throw UnitException("Attempted to access an unpopulated unit."); }
+    return this->cgroup_limits;
+}
+
+
+/**
+ * @brief Retrieves how a failing target of the unit is retried before rectification.
+ *
+ * @return The retry policy.  Its attempts are 1 if the unit does not retry.
+ *
+ * @throws UnitException if the unit has not been populated.
+ */
+RetryPolicy Unit::get_retry_policy()
+{
+    if ( ! this->populated ) { throw UnitException("Attempted to access an unpopulated unit."); }
+    return this->retry;
+}
@@ -19,6 +19,8 @@
 #define REX_UNIT_H
 
 #include <string>
+#include <map>
+#include <vector>
 #include "../json_support/JSON.h"
 #include "../logger/Logger.h"
 #include <iostream>
@@ -29,6 +31,25 @@
 #include <grp.h>
 
 
+/*
+ * How many times a failing target is executed before rectification, and how long to wait between executions.
+ * The wait before the n-th retry is delay_seconds * multiplier^(n-1), varied by up to +/- jitter of itself.
+ */
+struct RetryPolicy {
+    // executions of the target before falling through to rectification.  1 means no retries.
+    int attempts;
+
+    // the wait before the first retry
+    double delay_seconds;
+
+    // how much longer each successive wait is than the one before it
+    double multiplier;
+
+    // the fraction of each wait that is randomized, so failures with a common cause don't retry in lockstep
+    double jitter;
+};
+
+
 /*
  * Unit is a type that represents a safely deserialized JSON object which defines what actions are taken as rex
  * iterates through it's Tasks in it's given Plan.  They only define the behaviour on execution, while the tasks define
@@ -92,6 +113,36 @@ class Unit: JSON_Loader
         // the path to a file containing environment variables or functions to be set for this execution
         std::string env_vars_file;
 
+        // named resource tokens this unit holds while it executes, e.g. { "disk_io": 1, "cpu": 4 }.
+        // optional.  capacities are declared in the configuration file.
+        std::map<std::string, int> resources;
+
+        // whether a successful execution may be reused while nothing it depends on has changed.  optional.
+        bool cache;
+
+        // files the result of this unit depends on, besides its target, rectifier and environment file.  optional.
+        std::vector<std::string> cache_inputs;
+
+        // whether a reused execution echoes its stored output to the console.  optional.
+        bool cache_replay;
+
+        // whether the target and rectifier always get a shell of their own, even when shell sessions are enabled.  optional.
+        bool isolated;
+
+        // seconds each execution of the target or rectifier may run before it is terminated, or 0 for no limit.  optional.
+        int timeout_seconds;
+
+        // seconds between asking a timed out execution to terminate and killing it.  optional.
+        int kill_grace_seconds;
+
+        // whether each execution runs in a transient cgroup of its own, and the values written to its interface files,
+        // e.g. { "memory.max": "2G", "pids.max": "512" }.  optional.  the cgroups are made in the configured cgroup_root.
+        bool cgroup;
+        std::map<std::string, std::string> cgroup_limits;
+
+        // how a failing target is retried before rectification.  optional, defaults to no retries.
+        RetryPolicy retry;
+
     public:
         Unit( int LOG_LEVEL );
 
@@ -115,6 +166,16 @@ class Unit: JSON_Loader
         std::string get_group();
         bool get_supply_environment();
         std::string get_environment_file();
+        std::map<std::string, int> get_resources();
+        bool get_cache();
+        std::vector<std::string> get_cache_inputs();
+        bool get_cache_replay();
+        bool get_isolated();
+        int get_timeout_seconds();
+        int get_kill_grace_seconds();
+        bool get_cgroup();
+        std::map<std::string, std::string> get_cgroup_limits();
+        RetryPolicy get_retry_policy();
 
     private:
         int LOG_LEVEL;
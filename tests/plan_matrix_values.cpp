@@ -0,0 +1,162 @@
+// Checks that a Plan is refused when a matrix value could not safely be part of a Task's name, by running rex --check
+// on a plan for each such value.  The name becomes a directory of the Task's logs and a field of the run journal and
+// the duration history, so a value must not climb out of logs_path, break a line or field, or look like the name's own
+// punctuation.
+//
+// Usage: plan_matrix_values REX
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct Case {
+    const char * value;
+    // what the refusal must say the value contains, or null for a value that is accepted
+    const char * problem;
+};
+
+static const std::vector<Case> CASES = {
+    { "x86_64", nullptr },
+    { "el-9.1 beta", nullptr },
+    { "../../x", "'..'" },
+    { "..", "'..'" },
+    { "a/b", "'/'" },
+    { "/", "'/'" },
+    { "a\nb", "a control character" },
+    { "a\tb", "a control character" },
+    { "a\x7f", "a control character" },
+    { "a[b", "'['" },
+    { "a]b", "']'" },
+    { "a,b", "','" },
+    { "a=b", "'='" },
+};
+
+// a JSON string holding text
+static std::string json_string( const std::string & text )
+{
+    std::string quoted = "\"";
+    for ( size_t i = 0; i < text.size(); i++ ) {
+        unsigned char c = text[i];
+        if ( c == '"' || c == '\\' ) {
+            quoted += '\\';
+            quoted += text[i];
+        } else if ( c < 0x20 || c == 0x7f ) {
+            char escaped[8];
+            snprintf( escaped, sizeof( escaped ), "\\u%04x", c );
+            quoted += escaped;
+        } else {
+            quoted += text[i];
+        }
+    }
+    return quoted + "\"";
+}
+
+static void write_file( const std::string & path, const std::string & contents )
+{
+    FILE * file = fopen( path.c_str(), "w" );
+    if ( file == nullptr || fputs( contents.c_str(), file ) == EOF || fclose( file ) != 0 ) {
+        perror( path.c_str() );
+        exit( 2 );
+    }
+}
+
+// run rex --check on the plan, returning its exit status and everything it printed
+static int check_plan( const std::string & rex, const std::string & project, std::string & output )
+{
+    int channel[2];
+    if ( pipe( channel ) == -1 ) {
+        perror( "pipe" );
+        exit( 2 );
+    }
+    pid_t child = fork();
+    if ( child == -1 ) {
+        perror( "fork" );
+        exit( 2 );
+    }
+    if ( child == 0 ) {
+        dup2( channel[1], STDOUT_FILENO );
+        dup2( channel[1], STDERR_FILENO );
+        close( channel[0] );
+        close( channel[1] );
+        std::string config = project + "/rex.config";
+        std::string plan = project + "/plans/matrix.plan";
+        execl( rex.c_str(), rex.c_str(), "--check", "-c", config.c_str(), "-p", plan.c_str(), (char *) nullptr );
+        perror( rex.c_str() );
+        _exit( 127 );
+    }
+
+    close( channel[1] );
+    output.clear();
+    char buffer[4096];
+    ssize_t got;
+    while ( ( got = read( channel[0], buffer, sizeof( buffer ) ) ) != 0 ) {
+        if ( got < 0 ) {
+            if ( errno == EINTR ) { continue; }
+            break;
+        }
+        output.append( buffer, got );
+    }
+    close( channel[0] );
+    int status;
+    waitpid( child, &status, 0 );
+    return WIFEXITED( status ) ? WEXITSTATUS( status ) : 128 + WTERMSIG( status );
+}
+
+int main( int argc, char ** argv )
+{
+    if ( argc != 2 ) {
+        fprintf( stderr, "usage: %s REX\n", argv[0] );
+        return 2;
+    }
+    std::string rex = argv[1];
+
+    char directory[] = "/tmp/rex_plan_matrix_values.XXXXXX";
+    if ( mkdtemp( directory ) == nullptr ) {
+        perror( "test directory" );
+        return 2;
+    }
+    std::string project = directory;
+    const char * subdirectories[] = { "units", "plans", "shells", "logs" };
+    for ( const char * subdirectory : subdirectories ) {
+        mkdir( ( project + "/" + subdirectory ).c_str(), 0755 );
+    }
+    write_file( project + "/rex.config", "{ \"config\": { \"project_root\": " + json_string( project ) + ", \"units_path\": \"units/\", \"logs_path\": \"logs/\", \"shells_path\": \"shells/\", \"jobs\": 1 } }\n" );
+    write_file( project + "/shells/sh.shell", "{ \"shells\": [ { \"name\": \"sh\", \"path\": \"/bin/sh\", \"execution_arg\": \"-c\", \"source_cmd\": \".\" } ] }\n" );
+    write_file( project + "/units/build.units", "{ \"units\": [ { \"name\": \"build\", \"target\": \"/bin/true\", \"is_shell_command\": false, \"shell_definition\": \"sh\", \"force_pty\": false, \"set_working_directory\": false, \"working_directory\": \"\", \"rectify\": false, \"rectifier\": \"\", \"active\": true, \"required\": true, \"set_user_context\": false, \"supply_environment\": false, \"environment\": \"\" } ] }\n" );
+
+    int failures = 0;
+    for ( const Case & test : CASES ) {
+        write_file( project + "/plans/matrix.plan", "{ \"plan\": [ { \"name\": \"build\", \"dependencies\": [], \"matrix\": { \"ARCH\": [ " + json_string( test.value ) + " ] } } ] }\n" );
+        std::string output;
+        int status = check_plan( rex, project, output );
+
+        std::string problem;
+        if ( test.problem == nullptr && status != 0 ) {
+            problem = "was refused";
+        } else if ( test.problem != nullptr ) {
+            std::string expected = std::string( "has a value containing " ) + test.problem;
+            if ( status == 0 ) {
+                problem = "was accepted";
+            } else if ( output.find( "Invalid matrix" ) == std::string::npos || output.find( expected ) == std::string::npos ) {
+                problem = "was not refused as containing " + std::string( test.problem );
+            }
+        }
+        if (! problem.empty() ) {
+            fprintf( stderr, "FAIL: %s\n  %s.  rex printed:\n%s\n", json_string( test.value ).c_str(), problem.c_str(), output.c_str() );
+            failures++;
+        }
+    }
+
+    std::string remove = "rm -rf '" + project + "'";
+    if ( system( remove.c_str() ) != 0 ) {
+        fprintf( stderr, "could not remove %s\n", project.c_str() );
+    }
+
+    printf( "%zu values, %d failure(s)\n", CASES.size(), failures );
+    return failures == 0 ? 0 : 1;
+}
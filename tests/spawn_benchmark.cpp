@@ -0,0 +1,110 @@
+// Times starting /bin/true and waiting for it with spawn_process(), against fork() and execv() as lcpex launched
+// children before, while the parent holds a given amount of touched memory.  fork() copies the parent's page tables,
+// so its cost grows with the parent; spawn_process() shares them until the child executes.
+//
+// Not part of the build: cmake --build <dir> --target spawn_benchmark, then run it, optionally with the number of
+// spawns to time and the sizes of the parent to time them at, in MiB.
+
+#include "../src/lcpex/Spawn.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static char PROGRAM[] = "/bin/true";
+
+static bool reap( pid_t child )
+{
+    int status;
+    return child > 0 && waitpid( child, &status, 0 ) == child && WIFEXITED( status ) && WEXITSTATUS( status ) == 0;
+}
+
+static double microseconds_per_spawn( std::chrono::steady_clock::time_point started, long count )
+{
+    std::chrono::nanoseconds taken = std::chrono::steady_clock::now() - started;
+    return taken.count() / 1000.0 / count;
+}
+
+int main( int argc, char ** argv )
+{
+    long count = argc > 1 ? atol( argv[1] ) : 500;
+    std::vector<long> sizes;
+    for ( int i = 2; i < argc; i++ ) {
+        sizes.push_back( atol( argv[i] ) );
+    }
+    if ( sizes.empty() ) {
+        sizes = { 0, 256, 1024 };
+    }
+    if ( count <= 0 ) {
+        fprintf( stderr, "usage: %s [ COUNT [ MIB... ] ]\n", argv[0] );
+        return 2;
+    }
+
+    char * child_argv[] = { PROGRAM, nullptr };
+    SpawnRequest request;
+    request.argv = child_argv;
+    request.envp = nullptr;
+    request.stdin_fd = -1;
+    request.stdout_fd = -1;
+    request.stderr_fd = -1;
+    request.new_session = false;
+    request.controlling_tty_fd = -1;
+    request.own_process_group = false;
+    request.cgroup_procs_fd = -1;
+    request.working_directory = nullptr;
+    request.set_identity = false;
+    request.uid = 0;
+    request.gid = 0;
+    request.groups = nullptr;
+    request.group_count = 0;
+
+    printf( "%-10s %16s %16s\n", "parent MiB", "fork+exec us", "spawn_process us" );
+    for ( long size : sizes ) {
+        // touched, so that every page is mapped and fork() has to copy its table entry
+        size_t bytes = (size_t) size * 1024 * 1024;
+        char * held = nullptr;
+        if ( bytes > 0 ) {
+            held = (char *) mmap( nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+            if ( held == MAP_FAILED ) {
+                perror( "mmap" );
+                return 1;
+            }
+            memset( held, 1, bytes );
+        }
+
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        for ( long i = 0; i < count; i++ ) {
+            pid_t child = fork();
+            if ( child == 0 ) {
+                execv( PROGRAM, child_argv );
+                _exit( 255 );
+            }
+            if (! reap( child ) ) {
+                fprintf( stderr, "fork+exec of %s failed\n", PROGRAM );
+                return 1;
+            }
+        }
+        double fork_us = microseconds_per_spawn( started, count );
+
+        started = std::chrono::steady_clock::now();
+        for ( long i = 0; i < count; i++ ) {
+            SPAWN_STAGE failed_stage;
+            int failed_errno;
+            if (! reap( spawn_process( request, failed_stage, failed_errno ) ) ) {
+                fprintf( stderr, "%s", describe_spawn_failure( request, failed_stage, failed_errno ).c_str() );
+                return 1;
+            }
+        }
+        double spawn_us = microseconds_per_spawn( started, count );
+
+        printf( "%-10ld %16.0f %16.0f\n", size, fork_us, spawn_us );
+        if ( held != nullptr ) {
+            munmap( held, bytes );
+        }
+    }
+    return 0;
+}
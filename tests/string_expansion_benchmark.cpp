@@ -0,0 +1,71 @@
+// Times splitting typical command lines with CommandArgv, reused from one line to the next as the workers reuse it,
+// against wordexp() and wordfree() as execute() called them before.
+//
+// Not part of the build: cmake --build <dir> --target string_expansion_benchmark, then run it, optionally with the
+// number of times to split each line.
+
+#include "../src/lcpex/string_expansion/string_expansion.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+static const char * LINES[] = {
+    "/bin/bash -c '/opt/project/scripts/build.sh --target release --jobs 8'",
+    "/bin/bash -c '. /opt/project/environment && make -C /opt/project/src all'",
+    "/opt/tool/bin/tool --input \"$HOME/data file\" --output ~/out --label 'nightly run' --verbose",
+};
+
+static double nanoseconds_per_line( std::chrono::steady_clock::time_point started, long count )
+{
+    std::chrono::nanoseconds taken = std::chrono::steady_clock::now() - started;
+    return (double) taken.count() / count;
+}
+
+int main( int argc, char ** argv )
+{
+    long count = argc > 1 ? atol( argv[1] ) : 100000;
+    if ( count <= 0 ) {
+        fprintf( stderr, "usage: %s [ COUNT ]\n", argv[0] );
+        return 2;
+    }
+    if ( getenv( "HOME" ) == nullptr ) {
+        setenv( "HOME", "/root", 1 );
+    }
+
+    printf( "%-12s %14s %14s\n", "line", "wordexp ns", "CommandArgv ns" );
+    for ( size_t l = 0; l < sizeof( LINES ) / sizeof( LINES[0] ); l++ ) {
+        // every word is used, so that neither can be optimised away
+        size_t words = 0;
+
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        for ( long i = 0; i < count; i++ ) {
+            wordexp_t expansion;
+            if ( wordexp( LINES[l], &expansion, WRDE_NOCMD ) != 0 ) {
+                fprintf( stderr, "wordexp() refused: %s\n", LINES[l] );
+                return 1;
+            }
+            words += expansion.we_wordc;
+            wordfree( &expansion );
+        }
+        double wordexp_ns = nanoseconds_per_line( started, count );
+
+        CommandArgv split;
+        std::string error;
+        started = std::chrono::steady_clock::now();
+        for ( long i = 0; i < count; i++ ) {
+            if (! split.split( LINES[l], error ) ) {
+                fprintf( stderr, "CommandArgv refused: %s: %s\n", LINES[l], error.c_str() );
+                return 1;
+            }
+            words += split.size();
+        }
+        double split_ns = nanoseconds_per_line( started, count );
+
+        printf( "line %-7zu %14.0f %14.0f\n", l + 1, wordexp_ns, split_ns );
+        if ( words != 2 * count * split.size() ) {
+            fprintf( stderr, "the two split line %zu differently\n", l + 1 );
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,284 @@
+// Splits a fixed corpus of command lines with CommandArgv and with the C library's wordexp(), and fails on any
+// difference the corpus doesn't expect.  wordexp() runs in a forked child, as glibc's crashes on some malformed lines.
+//
+// Every line is either split the same way by both, refused by both, or one of the deliberate differences, where
+// CommandArgv follows POSIX and dash rather than glibc and its expected arguments are given.
+
+#include "../src/lcpex/string_expansion/string_expansion.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+enum EXPECTATION { SAME, REFUSED, DIFFERENT };
+
+struct Case {
+    EXPECTATION expectation;
+    const char * command;
+    // IFS while the line is split, or null for the default
+    const char * ifs;
+    // for DIFFERENT, the arguments CommandArgv must produce
+    std::vector<std::string> expected;
+};
+
+static const std::vector<Case> CORPUS = {
+    // plain words and whitespace
+    { SAME, "/bin/echo hello world", nullptr, {} },
+    { SAME, "  leading \t and   trailing  ", nullptr, {} },
+    { SAME, "one", nullptr, {} },
+
+    // quotes
+    { SAME, "'single $HOME \\n \"quoted\"' \"double $HOME 'x'\" mixed\"quo\"'tes'", nullptr, {} },
+    { SAME, "'' \"\" x''y", nullptr, {} },
+    { SAME, "\"a \\$b \\` \\\" \\\\ \\f\"", nullptr, {} },
+    { SAME, "\"line\nbreak\" 'tab\there'", nullptr, {} },
+
+    // escapes
+    { SAME, "a\\ b \\\"c\\\" \\\\d \\'e\\' \\$HOME \\~", nullptr, {} },
+    { SAME, "joined\\\nline", nullptr, {} },
+
+    // parameters
+    { SAME, "$HOME ${HOME} pre${HOME}post \"$HOME\" \"${HOME}/sub\"", nullptr, {} },
+    { SAME, "$REX_TEST_WORDS \"$REX_TEST_WORDS\" x$REX_TEST_WORDS", nullptr, {} },
+    { SAME, "$REX_TEST_UNSET x ${REX_TEST_UNSET} \"${REX_TEST_UNSET}y\"", nullptr, {} },
+    { SAME, "$REX_TEST_QUOTES", nullptr, {} },
+    { SAME, "a$ b$ \"c$\" $/", nullptr, {} },
+
+    // field splitting on IFS
+    { SAME, "$REX_TEST_COLONS", ":", {} },
+    { SAME, "$REX_TEST_COLONS x$REX_TEST_COLONS\"y\"", ": ", {} },
+    { SAME, "$REX_TEST_WORDS", "", {} },
+    { SAME, "a:b $REX_TEST_WORDS", ":", {} },
+
+    // tilde expansion
+    { SAME, "~ ~/bin ~root ~root/x", nullptr, {} },
+    { SAME, "'~' \"~\" \\~ x~ a/~", nullptr, {} },
+    { SAME, "PATH=~/bin:~/sbin /bin/env", nullptr, {} },
+    { SAME, "~rex_test_nobody_by_this_name", nullptr, {} },
+
+    // pathname expansion, in a directory of known files
+    { SAME, "*.txt f?le.c [ab].txt", nullptr, {} },
+    { SAME, "'*.txt' \"f?le.c\" \\[ab].txt", nullptr, {} },
+    { SAME, "nomatch* *.none", nullptr, {} },
+    { SAME, "sub/* \"sub\"/*.txt", nullptr, {} },
+
+    // left to wordexp()
+    { SAME, "${REX_TEST_UNSET:-fallback} ${HOME:+set} ${#HOME} $((1+2))", nullptr, {} },
+    { SAME, "\"${REX_TEST_UNSET-a b}\" ${REX_TEST_WORDS#one}", nullptr, {} },
+
+    // command substitution and what would make more than a simple command
+    { REFUSED, "/bin/echo $(id)", nullptr, {} },
+    { REFUSED, "/bin/echo `id`", nullptr, {} },
+    { REFUSED, "/bin/echo \"$(id)\"", nullptr, {} },
+    { REFUSED, "${REX_TEST_UNSET:-$(id)}", nullptr, {} },
+    { REFUSED, "a | b", nullptr, {} },
+    { REFUSED, "a ; b", nullptr, {} },
+    { REFUSED, "a & b", nullptr, {} },
+    { REFUSED, "a > out", nullptr, {} },
+    { REFUSED, "a < in", nullptr, {} },
+    { REFUSED, "( a )", nullptr, {} },
+    { REFUSED, "{ a; }", nullptr, {} },
+    { REFUSED, "a {b}", nullptr, {} },
+    { REFUSED, "a\nb", nullptr, {} },
+
+    // malformed
+    { REFUSED, "'unterminated", nullptr, {} },
+    { REFUSED, "\"unterminated", nullptr, {} },
+    { REFUSED, "${HOME", nullptr, {} },
+
+    // where glibc strays from POSIX
+    { DIFFERENT, "p${REX_TEST_PADDED}q", nullptr, { "p", "a", "b", "q" } },
+    { DIFFERENT, "\"$REX_TEST_EMPTY\"", nullptr, { "" } },
+    { DIFFERENT, "$REX_TEST_STAR", nullptr, { "a.txt", "b.txt", "file.c", "sub" } },
+    { DIFFERENT, "x \"\"''", nullptr, { "x", "" } },
+    { DIFFERENT, "~\"root\"", nullptr, { "~root" } },
+    { DIFFERENT, "/bin/echo $0 $1 $# $* $@ ${#}", nullptr, { "/bin/echo", "0", "0" } },
+};
+
+
+// split with wordexp() in a child.  the child writes its result, then each argument followed by a NUL.
+static bool split_wordexp( const std::string & command, std::vector<std::string> & words, std::string & outcome )
+{
+    int channel[2];
+    if ( pipe( channel ) == -1 ) {
+        perror( "pipe" );
+        exit( 2 );
+    }
+    pid_t child = fork();
+    if ( child == -1 ) {
+        perror( "fork" );
+        exit( 2 );
+    }
+    if ( child == 0 ) {
+        close( channel[0] );
+        wordexp_t expansion;
+        int result = wordexp( command.c_str(), &expansion, WRDE_NOCMD );
+        std::string reply = std::to_string( result ) + '\0';
+        if ( result == 0 ) {
+            for ( size_t i = 0; i < expansion.we_wordc; i++ ) {
+                reply.append( expansion.we_wordv[i] );
+                reply.push_back( '\0' );
+            }
+        }
+        size_t sent = 0;
+        while ( sent < reply.size() ) {
+            ssize_t wrote = write( channel[1], reply.data() + sent, reply.size() - sent );
+            if ( wrote <= 0 ) {
+                _exit( 1 );
+            }
+            sent += wrote;
+        }
+        _exit( 0 );
+    }
+
+    close( channel[1] );
+    std::string reply;
+    char buffer[4096];
+    ssize_t got;
+    while ( ( got = read( channel[0], buffer, sizeof( buffer ) ) ) != 0 ) {
+        if ( got < 0 ) {
+            if ( errno == EINTR ) { continue; }
+            break;
+        }
+        reply.append( buffer, got );
+    }
+    close( channel[0] );
+    int status;
+    waitpid( child, &status, 0 );
+    if ( WIFSIGNALED( status ) ) {
+        outcome = "crashed with signal " + std::to_string( WTERMSIG( status ) );
+        return false;
+    }
+
+    size_t end = reply.find( '\0' );
+    if ( end == std::string::npos ) {
+        outcome = "gave no result";
+        return false;
+    }
+    outcome = "returned " + reply.substr( 0, end );
+    if ( reply.substr( 0, end ) != "0" ) {
+        return false;
+    }
+    words.clear();
+    for ( size_t start = end + 1; start < reply.size(); start = end + 1 ) {
+        end = reply.find( '\0', start );
+        words.push_back( reply.substr( start, end - start ) );
+    }
+    return true;
+}
+
+static std::string show( const std::vector<std::string> & words )
+{
+    std::string shown = "[";
+    for ( size_t i = 0; i < words.size(); i++ ) {
+        shown += ( i == 0 ? "\"" : ", \"" ) + words[i] + "\"";
+    }
+    return shown + "]";
+}
+
+static void make_file( const std::string & path )
+{
+    int fd = open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if ( fd == -1 ) {
+        perror( path.c_str() );
+        exit( 2 );
+    }
+    close( fd );
+}
+
+int main()
+{
+    // the patterns are matched against files made for them
+    char directory[] = "/tmp/rex_string_expansion.XXXXXX";
+    if ( mkdtemp( directory ) == nullptr || chdir( directory ) == -1 ) {
+        perror( "test directory" );
+        return 2;
+    }
+    const char * files[] = { "a.txt", "b.txt", "file.c", "sub/c.txt" };
+    mkdir( "sub", 0755 );
+    for ( const char * file : files ) {
+        make_file( file );
+    }
+
+    setenv( "HOME", "/home/rex test", 1 );
+    setenv( "REX_TEST_WORDS", "one two  three", 1 );
+    setenv( "REX_TEST_QUOTES", "'a b' \"c\"", 1 );
+    setenv( "REX_TEST_COLONS", "a:b::c: d", 1 );
+    setenv( "REX_TEST_PADDED", " a b ", 1 );
+    setenv( "REX_TEST_EMPTY", "", 1 );
+    setenv( "REX_TEST_STAR", "*", 1 );
+    unsetenv( "REX_TEST_UNSET" );
+
+    // one object for every line, as each worker keeps one across executions
+    CommandArgv argv;
+    int failures = 0;
+    for ( const Case & test : CORPUS ) {
+        if ( test.ifs == nullptr ) {
+            unsetenv( "IFS" );
+        } else {
+            setenv( "IFS", test.ifs, 1 );
+        }
+
+        std::string error;
+        bool split = argv.split( test.command, error );
+        std::vector<std::string> ours( argv.argv(), argv.argv() + argv.size() );
+        if ( argv.argv()[ argv.size() ] != nullptr ) {
+            fprintf( stderr, "FAIL: %s\n  the arguments are not followed by a null pointer\n", test.command );
+            failures++;
+            continue;
+        }
+
+        std::vector<std::string> theirs;
+        std::string outcome;
+        bool expanded = split_wordexp( test.command, theirs, outcome );
+
+        std::string problem;
+        if ( test.expectation == SAME ) {
+            if (! split ) {
+                problem = "refused (" + error + "), but wordexp() " + ( expanded ? "gave " + show( theirs ) : outcome );
+            } else if (! expanded ) {
+                problem = "gave " + show( ours ) + ", but wordexp() " + outcome;
+            } else if ( ours != theirs ) {
+                problem = "gave " + show( ours ) + ", but wordexp() gave " + show( theirs );
+            }
+        } else if ( test.expectation == REFUSED ) {
+            if ( split ) {
+                problem = "gave " + show( ours ) + ", but should be refused";
+            } else if ( expanded ) {
+                problem = "refused, but wordexp() gave " + show( theirs );
+            } else if ( error.empty() ) {
+                problem = "refused without saying why";
+            }
+        } else {
+            if (! split ) {
+                problem = "refused (" + error + "), but should give " + show( test.expected );
+            } else if ( ours != test.expected ) {
+                problem = "gave " + show( ours ) + ", but should give " + show( test.expected );
+            }
+        }
+        if (! problem.empty() ) {
+            fprintf( stderr, "FAIL: %s\n  %s\n", test.command, problem.c_str() );
+            failures++;
+        }
+    }
+    unsetenv( "IFS" );
+
+    // the child has a pid of its own, so $$ is checked on its own
+    std::string error;
+    if (! argv.split( "$$", error ) || argv.size() != 1 || std::string( argv.argv()[0] ) != std::to_string( getpid() ) ) {
+        fprintf( stderr, "FAIL: $$\n  does not give this process's id\n" );
+        failures++;
+    }
+
+    for ( const char * file : files ) {
+        unlink( file );
+    }
+    rmdir( "sub" );
+    rmdir( directory );
+
+    printf( "%zu lines, %d failure(s)\n", CORPUS.size() + 1, failures );
+    return failures == 0 ? 0 : 1;
+}